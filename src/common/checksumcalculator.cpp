@@ -50,19 +50,12 @@ static QCryptographicHash::Algorithm algorithmTypeToQCryptoHashAlgorithm(Checksu
 ChecksumCalculator::ChecksumCalculator(const QString &filePath, const QByteArray &checksumTypeName)
     : _device(new QFile(filePath))
 {
-    if (checksumTypeName == checkSumMD5C) {
-        _algorithmType = AlgorithmType::MD5;
-    } else if (checksumTypeName == checkSumSHA1C) {
-        _algorithmType = AlgorithmType::SHA1;
-    } else if (checksumTypeName == checkSumSHA2C) {
-        _algorithmType = AlgorithmType::SHA256;
-    } else if (checksumTypeName == checkSumSHA3C) {
-        _algorithmType = AlgorithmType::SHA3_256;
-    } else if (checksumTypeName == checkSumAdlerC) {
-        _algorithmType = AlgorithmType::Adler32;
-    }
+    initChecksumAlgorithm(checksumTypeName);
+}
 
-    initChecksumAlgorithm();
+ChecksumCalculator::ChecksumCalculator(const QByteArray &checksumTypeName)
+{
+    initChecksumAlgorithm(checksumTypeName);
 }
 
 ChecksumCalculator::~ChecksumCalculator()
@@ -77,7 +70,7 @@ QByteArray ChecksumCalculator::calculate()
 {
     QByteArray result;
 
-    if (!_isInitialized) {
+    if (!_isInitialized || !_device) {
         return result;
     }
 
@@ -121,14 +114,7 @@ QByteArray ChecksumCalculator::calculate()
         }
     }
 
-    if (_algorithmType == AlgorithmType::Adler32) {
-        result = QByteArray::number(_adlerHash, 16);
-    } else {
-        Q_ASSERT(_cryptographicHash);
-        if (_cryptographicHash) {
-            result = _cryptographicHash->result().toHex();
-        }
-    }
+    result = this->result();
 
     {
         QMutexLocker locker(&_deviceMutex);
@@ -140,8 +126,35 @@ QByteArray ChecksumCalculator::calculate()
     return result;
 }
 
-void ChecksumCalculator::initChecksumAlgorithm()
+QByteArray ChecksumCalculator::result() const
 {
+    if (!_isInitialized) {
+        return {};
+    }
+    if (_algorithmType == AlgorithmType::Adler32) {
+        return QByteArray::number(_adlerHash, 16);
+    }
+    Q_ASSERT(_cryptographicHash);
+    if (_cryptographicHash) {
+        return _cryptographicHash->result().toHex();
+    }
+    return {};
+}
+
+void ChecksumCalculator::initChecksumAlgorithm(const QByteArray &checksumTypeName)
+{
+    if (checksumTypeName == checkSumMD5C) {
+        _algorithmType = AlgorithmType::MD5;
+    } else if (checksumTypeName == checkSumSHA1C) {
+        _algorithmType = AlgorithmType::SHA1;
+    } else if (checksumTypeName == checkSumSHA2C) {
+        _algorithmType = AlgorithmType::SHA256;
+    } else if (checksumTypeName == checkSumSHA3C) {
+        _algorithmType = AlgorithmType::SHA3_256;
+    } else if (checksumTypeName == checkSumAdlerC) {
+        _algorithmType = AlgorithmType::Adler32;
+    }
+
     if (_algorithmType == AlgorithmType::Undefined) {
         qCWarning(lcChecksumCalculator) << "_algorithmType is Undefined, impossible to init Checksum Algorithm";
         return;
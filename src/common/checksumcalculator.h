@@ -42,12 +42,22 @@ public:
     };
 
     ChecksumCalculator(const QString &filePath, const QByteArray &checksumTypeName);
+    /// Calculator without a file, fed through addChunk()
+    explicit ChecksumCalculator(const QByteArray &checksumTypeName);
     ~ChecksumCalculator();
     [[nodiscard]] QByteArray calculate();
 
-private:
-    void initChecksumAlgorithm();
+    /// Whether the checksum type is supported
+    [[nodiscard]] bool isValid() const { return _isInitialized; }
+
+    /// Adds the first \a size bytes of \a chunk to the checksum
     bool addChunk(const QByteArray &chunk, const qint64 size);
+
+    /// The checksum of all the data added so far
+    [[nodiscard]] QByteArray result() const;
+
+private:
+    void initChecksumAlgorithm(const QByteArray &checksumTypeName);
     QScopedPointer<QIODevice> _device;
     QScopedPointer<QCryptographicHash> _cryptographicHash;
     unsigned int _adlerHash = 0;
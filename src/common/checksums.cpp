@@ -19,10 +19,12 @@
 #include "filesystembase.h"
 #include "common/checksums.h"
 #include "checksumcalculator.h"
+#include "syncjournaldb.h"
 #include "asserts.h"
 
 #include <QLoggingCategory>
 #include <qtconcurrentrun.h>
+#include <QThreadPool>
 #include <QCryptographicHash>
 
 #ifdef ZLIB_FOUND
@@ -199,8 +201,34 @@ QByteArray ComputeChecksum::checksumType() const
     return _checksumType;
 }
 
+void ComputeChecksum::setThreadPool(QThreadPool *threadPool)
+{
+    _threadPool = threadPool;
+}
+
+void ComputeChecksum::setChecksumCache(SyncJournalDb *journal, quint64 inode, qint64 size, qint64 modtime, qint32 modtimeNsec)
+{
+    _journal = journal;
+    _inode = inode;
+    _size = size;
+    _modtime = modtime;
+    _modtimeNsec = modtimeNsec;
+}
+
 void ComputeChecksum::start(const QString &filePath)
 {
+    if (_journal && checksumComputationEnabled()) {
+        const auto checksum = _journal->getCachedChecksum(_inode, _size, _modtime, _modtimeNsec, _checksumType);
+        if (!checksum.isEmpty()) {
+            qCInfo(lcChecksums) << "Using cached" << checksumType() << "checksum of" << filePath;
+            // done() is always emitted asynchronously, as for a computation
+            QMetaObject::invokeMethod(this, [this, checksum] {
+                emit done(_checksumType, checksum);
+            }, Qt::QueuedConnection);
+            return;
+        }
+    }
+
     qCInfo(lcChecksums) << "Computing" << checksumType() << "checksum of" << filePath << "in a thread";
     startImpl(filePath);
 }
@@ -212,8 +240,8 @@ void ComputeChecksum::startImpl(const QString &filePath)
         Qt::UniqueConnection);
 
     _checksumCalculator.reset(new ChecksumCalculator(filePath, _checksumType));
-    _watcher.setFuture(QtConcurrent::run([this]() {
-        return _checksumCalculator->calculate();
+    _watcher.setFuture(QtConcurrent::run(_threadPool ? _threadPool : QThreadPool::globalInstance(), [checksumCalculator = _checksumCalculator]() {
+        return checksumCalculator->calculate();
     }));
 }
 
@@ -237,6 +265,9 @@ void ComputeChecksum::slotCalculationDone()
 {
     QByteArray checksum = _watcher.future().result();
     if (!checksum.isNull()) {
+        if (_journal && !checksum.isEmpty()) {
+            _journal->setCachedChecksum(_inode, _size, _modtime, _modtimeNsec, _checksumType, checksum);
+        }
         emit done(_checksumType, checksum);
     } else {
         emit done(QByteArray(), QByteArray());
@@ -249,17 +280,25 @@ ValidateChecksumHeader::ValidateChecksumHeader(QObject *parent)
 {
 }
 
-ComputeChecksum *ValidateChecksumHeader::prepareStart(const QByteArray &checksumHeader)
+bool ValidateChecksumHeader::parseExpectedChecksumHeader(const QByteArray &checksumHeader)
 {
     // If the incoming header is empty no validation can happen. Just continue.
     if (checksumHeader.isEmpty()) {
         emit validated(QByteArray(), QByteArray());
-        return nullptr;
+        return false;
     }
 
     if (!parseChecksumHeader(checksumHeader, &_expectedChecksumType, &_expectedChecksum)) {
         qCWarning(lcChecksums) << "Checksum header malformed:" << checksumHeader;
         emit validationFailed(tr("The checksum header is malformed."), _calculatedChecksumType, _calculatedChecksum, ChecksumHeaderMalformed);
+        return false;
+    }
+    return true;
+}
+
+ComputeChecksum *ValidateChecksumHeader::prepareStart(const QByteArray &checksumHeader)
+{
+    if (!parseExpectedChecksumHeader(checksumHeader)) {
         return nullptr;
     }
 
@@ -276,6 +315,12 @@ void ValidateChecksumHeader::start(const QString &filePath, const QByteArray &ch
         calculator->start(filePath);
 }
 
+void ValidateChecksumHeader::validate(const QByteArray &checksumHeader, const QByteArray &calculatedChecksumType, const QByteArray &calculatedChecksum)
+{
+    if (parseExpectedChecksumHeader(checksumHeader))
+        slotChecksumCalculated(calculatedChecksumType, calculatedChecksum);
+}
+
 QByteArray ValidateChecksumHeader::calculatedChecksumType() const
 {
     return _calculatedChecksumType;
@@ -24,10 +24,12 @@
 #include <QObject>
 #include <QByteArray>
 #include <QFutureWatcher>
+#include <QSharedPointer>
 
 #include <memory>
 
 class QFile;
+class QThreadPool;
 
 namespace OCC {
 
@@ -76,6 +78,20 @@ public:
 
     QByteArray checksumType() const;
 
+    /**
+     * Sets the thread pool the checksum is computed in. The default is the global one.
+     */
+    void setThreadPool(QThreadPool *threadPool);
+
+    /**
+     * Reuses and fills the checksum cache of \a journal.
+     *
+     * \a inode, \a size, \a modtime and \a modtimeNsec identify the file content
+     * and should be taken from the file right before starting. A cached checksum
+     * is only used while all of them match.
+     */
+    void setChecksumCache(SyncJournalDb *journal, quint64 inode, qint64 size, qint64 modtime, qint32 modtimeNsec);
+
     /**
      * Computes the checksum for the given file path.
      *
@@ -104,10 +120,19 @@ private:
 
     QByteArray _checksumType;
 
+    QThreadPool *_threadPool = nullptr;
+
+    SyncJournalDb *_journal = nullptr;
+    quint64 _inode = 0;
+    qint64 _size = 0;
+    qint64 _modtime = 0;
+    qint32 _modtimeNsec = -1;
+
     // watcher for the checksum calculation thread
     QFutureWatcher<QByteArray> _watcher;
 
-    QScopedPointer<ChecksumCalculator> _checksumCalculator;
+    // shared with the calculation thread, which may outlive this object
+    QSharedPointer<ChecksumCalculator> _checksumCalculator;
 };
 
 /**
@@ -137,6 +162,13 @@ public:
      */
     void start(const QString &filePath, const QByteArray &checksumHeader);
 
+    /**
+     * Check an already calculated checksum against the provided checksumHeader
+     *
+     * Emits the same signals as start(), without reading any file.
+     */
+    void validate(const QByteArray &checksumHeader, const QByteArray &calculatedChecksumType, const QByteArray &calculatedChecksum);
+
     [[nodiscard]] QByteArray calculatedChecksumType() const;
     [[nodiscard]] QByteArray calculatedChecksum() const;
 
@@ -149,6 +181,8 @@ private slots:
     void slotChecksumCalculated(const QByteArray &checksumType, const QByteArray &checksum);
 
 private:
+    // Returns false if no validation is needed or possible, the signals are emitted then
+    bool parseExpectedChecksumHeader(const QByteArray &checksumHeader);
     ComputeChecksum *prepareStart(const QByteArray &checksumHeader);
 
     QByteArray _expectedChecksumType;
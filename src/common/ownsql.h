@@ -46,7 +46,12 @@ public:
 
     bool isOpen();
     bool openOrCreateReadWrite(const QString &filename);
-    bool openReadOnly(const QString &filename);
+    /** Opens an existing database for reading.
+     *
+     * The consistency check can be skipped for databases another connection
+     * opened (and checked) already.
+     */
+    bool openReadOnly(const QString &filename, bool checkConsistency = true);
     bool transaction();
     bool commit();
     void close();
@@ -66,6 +66,7 @@ public:
         GetFilesBelowPathQuery,
         GetAllFilesQuery,
         ListFilesInPathQuery,
+        HasFilesInPathQuery,
         SetFileRecordQuery,
         SetFileRecordChecksumQuery,
         SetFileRecordLocalMetadataQuery,
@@ -83,6 +84,10 @@ public:
         GetChecksumTypeIdQuery,
         GetChecksumTypeQuery,
         InsertChecksumTypeQuery,
+        GetChecksumCacheQuery,
+        GetChecksumCacheFromMetadataQuery,
+        SetChecksumCacheQuery,
+        InvalidateChecksumCacheQuery,
         GetDataFingerprintQuery,
         SetDataFingerprintQuery1,
         SetDataFingerprintQuery2,
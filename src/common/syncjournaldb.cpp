@@ -18,13 +18,18 @@
 
 #include <QCryptographicHash>
 #include <QFile>
+#include <QFileInfo>
 #include <QLoggingCategory>
 #include <QStringList>
 #include <QElapsedTimer>
 #include <QUrl>
 #include <QDir>
+#include <QThread>
+#include <qtconcurrentrun.h>
 #include <sqlite3.h>
 #include <cstring>
+#include <algorithm>
+#include <chrono>
 
 #include "common/syncjournaldb.h"
 #include "version.h"
@@ -46,10 +51,43 @@ namespace OCC {
 
 Q_LOGGING_CATEGORY(lcDb, "nextcloud.sync.database", QtInfoMsg)
 
+namespace {
+// Scheduled commits are grouped until there are this many, or the interval passed
+constexpr auto groupCommitMaxPending = 200;
+constexpr auto groupCommitInterval = std::chrono::milliseconds(1000);
+
+// The WAL is truncated to this size when it starts over after a checkpoint
+constexpr auto walSizeLimit = 16 * 1024 * 1024;
+// Free pages are reclaimed once there are this many, and they are more than a quarter of all pages
+constexpr auto minFreePagesForVacuum = 1024;
+// Pages reclaimed per step of the maintenance, the journal is locked during a step
+constexpr auto vacuumPagesPerStep = 256;
+constexpr auto analyzeInterval = std::chrono::hours(24);
+constexpr auto incrementalAutoVacuum = 2;
+
+// Steps through all rows, some pragmas do their work row by row. Returns the first value, -1 on errors.
+qint64 runPragma(SqlDatabase &db, const QByteArray &pragma)
+{
+    SqlQuery query("PRAGMA " + pragma + ";", db);
+    auto next = query.next();
+    const auto value = next.hasData ? query.int64Value(0) : 0;
+    while (next.hasData) {
+        next = query.next();
+    }
+    return next.ok ? value : -1;
+}
+
+bool hasReclaimablePages(qint64 pageCount, qint64 freePageCount)
+{
+    return freePageCount > minFreePagesForVacuum && freePageCount * 4 > pageCount;
+}
+}
+
 #define GET_FILE_RECORD_QUERY \
         "SELECT path, inode, modtime, type, md5, fileid, remotePerm, filesize," \
         "  ignoredChildrenRemote, contentchecksumtype.name || ':' || contentChecksum, e2eMangledName, isE2eEncrypted, " \
-        "  lock, lockOwnerDisplayName, lockOwnerId, lockType, lockOwnerEditor, lockTime, lockTimeout, isShared, lastShareStateFetchedTimestmap, sharedByMe" \
+        "  lock, lockOwnerDisplayName, lockOwnerId, lockType, lockOwnerEditor, lockTime, lockTimeout, isShared, lastShareStateFetchedTimestmap, sharedByMe," \
+        "  modtimeNsec" \
         " FROM metadata" \
         "  LEFT JOIN checksumtype as contentchecksumtype ON metadata.contentChecksumTypeId == contentchecksumtype.id"
 
@@ -77,8 +115,115 @@ static void fillFileRecordFromGetQuery(SyncJournalFileRecord &rec, SqlQuery &que
     rec._isShared = query.intValue(19) > 0;
     rec._lastShareStateFetchedTimestamp = query.int64Value(20);
     rec._sharedByMe = query.intValue(21) > 0;
+    // Rows written before the column was added have no value
+    rec._modtimeNsec = query.nullValue(22) ? -1 : query.intValue(22);
 }
 
+/**
+ * The file records of the journal, indexed the ways the discovery looks them up.
+ *
+ * Removed records stay in the vector as invalid records until the snapshot is dropped.
+ */
+struct SyncJournalDb::DiscoverySnapshot
+{
+    std::vector<SyncJournalFileRecord> records;
+    QHash<QByteArray, int> byPath;
+    // In the order of the ORDER BY path||'/' of listFilesInPath()
+    QHash<QByteArray, QVector<int>> childrenByParent;
+    QMultiHash<quint64, int> byInode;
+    QMultiHash<QByteArray, int> byFileId;
+
+    static QByteArray parentPath(const QByteArray &path)
+    {
+        const auto slash = path.lastIndexOf('/');
+        return slash < 0 ? QByteArray() : path.left(slash);
+    }
+
+    // A rough guess of the memory one record needs, including the indexes
+    static qint64 estimatedSize(const SyncJournalFileRecord &record)
+    {
+        return static_cast<qint64>(sizeof(SyncJournalFileRecord)) + 160 + 2 * record._path.size() + record._etag.size()
+            + record._fileId.size() + record._checksumHeader.size() + record._e2eMangledName.size();
+    }
+
+    /// Records must be appended in the order of the query of listFilesInPath()
+    void append(SyncJournalFileRecord &&record)
+    {
+        const auto index = static_cast<int>(records.size());
+        records.push_back(std::move(record));
+        addToIndexes(index, false);
+    }
+
+    void insert(const SyncJournalFileRecord &record)
+    {
+        remove(record._path);
+        const auto index = static_cast<int>(records.size());
+        records.push_back(record);
+        addToIndexes(index, true);
+    }
+
+    void remove(const QByteArray &path)
+    {
+        const auto it = byPath.find(path);
+        if (it == byPath.end()) {
+            return;
+        }
+        const auto index = *it;
+        byPath.erase(it);
+
+        auto &record = records[index];
+        childrenByParent[parentPath(path)].removeOne(index);
+        byInode.remove(record._inode, index);
+        byFileId.remove(record._fileId, index);
+        record = SyncJournalFileRecord();
+    }
+
+    void removeRecursively(const QByteArray &path)
+    {
+        const auto children = childrenByParent.take(path);
+        for (const auto index : children) {
+            // Copy, removing invalidates the record
+            const auto childPath = records[index]._path;
+            removeRecursively(childPath);
+            remove(childPath);
+        }
+    }
+
+private:
+    void addToIndexes(int index, bool sorted)
+    {
+        const auto &record = records[index];
+        byPath.insert(record._path, index);
+        auto &children = childrenByParent[parentPath(record._path)];
+        if (sorted) {
+            const QByteArray key = record._path + '/';
+            const auto position = std::lower_bound(children.begin(), children.end(), key, [this](int child, const QByteArray &value) {
+                return records[child]._path + '/' < value;
+            });
+            children.insert(position, index);
+        } else {
+            children.append(index);
+        }
+        if (record._inode) {
+            byInode.insert(record._inode, index);
+        }
+        if (!record._fileId.isEmpty()) {
+            byFileId.insert(record._fileId, index);
+        }
+    }
+};
+
+struct SyncJournalDb::ReadConnection
+{
+    SqlDatabase db;
+    // Declared after db, the queries must be finalized first
+    PreparedSqlQueryManager queryManager;
+    int generation = 0;
+};
+
+// Connections beyond that are closed again once the lookup is done
+static constexpr size_t maxIdleReadConnections = 4;
+
 static QByteArray defaultJournalMode(const QString &dbPath)
 {
 #if defined(Q_OS_WIN)
@@ -111,6 +256,15 @@ SyncJournalDb::SyncJournalDb(const QString &dbFilePath, QObject *parent)
     if (_journalMode.isEmpty()) {
         _journalMode = defaultJournalMode(_dbFile);
     }
+
+    _groupCommitTimer.setSingleShot(true);
+    _groupCommitTimer.setInterval(groupCommitInterval);
+    connect(&_groupCommitTimer, &QTimer::timeout, this, [this] {
+        QMutexLocker lock(&_mutex);
+        if (_pendingCommits > 0 && _transaction == 1) {
+            commitInternal(QStringLiteral("group commit timer"));
+        }
+    });
 }
 
 QString SyncJournalDb::makeDbName(const QString &localPath,
@@ -278,6 +432,7 @@ void SyncJournalDb::commitTransaction()
             return;
         }
         _transaction = 0;
+        ++_commitStatistics.transactions;
     } else {
         qCDebug(lcDb) << "No database Transaction to commit";
     }
@@ -338,26 +493,62 @@ bool SyncJournalDb::checkConnect()
         qCInfo(lcDb) << "sqlite3 version" << pragma1.stringValue(0);
     }
 
+    // Only has an effect on a new database, before the WAL journal is enabled and the
+    // first table is created. Older journals are converted by performMaintenance().
+    pragma1.prepare("PRAGMA auto_vacuum=INCREMENTAL;");
+    if (!pragma1.exec() || !pragma1.next().ok) {
+        return sqlFail(QStringLiteral("Set PRAGMA auto_vacuum"), pragma1);
+    }
+
+    // Read-only connections for the getCommitted*() lookups are opt-in: they need
+    // the normal locking mode and the -shm file, which doesn't work on every
+    // network file system and no longer keeps a second client away from the journal.
+    const auto readConnectionsEnabled = _readConnectionsEnabled || !qEnvironmentVariableIsEmpty("OWNCLOUD_SQLITE_READ_CONNECTIONS");
+
     // Set locking mode to avoid issues with WAL on Windows
-    static QByteArray locking_mode_env = qgetenv("OWNCLOUD_SQLITE_LOCKING_MODE");
-    if (locking_mode_env.isEmpty())
-        locking_mode_env = "EXCLUSIVE";
-    pragma1.prepare("PRAGMA locking_mode=" + locking_mode_env + ";");
+    static const QByteArray locking_mode_env = qgetenv("OWNCLOUD_SQLITE_LOCKING_MODE");
+    auto locking_mode = locking_mode_env;
+    if (locking_mode.isEmpty()) {
+#ifndef Q_OS_WIN
+        if (readConnectionsEnabled) {
+            locking_mode = "NORMAL";
+        } else
+#endif
+        {
+            locking_mode = "EXCLUSIVE";
+        }
+    }
+    QString lockingMode;
+    pragma1.prepare("PRAGMA locking_mode=" + locking_mode + ";");
     if (!pragma1.exec()) {
         return sqlFail(QStringLiteral("Set PRAGMA locking_mode"), pragma1);
     } else {
         pragma1.next();
-        qCInfo(lcDb) << "sqlite3 locking_mode=" << pragma1.stringValue(0);
+        lockingMode = pragma1.stringValue(0);
+        qCInfo(lcDb) << "sqlite3 locking_mode=" << lockingMode;
     }
 
+    QString journalMode;
     pragma1.prepare("PRAGMA journal_mode=" + _journalMode + ";");
     if (!pragma1.exec()) {
         return sqlFail(QStringLiteral("Set PRAGMA journal_mode"), pragma1);
     } else {
         pragma1.next();
-        qCInfo(lcDb) << "sqlite3 journal_mode=" << pragma1.stringValue(0);
+        journalMode = pragma1.stringValue(0);
+        qCInfo(lcDb) << "sqlite3 journal_mode=" << journalMode;
+    }
+
+    pragma1.prepare("PRAGMA journal_size_limit=" + QByteArray::number(walSizeLimit) + ";");
+    if (!pragma1.exec() || !pragma1.next().ok) {
+        return sqlFail(QStringLiteral("Set PRAGMA journal_size_limit"), pragma1);
     }
 
+    // Other connections can only read a WAL journal without waiting for the transaction
+    // of this one, and can't open it at all while it is locked exclusively
+    _readConnectionsSupported = readConnectionsEnabled
+        && lockingMode.compare(QStringLiteral("normal"), Qt::CaseInsensitive) == 0
+        && journalMode.compare(QStringLiteral("wal"), Qt::CaseInsensitive) == 0;
+
     // For debugging purposes, allow temp_store to be set
     static QByteArray env_temp_store = qgetenv("OWNCLOUD_SQLITE_TEMP_STORE");
     if (!env_temp_store.isEmpty()) {
@@ -452,6 +643,7 @@ bool SyncJournalDb::checkConnect()
                         "tmpfile VARCHAR(4096),"
                         "etag VARCHAR(32),"
                         "errorcount INTEGER,"
+                        "segments TEXT,"
                         "PRIMARY KEY(path)"
                         ");");
 
@@ -516,6 +708,20 @@ bool SyncJournalDb::checkConnect()
         return sqlFail(QStringLiteral("Create table checksumtype"), createQuery);
     }
 
+    // create the checksumcache table.
+    createQuery.prepare("CREATE TABLE IF NOT EXISTS checksumcache("
+                        "inode INTEGER,"
+                        "filesize BIGINT,"
+                        "modtime INTEGER(8),"
+                        "checksumTypeId INTEGER,"
+                        "checksum TEXT,"
+                        "modtimeNsec INTEGER,"
+                        "PRIMARY KEY(inode, checksumTypeId)"
+                        ");");
+    if (!createQuery.exec()) {
+        return sqlFail(QStringLiteral("Create table checksumcache"), createQuery);
+    }
+
     // create the datafingerprint table.
     createQuery.prepare("CREATE TABLE IF NOT EXISTS datafingerprint("
                         "fingerprint TEXT UNIQUE"
@@ -683,6 +889,56 @@ bool SyncJournalDb::checkConnect()
     return rc;
 }
 
+std::unique_ptr<SyncJournalDb::ReadConnection> SyncJournalDb::acquireReadConnection()
+{
+    if (!_readConnectionsSupported) {
+        return nullptr;
+    }
+
+    int generation = 0;
+    {
+        QMutexLocker locker(&_readConnectionsMutex);
+        if (!_idleReadConnections.empty()) {
+            auto connection = std::move(_idleReadConnections.back());
+            _idleReadConnections.pop_back();
+            return connection;
+        }
+        generation = _readConnectionsGeneration;
+    }
+
+    // The main connection checked the consistency already
+    auto connection = std::make_unique<ReadConnection>();
+    if (!connection->db.openReadOnly(_dbFile, false)) {
+        qCWarning(lcDb) << "Could not open a read-only connection to" << _dbFile << connection->db.error();
+        return nullptr;
+    }
+    connection->generation = generation;
+    return connection;
+}
+
+void SyncJournalDb::releaseReadConnection(std::unique_ptr<ReadConnection> connection)
+{
+    QMutexLocker locker(&_readConnectionsMutex);
+    // Connections opened before close() are not reused
+    if (connection->generation == _readConnectionsGeneration && _idleReadConnections.size() < maxIdleReadConnections) {
+        _idleReadConnections.push_back(std::move(connection));
+    }
+}
+
+void SyncJournalDb::setReadConnectionsEnabled(bool enabled)
+{
+    QMutexLocker locker(&_mutex);
+    _readConnectionsEnabled = enabled;
+}
+
+void SyncJournalDb::closeReadConnections()
+{
+    _readConnectionsSupported = false;
+    QMutexLocker locker(&_readConnectionsMutex);
+    _idleReadConnections.clear();
+    ++_readConnectionsGeneration;
+}
+
 void SyncJournalDb::close()
 {
     QMutexLocker locker(&_mutex);
@@ -690,6 +946,8 @@ void SyncJournalDb::close()
 
     commitTransaction();
 
+    dropDiscoverySnapshotLocked("closing the database");
+    closeReadConnections();
     _db.close();
     clearEtagStorageFilter();
     _metadataTableIsEmpty = false;
@@ -780,6 +1038,7 @@ bool SyncJournalDb::updateMetadataTableStructure()
     addColumn(QStringLiteral("isShared"), QStringLiteral("INTEGER"));
     addColumn(QStringLiteral("lastShareStateFetchedTimestmap"), QStringLiteral("INTEGER"));
     addColumn(QStringLiteral("sharedByMe"), QStringLiteral("INTEGER"));
+    addColumn(QStringLiteral("modtimeNsec"), QStringLiteral("INTEGER"));
 
     auto uploadInfoColumns = tableColumns("uploadinfo");
     if (uploadInfoColumns.isEmpty())
@@ -794,6 +1053,32 @@ bool SyncJournalDb::updateMetadataTableStructure()
         commitInternal(QStringLiteral("update database structure: add contentChecksum col for uploadinfo"));
     }
 
+    auto downloadInfoColumns = tableColumns("downloadinfo");
+    if (downloadInfoColumns.isEmpty())
+        return false;
+    if (!downloadInfoColumns.contains("segments")) {
+        SqlQuery query(_db);
+        query.prepare("ALTER TABLE downloadinfo ADD COLUMN segments TEXT;");
+        if (!query.exec()) {
+            sqlFail(QStringLiteral("updateMetadataTableStructure: add segments column"), query);
+            re = false;
+        }
+        commitInternal(QStringLiteral("update database structure: add segments col for downloadinfo"));
+    }
+
+    auto checksumCacheColumns = tableColumns("checksumcache");
+    if (checksumCacheColumns.isEmpty())
+        return false;
+    if (!checksumCacheColumns.contains("modtimeNsec")) {
+        SqlQuery query(_db);
+        query.prepare("ALTER TABLE checksumcache ADD COLUMN modtimeNsec INTEGER;");
+        if (!query.exec()) {
+            sqlFail(QStringLiteral("updateMetadataTableStructure: add modtimeNsec column"), query);
+            re = false;
+        }
+        commitInternal(QStringLiteral("update database structure: add modtimeNsec col for checksumcache"));
+    }
+
     auto conflictsColumns = tableColumns("conflicts");
     if (conflictsColumns.isEmpty())
         return false;
@@ -947,7 +1232,7 @@ Result<void, QString> SyncJournalDb::setFileRecord(const SyncJournalFileRecord &
     }
 
     qCInfo(lcDb) << "Updating file record for path:" << record.path() << "inode:" << record._inode
-                 << "modtime:" << record._modtime << "type:" << record._type << "etag:" << record._etag
+                 << "modtime:" << record._modtime << record._modtimeNsec << "type:" << record._type << "etag:" << record._etag
                  << "fileId:" << record._fileId << "remotePerm:" << record._remotePerm.toString()
                  << "fileSize:" << record._fileSize << "checksum:" << record._checksumHeader
                  << "e2eMangledName:" << record.e2eMangledName() << "isE2eEncrypted:" << record.isE2eEncrypted()
@@ -984,8 +1269,8 @@ Result<void, QString> SyncJournalDb::setFileRecord(const SyncJournalFileRecord &
     const auto query = _queryManager.get(PreparedSqlQueryManager::SetFileRecordQuery, QByteArrayLiteral("INSERT OR REPLACE INTO metadata "
                                                                                                         "(phash, pathlen, path, inode, uid, gid, mode, modtime, type, md5, fileid, remotePerm, filesize, ignoredChildrenRemote, "
                                                                                                         "contentChecksum, contentChecksumTypeId, e2eMangledName, isE2eEncrypted, lock, lockType, lockOwnerDisplayName, lockOwnerId, "
-                                                                                                        "lockOwnerEditor, lockTime, lockTimeout, isShared, lastShareStateFetchedTimestmap, sharedByMe) "
-                                                                                                        "VALUES (?1 , ?2, ?3 , ?4 , ?5 , ?6 , ?7,  ?8 , ?9 , ?10, ?11, ?12, ?13, ?14, ?15, ?16, ?17, ?18, ?19, ?20, ?21, ?22, ?23, ?24, ?25, ?26, ?27, ?28);"),
+                                                                                                        "lockOwnerEditor, lockTime, lockTimeout, isShared, lastShareStateFetchedTimestmap, sharedByMe, modtimeNsec) "
+                                                                                                        "VALUES (?1 , ?2, ?3 , ?4 , ?5 , ?6 , ?7,  ?8 , ?9 , ?10, ?11, ?12, ?13, ?14, ?15, ?16, ?17, ?18, ?19, ?20, ?21, ?22, ?23, ?24, ?25, ?26, ?27, ?28, ?29);"),
         _db);
     if (!query) {
         return query->error();
@@ -1019,6 +1304,7 @@ Result<void, QString> SyncJournalDb::setFileRecord(const SyncJournalFileRecord &
     query->bindValue(26, record._isShared);
     query->bindValue(27, record._lastShareStateFetchedTimestamp);
     query->bindValue(28, record._sharedByMe);
+    query->bindValue(29, record._modtimeNsec);
 
     if (!query->exec()) {
         return query->error();
@@ -1027,6 +1313,8 @@ Result<void, QString> SyncJournalDb::setFileRecord(const SyncJournalFileRecord &
     // Can't be true anymore.
     _metadataTableIsEmpty = false;
 
+    updateDiscoverySnapshot(record._path);
+
     return {};
 }
 
@@ -1218,6 +1506,14 @@ bool SyncJournalDb::deleteFileRecord(const QString &filename, bool recursively)
                 return false;
             }
         }
+
+        if (_discoverySnapshot) {
+            const auto path = filename.toUtf8();
+            if (recursively) {
+                _discoverySnapshot->removeRecursively(path);
+            }
+            _discoverySnapshot->remove(path);
+        }
         return true;
     } else {
         qCWarning(lcDb) << "Failed to connect database.";
@@ -1238,6 +1534,14 @@ bool SyncJournalDb::getFileRecord(const QByteArray &filename, SyncJournalFileRec
     if (_metadataTableIsEmpty)
         return true; // no error, yet nothing found (rec->isValid() == false)
 
+    if (_discoverySnapshot) {
+        const auto it = _discoverySnapshot->byPath.constFind(filename);
+        if (it != _discoverySnapshot->byPath.constEnd()) {
+            *rec = _discoverySnapshot->records[*it];
+        }
+        return true;
+    }
+
     if (!checkConnect())
         return false;
 
@@ -1268,6 +1572,85 @@ bool SyncJournalDb::getFileRecord(const QByteArray &filename, SyncJournalFileRec
     return true;
 }
 
+bool SyncJournalDb::getCommittedFileRecord(const QByteArray &filename, SyncJournalFileRecord *rec)
+{
+    auto connection = acquireReadConnection();
+    if (!connection) {
+        return getFileRecord(filename, rec);
+    }
+
+    // Reset the output var in case the caller is reusing it.
+    Q_ASSERT(rec);
+    rec->_path.clear();
+    Q_ASSERT(!rec->isValid());
+
+    if (filename.isEmpty()) {
+        releaseReadConnection(std::move(connection));
+        return true;
+    }
+
+    {
+        const auto query = connection->queryManager.get(PreparedSqlQueryManager::GetFileRecordQuery, QByteArrayLiteral(GET_FILE_RECORD_QUERY " WHERE phash=?1"), connection->db);
+        if (!query) {
+            return false;
+        }
+
+        query->bindValue(1, getPHash(filename));
+
+        if (!query->exec()) {
+            return false;
+        }
+
+        auto next = query->next();
+        if (!next.ok) {
+            qCWarning(lcDb) << "No committed journal entry found for" << filename << "Error:" << query->error();
+            return false;
+        }
+        if (next.hasData) {
+            fillFileRecordFromGetQuery(*rec, *query);
+        }
+    }
+    releaseReadConnection(std::move(connection));
+    return true;
+}
+
+bool SyncJournalDb::getCommittedFileRecordByE2eMangledName(const QString &mangledName, SyncJournalFileRecord *rec)
+{
+    auto connection = acquireReadConnection();
+    if (!connection) {
+        return getFileRecordByE2eMangledName(mangledName, rec);
+    }
+
+    // Reset the output var in case the caller is reusing it.
+    Q_ASSERT(rec);
+    rec->_path.clear();
+    Q_ASSERT(!rec->isValid());
+
+    if (!mangledName.isEmpty()) {
+        const auto query = connection->queryManager.get(PreparedSqlQueryManager::GetFileRecordQueryByMangledName, QByteArrayLiteral(GET_FILE_RECORD_QUERY " WHERE e2eMangledName=?1"), connection->db);
+        if (!query) {
+            return false;
+        }
+
+        query->bindValue(1, mangledName);
+
+        if (!query->exec()) {
+            return false;
+        }
+
+        auto next = query->next();
+        if (!next.ok) {
+            qCWarning(lcDb) << "No committed journal entry found for mangled name" << mangledName << "Error:" << query->error();
+            return false;
+        }
+        if (next.hasData) {
+            fillFileRecordFromGetQuery(*rec, *query);
+        }
+    }
+    releaseReadConnection(std::move(connection));
+    return true;
+}
+
 bool SyncJournalDb::getFileRecordByE2eMangledName(const QString &mangledName, SyncJournalFileRecord *rec)
 {
     QMutexLocker locker(&_mutex);
@@ -1324,6 +1707,14 @@ bool SyncJournalDb::getFileRecordByInode(quint64 inode, SyncJournalFileRecord *r
     if (!inode || _metadataTableIsEmpty)
         return true; // no error, yet nothing found (rec->isValid() == false)
 
+    if (_discoverySnapshot) {
+        const auto it = _discoverySnapshot->byInode.constFind(inode);
+        if (it != _discoverySnapshot->byInode.constEnd()) {
+            *rec = _discoverySnapshot->records[*it];
+        }
+        return true;
+    }
+
     if (!checkConnect())
         return false;
     const auto query = _queryManager.get(PreparedSqlQueryManager::GetFileRecordQueryByInode, QByteArrayLiteral(GET_FILE_RECORD_QUERY " WHERE inode=?1"), _db);
@@ -1351,6 +1742,19 @@ bool SyncJournalDb::getFileRecordsByFileId(const QByteArray &fileId, const std::
     if (fileId.isEmpty() || _metadataTableIsEmpty)
         return true; // no error, yet nothing found (rec->isValid() == false)
 
+    if (_discoverySnapshot) {
+        // The callback may write to the journal, which changes the snapshot
+        const auto indexes = _discoverySnapshot->byFileId.values(fileId);
+        QVector<SyncJournalFileRecord> records;
+        for (const auto index : indexes) {
+            records.append(_discoverySnapshot->records[index]);
+        }
+        for (const auto &rec : qAsConst(records)) {
+            rowCallback(rec);
+        }
+        return true;
+    }
+
     if (!checkConnect())
         return false;
 
@@ -1447,6 +1851,20 @@ bool SyncJournalDb::listFilesInPath(const QByteArray& path,
     if (_metadataTableIsEmpty)
         return true;
 
+    if (_discoverySnapshot) {
+        // The callback may write to the journal, which changes the snapshot
+        const auto indexes = _discoverySnapshot->childrenByParent.value(path);
+        QVector<SyncJournalFileRecord> records;
+        records.reserve(indexes.size());
+        for (const auto index : indexes) {
+            records.append(_discoverySnapshot->records[index]);
+        }
+        for (const auto &rec : qAsConst(records)) {
+            rowCallback(rec);
+        }
+        return true;
+    }
+
     if (!checkConnect())
         return false;
 
@@ -1478,6 +1896,36 @@ bool SyncJournalDb::listFilesInPath(const QByteArray& path,
     return true;
 }
 
+Optional<bool> SyncJournalDb::hasFilesInPath(const QByteArray &path)
+{
+    QMutexLocker locker(&_mutex);
+
+    if (_metadataTableIsEmpty)
+        return false;
+
+    if (_discoverySnapshot) {
+        return !_discoverySnapshot->childrenByParent.value(path).isEmpty();
+    }
+
+    if (!checkConnect())
+        return {};
+
+    // A parent_hash collision only makes the answer err on the side of existing records
+    const auto query = _queryManager.get(PreparedSqlQueryManager::HasFilesInPathQuery, QByteArrayLiteral("SELECT 1 FROM metadata WHERE parent_hash(path) = ?1 LIMIT 1"), _db);
+    if (!query) {
+        return {};
+    }
+    query->bindValue(1, getPHash(path));
+
+    if (!query->exec())
+        return {};
+
+    const auto next = query->next();
+    if (!next.ok)
+        return {};
+    return next.hasData;
+}
+
 int SyncJournalDb::getFileRecordCount()
 {
     QMutexLocker locker(&_mutex);
@@ -1497,6 +1945,96 @@ int SyncJournalDb::getFileRecordCount()
     return -1;
 }
 
+bool SyncJournalDb::loadDiscoverySnapshot(qint64 memoryBudget)
+{
+    QMutexLocker locker(&_mutex);
+
+    _discoverySnapshot.reset();
+    if (memoryBudget <= 0 || !checkConnect()) {
+        return false;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // Avoid reading the whole table when it clearly does not fit
+    const auto count = getFileRecordCount();
+    if (count < 0 || count * static_cast<qint64>(sizeof(SyncJournalFileRecord)) > memoryBudget) {
+        qCInfo(lcDb) << "Not loading the discovery snapshot of" << count << "records, the memory budget is" << memoryBudget;
+        return false;
+    }
+
+    const auto query = _queryManager.get(PreparedSqlQueryManager::GetAllFilesQuery, QByteArrayLiteral(GET_FILE_RECORD_QUERY " ORDER BY path||'/' ASC"), _db);
+    if (!query) {
+        return false;
+    }
+    if (!query->exec()) {
+        return false;
+    }
+
+    auto snapshot = std::make_unique<DiscoverySnapshot>();
+    snapshot->records.reserve(count);
+    qint64 size = 0;
+    forever {
+        auto next = query->next();
+        if (!next.ok) {
+            return false;
+        }
+        if (!next.hasData) {
+            break;
+        }
+
+        SyncJournalFileRecord rec;
+        fillFileRecordFromGetQuery(rec, *query);
+        size += DiscoverySnapshot::estimatedSize(rec);
+        if (size > memoryBudget) {
+            qCInfo(lcDb) << "Not loading the discovery snapshot, it exceeds the memory budget of" << memoryBudget;
+            return false;
+        }
+        snapshot->append(std::move(rec));
+    }
+
+    qCInfo(lcDb) << "Loaded the discovery snapshot of" << snapshot->records.size() << "records in"
+                 << timer.elapsed() << "ms, about" << size / (1024 * 1024) << "MB";
+    _discoverySnapshot = std::move(snapshot);
+    return true;
+}
+
+void SyncJournalDb::dropDiscoverySnapshot()
+{
+    QMutexLocker locker(&_mutex);
+    dropDiscoverySnapshotLocked("discovery finished");
+}
+
+void SyncJournalDb::dropDiscoverySnapshotLocked(const char *reason)
+{
+    if (_discoverySnapshot) {
+        qCInfo(lcDb) << "Dropping the discovery snapshot:" << reason;
+        _discoverySnapshot.reset();
+    }
+}
+
+void SyncJournalDb::updateDiscoverySnapshot(const QByteArray &path)
+{
+    if (!_discoverySnapshot) {
+        return;
+    }
+
+    // Let getFileRecord() read the database, it stays dropped if that fails
+    auto snapshot = std::move(_discoverySnapshot);
+    SyncJournalFileRecord record;
+    if (!getFileRecord(path, &record)) {
+        qCWarning(lcDb) << "Dropping the discovery snapshot, could not read back" << path;
+        return;
+    }
+    if (record.isValid()) {
+        snapshot->insert(record);
+    } else {
+        snapshot->remove(path);
+    }
+    _discoverySnapshot = std::move(snapshot);
+}
+
 bool SyncJournalDb::updateFileRecordChecksum(const QString &filename,
     const QByteArray &contentChecksum,
     const QByteArray &contentChecksumType)
@@ -1523,16 +2061,20 @@ bool SyncJournalDb::updateFileRecordChecksum(const QString &filename,
     query->bindValue(1, phash);
     query->bindValue(2, contentChecksum);
     query->bindValue(3, checksumTypeId);
-    return query->exec();
+    if (!query->exec()) {
+        return false;
+    }
+    updateDiscoverySnapshot(filename.toUtf8());
+    return true;
 }
 
 bool SyncJournalDb::updateLocalMetadata(const QString &filename,
-    qint64 modtime, qint64 size, quint64 inode, const SyncJournalFileLockInfo &lockInfo)
+    qint64 modtime, qint32 modtimeNsec, qint64 size, quint64 inode, const SyncJournalFileLockInfo &lockInfo)
 
 {
     QMutexLocker locker(&_mutex);
 
-    qCInfo(lcDb) << "Updating local metadata for:" << filename << modtime << size << inode;
+    qCInfo(lcDb) << "Updating local metadata for:" << filename << modtime << modtimeNsec << size << inode;
 
     const qint64 phash = getPHash(filename.toUtf8());
     if (!checkConnect()) {
@@ -1543,7 +2085,7 @@ bool SyncJournalDb::updateLocalMetadata(const QString &filename,
     const auto query = _queryManager.get(PreparedSqlQueryManager::SetFileRecordLocalMetadataQuery, QByteArrayLiteral("UPDATE metadata"
                                                                                                                      " SET inode=?2, modtime=?3, filesize=?4, lock=?5, lockType=?6,"
                                                                                                                      " lockOwnerDisplayName=?7, lockOwnerId=?8, lockOwnerEditor = ?9,"
-                                                                                                                     " lockTime=?10, lockTimeout=?11"
+                                                                                                                     " lockTime=?10, lockTimeout=?11, modtimeNsec=?12"
                                                                                                                      " WHERE phash == ?1;"),
         _db);
     if (!query) {
@@ -1561,7 +2103,12 @@ bool SyncJournalDb::updateLocalMetadata(const QString &filename,
     query->bindValue(9, lockInfo._lockEditorApp);
     query->bindValue(10, lockInfo._lockTime);
     query->bindValue(11, lockInfo._lockTimeout);
-    return query->exec();
+    query->bindValue(12, modtimeNsec);
+    if (!query->exec()) {
+        return false;
+    }
+    updateDiscoverySnapshot(filename.toUtf8());
+    return true;
 }
 
 Optional<SyncJournalDb::HasHydratedDehydrated> SyncJournalDb::hasHydratedOrDehydratedFiles(const QByteArray &filename)
@@ -1598,12 +2145,45 @@ Optional<SyncJournalDb::HasHydratedDehydrated> SyncJournalDb::hasHydratedOrDehyd
     return result;
 }
 
+// Segments are stored as "offset:size:downloaded" entries separated by ';'
+static QByteArray segmentsToString(const QVector<SyncJournalDb::DownloadInfo::Segment> &segments)
+{
+    QByteArrayList entries;
+    entries.reserve(segments.size());
+    for (const auto &segment : segments) {
+        entries.append(QByteArray::number(segment._offset) + ':' + QByteArray::number(segment._size) + ':' + QByteArray::number(segment._downloaded));
+    }
+    return entries.join(';');
+}
+
+static QVector<SyncJournalDb::DownloadInfo::Segment> segmentsFromString(const QByteArray &string)
+{
+    QVector<SyncJournalDb::DownloadInfo::Segment> segments;
+    if (string.isEmpty()) {
+        return segments;
+    }
+    for (const auto &entry : string.split(';')) {
+        const auto fields = entry.split(':');
+        if (fields.size() != 3) {
+            qCWarning(lcDb) << "Invalid download segment" << entry;
+            return {};
+        }
+        SyncJournalDb::DownloadInfo::Segment segment;
+        segment._offset = fields.at(0).toLongLong();
+        segment._size = fields.at(1).toLongLong();
+        segment._downloaded = fields.at(2).toLongLong();
+        segments.append(segment);
+    }
+    return segments;
+}
+
 static void toDownloadInfo(SqlQuery &query, SyncJournalDb::DownloadInfo *res)
 {
     bool ok = true;
     res->_tmpfile = query.stringValue(0);
     res->_etag = query.baValue(1);
     res->_errorCount = query.intValue(2);
+    res->_segments = segmentsFromString(query.baValue(3));
     res->_valid = ok;
 }
 
@@ -1632,7 +2212,7 @@ SyncJournalDb::DownloadInfo SyncJournalDb::getDownloadInfo(const QString &file)
     DownloadInfo res;
 
     if (checkConnect()) {
-        const auto query = _queryManager.get(PreparedSqlQueryManager::GetDownloadInfoQuery, QByteArrayLiteral("SELECT tmpfile, etag, errorcount FROM downloadinfo WHERE path=?1"), _db);
+        const auto query = _queryManager.get(PreparedSqlQueryManager::GetDownloadInfoQuery, QByteArrayLiteral("SELECT tmpfile, etag, errorcount, segments FROM downloadinfo WHERE path=?1"), _db);
         if (!query) {
             return res;
         }
@@ -1661,8 +2241,8 @@ void SyncJournalDb::setDownloadInfo(const QString &file, const SyncJournalDb::Do
 
     if (i._valid) {
         const auto query = _queryManager.get(PreparedSqlQueryManager::SetDownloadInfoQuery, QByteArrayLiteral("INSERT OR REPLACE INTO downloadinfo "
-                                                                                                              "(path, tmpfile, etag, errorcount) "
-                                                                                                              "VALUES ( ?1 , ?2, ?3, ?4 )"),
+                                                                                                              "(path, tmpfile, etag, errorcount, segments) "
+                                                                                                              "VALUES ( ?1 , ?2, ?3, ?4, ?5 )"),
             _db);
         if (!query) {
             return;
@@ -1671,6 +2251,7 @@ void SyncJournalDb::setDownloadInfo(const QString &file, const SyncJournalDb::Do
         query->bindValue(2, i._tmpfile);
         query->bindValue(3, i._etag);
         query->bindValue(4, i._errorCount);
+        query->bindValue(5, segmentsToString(i._segments));
         query->exec();
     } else {
         const auto query = _queryManager.get(PreparedSqlQueryManager::DeleteDownloadInfoQuery);
@@ -1690,7 +2271,7 @@ QVector<SyncJournalDb::DownloadInfo> SyncJournalDb::getAndDeleteStaleDownloadInf
 
     SqlQuery query(_db);
     // The selected values *must* match the ones expected by toDownloadInfo().
-    query.prepare("SELECT tmpfile, etag, errorcount, path FROM downloadinfo");
+    query.prepare("SELECT tmpfile, etag, errorcount, segments, path FROM downloadinfo");
 
     if (!query.exec()) {
         return empty_result;
@@ -1700,7 +2281,7 @@ QVector<SyncJournalDb::DownloadInfo> SyncJournalDb::getAndDeleteStaleDownloadInf
     QVector<SyncJournalDb::DownloadInfo> deleted_entries;
 
     while (query.next().hasData) {
-        const QString file = query.stringValue(3); // path
+        const QString file = query.stringValue(4); // path
         if (!keep.contains(file)) {
             superfluousPaths.append(file);
             DownloadInfo info;
@@ -1911,6 +2492,121 @@ void SyncJournalDb::deleteStaleFlagsEntries()
     }
 }
 
+QByteArray SyncJournalDb::getCachedChecksum(quint64 inode, qint64 size, qint64 modtime, qint32 modtimeNsec, const QByteArray &checksumType)
+{
+    QMutexLocker locker(&_mutex);
+    if (!inode || modtimeNsec < 0 || checksumType.isEmpty() || !checkConnect())
+        return {};
+
+    const auto checksumTypeId = mapChecksumType(checksumType);
+    if (!checksumTypeId)
+        return {};
+
+    {
+        const auto query = _queryManager.get(PreparedSqlQueryManager::GetChecksumCacheQuery, QByteArrayLiteral("SELECT checksum FROM checksumcache"
+                                                                                                             " WHERE inode=?1 AND checksumTypeId=?2 AND filesize=?3 AND modtime=?4 AND modtimeNsec=?5"),
+            _db);
+        if (!query) {
+            return {};
+        }
+        query->bindValue(1, inode);
+        query->bindValue(2, checksumTypeId);
+        query->bindValue(3, size);
+        query->bindValue(4, modtime);
+        query->bindValue(5, modtimeNsec);
+        if (!query->exec()) {
+            return {};
+        }
+        if (query->next().hasData) {
+            return query->baValue(0);
+        }
+    }
+
+    if (_metadataTableIsEmpty)
+        return {};
+
+    // Synced files that did not change since carry a content checksum already. Records
+    // without the sub-second part of their modtime never match, it's NULL or -1 there.
+    const auto query = _queryManager.get(PreparedSqlQueryManager::GetChecksumCacheFromMetadataQuery, QByteArrayLiteral("SELECT contentChecksum FROM metadata"
+                                                                                                                     " WHERE inode=?1 AND contentChecksumTypeId=?2 AND filesize=?3 AND modtime=?4 AND type=?5 AND modtimeNsec=?6"),
+        _db);
+    if (!query) {
+        return {};
+    }
+    query->bindValue(1, inode);
+    query->bindValue(2, checksumTypeId);
+    query->bindValue(3, size);
+    query->bindValue(4, modtime);
+    query->bindValue(5, ItemTypeFile);
+    query->bindValue(6, modtimeNsec);
+    if (!query->exec()) {
+        return {};
+    }
+    if (query->next().hasData) {
+        return query->baValue(0);
+    }
+    return {};
+}
+
+bool SyncJournalDb::setCachedChecksum(quint64 inode, qint64 size, qint64 modtime, qint32 modtimeNsec, const QByteArray &checksumType, const QByteArray &checksum)
+{
+    QMutexLocker locker(&_mutex);
+    if (!inode || modtimeNsec < 0 || checksumType.isEmpty() || checksum.isEmpty())
+        return false;
+
+    if (!checkConnect()) {
+        qCWarning(lcDb) << "Failed to connect database.";
+        return false;
+    }
+
+    const auto checksumTypeId = mapChecksumType(checksumType);
+    if (!checksumTypeId)
+        return false;
+
+    {
+        const auto query = _queryManager.get(PreparedSqlQueryManager::InvalidateChecksumCacheQuery, QByteArrayLiteral("DELETE FROM checksumcache"
+                                                                                                                    " WHERE inode=?1 AND (filesize!=?2 OR modtime!=?3 OR modtimeNsec IS NOT ?4)"),
+            _db);
+        if (!query) {
+            return false;
+        }
+        query->bindValue(1, inode);
+        query->bindValue(2, size);
+        query->bindValue(3, modtime);
+        query->bindValue(4, modtimeNsec);
+        if (!query->exec()) {
+            return false;
+        }
+    }
+
+    const auto query = _queryManager.get(PreparedSqlQueryManager::SetChecksumCacheQuery, QByteArrayLiteral("INSERT OR REPLACE INTO checksumcache"
+                                                                                                         " (inode, filesize, modtime, checksumTypeId, checksum, modtimeNsec)"
+                                                                                                         " VALUES (?1, ?2, ?3, ?4, ?5, ?6)"),
+        _db);
+    if (!query) {
+        return false;
+    }
+    query->bindValue(1, inode);
+    query->bindValue(2, size);
+    query->bindValue(3, modtime);
+    query->bindValue(4, checksumTypeId);
+    query->bindValue(5, checksum);
+    query->bindValue(6, modtimeNsec);
+    return query->exec();
+}
+
+void SyncJournalDb::deleteStaleChecksumCacheEntries()
+{
+    QMutexLocker locker(&_mutex);
+    if (!checkConnect())
+        return;
+
+    SqlQuery delQuery("DELETE FROM checksumcache WHERE inode NOT IN (SELECT inode FROM metadata);", _db);
+    if (!delQuery.exec()) {
+        sqlFail(QStringLiteral("deleteStaleChecksumCacheEntries"), delQuery);
+    }
+}
+
 int SyncJournalDb::errorBlackListEntryCount()
 {
     int re = 0;
@@ -2147,6 +2843,7 @@ void SyncJournalDb::avoidRenamesOnNextSync(const QByteArray &path)
     if (!query.exec()) {
         sqlFail(QStringLiteral("avoidRenamesOnNextSync path: %1").arg(QString::fromUtf8(path)), query);
     }
+    dropDiscoverySnapshotLocked("avoidRenamesOnNextSync");
 
     // We also need to remove the ETags so the update phase refreshes the directory paths
     // on the next sync
@@ -2176,6 +2873,19 @@ void SyncJournalDb::schedulePathForRemoteDiscovery(const QByteArray &fileName)
         sqlFail(QStringLiteral("schedulePathForRemoteDiscovery path: %1").arg(QString::fromUtf8(fileName)), query);
     }
 
+    if (_discoverySnapshot) {
+        // Same as the query: the directory itself and all its parents
+        for (auto path = argument; !path.isEmpty(); path = DiscoverySnapshot::parentPath(path)) {
+            const auto it = _discoverySnapshot->byPath.constFind(path);
+            if (it != _discoverySnapshot->byPath.constEnd()) {
+                auto &record = _discoverySnapshot->records[*it];
+                if (record._type == ItemTypeDirectory) {
+                    record._etag = "_invalid_";
+                }
+            }
+        }
+    }
+
     // Prevent future overwrite of the etags of this folder and all
     // parent folders for this sync
     argument.append('/');
@@ -2207,6 +2917,7 @@ void SyncJournalDb::forceRemoteDiscoveryNextSyncLocked()
     if (!deleteRemoteFolderEtagsQuery.exec()) {
         sqlFail(QStringLiteral("forceRemoteDiscoveryNextSyncLocked"), deleteRemoteFolderEtagsQuery);
     }
+    dropDiscoverySnapshotLocked("forceRemoteDiscoveryNextSync");
 }
 
 
@@ -2512,6 +3223,7 @@ void SyncJournalDb::clearFileTable()
     if (!query.exec()) {
         sqlFail(QStringLiteral("clearFileTable"), query);
     }
+    dropDiscoverySnapshotLocked("clearFileTable");
 }
 
 void SyncJournalDb::markVirtualFileForDownloadRecursively(const QByteArray &path)
@@ -2540,6 +3252,7 @@ void SyncJournalDb::markVirtualFileForDownloadRecursively(const QByteArray &path
     if (!query.exec()) {
         sqlFail(QStringLiteral("markVirtualFileForDownloadRecursively UPDATE metadata SET md5='_invalid_' path: %1").arg(QString::fromUtf8(path)), query);
     }
+    dropDiscoverySnapshotLocked("markVirtualFileForDownloadRecursively");
 }
 
 void SyncJournalDb::setE2EeLockedFolder(const QByteArray &folderId, const QByteArray &folderToken)
@@ -2769,9 +3482,198 @@ SyncJournalDb::PinStateInterface SyncJournalDb::internalPinStates()
 void SyncJournalDb::commit(const QString &context, bool startTrans)
 {
     QMutexLocker lock(&_mutex);
+    ++_commitStatistics.commitRequests;
     commitInternal(context, startTrans);
 }
 
+void SyncJournalDb::scheduleCommit(const QString &context)
+{
+    QMutexLocker lock(&_mutex);
+    ++_commitStatistics.commitRequests;
+    // The timer can only be started from our thread
+    if (!_groupCommit || QThread::currentThread() != thread() || ++_pendingCommits >= groupCommitMaxPending) {
+        commitInternal(context);
+        return;
+    }
+    if (!_groupCommitTimer.isActive()) {
+        _groupCommitTimer.start();
+    }
+}
+
+void SyncJournalDb::setGroupCommitEnabled(bool enabled)
+{
+    QMutexLocker lock(&_mutex);
+    if (!enabled && _pendingCommits > 0 && _transaction == 1) {
+        commitInternal(QStringLiteral("group commit end"));
+    }
+    _groupCommit = enabled;
+    _commitStatistics = {};
+    _commitStatisticsTimer.start();
+}
+
+SyncJournalDb::CommitStatistics SyncJournalDb::commitStatistics()
+{
+    QMutexLocker lock(&_mutex);
+    auto statistics = _commitStatistics;
+    statistics.elapsedMsecs = _commitStatisticsTimer.isValid() ? _commitStatisticsTimer.elapsed() : 0;
+    return statistics;
+}
+
+QFuture<void> SyncJournalDb::scheduleMaintenance()
+{
+    if (_maintenanceFuture.isRunning()) {
+        return _maintenanceFuture;
+    }
+    _maintenanceAbortRequested = false;
+    _maintenanceFuture = QtConcurrent::run([this] {
+        performMaintenance();
+    });
+    return _maintenanceFuture;
+}
+
+void SyncJournalDb::abortMaintenance()
+{
+    if (_maintenanceFuture.isRunning()) {
+        _maintenanceAbortRequested = true;
+    }
+}
+
+bool SyncJournalDb::runMaintenanceStep(const std::function<void()> &step)
+{
+    if (_maintenanceAbortRequested) {
+        qCInfo(lcDb) << "Journal maintenance aborted";
+        return false;
+    }
+
+    QMutexLocker locker(&_mutex);
+
+    // A closed journal may be about to be removed, don't create it again
+    if (!_db.isOpen() || !checkConnect()) {
+        return false;
+    }
+
+    // Neither checkpoints nor vacuuming can run inside a transaction
+    const auto wasInTransaction = _transaction == 1;
+    commitInternal(QStringLiteral("journal maintenance"), false);
+    step();
+    if (wasInTransaction) {
+        startTransaction();
+    }
+    return true;
+}
+
+bool SyncJournalDb::performMaintenance()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    // Other threads get the journal between the steps
+    qint64 pageCount = -1;
+    qint64 freePageCount = -1;
+    qint64 autoVacuum = -1;
+    const auto readPageCounts = [&] {
+        pageCount = runPragma(_db, "page_count");
+        freePageCount = runPragma(_db, "freelist_count");
+        autoVacuum = runPragma(_db, "auto_vacuum");
+    };
+    if (!runMaintenanceStep(readPageCounts)) {
+        return false;
+    }
+
+    bool vacuumed = false;
+    if (hasReclaimablePages(pageCount, freePageCount)) {
+        if (autoVacuum == incrementalAutoVacuum) {
+            qCInfo(lcDb) << "Reclaiming" << freePageCount << "free pages of" << pageCount;
+            const auto vacuumStep = [&] {
+                if (runPragma(_db, "incremental_vacuum(" + QByteArray::number(vacuumPagesPerStep) + ")") == -1) {
+                    freePageCount = -1;
+                    return;
+                }
+                freePageCount = runPragma(_db, "freelist_count");
+            };
+            while (freePageCount > 0) {
+                if (!runMaintenanceStep(vacuumStep)) {
+                    return false;
+                }
+            }
+            vacuumed = freePageCount == 0;
+        } else {
+            // Journals created before auto_vacuum=INCREMENTAL need a VACUUM to switch to it.
+            // It rewrites the whole file in one step, only ever on this thread.
+            qCInfo(lcDb) << "Reclaiming" << freePageCount << "free pages of" << pageCount << "and switching to incremental vacuum";
+            const auto fullVacuum = [&] {
+                QElapsedTimer vacuumTimer;
+                vacuumTimer.start();
+                runPragma(_db, "auto_vacuum=INCREMENTAL");
+                SqlQuery vacuum("VACUUM;", _db);
+                if (vacuum.exec()) {
+                    qCInfo(lcDb) << "Vacuumed the journal in" << vacuumTimer.elapsed() << "ms";
+                    vacuumed = true;
+                } else {
+                    qCWarning(lcDb) << "Could not vacuum the journal" << vacuum.error();
+                }
+            };
+            if (!runMaintenanceStep(fullVacuum)) {
+                return false;
+            }
+        }
+    }
+
+    const auto now = QDateTime::currentDateTimeUtc();
+    const auto lastAnalyze = QDateTime::fromSecsSinceEpoch(keyValueStoreGetInt(QStringLiteral("last_analyze"), 0), Qt::UTC);
+    if (vacuumed || lastAnalyze.secsTo(now) > std::chrono::seconds(analyzeInterval).count()) {
+        const auto analyze = [&] {
+            // Bounds the rows looked at per index, older sqlite versions ignore it
+            runPragma(_db, "analysis_limit=1000");
+            SqlQuery query("ANALYZE;", _db);
+            if (query.exec()) {
+                keyValueStoreSet(QStringLiteral("last_analyze"), now.toSecsSinceEpoch());
+            }
+        };
+        if (!runMaintenanceStep(analyze)) {
+            return false;
+        }
+    }
+
+    // Last, vacuuming and ANALYZE write to the WAL too. A PASSIVE checkpoint doesn't wait
+    // for readers, once it is through journal_size_limit truncates the WAL.
+    const auto checkpoint = [this] {
+        SqlQuery query("PRAGMA wal_checkpoint(PASSIVE);", _db);
+        if (query.next().hasData) {
+            qCInfo(lcDb) << "WAL checkpoint: busy" << query.intValue(0) << "frames" << query.intValue(1)
+                         << "checkpointed" << query.intValue(2);
+        }
+    };
+    if (!runMaintenanceStep(checkpoint)) {
+        return false;
+    }
+
+    const auto storeStatistics = [&] {
+        QMutexLocker statisticsLocker(&_maintenanceStatisticsMutex);
+        _maintenanceStatistics.pageCount = runPragma(_db, "page_count");
+        _maintenanceStatistics.freePageCount = runPragma(_db, "freelist_count");
+        _maintenanceStatistics.lastMaintenance = now;
+        _maintenanceStatistics.lastMaintenanceMsecs = timer.elapsed();
+    };
+    if (!runMaintenanceStep(storeStatistics)) {
+        return false;
+    }
+    qCInfo(lcDb) << "Journal maintenance took" << timer.elapsed() << "ms";
+    return true;
+}
+
+SyncJournalDb::MaintenanceStatistics SyncJournalDb::maintenanceStatistics() const
+{
+    MaintenanceStatistics statistics;
+    {
+        QMutexLocker locker(&_maintenanceStatisticsMutex);
+        statistics = _maintenanceStatistics;
+    }
+    statistics.databaseSize = QFileInfo(_dbFile).size();
+    statistics.walSize = QFileInfo(_dbFile + QStringLiteral("-wal")).size();
+    return statistics;
+}
+
 void SyncJournalDb::commitIfNeededAndStartNewTransaction(const QString &context)
 {
     QMutexLocker lock(&_mutex);
@@ -2798,6 +3700,7 @@ void SyncJournalDb::commitInternal(const QString &context, bool startTrans)
 {
     qCDebug(lcDb) << "Transaction commit" << context << (startTrans ? "and starting new transaction" : "");
     commitTransaction();
+    _pendingCommits = 0;
 
     if (startTrans) {
         startTransaction();
@@ -2806,6 +3709,8 @@ void SyncJournalDb::commitInternal(const QString &context, bool startTrans)
 
 SyncJournalDb::~SyncJournalDb()
 {
+    abortMaintenance();
+    _maintenanceFuture.waitForFinished();
     if (isOpen()) {
         close();
     }
@@ -2818,7 +3723,16 @@ bool operator==(const SyncJournalDb::DownloadInfo &lhs,
     return lhs._errorCount == rhs._errorCount
         && lhs._etag == rhs._etag
         && lhs._tmpfile == rhs._tmpfile
-        && lhs._valid == rhs._valid;
+        && lhs._valid == rhs._valid
+        && lhs._segments == rhs._segments;
+}
+
+bool operator==(const SyncJournalDb::DownloadInfo::Segment &lhs,
+    const SyncJournalDb::DownloadInfo::Segment &rhs)
+{
+    return lhs._offset == rhs._offset
+        && lhs._size == rhs._size
+        && lhs._downloaded == rhs._downloaded;
 }
 
 bool operator==(const SyncJournalDb::UploadInfo &lhs,
@@ -22,9 +22,15 @@
 #include <QObject>
 #include <QDateTime>
 #include <QHash>
+#include <QElapsedTimer>
+#include <QFuture>
 #include <QMutex>
+#include <QTimer>
 #include <QVariant>
+#include <atomic>
 #include <functional>
+#include <memory>
+#include <vector>
 
 #include "common/utility.h"
 #include "common/ownsql.h"
@@ -64,11 +70,41 @@ public:
     // To verify that the record could be found check with SyncJournalFileRecord::isValid()
     [[nodiscard]] bool getFileRecord(const QString &filename, SyncJournalFileRecord *rec) { return getFileRecord(filename.toUtf8(), rec); }
     [[nodiscard]] bool getFileRecord(const QByteArray &filename, SyncJournalFileRecord *rec);
+
+    /**
+     * Like getFileRecord(), but reads on a separate read-only connection.
+     *
+     * It never waits for a running sync, but only sees what that sync has
+     * committed so far. Meant for the status lookups of the GUI thread.
+     * Only enabled with setReadConnectionsEnabled() or OWNCLOUD_SQLITE_READ_CONNECTIONS,
+     * otherwise and when the journal can not be shared between connections (journal
+     * mode other than WAL, or exclusive locking) it falls back to getFileRecord().
+     */
+    [[nodiscard]] bool getCommittedFileRecord(const QString &filename, SyncJournalFileRecord *rec) { return getCommittedFileRecord(filename.toUtf8(), rec); }
+    [[nodiscard]] bool getCommittedFileRecord(const QByteArray &filename, SyncJournalFileRecord *rec);
     [[nodiscard]] bool getFileRecordByE2eMangledName(const QString &mangledName, SyncJournalFileRecord *rec);
+    /// Like getFileRecordByE2eMangledName(), on a read-only connection as getCommittedFileRecord()
+    [[nodiscard]] bool getCommittedFileRecordByE2eMangledName(const QString &mangledName, SyncJournalFileRecord *rec);
     [[nodiscard]] bool getFileRecordByInode(quint64 inode, SyncJournalFileRecord *rec);
     [[nodiscard]] bool getFileRecordsByFileId(const QByteArray &fileId, const std::function<void(const SyncJournalFileRecord &)> &rowCallback);
     [[nodiscard]] bool getFilesBelowPath(const QByteArray &path, const std::function<void(const SyncJournalFileRecord&)> &rowCallback);
     [[nodiscard]] bool listFilesInPath(const QByteArray &path, const std::function<void(const SyncJournalFileRecord&)> &rowCallback);
+    /// Whether the directory has any records directly inside it, without reading them like listFilesInPath()
+    [[nodiscard]] Optional<bool> hasFilesInPath(const QByteArray &path);
+
+    /**
+     * Loads all file records into memory, in one pass over the metadata table.
+     *
+     * While loaded, getFileRecord(), getFileRecordByInode(), getFileRecordsByFileId()
+     * and listFilesInPath() are answered from memory instead of running a query each.
+     * Used for the duration of the discovery.
+     *
+     * Journals estimated to need more than memoryBudget bytes are not loaded and
+     * the queries keep being used. Writes to single records keep the snapshot up to
+     * date, other writes to the metadata table drop it.
+     */
+    bool loadDiscoverySnapshot(qint64 memoryBudget);
+    void dropDiscoverySnapshot();
     [[nodiscard]] Result<void, QString> setFileRecord(const SyncJournalFileRecord &record);
     [[nodiscard]] bool getRootE2eFolderRecord(const QString &remoteFolderPath, SyncJournalFileRecord *rec);
     [[nodiscard]] bool listAllE2eeFoldersWithEncryptionStatusLessThan(const int status, const std::function<void(const SyncJournalFileRecord &)> &rowCallback);
@@ -84,7 +120,7 @@ public:
         const QByteArray &contentChecksum,
         const QByteArray &contentChecksumType);
     [[nodiscard]] bool updateLocalMetadata(const QString &filename,
-        qint64 modtime, qint64 size, quint64 inode, const SyncJournalFileLockInfo &lockInfo);
+        qint64 modtime, qint32 modtimeNsec, qint64 size, quint64 inode, const SyncJournalFileLockInfo &lockInfo);
 
     /// Return value for hasHydratedOrDehydratedFiles()
     struct HasHydratedDehydrated
@@ -111,10 +147,22 @@ public:
 
     struct DownloadInfo
     {
+        /// A byte range of a file downloaded by a separate request
+        struct Segment
+        {
+            qint64 _offset = 0;
+            qint64 _size = 0;
+            qint64 _downloaded = 0;
+
+            [[nodiscard]] bool isComplete() const { return _downloaded >= _size; }
+        };
+
         QString _tmpfile;
         QByteArray _etag;
         int _errorCount = 0;
         bool _valid = false;
+        /// The ranges of a segmented download, empty for a sequential download
+        QVector<Segment> _segments;
     };
     struct UploadInfo
     {
@@ -157,6 +205,29 @@ public:
     /// Delete flags table entries that have no metadata correspondent
     void deleteStaleFlagsEntries();
 
+    /**
+     * Returns the cached \a checksumType checksum of a local file, or an empty
+     * value if there is none.
+     *
+     * The file is identified by its \a inode, \a size, \a modtime and
+     * \a modtimeNsec: the cached value is only returned if all of them still
+     * match. Nothing is returned while the sub-second part is unknown (-1).
+     * Content checksums of unchanged synced files in the metadata table are
+     * used too.
+     */
+    QByteArray getCachedChecksum(quint64 inode, qint64 size, qint64 modtime, qint32 modtimeNsec, const QByteArray &checksumType);
+
+    /**
+     * Remember a checksum of a local file for getCachedChecksum().
+     *
+     * Checksums of other types for the same file are kept, those stored
+     * for an older size or modtime of the inode are dropped.
+     */
+    bool setCachedChecksum(quint64 inode, qint64 size, qint64 modtime, qint32 modtimeNsec, const QByteArray &checksumType, const QByteArray &checksum);
+
+    /// Delete checksum cache entries for inodes that have no metadata correspondent
+    void deleteStaleChecksumCacheEntries();
+
     void avoidRenamesOnNextSync(const QString &path) { avoidRenamesOnNextSync(path.toUtf8()); }
     void avoidRenamesOnNextSync(const QByteArray &path);
     void setPollInfo(const PollInfo &);
@@ -220,6 +291,70 @@ public:
     void commit(const QString &context, bool startTrans = true);
     void commitIfNeededAndStartNewTransaction(const QString &context);
 
+    /**
+     * Like commit(), but with group commits enabled the transaction is only committed
+     * once enough commits were scheduled or a short time passed.
+     *
+     * Use commit() when the data must be on disk before going on, like upload resume
+     * information.
+     */
+    void scheduleCommit(const QString &context);
+
+    /**
+     * Enables grouping scheduleCommit() calls into fewer transactions, used while
+     * propagating. Disabling commits what is pending and resets the statistics.
+     */
+    void setGroupCommitEnabled(bool enabled);
+
+    struct CommitStatistics
+    {
+        /// Number of commit() and scheduleCommit() calls
+        quint64 commitRequests = 0;
+        /// Number of transactions actually committed
+        quint64 transactions = 0;
+        qint64 elapsedMsecs = 0;
+    };
+    /// The statistics since group commits were enabled
+    [[nodiscard]] CommitStatistics commitStatistics();
+
+    struct MaintenanceStatistics
+    {
+        qint64 databaseSize = 0;
+        qint64 walSize = 0;
+        /// As of the last maintenance
+        qint64 pageCount = 0;
+        qint64 freePageCount = 0;
+        /// Invalid if there was no maintenance yet
+        QDateTime lastMaintenance;
+        qint64 lastMaintenanceMsecs = 0;
+    };
+
+    /** Runs performMaintenance() on a worker thread.
+     *
+     * Meant for when no sync is running. Returns the running maintenance if there
+     * is one already.
+     */
+    QFuture<void> scheduleMaintenance();
+
+    /// Makes a running maintenance stop after its current step
+    void abortMaintenance();
+
+    /** Reclaims free pages, updates the query planner statistics and checkpoints the WAL.
+     *
+     * The work is done in short steps, the journal is only locked during a step.
+     * Once more than a quarter of the pages is free they are reclaimed with an incremental
+     * vacuum. Journals created without auto_vacuum=INCREMENTAL are switched to it by a
+     * full VACUUM instead, that step takes as long as rewriting the journal.
+     * ANALYZE runs after vacuuming and otherwise once a day.
+     * The WAL checkpoint comes last and is PASSIVE, it doesn't wait for readers.
+     *
+     * Returns false if the journal is not open or the maintenance was aborted.
+     */
+    bool performMaintenance();
+
+    /// Does not wait for a running maintenance
+    [[nodiscard]] MaintenanceStatistics maintenanceStatistics() const;
+
     /** Open the db if it isn't already.
      *
      * This usually creates some temporary files next to the db file, like
@@ -235,6 +370,14 @@ public:
     /** Close the database */
     void close();
 
+    /**
+     * Allows the read-only connections of the getCommitted*() lookups.
+     *
+     * They need the normal locking mode instead of the exclusive one, so this
+     * takes effect the next time the database is opened.
+     */
+    void setReadConnectionsEnabled(bool enabled);
+
     /**
      * Returns the checksum type for an id.
      */
@@ -420,6 +563,21 @@ private:
     // Returns 0 on failure and for empty checksum types.
     [[nodiscard]] int mapChecksumType(const QByteArray &checksumType);
 
+    struct DiscoverySnapshot;
+    // Reads the record back from the database into the snapshot, if there is one
+    void updateDiscoverySnapshot(const QByteArray &path);
+    void dropDiscoverySnapshotLocked(const char *reason);
+
+    // Runs one step of performMaintenance() outside of the transaction, with the journal locked.
+    // Returns false if the maintenance was aborted or the journal is not open.
+    bool runMaintenanceStep(const std::function<void()> &step);
+
+    struct ReadConnection;
+    // Returns nullptr if there can't be read-only connections
+    std::unique_ptr<ReadConnection> acquireReadConnection();
+    void releaseReadConnection(std::unique_ptr<ReadConnection> connection);
+    void closeReadConnections();
+
     SqlDatabase _db;
     QString _dbFile;
     QRecursiveMutex _mutex; // Public functions are protected with the mutex.
@@ -442,6 +600,20 @@ private:
      */
     QList<QByteArray> _etagStorageFilter;
 
+    std::unique_ptr<DiscoverySnapshot> _discoverySnapshot;
+
+    /* Idle read-only connections for the getCommitted*() lookups.
+     *
+     * Only used when enabled, with the WAL journal mode and normal locking,
+     * as set up by checkConnect(). Protected by _readConnectionsMutex instead of _mutex
+     * so they don't wait for the main connection.
+     */
+    QMutex _readConnectionsMutex;
+    std::vector<std::unique_ptr<ReadConnection>> _idleReadConnections;
+    int _readConnectionsGeneration = 0;
+    bool _readConnectionsEnabled = false;
+    std::atomic<bool> _readConnectionsSupported{false};
+
     /** The journal mode to use for the db.
      *
      * Typically WAL initially, but may be set to other modes via environment
@@ -449,6 +621,17 @@ private:
      */
     QByteArray _journalMode;
 
+    bool _groupCommit = false;
+    int _pendingCommits = 0;
+    QTimer _groupCommitTimer;
+    CommitStatistics _commitStatistics;
+    QElapsedTimer _commitStatisticsTimer;
+
+    QFuture<void> _maintenanceFuture;
+    std::atomic<bool> _maintenanceAbortRequested{false};
+    mutable QMutex _maintenanceStatisticsMutex;
+    MaintenanceStatistics _maintenanceStatistics;
+
     PreparedSqlQueryManager _queryManager;
 };
 
@@ -456,6 +639,9 @@ bool OCSYNC_EXPORT
 operator==(const SyncJournalDb::DownloadInfo &lhs,
     const SyncJournalDb::DownloadInfo &rhs);
 bool OCSYNC_EXPORT
+operator==(const SyncJournalDb::DownloadInfo::Segment &lhs,
+    const SyncJournalDb::DownloadInfo::Segment &rhs);
+bool OCSYNC_EXPORT
 operator==(const SyncJournalDb::UploadInfo &lhs,
     const SyncJournalDb::UploadInfo &rhs);
 
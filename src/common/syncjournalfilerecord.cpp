@@ -45,6 +45,7 @@ bool operator==(const SyncJournalFileRecord &lhs,
     return lhs._path == rhs._path
         && lhs._inode == rhs._inode
         && lhs._modtime == rhs._modtime
+        && lhs._modtimeNsec == rhs._modtimeNsec
         && lhs._type == rhs._type
         && lhs._etag == rhs._etag
         && lhs._fileId == rhs._fileId
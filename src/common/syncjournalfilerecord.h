@@ -74,6 +74,8 @@ public:
     QByteArray _path;
     quint64 _inode = 0;
     qint64 _modtime = 0;
+    // Sub-second part of _modtime, -1 if unknown (recorded by an older client)
+    qint32 _modtimeNsec = -1;
     ItemType _type = ItemTypeSkip;
     QByteArray _etag;
     QByteArray _fileId;
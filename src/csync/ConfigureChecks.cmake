@@ -35,6 +35,7 @@ if(WIN32)
 endif()
 
 check_function_exists(utimes HAVE_UTIMES)
+check_function_exists(utimensat HAVE_UTIMENSAT)
 check_function_exists(lstat HAVE_LSTAT)
 
 set(CSYNC_REQUIRED_LIBRARIES ${CMAKE_REQUIRED_LIBRARIES} CACHE INTERNAL "csync required system libraries")
@@ -9,6 +9,7 @@
 #cmakedefine HAVE_ARGP_H 1
 
 #cmakedefine HAVE_UTIMES 1
+#cmakedefine HAVE_UTIMENSAT 1
 #cmakedefine HAVE_LSTAT 1
 
 
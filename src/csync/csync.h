@@ -202,6 +202,7 @@ using csync_file_stat_t = struct csync_file_stat_s;
 
 struct OCSYNC_EXPORT csync_file_stat_s {
   time_t modtime = 0;
+  int32_t modtime_nsec = 0; // sub-second part of modtime, 0 where the file system has none
   int64_t size = 0;
   uint64_t inode = 0;
 
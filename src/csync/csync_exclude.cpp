@@ -321,6 +321,9 @@ bool ExcludedFiles::reloadExcludeFiles()
     _fullTraversalRegexDir.clear();
     _fullRegexFile.clear();
     _fullRegexDir.clear();
+    _bnameTraversalLiteralsFile.clear();
+    _bnameTraversalLiteralsDir.clear();
+    _traversalBasePathsValid = false;
 
     bool success = true;
     const auto keys = _excludeFiles.keys();
@@ -424,6 +427,23 @@ bool ExcludedFiles::isExcluded(
     return fullPatternMatch(relativePath, type) != CSYNC_NOT_EXCLUDED;
 }
 
+bool ExcludedFiles::isExcludedPath(
+    const QString &relativePath,
+    ItemType filetype,
+    bool excludeHidden) const
+{
+    if (excludeHidden) {
+        const auto components = relativePath.splitRef(QLatin1Char('/'), Qt::SkipEmptyParts);
+        for (const auto &component : components) {
+            if (component.startsWith(QLatin1Char('.')) && component != QLatin1String(".sync-exclude.lst")) {
+                return true;
+            }
+        }
+    }
+
+    return fullPatternMatch(relativePath, filetype) != CSYNC_NOT_EXCLUDED;
+}
+
 CSYNC_EXCLUDE_TYPE ExcludedFiles::traversalPatternMatch(const QString &path, ItemType filetype)
 {
     auto match = _csync_excluded_common(path, _excludeConflictFiles);
@@ -448,6 +468,15 @@ CSYNC_EXCLUDE_TYPE ExcludedFiles::traversalPatternMatch(const QString &path, Ite
         }
     }
 
+    if (path.isEmpty() || (filetype != ItemTypeDirectory && filetype != ItemTypeFile))
+        return CSYNC_NOT_EXCLUDED;
+
+    const auto &basePaths = traversalBasePaths(path);
+    if (basePaths.isEmpty()) {
+        // No patterns apply to this directory
+        return CSYNC_NOT_EXCLUDED;
+    }
+
     // Check the bname part of the path to see whether the full
     // regex should be run.
     QStringRef bnameStr(&path);
@@ -456,44 +485,34 @@ CSYNC_EXCLUDE_TYPE ExcludedFiles::traversalPatternMatch(const QString &path, Ite
         bnameStr = path.midRef(lastSlash + 1);
     }
 
-    QString basePath(_localPath + path);
-    while (basePath.size() > _localPath.size()) {
-        basePath = leftIncludeLast(basePath, QLatin1Char('/'));
+    const auto cs = OCC::Utility::fsCasePreserving() ? Qt::CaseInsensitive : Qt::CaseSensitive;
+    const auto &bnameLiterals = filetype == ItemTypeDirectory ? _bnameTraversalLiteralsDir : _bnameTraversalLiteralsFile;
+    const auto &bnameRegexes = filetype == ItemTypeDirectory ? _bnameTraversalRegexDir : _bnameTraversalRegexFile;
+    for (const auto &basePath : basePaths) {
+        const auto literals = bnameLiterals.constFind(basePath);
+        Q_ASSERT(literals != bnameLiterals.cend());
+
+        // Same precedence as the groups of the regex: exclude, excluderemove, trigger
+        if (literals->exclude.matches(bnameStr, cs))
+            return CSYNC_FILE_EXCLUDE_LIST;
+        const auto excludeRemove = literals->excludeRemove.matches(bnameStr, cs);
+
         QRegularExpressionMatch m;
-        if (filetype == ItemTypeDirectory
-            && _bnameTraversalRegexDir.contains(basePath)) {
-            m = _bnameTraversalRegexDir[basePath].match(bnameStr);
-        } else if (filetype == ItemTypeFile
-            && _bnameTraversalRegexFile.contains(basePath)) {
-            m = _bnameTraversalRegexFile[basePath].match(bnameStr);
-        } else {
-            continue;
+        if (literals->regexNeeded) {
+            m = bnameRegexes.constFind(basePath)->match(bnameStr);
         }
-
-        if (!m.hasMatch())
-            return CSYNC_NOT_EXCLUDED;
-        if (m.capturedStart(QStringLiteral("exclude")) != -1) {
+        if (m.hasMatch() && m.capturedStart(QStringLiteral("exclude")) != -1)
             return CSYNC_FILE_EXCLUDE_LIST;
-        } else if (m.capturedStart(QStringLiteral("excluderemove")) != -1) {
+        if (excludeRemove || (m.hasMatch() && m.capturedStart(QStringLiteral("excluderemove")) != -1))
             return CSYNC_FILE_EXCLUDE_AND_REMOVE;
-        }
+        if (!m.hasMatch())
+            return CSYNC_NOT_EXCLUDED;
     }
 
     // third capture: full path matching is triggered
-    basePath = _localPath + path;
-    while (basePath.size() > _localPath.size()) {
-        basePath = leftIncludeLast(basePath, QLatin1Char('/'));
-        QRegularExpressionMatch m;
-        if (filetype == ItemTypeDirectory
-            && _fullTraversalRegexDir.contains(basePath)) {
-            m = _fullTraversalRegexDir[basePath].match(path);
-        } else if (filetype == ItemTypeFile
-            && _fullTraversalRegexFile.contains(basePath)) {
-            m = _fullTraversalRegexFile[basePath].match(path);
-        } else {
-            continue;
-        }
-
+    const auto &fullRegexes = filetype == ItemTypeDirectory ? _fullTraversalRegexDir : _fullTraversalRegexFile;
+    for (const auto &basePath : basePaths) {
+        const auto m = fullRegexes.constFind(basePath)->match(path);
         if (m.hasMatch()) {
             if (m.capturedStart(QStringLiteral("exclude")) != -1) {
                 return CSYNC_FILE_EXCLUDE_LIST;
@@ -505,6 +524,28 @@ CSYNC_EXCLUDE_TYPE ExcludedFiles::traversalPatternMatch(const QString &path, Ite
     return CSYNC_NOT_EXCLUDED;
 }
 
+const QStringList &ExcludedFiles::traversalBasePaths(const QString &path)
+{
+    // The parent directory part of path, as the first leftIncludeLast() would cut it
+    const auto parentSize = path.size() < 2 ? 0 : path.lastIndexOf(QLatin1Char('/'), path.size() - 2) + 1;
+    const auto parent = path.leftRef(parentSize);
+    if (_traversalBasePathsValid && _traversalShortcuts && parent == _traversalBasePathsParent)
+        return _traversalBasePaths;
+
+    _traversalBasePathsParent = parent.toString();
+    _traversalBasePaths.clear();
+    QString basePath = _localPath + _traversalBasePathsParent;
+    while (true) {
+        if (_bnameTraversalRegexFile.contains(basePath))
+            _traversalBasePaths.append(basePath);
+        if (basePath.size() <= _localPath.size())
+            break;
+        basePath = leftIncludeLast(basePath, QLatin1Char('/'));
+    }
+    _traversalBasePathsValid = true;
+    return _traversalBasePaths;
+}
+
 CSYNC_EXCLUDE_TYPE ExcludedFiles::fullPatternMatch(const QString &p, ItemType filetype) const
 {
     auto match = _csync_excluded_common(p, _excludeConflictFiles);
@@ -676,6 +717,64 @@ QString ExcludedFiles::extractBnameTrigger(const QString &exclude, bool wildcard
     return pattern;
 }
 
+bool ExcludedFiles::BnameLiterals::add(const QString &pattern, Qt::CaseSensitivity cs)
+{
+    // Escapes, ? and bracket expressions are left to the regex
+    for (const auto c : pattern) {
+        if (c == QLatin1Char('\\') || c == QLatin1Char('?') || c == QLatin1Char('['))
+            return false;
+    }
+
+    const auto fold = [cs](const QString &str) {
+        return cs == Qt::CaseInsensitive ? str.toCaseFolded() : str;
+    };
+    const auto wildcards = pattern.count(QLatin1Char('*'));
+    if (wildcards == 0) {
+        names.insert(fold(pattern));
+        return true;
+    }
+    if (wildcards != 1 || pattern.size() == 1)
+        return false;
+
+    if (pattern.startsWith(QLatin1Char('*'))) {
+        const auto suffix = pattern.mid(1);
+        if (suffix.lastIndexOf(QLatin1Char('.')) == 0) {
+            extensions.insert(fold(suffix));
+        } else {
+            suffixes.append(suffix);
+        }
+        return true;
+    }
+    if (pattern.endsWith(QLatin1Char('*'))) {
+        prefixes.append(pattern.left(pattern.size() - 1));
+        return true;
+    }
+    return false;
+}
+
+bool ExcludedFiles::BnameLiterals::matches(const QStringRef &bname, Qt::CaseSensitivity cs) const
+{
+    if (!names.isEmpty() || !extensions.isEmpty()) {
+        // QSet needs a QString, fromRawData() avoids copying the characters
+        const auto name = cs == Qt::CaseInsensitive ? bname.toString().toCaseFolded() : QString::fromRawData(bname.unicode(), bname.size());
+        if (names.contains(name))
+            return true;
+        // An extension only has a leading dot, so it can only match from the last dot on
+        const auto dot = name.lastIndexOf(QLatin1Char('.'));
+        if (dot >= 0 && extensions.contains(QString::fromRawData(name.unicode() + dot, name.size() - dot)))
+            return true;
+    }
+    for (const auto &suffix : suffixes) {
+        if (bname.endsWith(suffix, cs))
+            return true;
+    }
+    for (const auto &prefix : prefixes) {
+        if (bname.startsWith(prefix, cs))
+            return true;
+    }
+    return false;
+}
+
 void ExcludedFiles::prepare()
 {
     // clear all regex
@@ -685,6 +784,9 @@ void ExcludedFiles::prepare()
     _fullTraversalRegexDir.clear();
     _fullRegexFile.clear();
     _fullRegexDir.clear();
+    _bnameTraversalLiteralsFile.clear();
+    _bnameTraversalLiteralsDir.clear();
+    _traversalBasePathsValid = false;
 
     const auto keys = _allExcludes.keys();
     for (auto const & basePath : keys)
@@ -694,6 +796,7 @@ void ExcludedFiles::prepare()
 void ExcludedFiles::prepare(const BasePathString & basePath)
 {
     Q_ASSERT(_allExcludes.contains(basePath));
+    _traversalBasePathsValid = false;
 
     // Build regular expressions for the different cases.
     //
@@ -729,6 +832,16 @@ void ExcludedFiles::prepare(const BasePathString & basePath)
     QString bnameTriggerFileDir;
     QString bnameTriggerDir;
 
+    // The bname patterns that aren't literals, for the traversal regex
+    QString bnameRegexFileDirKeep;
+    QString bnameRegexFileDirRemove;
+    QString bnameRegexDirKeep;
+    QString bnameRegexDirRemove;
+
+    const auto cs = OCC::Utility::fsCasePreserving() ? Qt::CaseInsensitive : Qt::CaseSensitive;
+    BnameTraversalLiterals literalsFile;
+    BnameTraversalLiterals literalsDir;
+
     auto regexAppend = [](QString &fileDirPattern, QString &dirPattern, const QString &appendMe, bool dirOnly) {
         QString &pattern = dirOnly ? dirPattern : fileDirPattern;
         if (!pattern.isEmpty())
@@ -757,6 +870,8 @@ void ExcludedFiles::prepare(const BasePathString & basePath)
         auto &bnameDir = removeExcluded ? bnameDirRemove : bnameDirKeep;
         auto &fullFileDir = removeExcluded ? fullFileDirRemove : fullFileDirKeep;
         auto &fullDir = removeExcluded ? fullDirRemove : fullDirKeep;
+        auto &bnameRegexFileDir = removeExcluded ? bnameRegexFileDirRemove : bnameRegexFileDirKeep;
+        auto &bnameRegexDir = removeExcluded ? bnameRegexDirRemove : bnameRegexDirKeep;
 
         if (fullPath) {
             // The full pattern is matched against a path relative to _localPath, however exclude is
@@ -770,6 +885,14 @@ void ExcludedFiles::prepare(const BasePathString & basePath)
         auto regexExclude = convertToRegexpSyntax(exclude, _wildcardsMatchSlash);
         if (!fullPath) {
             regexAppend(bnameFileDir, bnameDir, regexExclude, matchDirOnly);
+
+            auto &dirLiterals = removeExcluded ? literalsDir.excludeRemove : literalsDir.exclude;
+            auto &fileLiterals = removeExcluded ? literalsFile.excludeRemove : literalsFile.exclude;
+            if (!_traversalShortcuts || !dirLiterals.add(exclude, cs)) {
+                regexAppend(bnameRegexFileDir, bnameRegexDir, regexExclude, matchDirOnly);
+            } else if (!matchDirOnly) {
+                fileLiterals.add(exclude, cs);
+            }
         } else {
             regexAppend(fullFileDir, fullDir, regexExclude, matchDirOnly);
 
@@ -780,6 +903,12 @@ void ExcludedFiles::prepare(const BasePathString & basePath)
         }
     }
 
+    literalsFile.regexNeeded = !bnameRegexFileDirKeep.isEmpty() || !bnameRegexFileDirRemove.isEmpty() || !bnameTriggerFileDir.isEmpty();
+    literalsDir.regexNeeded = literalsFile.regexNeeded
+        || !bnameRegexDirKeep.isEmpty() || !bnameRegexDirRemove.isEmpty() || !bnameTriggerDir.isEmpty();
+    _bnameTraversalLiteralsFile[basePath] = literalsFile;
+    _bnameTraversalLiteralsDir[basePath] = literalsDir;
+
     // The empty pattern would match everything - change it to match-nothing
     auto emptyMatchNothing = [](QString &pattern) {
         if (pattern.isEmpty())
@@ -798,8 +927,14 @@ void ExcludedFiles::prepare(const BasePathString & basePath)
     emptyMatchNothing(bnameTriggerFileDir);
     emptyMatchNothing(bnameTriggerDir);
 
+    emptyMatchNothing(bnameRegexFileDirKeep);
+    emptyMatchNothing(bnameRegexFileDirRemove);
+    emptyMatchNothing(bnameRegexDirKeep);
+    emptyMatchNothing(bnameRegexDirRemove);
+
     // The bname regex is applied to the bname only, so it must be
-    // anchored in the beginning and in the end. It has the structure:
+    // anchored in the beginning and in the end. The literal bname patterns
+    // are not part of it, they are checked before. It has the structure:
     // (exclude)|(excluderemove)|(bname triggers).
     // If the third group matches, the fullActivatedRegex needs to be applied
     // to the full path.
@@ -807,12 +942,12 @@ void ExcludedFiles::prepare(const BasePathString & basePath)
         QStringLiteral("^(?P<exclude>%1)$|"
                        "^(?P<excluderemove>%2)$|"
                        "^(?P<trigger>%3)$")
-            .arg(bnameFileDirKeep, bnameFileDirRemove, bnameTriggerFileDir));
+            .arg(bnameRegexFileDirKeep, bnameRegexFileDirRemove, bnameTriggerFileDir));
     _bnameTraversalRegexDir[basePath].setPattern(
         QStringLiteral("^(?P<exclude>%1|%2)$|"
                        "^(?P<excluderemove>%3|%4)$|"
                        "^(?P<trigger>%5|%6)$")
-            .arg(bnameFileDirKeep, bnameDirKeep, bnameFileDirRemove, bnameDirRemove, bnameTriggerFileDir, bnameTriggerDir));
+            .arg(bnameRegexFileDirKeep, bnameRegexDirKeep, bnameRegexFileDirRemove, bnameRegexDirRemove, bnameTriggerFileDir, bnameTriggerDir));
 
     // The full traveral regex is applied to the full path if the trigger capture of
     // the bname regex matches. Its basic form is (exclude)|(excluderemove)".
@@ -100,6 +100,19 @@ public:
         const QString &basePath,
         bool excludeHidden) const;
 
+    /**
+     * Checks whether a file or directory should be excluded, without touching the file system.
+     *
+     * The item type has to be known already, e.g. from the journal. Hidden files are
+     * recognized by their leading dot only.
+     *
+     * @param relativePath the path relative to the local path, without trailing slash
+     */
+    [[nodiscard]] bool isExcludedPath(
+        const QString &relativePath,
+        ItemType filetype,
+        bool excludeHidden) const;
+
     /**
      * Adds an exclude pattern anchored to base path
      *
@@ -226,6 +239,11 @@ private:
      * Note: The traversal matcher will return not-excluded on some paths that the
      * full matcher would exclude. Example: "b" is excluded. traversal("b/c")
      * returns not-excluded because "c" isn't a bname activation pattern.
+     *
+     * Most bname patterns are plain names ("Thumbs.db"), extensions ("*.tmp")
+     * or prefixes ("~$*"). These are put into _bnameTraversalLiteralsFile/Dir
+     * and looked up directly instead of being part of _bnameTraversalRegex,
+     * which then only contains the remaining patterns.
      */
     void prepare(const BasePathString &basePath);
 
@@ -234,6 +252,46 @@ private:
     static QString extractBnameTrigger(const QString &exclude, bool wildcardsMatchSlash);
     static QString convertToRegexpSyntax(QString exclude, bool wildcardsMatchSlash);
 
+    /// Bname patterns that can be matched without a regular expression, see prepare()
+    struct BnameLiterals
+    {
+        QSet<QString> names;
+        /// "*.ext" patterns, stored with the dot
+        QSet<QString> extensions;
+        /// Other "*suffix" patterns
+        QStringList suffixes;
+        /// "prefix*" patterns
+        QStringList prefixes;
+
+        /// Adds \a pattern if it is a literal pattern, returns false otherwise
+        bool add(const QString &pattern, Qt::CaseSensitivity cs);
+        [[nodiscard]] bool matches(const QStringRef &bname, Qt::CaseSensitivity cs) const;
+    };
+
+    struct BnameTraversalLiterals
+    {
+        BnameLiterals exclude;
+        BnameLiterals excludeRemove;
+        /// False if all bname patterns are literals: the regex can't match anything
+        bool regexNeeded = true;
+    };
+
+    /**
+     * The base paths whose patterns apply to the entries of \a path's parent
+     * directory, deepest first.
+     *
+     * Cached for the last directory: the entries of a directory are matched
+     * one after another during discovery.
+     *
+     * An empty list is the verdict that the directory is fully included, its
+     * entries are not matched at all. There is no other per directory verdict:
+     * - bname patterns match at every depth, so a directory with patterns can't
+     *   be known to be fully included without looking at its entries,
+     * - the entries of an excluded directory are never matched, the discovery
+     *   doesn't descend into it.
+     */
+    const QStringList &traversalBasePaths(const QString &path);
+
     QString _localPath;
 
     /// Files to load excludes from
@@ -252,6 +310,21 @@ private:
     QMap<BasePathString, QRegularExpression> _fullTraversalRegexDir;
     QMap<BasePathString, QRegularExpression> _fullRegexFile;
     QMap<BasePathString, QRegularExpression> _fullRegexDir;
+    QMap<BasePathString, BnameTraversalLiterals> _bnameTraversalLiteralsFile;
+    QMap<BasePathString, BnameTraversalLiterals> _bnameTraversalLiteralsDir;
+
+    /// see traversalBasePaths()
+    QString _traversalBasePathsParent;
+    QStringList _traversalBasePaths;
+    bool _traversalBasePathsValid = false;
+
+    /**
+     * Whether traversal matching uses the bname literals and the cached base paths.
+     *
+     * Only turned off to compare with plain regular expression matching in tests,
+     * prepare() must run again after changing it.
+     */
+    bool _traversalShortcuts = true;
 
     bool _excludeConflictFiles = true;
 
@@ -24,6 +24,11 @@
 
 #include <QFile>
 
+#ifdef HAVE_UTIMENSAT
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+
 #ifdef HAVE_UTIMES
 int c_utimes(const QString &uri, const struct timeval *times) {
     int ret = utimes(QFile::encodeName(uri).constData(), times);
@@ -47,12 +52,20 @@ static void UnixTimevalToFileTime(struct timeval t, LPFILETIME pft)
     pft->dwHighDateTime = ll >> 32;
 }
 
+// FILETIME has a resolution of 100ns
+static void UnixTimespecToFileTime(struct timespec t, LPFILETIME pft)
+{
+    LONGLONG ll = 0;
+    ll = Int32x32To64(t.tv_sec, CSYNC_USEC_IN_SEC*10) + t.tv_nsec/100 + CSYNC_SECONDS_SINCE_1601*CSYNC_USEC_IN_SEC*10;
+    pft->dwLowDateTime = (DWORD)ll;
+    pft->dwHighDateTime = ll >> 32;
+}
+
+static int c_setfiletime(const QString &uri, const FILETIME *LastAccessTime, const FILETIME *LastModificationTime);
+
 int c_utimes(const QString &uri, const struct timeval *times) {
     FILETIME LastAccessTime;
     FILETIME LastModificationTime;
-    HANDLE hFile = nullptr;
-
-    auto wuri = uri.toStdWString();
 
     if(times) {
         UnixTimevalToFileTime(times[0], &LastAccessTime);
@@ -63,6 +76,30 @@ int c_utimes(const QString &uri, const struct timeval *times) {
         GetSystemTimeAsFileTime(&LastModificationTime);
     }
 
+    return c_setfiletime(uri, &LastAccessTime, &LastModificationTime);
+}
+
+int c_utimens(const QString &uri, const struct timespec *times) {
+    FILETIME LastAccessTime;
+    FILETIME LastModificationTime;
+
+    if(times) {
+        UnixTimespecToFileTime(times[0], &LastAccessTime);
+        UnixTimespecToFileTime(times[1], &LastModificationTime);
+    }
+    else {
+        GetSystemTimeAsFileTime(&LastAccessTime);
+        GetSystemTimeAsFileTime(&LastModificationTime);
+    }
+
+    return c_setfiletime(uri, &LastAccessTime, &LastModificationTime);
+}
+
+static int c_setfiletime(const QString &uri, const FILETIME *LastAccessTime, const FILETIME *LastModificationTime) {
+    HANDLE hFile = nullptr;
+
+    auto wuri = uri.toStdWString();
+
     hFile=CreateFileW(wuri.data(), FILE_WRITE_ATTRIBUTES, FILE_SHARE_DELETE | FILE_SHARE_READ | FILE_SHARE_WRITE,
                       nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL+FILE_FLAG_BACKUP_SEMANTICS, nullptr);
     if(hFile==INVALID_HANDLE_VALUE) {
@@ -87,7 +124,7 @@ int c_utimes(const QString &uri, const struct timeval *times) {
         return -1;
     }
 
-    if(!SetFileTime(hFile, nullptr, &LastAccessTime, &LastModificationTime)) {
+    if(!SetFileTime(hFile, nullptr, LastAccessTime, LastModificationTime)) {
         //can this happen?
         errno=ENOENT;
         CloseHandle(hFile);
@@ -101,3 +138,21 @@ int c_utimes(const QString &uri, const struct timeval *times) {
 
 #endif // _WIN32
 #endif // HAVE_UTIMES
+
+#ifdef HAVE_UTIMENSAT
+int c_utimens(const QString &uri, const struct timespec *times) {
+    return utimensat(AT_FDCWD, QFile::encodeName(uri).constData(), times, 0);
+}
+#elif defined(HAVE_UTIMES)
+int c_utimens(const QString &uri, const struct timespec *times) {
+    if (!times) {
+        return c_utimes(uri, nullptr);
+    }
+    struct timeval tv[2];
+    for (int i = 0; i < 2; ++i) {
+        tv[i].tv_sec = times[i].tv_sec;
+        tv[i].tv_usec = times[i].tv_nsec / 1000;
+    }
+    return c_utimes(uri, tv);
+}
+#endif // HAVE_UTIMENSAT
@@ -33,5 +33,8 @@
 
 OCSYNC_EXPORT int c_utimes(const QString &uri, const struct timeval *times);
 
+/** Like c_utimes(), with nanosecond precision where the platform supports it */
+OCSYNC_EXPORT int c_utimens(const QString &uri, const struct timespec *times);
+
 
 #endif /* _C_TIME_H */
@@ -50,6 +50,7 @@ struct csync_vio_handle_t {
 };
 
 static int _csync_vio_local_stat_mb(const mbchar_t *wuri, csync_file_stat_t *buf);
+static int _csync_vio_local_fstatat(int dirfd, const char *name, csync_file_stat_t *buf);
 
 csync_vio_handle_t *csync_vio_local_opendir(const QString &name) {
     QScopedPointer<csync_vio_handle_t> handle(new csync_vio_handle_t{});
@@ -85,9 +86,8 @@ std::unique_ptr<csync_file_stat_t> csync_vio_local_readdir(csync_vio_handle_t *h
 
   file_stat = std::make_unique<csync_file_stat_t>();
   file_stat->path = QFile::decodeName(dirent->d_name).toUtf8();
-  QByteArray fullPath = handle->path % '/' % QByteArray() % const_cast<const char *>(dirent->d_name);
   if (file_stat->path.isNull()) {
-      file_stat->original_path = fullPath;
+      file_stat->original_path = handle->path % '/' % QByteArray() % const_cast<const char *>(dirent->d_name);
       qCWarning(lcCSyncVIOLocal) << "Invalid characters in file/directory name, please rename:" << dirent->d_name << handle->path;
   }
 
@@ -115,7 +115,8 @@ std::unique_ptr<csync_file_stat_t> csync_vio_local_readdir(csync_vio_handle_t *h
   if (file_stat->path.isNull())
       return file_stat;
 
-  if (_csync_vio_local_stat_mb(fullPath.constData(), file_stat.get()) < 0) {
+  // Relative to the directory, so that the kernel doesn't resolve the whole path again for every entry
+  if (_csync_vio_local_fstatat(dirfd(handle->dh), dirent->d_name, file_stat.get()) < 0) {
       // Will get excluded by _csync_detect_update.
       file_stat->type = ItemTypeSkip;
   }
@@ -137,14 +138,8 @@ int csync_vio_local_stat(const QString &uri, csync_file_stat_t *buf)
     return _csync_vio_local_stat_mb(QFile::encodeName(uri).constData(), buf);
 }
 
-static int _csync_vio_local_stat_mb(const mbchar_t *wuri, csync_file_stat_t *buf)
+static void _csync_vio_local_fill_stat(const csync_stat_t &sb, csync_file_stat_t *buf)
 {
-    csync_stat_t sb;
-
-    if (_tstat(wuri, &sb) < 0) {
-        return -1;
-    }
-
     switch (sb.st_mode & S_IFMT) {
     case S_IFDIR:
       buf->type = ItemTypeDirectory;
@@ -169,6 +164,35 @@ static int _csync_vio_local_stat_mb(const mbchar_t *wuri, csync_file_stat_t *buf
 
   buf->inode = sb.st_ino;
   buf->modtime = sb.st_mtime;
+#ifdef __APPLE__
+  buf->modtime_nsec = sb.st_mtimespec.tv_nsec;
+#else
+  buf->modtime_nsec = sb.st_mtim.tv_nsec;
+#endif
   buf->size = sb.st_size;
-  return 0;
+}
+
+static int _csync_vio_local_stat_mb(const mbchar_t *wuri, csync_file_stat_t *buf)
+{
+    csync_stat_t sb;
+
+    if (_tstat(wuri, &sb) < 0) {
+        return -1;
+    }
+
+    _csync_vio_local_fill_stat(sb, buf);
+    return 0;
+}
+
+static int _csync_vio_local_fstatat(int dirfd, const char *name, csync_file_stat_t *buf)
+{
+    csync_stat_t sb;
+
+    // Same as _tstat (lstat): don't follow symlinks
+    if (fstatat(dirfd, name, &sb, AT_SYMLINK_NOFOLLOW) < 0) {
+        return -1;
+    }
+
+    _csync_vio_local_fill_stat(sb, buf);
+    return 0;
 }
@@ -172,6 +172,7 @@ std::unique_ptr<csync_file_stat_t> csync_vio_local_readdir(csync_vio_handle_t *h
 
     file_stat->size = (handle->ffd.nFileSizeHigh * ((int64_t)(MAXDWORD)+1)) + handle->ffd.nFileSizeLow;
     file_stat->modtime = FileTimeToUnixTime(&handle->ffd.ftLastWriteTime, &rem);
+    file_stat->modtime_nsec = rem * 100;
 
     // path always ends with '\', by construction
 
@@ -221,6 +222,7 @@ int csync_vio_local_stat(const QString &uri, csync_file_stat_t *buf)
 
     DWORD rem = 0;
     buf->modtime = FileTimeToUnixTime(&fileInfo.ftLastWriteTime, &rem);
+    buf->modtime_nsec = rem * 100;
 
     CloseHandle(h);
     return 0;
@@ -84,6 +84,8 @@ Folder::Folder(const FolderDefinition &definition,
 
     _syncResult.setFolder(_definition.alias);
 
+    _journal.setReadConnectionsEnabled(ConfigFile().sqliteReadConnections());
+
     _engine.reset(new SyncEngine(_accountState->account(), path(), initializeSyncOptions(), remotePath(), &_journal));
     // pass the setting if hidden files are to be ignored, will be read in csync_update
     _engine->setIgnoreHiddenFiles(_definition.ignoreHiddenFiles);
@@ -409,7 +411,8 @@ void Folder::showSyncResultPopup()
         createGuiLog(_syncResult.firstItemLocked()->_file, LogStatusFileLocked, lockedCount);
     }
 
-    qCInfo(lcFolder) << "Folder" << _syncResult.folder() << "sync result: " << _syncResult.status();
+    qCInfo(lcFolder) << "Folder" << _syncResult.folder() << "sync result: " << _syncResult.status()
+                     << "scheduling:" << _syncResult.schedulingDuration().count() << "ms in" << _syncResult.schedulingPasses() << "passes";
 }
 
 void Folder::createGuiLog(const QString &filename, LogStatus status, int count,
@@ -610,7 +613,7 @@ void Folder::slotWatchedPathChanged(const QString &path, ChangeReason reason)
         // an attribute change (pin state) that caused the notification
         bool spurious = false;
         if (record.isValid()
-            && !FileSystem::fileChanged(path, record._fileSize, record._modtime)) {
+            && !FileSystem::fileChanged(path, record._fileSize, record._modtime, record._modtimeNsec)) {
             spurious = true;
 
             if (auto pinState = _vfs->pinState(relativePath.toString())) {
@@ -1170,6 +1173,10 @@ void Folder::slotSyncFinished(bool success)
     } else {
         qCInfo(lcFolder) << "SyncEngine finished without problem.";
     }
+    if (const auto propagator = _engine->getPropagator()) {
+        _syncResult.setSchedulingStatistics(std::chrono::duration_cast<std::chrono::milliseconds>(propagator->schedulingDuration()),
+                                            propagator->schedulingPasses());
+    }
     _fileLog->finish();
     showSyncResultPopup();
 
@@ -27,6 +27,7 @@
 #include "gui/systray.h"
 #include <pushnotifications.h>
 #include <syncengine.h>
+#include <networkjobbudget.h>
 #include "updatee2eefolderusersmetadatajob.h"
 
 #ifdef Q_OS_MAC
@@ -69,6 +70,11 @@ FolderMan::FolderMan(QObject *parent)
     QObject::connect(&_etagPollTimer, &QTimer::timeout, this, &FolderMan::slotEtagPollTimerTimeout);
     _etagPollTimer.start();
 
+    _maxConcurrentSyncs = cfg.maxConcurrentSyncs();
+    NetworkJobBudget::instance()->setLimit(cfg.maxParallelNetworkJobs());
+    qCInfo(lcFolderMan) << "up to" << _maxConcurrentSyncs << "folders sync at the same time, sharing"
+                        << NetworkJobBudget::instance()->limit() << "network jobs";
+
     _startScheduledSyncTimer.setSingleShot(true);
     connect(&_startScheduledSyncTimer, &QTimer::timeout,
         this, &FolderMan::slotStartScheduledFolderSync);
@@ -147,7 +153,7 @@ int FolderMan::unloadAndDeleteAllFolders()
     ASSERT(_folderMap.isEmpty());
 
     _lastSyncFolder = nullptr;
-    _currentSyncFolder = nullptr;
+    _currentSyncFolders.clear();
     _scheduledFolders.clear();
     emit folderListChanged(_folderMap);
     emit scheduleQueueChanged();
@@ -651,9 +657,10 @@ void FolderMan::scheduleAllFolders()
 
 void FolderMan::forceSyncForFolder(Folder *folder)
 {
-    // Terminate and reschedule any running sync
+    // Terminate and reschedule the running syncs if there is no room for another one
+    const auto mustMakeRoom = !canStartScheduledSync();
     for (const auto folderInMap : map()) {
-        if (folderInMap->isSyncRunning()) {
+        if (folderInMap->isSyncRunning() && (mustMakeRoom || folderInMap == folder)) {
             folderInMap->slotTerminateSync();
             scheduleFolder(folderInMap);
         }
@@ -847,7 +854,7 @@ void FolderMan::startScheduledSyncSoon()
     if (_scheduledFolders.empty()) {
         return;
     }
-    if (isAnySyncRunning()) {
+    if (!canStartScheduledSync()) {
         return;
     }
 
@@ -891,7 +898,7 @@ void FolderMan::startScheduledSyncSoon()
   */
 void FolderMan::slotStartScheduledFolderSync()
 {
-    if (isAnySyncRunning()) {
+    if (!canStartScheduledSync()) {
         for (auto f : qAsConst(_folderMap)) {
             if (f->isSyncRunning())
                 qCInfo(lcFolderMan) << "Currently folder " << f->remoteUrl().toString() << " is running, wait for finish!";
@@ -909,15 +916,7 @@ void FolderMan::slotStartScheduledFolderSync()
         return;
     }
 
-    // Find the first folder in the queue that can be synced.
-    Folder *folder = nullptr;
-    while (!_scheduledFolders.isEmpty()) {
-        Folder *g = _scheduledFolders.dequeue();
-        if (g->canSync()) {
-            folder = g;
-            break;
-        }
-    }
+    Folder *folder = takeNextScheduledFolder();
 
     emit scheduleQueueChanged();
 
@@ -928,9 +927,62 @@ void FolderMan::slotStartScheduledFolderSync()
         folder->registerFolderWatcher();
         registerFolderWithSocketApi(folder);
 
-        _currentSyncFolder = folder;
+        _currentSyncFolders.append(folder);
         folder->startSync(QStringList());
     }
+
+    // There may be room for more
+    startScheduledSyncSoon();
+}
+
+int FolderMan::runningSyncCount() const
+{
+    auto count = _currentSyncFolders.size();
+    for (const auto f : _folderMap) {
+        if (f->isSyncRunning() && !_currentSyncFolders.contains(f)) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+bool FolderMan::canStartScheduledSync() const
+{
+    return runningSyncCount() < _maxConcurrentSyncs;
+}
+
+Folder *FolderMan::takeNextScheduledFolder()
+{
+    // Folders that can't sync anymore are dropped from the queue
+    _scheduledFolders.erase(std::remove_if(_scheduledFolders.begin(), _scheduledFolders.end(), [](Folder *f) {
+        return !f->canSync();
+    }), _scheduledFolders.end());
+
+    QHash<AccountState *, int> runningSyncsPerAccount;
+    for (const auto f : qAsConst(_folderMap)) {
+        if (f->isSyncRunning() || _currentSyncFolders.contains(f)) {
+            ++runningSyncsPerAccount[f->accountState()];
+        }
+    }
+
+    // The queue order decides between folders of equally busy accounts
+    int nextIndex = -1;
+    for (int i = 0; i < _scheduledFolders.size(); ++i) {
+        const auto f = _scheduledFolders.at(i);
+        if (f->isSyncRunning() || _currentSyncFolders.contains(f)) {
+            // it stays scheduled and is picked up once the running sync is done
+            continue;
+        }
+        if (nextIndex < 0
+            || runningSyncsPerAccount.value(f->accountState()) < runningSyncsPerAccount.value(_scheduledFolders.at(nextIndex)->accountState())) {
+            nextIndex = i;
+        }
+    }
+
+    if (nextIndex < 0) {
+        return nullptr;
+    }
+    return _scheduledFolders.takeAt(nextIndex);
 }
 
 bool FolderMan::pushNotificationsFilesReady(Account *account)
@@ -1126,7 +1178,7 @@ void FolderMan::slotScheduleFolderByTime()
 
 bool FolderMan::isAnySyncRunning() const
 {
-    if (_currentSyncFolder)
+    if (!_currentSyncFolders.isEmpty())
         return true;
 
     for (auto f : _folderMap) {
@@ -1167,12 +1219,10 @@ void FolderMan::slotFolderSyncFinished(const SyncResult &)
         qPrintable(f->accountState()->account()->displayName()),
         qPrintable(f->remoteUrl().toString()));
 
-    if (f == _currentSyncFolder) {
-        _lastSyncFolder = _currentSyncFolder;
-        _currentSyncFolder = nullptr;
+    if (_currentSyncFolders.removeAll(f) > 0) {
+        _lastSyncFolder = f;
     }
-    if (!isAnySyncRunning())
-        startScheduledSyncSoon();
+    startScheduledSyncSoon();
 }
 
 Folder *FolderMan::addFolder(AccountState *accountState, const FolderDefinition &folderDefinition)
@@ -1461,10 +1511,11 @@ void FolderMan::slotWipeFolderForAccount(AccountState *accountState)
 
         qCInfo(lcFolderMan) << "Removing " << f->alias();
 
-        const bool currentlyRunning = (_currentSyncFolder == f);
+        const bool currentlyRunning = _currentSyncFolders.contains(f);
         if (currentlyRunning) {
             // abort the sync now
-            _currentSyncFolder->slotTerminateSync();
+            f->slotTerminateSync();
+            _currentSyncFolders.removeAll(f);
         }
 
         if (_scheduledFolders.removeAll(f) > 0) {
@@ -1909,9 +1960,9 @@ QQueue<Folder *> FolderMan::scheduleQueue() const
     return _scheduledFolders;
 }
 
-Folder *FolderMan::currentSyncFolder() const
+QVector<Folder *> FolderMan::currentSyncFolders() const
 {
-    return _currentSyncFolder;
+    return _currentSyncFolders;
 }
 
 void FolderMan::restartApplication()
@@ -21,6 +21,7 @@
 #include <QQueue>
 #include <QList>
 
+#include "configfile.h"
 #include "folder.h"
 #include "folderwatcher.h"
 #include "navigationpanehelper.h"
@@ -187,14 +188,14 @@ public:
     [[nodiscard]] QQueue<Folder *> scheduleQueue() const;
 
     /**
-     * Access to the currently syncing folder.
+     * Access to the currently syncing folders.
      *
-     * Note: This is only the folder that's currently syncing *as-scheduled*. There
+     * Note: These are only the folders that are currently syncing *as-scheduled*. There
      * may be externally-managed syncs such as from placeholder hydrations.
      *
      * See also isAnySyncRunning()
      */
-    [[nodiscard]] Folder *currentSyncFolder() const;
+    [[nodiscard]] QVector<Folder *> currentSyncFolders() const;
 
     /**
      * Returns true if any folder is currently syncing.
@@ -364,11 +365,25 @@ private:
 
     void addFolderToSelectiveSyncList(const QString &path, const SyncJournalDb::SelectiveSyncListType list);
 
+    /** Number of folders syncing, scheduled or externally managed */
+    [[nodiscard]] int runningSyncCount() const;
+
+    /** Whether fewer than the configured number of concurrent syncs are running */
+    [[nodiscard]] bool canStartScheduledSync() const;
+
+    /** Takes the next folder to sync out of the queue
+     *
+     * Folders of the accounts with the fewest running syncs go first, so that
+     * one account can't starve the others. Returns nullptr if no folder can start.
+     */
+    Folder *takeNextScheduledFolder();
+
     QSet<Folder *> _disabledFolders;
     Folder::Map _folderMap;
     QString _folderConfigPath;
-    Folder *_currentSyncFolder = nullptr;
+    QVector<Folder *> _currentSyncFolders;
     QPointer<Folder> _lastSyncFolder;
+    int _maxConcurrentSyncs = ConfigFile::defaultMaxConcurrentSyncs;
     bool _syncEnabled = true;
 
     /// Folder aliases from the settings that weren't read
@@ -756,7 +756,7 @@ void FolderStatusModel::slotUpdateDirectories(const QStringList &list)
             && _accountState->account()->e2e()->_privateKey.isNull();
 
         SyncJournalFileRecord rec;
-        if (!parentInfo->_folder->journalDb()->getFileRecordByE2eMangledName(removeTrailingSlash(relativePath), &rec)) {
+        if (!parentInfo->_folder->journalDb()->getCommittedFileRecordByE2eMangledName(removeTrailingSlash(relativePath), &rec)) {
             qCWarning(lcFolderStatus) << "Could not get file record by E2E Mangled Name from local DB" << removeTrailingSlash(relativePath);
         }
         if (rec.isValid()) {
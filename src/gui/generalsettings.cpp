@@ -107,6 +107,26 @@ QVector<ZipEntry> createDebugArchiveFileList()
     return list;
 }
 
+QByteArray createJournalStatistics()
+{
+    QByteArray result;
+    const auto folders = OCC::FolderMan::instance()->map().values();
+    for (const auto folder : folders) {
+        const auto statistics = folder->journalDb()->maintenanceStatistics();
+        const auto lastMaintenance = statistics.lastMaintenance.isValid() ? statistics.lastMaintenance.toString(Qt::ISODate) : QStringLiteral("never");
+        result += QStringLiteral("%1: journal %2 bytes, WAL %3 bytes, %4 of %5 pages free, last maintenance %6 (%7 ms)\n")
+                      .arg(folder->alias())
+                      .arg(statistics.databaseSize)
+                      .arg(statistics.walSize)
+                      .arg(statistics.freePageCount)
+                      .arg(statistics.pageCount)
+                      .arg(lastMaintenance)
+                      .arg(statistics.lastMaintenanceMsecs)
+                      .toUtf8();
+    }
+    return result;
+}
+
 void createDebugArchive(const QString &filename)
 {
     const auto entries = createDebugArchiveFileList();
@@ -127,6 +147,11 @@ void createDebugArchive(const QString &filename)
     zip.prepareWriting("__nextcloud_client_buildinfo.txt", {}, {}, buildInfo.size());
     zip.writeData(buildInfo, buildInfo.size());
     zip.finishWriting(buildInfo.size());
+
+    const auto journalStatistics = createJournalStatistics();
+    zip.prepareWriting("__nextcloud_journal_statistics.txt", {}, {}, journalStatistics.size());
+    zip.writeData(journalStatistics, journalStatistics.size());
+    zip.finishWriting(journalStatistics.size());
 }
 }
 
@@ -73,6 +73,8 @@
 #include <QProcess>
 #include <QStandardPaths>
 
+#include <algorithm>
+
 #ifdef Q_OS_MAC
 #include <CoreFoundation/CoreFoundation.h>
 #endif
@@ -81,7 +83,7 @@
 // This is the version that is returned when the client asks for the VERSION.
 // The first number should be changed if there is an incompatible change that breaks old clients.
 // The second number should be changed when there are new features.
-#define MIRALL_SOCKET_API_VERSION "1.1"
+#define MIRALL_SOCKET_API_VERSION "1.2"
 
 namespace {
 constexpr auto encryptJobPropertyFolder = "folder";
@@ -365,11 +367,19 @@ void SocketApi::slotReadSocket()
     while (socket->canReadLine()) {
         // Make sure to normalize the input from the socket to
         // make sure that the path will match, especially on OS X.
-        const QString line = QString::fromUtf8(socket->readLine().trimmed()).normalized(QString::NormalizationForm_C);
+        // Plain ASCII is always normalized already.
+        const auto data = socket->readLine().trimmed();
+        const auto isAscii = std::none_of(data.cbegin(), data.cend(), [](char c) { return c & 0x80; });
+        const QString line = isAscii ? QString::fromLatin1(data) : QString::fromUtf8(data).normalized(QString::NormalizationForm_C);
         qCDebug(lcSocketApi) << "Received SocketAPI message <--" << line << "from" << socket;
         const int argPos = line.indexOf(QLatin1Char(':'));
         const QByteArray command = line.midRef(0, argPos).toUtf8().toUpper();
         const int indexOfMethod = [&] {
+            const auto cached = _commandMethodIndices.constFind(command);
+            if (cached != _commandMethodIndices.cend()) {
+                return *cached;
+            }
+
             QByteArray functionWithArguments = QByteArrayLiteral("command_");
             if (command.startsWith("ASYNC_")) {
                 functionWithArguments += command + QByteArrayLiteral("(QSharedPointer<SocketApiJob>)");
@@ -381,9 +391,12 @@ void SocketApi::slotReadSocket()
             Q_ASSERT(staticQtMetaObject.normalizedSignature(functionWithArguments) == functionWithArguments);
             const auto out = staticMetaObject.indexOfMethod(functionWithArguments);
             if (out == -1) {
+                // Not cached, and not fatal: shell extensions can be newer than the client
+                qCWarning(lcSocketApi) << "Unknown SocketAPI command" << command;
                 listener->sendError(QStringLiteral("Function %1 not found").arg(QString::fromUtf8(functionWithArguments)));
+            } else {
+                _commandMethodIndices.insert(command, out);
             }
-            ASSERT(out != -1)
             return out;
         }();
 
@@ -1126,6 +1139,47 @@ void SocketApi::command_V2_UPLOAD_FILES_FROM(const QSharedPointer<SocketApiJobV2
     uploadJob->start();
 }
 
+void SocketApi::command_V2_GET_FILE_STATUSES(const QSharedPointer<SocketApiJobV2> &job)
+{
+    const auto statusEntry = [](const QString &localFile, const SyncFileStatus &status) {
+        return QJsonObject({ { "path", QDir::toNativeSeparators(localFile) }, { "status", status.toSocketAPIString() } });
+    };
+
+    QJsonArray statuses;
+    const auto &arguments = job->arguments();
+    const auto directory = arguments[QStringLiteral("directory")].toString();
+    if (!directory.isEmpty()) {
+        // Resolve the folder once for all the children
+        const auto directoryData = FileData::get(directory);
+        if (!directoryData.folder) {
+            // this can happen in offline mode e.g.: nothing to worry about
+            job->failure(QStringLiteral("directory is not in a sync folder"));
+            return;
+        }
+        job->socketListener()->registerMonitoredDirectory(qHash(directoryData.localPath));
+
+        auto &tracker = directoryData.folder->syncEngine().syncFileStatusTracker();
+        const auto relativePrefix = directoryData.folderRelativePath.isEmpty() ? QString() : QString(directoryData.folderRelativePath + QLatin1Char('/'));
+        const auto entries = QDir(directoryData.localPath).entryList(QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden | QDir::System);
+        for (const auto &entry : entries) {
+            statuses.append(statusEntry(directoryData.localPath + QLatin1Char('/') + entry, tracker.fileStatus(relativePrefix + entry)));
+        }
+    } else {
+        const auto files = arguments[QStringLiteral("files")].toArray();
+        for (const auto &file : files) {
+            const auto localFile = file.toString();
+            const auto fileData = FileData::get(localFile);
+            if (!fileData.folder) {
+                statuses.append(QJsonObject({ { "path", QDir::toNativeSeparators(localFile) }, { "status", "NOP" } }));
+                continue;
+            }
+            job->socketListener()->registerMonitoredDirectory(qHash(fileData.localPath.left(fileData.localPath.lastIndexOf('/'))));
+            statuses.append(statusEntry(localFile, fileData.syncFileStatus()));
+        }
+    }
+    job->success({ { "statuses", statuses } });
+}
+
 void SocketApi::emailPrivateLink(const QString &link)
 {
     Utility::openEmailComposer(
@@ -1323,7 +1377,7 @@ SyncJournalFileRecord SocketApi::FileData::journalRecord() const
     SyncJournalFileRecord record;
     if (!folder)
         return record;
-    if (!folder->journalDb()->getFileRecord(folderRelativePath, &record)) {
+    if (!folder->journalDb()->getCommittedFileRecord(folderRelativePath, &record)) {
         qCWarning(lcSocketApi) << "Failed to get journal record for path" << folderRelativePath;
     }
     return record;
@@ -155,6 +155,9 @@ private:
     Q_INVOKABLE void command_V2_LIST_ACCOUNTS(const QSharedPointer<OCC::SocketApiJobV2> &job) const;
     Q_INVOKABLE void command_V2_UPLOAD_FILES_FROM(const QSharedPointer<OCC::SocketApiJobV2> &job) const;
 
+    // Overlay icons for a whole directory, or a list of files, in one reply
+    Q_INVOKABLE void command_V2_GET_FILE_STATUSES(const QSharedPointer<OCC::SocketApiJobV2> &job);
+
     // Fetch the private link and call targetFun
     void fetchPrivateLinkUrlHelper(const QString &localFile, const std::function<void(const QString &url)> &targetFun);
 
@@ -207,6 +210,8 @@ private:
 
     QSet<QString> _registeredAliases;
     QMap<QIODevice *, QSharedPointer<SocketListener>> _listeners;
+    // Method index of each command received so far, saves the meta object lookup per line
+    QHash<QByteArray, int> _commandMethodIndices;
     QLocalServer _localServer;
 };
 }
@@ -37,6 +37,33 @@ Q_LOGGING_CATEGORY(lcBandwidthManager, "nextcloud.sync.bandwidthmanager", QtInfo
 static qint64 relativeLimitMeasuringTimerIntervalMsec = 1000 * 2;
 // See also WritingState in http://code.woboq.org/qt5/qtbase/src/network/access/qhttpprotocolhandler.cpp.html#_ZN20QHttpProtocolHandler11sendRequestEv
 
+// How often the token buckets are refilled and waiting transfers are woken up
+static constexpr qint64 refillTimerIntervalMsec = 100;
+
+// The bucket must hold at least what Qt reads from a device or a reply at once
+static constexpr qint64 minimumBucketCapacity = 16 * 1024;
+
+namespace {
+
+// The absolute limits are for the whole client, not for the sync of a single folder
+struct AbsoluteLimitBuckets
+{
+    BandwidthTokenBucket upload;
+    BandwidthTokenBucket download;
+    QElapsedTimer lastRefill;
+};
+Q_GLOBAL_STATIC(AbsoluteLimitBuckets, absoluteLimitBuckets)
+
+void setAbsoluteLimitRate(BandwidthTokenBucket &bucket, qint64 bytesPerSecond)
+{
+    // Another folder may use the bucket already, don't fill it up again
+    if (bucket.rate() != bytesPerSecond) {
+        bucket.setRate(bytesPerSecond);
+    }
+}
+
+}
+
 // FIXME At some point:
 //  * Register device only after the QNR received its metaDataChanged() signal
 //  * Incorporate Qt buffer fill state (it's a negative absolute delta).
@@ -44,22 +71,64 @@ static qint64 relativeLimitMeasuringTimerIntervalMsec = 1000 * 2;
 //  * For relative limiting, do less measuring and more delaying+giving quota
 //  * For relative limiting, smoothen measurements
 
+void BandwidthTokenBucket::setRate(qint64 bytesPerSecond)
+{
+    _rate = qMax(qint64(0), bytesPerSecond);
+    _tokens = capacity();
+}
+
+qint64 BandwidthTokenBucket::capacity() const
+{
+    if (_rate <= 0) {
+        return 0;
+    }
+    // allow bursts of half a second
+    return qMax(_rate / 2, minimumBucketCapacity);
+}
+
+void BandwidthTokenBucket::refill(qint64 msecs)
+{
+    const auto maximum = capacity();
+    if (_tokens >= maximum || msecs <= 0) {
+        return;
+    }
+    _tokens = qMin(maximum, _tokens + _rate * msecs / 1000);
+}
+
+void BandwidthTokenBucket::grant(qint64 bytes)
+{
+    _tokens += qMax(qint64(0), bytes);
+}
+
+qint64 BandwidthTokenBucket::take(qint64 wanted)
+{
+    const auto taken = qBound(qint64(0), wanted, _tokens);
+    _tokens -= taken;
+    return taken;
+}
+
 BandwidthManager::BandwidthManager(OwncloudPropagator *p)
     : QObject()
     , _propagator(p)
 {
     _currentUploadLimit = _propagator->_uploadLimit;
     _currentDownloadLimit = _propagator->_downloadLimit;
+    if (usingAbsoluteUploadLimit()) {
+        setAbsoluteLimitRate(absoluteLimitBuckets()->upload, _currentUploadLimit);
+    }
+    if (usingAbsoluteDownloadLimit()) {
+        setAbsoluteLimitRate(absoluteLimitBuckets()->download, _currentDownloadLimit);
+    }
 
     QObject::connect(&_switchingTimer, &QTimer::timeout, this, &BandwidthManager::switchingTimerExpired);
     _switchingTimer.setInterval(10 * 1000);
     _switchingTimer.start();
     QMetaObject::invokeMethod(this, "switchingTimerExpired", Qt::QueuedConnection);
 
-    // absolute uploads/downloads
-    QObject::connect(&_absoluteLimitTimer, &QTimer::timeout, this, &BandwidthManager::absoluteLimitTimerExpired);
-    _absoluteLimitTimer.setInterval(1000);
-    _absoluteLimitTimer.start();
+    // token buckets shared by all uploads/downloads
+    QObject::connect(&_refillTimer, &QTimer::timeout, this, &BandwidthManager::refillTimerExpired);
+    _refillTimer.setInterval(refillTimerIntervalMsec);
+    _refillTimer.start();
 
     // Relative uploads
     QObject::connect(&_relativeUploadMeasuringTimer, &QTimer::timeout,
@@ -187,14 +256,15 @@ void BandwidthManager::relativeUploadMeasuringTimerExpired()
     _relativeUploadDelayTimer.setInterval(realWaitTimeMsec);
     _relativeUploadDelayTimer.start();
 
-    const auto deviceCount = _relativeUploadDeviceList.size();
-    const auto  quotaPerDevice = relativeLimitProgressDifference * (uploadLimitPercent / 100.0) / deviceCount + 1.0;
+    // All devices share the quota, a device that is done early leaves its part to the others
+    const qint64 quota = relativeLimitProgressDifference * (uploadLimitPercent / 100.0) + 1.0;
+    _relativeUploadBucket.clear();
+    _relativeUploadBucket.grant(quota);
+    qCDebug(lcBandwidthManager) << "Gave" << quota / 1024.0 << "kB to" << _relativeUploadDeviceList.size() << "devices";
 
     for (const auto uploadDevice : _relativeUploadDeviceList) {
         uploadDevice->setBandwidthLimited(true);
         uploadDevice->setChoked(false);
-        uploadDevice->giveBandwidthQuota(quotaPerDevice);
-        qCDebug(lcBandwidthManager) << "Gave" << quotaPerDevice / 1024.0 << "kB to" << uploadDevice;
     }
 
     _relativeLimitCurrentMeasuredDevice = nullptr;
@@ -282,21 +352,21 @@ void BandwidthManager::relativeDownloadMeasuringTimerExpired()
     _relativeDownloadDelayTimer.setInterval(realWaitTimeMsec);
     _relativeDownloadDelayTimer.start();
 
-    const auto jobCount = _downloadJobList.size();
-    auto quota = relativeLimitProgressDifference * (downloadLimitPercent / 100.0);
+    qint64 quota = relativeLimitProgressDifference * (downloadLimitPercent / 100.0);
 
     if (quota > 20 * 1024) {
         qCDebug(lcBandwidthManager) << "ADJUSTING QUOTA FROM " << quota << " TO " << quota - 20 * 1024;
         quota -= 20 * 1024;
     }
 
-    const auto quotaPerJob = quota / jobCount + 1;
+    // All jobs share the quota, a job that is done early leaves its part to the others
+    _relativeDownloadBucket.clear();
+    _relativeDownloadBucket.grant(quota + 1);
+    qCDebug(lcBandwidthManager) << "Gave" << quota / 1024.0 << "kB to" << _downloadJobList.size() << "jobs";
+
     for (const auto getFileJob : _downloadJobList) {
         getFileJob->setBandwidthLimited(true);
         getFileJob->setChoked(false);
-        getFileJob->giveBandwidthQuota(quotaPerJob);
-
-        qCDebug(lcBandwidthManager) << "Gave" << quotaPerJob / 1024.0 << "kB to" << getFileJob;
     }
     _relativeLimitCurrentMeasuredDevice = nullptr;
 }
@@ -347,6 +417,10 @@ void BandwidthManager::switchingTimerExpired()
     if (newUploadLimit != _currentUploadLimit) {
         qCInfo(lcBandwidthManager) << "Upload Bandwidth limit changed" << _currentUploadLimit << newUploadLimit;
         _currentUploadLimit = newUploadLimit;
+        _relativeUploadBucket.clear();
+        if (usingAbsoluteUploadLimit()) {
+            setAbsoluteLimitRate(absoluteLimitBuckets()->upload, _currentUploadLimit);
+        }
 
         for (const auto uploadDevice : _relativeUploadDeviceList) {
             Q_ASSERT(uploadDevice);
@@ -368,6 +442,10 @@ void BandwidthManager::switchingTimerExpired()
     if (newDownloadLimit != _currentDownloadLimit) {
         qCInfo(lcBandwidthManager) << "Download Bandwidth limit changed" << _currentDownloadLimit << newDownloadLimit;
         _currentDownloadLimit = newDownloadLimit;
+        _relativeDownloadBucket.clear();
+        if (usingAbsoluteDownloadLimit()) {
+            setAbsoluteLimitRate(absoluteLimitBuckets()->download, _currentDownloadLimit);
+        }
 
         for (const auto getJob : _downloadJobList) {
             Q_ASSERT(getJob);
@@ -386,27 +464,69 @@ void BandwidthManager::switchingTimerExpired()
     }
 }
 
-void BandwidthManager::absoluteLimitTimerExpired()
+BandwidthTokenBucket &BandwidthManager::uploadBucket()
 {
-    if (usingAbsoluteUploadLimit() && !_absoluteUploadDeviceList.empty()) {
-        const auto quotaPerDevice = _currentUploadLimit / qMax((std::list<UploadDevice *>::size_type)1, _absoluteUploadDeviceList.size());
+    return usingAbsoluteUploadLimit() ? absoluteLimitBuckets()->upload : _relativeUploadBucket;
+}
 
-        qCDebug(lcBandwidthManager) << quotaPerDevice << _absoluteUploadDeviceList.size() << _currentUploadLimit;
+BandwidthTokenBucket &BandwidthManager::downloadBucket()
+{
+    return usingAbsoluteDownloadLimit() ? absoluteLimitBuckets()->download : _relativeDownloadBucket;
+}
 
-        for (const auto device : _absoluteUploadDeviceList) {
-            device->giveBandwidthQuota(quotaPerDevice);
-            qCDebug(lcBandwidthManager) << "Gave " << quotaPerDevice / 1024.0 << " kB to" << device;
-        }
+qint64 BandwidthManager::takeUploadQuota(qint64 wanted)
+{
+    const auto taken = uploadBucket().take(wanted);
+    if (taken <= 0) {
+        _uploadsWaiting = true;
+    }
+    return taken;
+}
+
+qint64 BandwidthManager::takeDownloadQuota(qint64 wanted)
+{
+    const auto taken = downloadBucket().take(wanted);
+    if (taken <= 0) {
+        _downloadsWaiting = true;
     }
+    return taken;
+}
+
+void BandwidthManager::returnUploadQuota(qint64 unused)
+{
+    uploadBucket().grant(unused);
+}
 
-    if (usingAbsoluteDownloadLimit() && !_downloadJobList.empty()) {
-        const auto quotaPerJob = _currentDownloadLimit / qMax((std::list<GETFileJob *>::size_type)1, _downloadJobList.size());
+void BandwidthManager::returnDownloadQuota(qint64 unused)
+{
+    downloadBucket().grant(unused);
+}
 
-        qCDebug(lcBandwidthManager) << quotaPerJob << _downloadJobList.size() << _currentDownloadLimit;
+void BandwidthManager::refillTimerExpired()
+{
+    // The managers of all folders refill the shared buckets in turn,
+    // each with the time since any of them did it last
+    auto &absoluteBuckets = *absoluteLimitBuckets();
+    if (!absoluteBuckets.lastRefill.isValid()) {
+        absoluteBuckets.lastRefill.start();
+    }
+    const auto elapsedMsec = absoluteBuckets.lastRefill.restart();
+    absoluteBuckets.upload.refill(elapsedMsec);
+    absoluteBuckets.download.refill(elapsedMsec);
+
+    if (_uploadsWaiting && uploadBucket().available() > 0) {
+        _uploadsWaiting = false;
+        for (const auto device : _absoluteUploadDeviceList) {
+            if (device->isBandwidthLimited() && !device->isChoked()) {
+                QMetaObject::invokeMethod(device, "readyRead", Qt::QueuedConnection); // tell QNAM that we have quota
+            }
+        }
+    }
 
+    if (_downloadsWaiting && downloadBucket().available() > 0) {
+        _downloadsWaiting = false;
         for (const auto job : _downloadJobList) {
-            job->giveBandwidthQuota(quotaPerJob);
-            qCDebug(lcBandwidthManager) << "Gave " << quotaPerJob / 1024.0 << " kB to" << job;
+            QMetaObject::invokeMethod(job, "slotReadyRead", Qt::QueuedConnection);
         }
     }
 }
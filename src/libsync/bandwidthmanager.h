@@ -15,8 +15,11 @@
 #ifndef BANDWIDTHMANAGER_H
 #define BANDWIDTHMANAGER_H
 
+#include "owncloudlib.h"
+
 #include <QObject>
 #include <QTimer>
+#include <QElapsedTimer>
 #include <QIODevice>
 #include <list>
 
@@ -26,8 +29,47 @@ class UploadDevice;
 class GETFileJob;
 class OwncloudPropagator;
 
+/**
+ * @brief Bytes that the transfers of one direction may send or receive
+ *
+ * The bucket refills at rate() bytes per second and holds at most
+ * capacity() bytes, so short idle periods can't be turned into long bursts.
+ * Tokens can also be granted directly, the relative limits do that with
+ * the quota they measured.
+ *
+ * @ingroup libsync
+ */
+class OWNCLOUDSYNC_EXPORT BandwidthTokenBucket
+{
+public:
+    /** Sets the refill rate, the bucket starts out full. 0 means only granted tokens are available */
+    void setRate(qint64 bytesPerSecond);
+    [[nodiscard]] qint64 rate() const { return _rate; }
+    [[nodiscard]] qint64 capacity() const;
+
+    /** Adds the tokens accumulated during \a msecs, up to capacity() */
+    void refill(qint64 msecs);
+    /** Adds \a bytes tokens, regardless of the capacity */
+    void grant(qint64 bytes);
+    /** Removes all tokens */
+    void clear() { _tokens = 0; }
+
+    /** Takes up to \a wanted tokens and returns how many were taken */
+    qint64 take(qint64 wanted);
+    [[nodiscard]] qint64 available() const { return _tokens; }
+
+private:
+    qint64 _rate = 0;
+    qint64 _tokens = 0;
+};
+
 /**
  * @brief The BandwidthManager class
+ *
+ * All UploadDevices share one token bucket and all GETFileJobs another one,
+ * so a limit applies to the sum of the parallel transfers. The buckets of the
+ * absolute limits are also shared with the managers of the other folders.
+ *
  * @ingroup libsync
  */
 class BandwidthManager : public QObject
@@ -42,6 +84,13 @@ public:
     bool usingAbsoluteDownloadLimit() { return _currentDownloadLimit > 0; }
     bool usingRelativeDownloadLimit() { return _currentDownloadLimit < 0; }
 
+    /** Takes up to \a wanted bytes of upload quota, returns 0 if the devices have to wait */
+    qint64 takeUploadQuota(qint64 wanted);
+    /** Takes up to \a wanted bytes of download quota, returns 0 if the jobs have to wait */
+    qint64 takeDownloadQuota(qint64 wanted);
+    /** Gives back quota that was taken but not used, e.g. because less could be read */
+    void returnUploadQuota(qint64 unused);
+    void returnDownloadQuota(qint64 unused);
 
 public slots:
     void registerUploadDevice(OCC::UploadDevice *);
@@ -50,7 +99,7 @@ public slots:
     void registerDownloadJob(OCC::GETFileJob *);
     void unregisterDownloadJob(QObject *);
 
-    void absoluteLimitTimerExpired();
+    void refillTimerExpired();
     void switchingTimerExpired();
 
     void relativeUploadMeasuringTimerExpired();
@@ -60,6 +109,9 @@ public slots:
     void relativeDownloadDelayTimerExpired();
 
 private:
+    BandwidthTokenBucket &uploadBucket();
+    BandwidthTokenBucket &downloadBucket();
+
     // for switching between absolute and relative bw limiting
     QTimer _switchingTimer;
 
@@ -67,8 +119,15 @@ private:
     // by the propagator emitting the changed limit values to us as signal
     OwncloudPropagator *_propagator;
 
-    // for absolute up/down bw limiting
-    QTimer _absoluteLimitTimer;
+    // for refilling the buckets and waking up the transfers waiting for quota
+    QTimer _refillTimer;
+
+    // quota measured for the relative limits, shared by all upload devices and all download jobs
+    BandwidthTokenBucket _relativeUploadBucket;
+    BandwidthTokenBucket _relativeDownloadBucket;
+    // whether a transfer ran out of quota and waits to be woken up
+    bool _uploadsWaiting = false;
+    bool _downloadsWaiting = false;
 
     // FIXME merge these two lists
     std::list<UploadDevice *> _absoluteUploadDeviceList;
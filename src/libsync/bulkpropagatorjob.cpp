@@ -169,7 +169,7 @@ void BulkPropagatorJob::doStartUpload(SyncFileItemPtr item,
         fileToUpload._file = item->_file = item->_renameTarget;
         fileToUpload._path = propagator()->fullLocalPath(fileToUpload._file);
 
-        item->_modtime = FileSystem::getModTime(newFilePathAbsolute);
+        item->_modtime = FileSystem::getModTime(newFilePathAbsolute, &item->_modtimeNsec);
         if (item->_modtime <= 0) {
             _pendingChecksumFiles.remove(item->_file);
             slotOnErrorStartFolderUnlock(item, SyncFileItem::NormalError, tr("File %1 has invalid modified time. Do not upload to the server.").arg(QDir::toNativeSeparators(item->_file)), ErrorCategory::GenericError);
@@ -270,6 +270,7 @@ void BulkPropagatorJob::slotComputeTransmissionChecksum(SyncFileItemPtr item,
     const auto computeChecksum = new ComputeChecksum(this);
     const auto checksumType = uploadChecksumEnabled() ? "MD5" : "";
     computeChecksum->setChecksumType(checksumType);
+    propagator()->setupChecksumCache(computeChecksum, fileToUpload._path);
 
     connect(computeChecksum, &ComputeChecksum::done, this, [this, item, fileToUpload] (const QByteArray &contentChecksumType, const QByteArray &contentChecksum) {
         slotStartUpload(item, fileToUpload, contentChecksumType, contentChecksum);
@@ -299,23 +300,24 @@ void BulkPropagatorJob::slotStartUpload(SyncFileItemPtr item,
     }
 
     const auto prevModtime = item->_modtime; // the _item value was set in PropagateUploadFile::start()
+    const auto prevModtimeNsec = item->_modtimeNsec;
     // but a potential checksum calculation could have taken some time during which the file could
     // have been changed again, so better check again here.
 
-    item->_modtime = FileSystem::getModTime(originalFilePath);
+    item->_modtime = FileSystem::getModTime(originalFilePath, &item->_modtimeNsec);
     if (item->_modtime <= 0) {
         _pendingChecksumFiles.remove(item->_file);
         slotOnErrorStartFolderUnlock(item, SyncFileItem::NormalError, tr("File %1 has invalid modification time. Do not upload to the server.").arg(QDir::toNativeSeparators(item->_file)), ErrorCategory::GenericError);
         checkPropagationIsDone();
         return;
     }
-    if (prevModtime != item->_modtime) {
+    if (prevModtime != item->_modtime || prevModtimeNsec != item->_modtimeNsec) {
         propagator()->_anotherSyncNeeded = true;
         _pendingChecksumFiles.remove(item->_file);
 
         qCDebug(lcBulkPropagatorJob) << "trigger another sync after checking modified time of item" << item->_file
-                                     << "prevModtime" << prevModtime
-                                     << "Curr" << item->_modtime;
+                                     << "prevModtime" << prevModtime << prevModtimeNsec
+                                     << "Curr" << item->_modtime << item->_modtimeNsec;
 
         slotOnErrorStartFolderUnlock(item, SyncFileItem::SoftError, tr("Local file changed during syncing. It will be resumed."), ErrorCategory::GenericError);
         checkPropagationIsDone();
@@ -504,7 +506,7 @@ void BulkPropagatorJob::finalizeOneFile(const BulkUploadItem &oneFile)
 
     // Remove from the progress database:
     propagator()->_journal->setUploadInfo(oneFile._item->_file, SyncJournalDb::UploadInfo());
-    propagator()->_journal->commit("upload file start");
+    propagator()->_journal->scheduleCommit(QStringLiteral("upload file start"));
 }
 
 void BulkPropagatorJob::finalize(const QJsonObject &fullReply)
@@ -670,7 +672,7 @@ bool BulkPropagatorJob::checkFileChanged(SyncFileItemPtr item,
                                          const bool finished,
                                          const QString &fullFilePath)
 {
-    if (!FileSystem::verifyFileUnchanged(fullFilePath, item->_size, item->_modtime)) {
+    if (!FileSystem::verifyFileUnchanged(fullFilePath, item->_size, item->_modtime, item->_modtimeNsec)) {
         propagator()->_anotherSyncNeeded = true;
 
         if (!finished) {
@@ -16,6 +16,7 @@
 #include "creds/abstractcredentials.h"
 #include "common/utility.h"
 #include "common/constants.h"
+#include "filesystem.h"
 #include <common/checksums.h>
 #include "wordlist.h"
 
@@ -44,6 +45,8 @@
 #include <algorithm>
 
 #include <cstdio>
+#include <cstring>
+#include <limits>
 
 QDebug operator<<(QDebug out, const std::string& str)
 {
@@ -2302,4 +2305,290 @@ bool EncryptionHelper::StreamingDecryptor::isFinished() const
 {
     return _isFinished;
 }
+
+EncryptionHelper::StreamingEncryptor::StreamingEncryptor(const QByteArray &key, const QByteArray &iv)
+{
+    if (_ctx && !key.isEmpty() && !iv.isEmpty()) {
+        _isInitialized = true;
+
+        /* Initialize the encryption operation. */
+        if(!EVP_EncryptInit_ex(_ctx, EVP_aes_128_gcm(), nullptr, nullptr, nullptr)) {
+            qCritical(lcCse()) << "Could not init cipher";
+            _isInitialized = false;
+        }
+
+        EVP_CIPHER_CTX_set_padding(_ctx, 0);
+
+        /* Set IV length. */
+        if(!EVP_CIPHER_CTX_ctrl(_ctx, EVP_CTRL_GCM_SET_IVLEN, iv.size(), nullptr)) {
+            qCritical(lcCse()) << "Could not set iv length";
+            _isInitialized = false;
+        }
+
+        /* Initialize key and IV */
+        if(!EVP_EncryptInit_ex(_ctx, nullptr, nullptr, reinterpret_cast<const unsigned char*>(key.constData()), reinterpret_cast<const unsigned char*>(iv.constData()))) {
+            qCritical(lcCse()) << "Could not set key and iv";
+            _isInitialized = false;
+        }
+    }
+}
+
+bool EncryptionHelper::StreamingEncryptor::chunkEncryption(const char *input, char *output, quint64 chunkSize)
+{
+    Q_ASSERT(isInitialized() && !isFinished());
+    if (!isInitialized() || isFinished()) {
+        qCritical(lcCse()) << "Encryption failed. Encryptor is not initialized or already finished!";
+        return false;
+    }
+
+    quint64 inputPos = 0;
+    while (inputPos < chunkSize) {
+        // EVP_EncryptUpdate takes an int length
+        const auto size = static_cast<int>(qMin<quint64>(chunkSize - inputPos, std::numeric_limits<int>::max()));
+        int outLen = 0;
+
+        if(!EVP_EncryptUpdate(_ctx, reinterpret_cast<unsigned char*>(output + inputPos), &outLen, reinterpret_cast<const unsigned char*>(input + inputPos), size)) {
+            qCritical(lcCse()) << "Could not encrypt";
+            return false;
+        }
+
+        // GCM is a stream mode, nothing is held back
+        Q_ASSERT(outLen == size);
+        if (outLen != size) {
+            qCritical(lcCse()) << "Encryption failed. Unexpected output size" << outLen << "for" << size << "input bytes";
+            return false;
+        }
+
+        inputPos += size;
+    }
+
+    return true;
+}
+
+bool EncryptionHelper::StreamingEncryptor::finalize()
+{
+    Q_ASSERT(isInitialized() && !isFinished());
+    if (!isInitialized() || isFinished()) {
+        qCritical(lcCse()) << "Encryption failed. Encryptor is not initialized or already finished!";
+        return false;
+    }
+
+    QByteArray out(OCC::Constants::e2EeTagSize, '\0');
+    int outLen = 0;
+    if(1 != EVP_EncryptFinal_ex(_ctx, unsignedData(out), &outLen) || outLen != 0) {
+        qCritical(lcCse()) << "Could finalize encryption";
+        return false;
+    }
+
+    /* Get the e2EeTag */
+    QByteArray e2EeTag(OCC::Constants::e2EeTagSize, '\0');
+    if(1 != EVP_CIPHER_CTX_ctrl(_ctx, EVP_CTRL_GCM_GET_TAG, OCC::Constants::e2EeTagSize, unsignedData(e2EeTag))) {
+        qCritical(lcCse()) << "Could not get e2EeTag";
+        return false;
+    }
+
+    _e2EeTag = e2EeTag;
+    _isFinished = true;
+    return true;
+}
+
+QByteArray EncryptionHelper::StreamingEncryptor::e2EeTag() const
+{
+    return _e2EeTag;
+}
+
+bool EncryptionHelper::StreamingEncryptor::isInitialized() const
+{
+    return _isInitialized;
+}
+
+bool EncryptionHelper::StreamingEncryptor::isFinished() const
+{
+    return _isFinished;
+}
+
+EncryptionHelper::EncryptedFileDevice::EncryptedFileDevice(const QString &fileName, const QByteArray &key, const QByteArray &iv, QObject *parent)
+    : QIODevice(parent)
+    , _fileName(fileName)
+    , _file(fileName)
+    , _key(key)
+    , _iv(iv)
+    , _plainSize(FileSystem::getSize(fileName))
+{
+    _plainModtime = FileSystem::getModTime(fileName, &_plainModtimeNsec);
+}
+
+EncryptionHelper::EncryptedFileDevice::~EncryptedFileDevice() = default;
+
+bool EncryptionHelper::EncryptedFileDevice::open(QIODevice::OpenMode mode)
+{
+    if (mode & QIODevice::WriteOnly) {
+        return false;
+    }
+
+    QString openError;
+    if (!FileSystem::openAndSeekFileSharedRead(&_file, &openError, 0)) {
+        setErrorString(openError);
+        return false;
+    }
+
+    if (!restartEncryption()) {
+        _file.close();
+        return false;
+    }
+
+    // The position is all the state there is, QIODevice must not buffer ahead
+    return QIODevice::open(mode | QIODevice::Unbuffered);
+}
+
+void EncryptionHelper::EncryptedFileDevice::close()
+{
+    _file.close();
+    QIODevice::close();
+}
+
+qint64 EncryptionHelper::EncryptedFileDevice::size() const
+{
+    return encryptedSize(_plainSize);
+}
+
+// random access, see readData()
+bool EncryptionHelper::EncryptedFileDevice::isSequential() const
+{
+    return false;
+}
+
+QByteArray EncryptionHelper::EncryptedFileDevice::e2EeTag() const
+{
+    return _e2EeTag;
+}
+
+qint64 EncryptionHelper::EncryptedFileDevice::encryptedSize(qint64 plainSize)
+{
+    return plainSize + OCC::Constants::e2EeTagSize;
+}
+
+qint64 EncryptionHelper::EncryptedFileDevice::writeData(const char *, qint64)
+{
+    Q_ASSERT(false);
+    return -1;
+}
+
+qint64 EncryptionHelper::EncryptedFileDevice::readData(char *data, qint64 maxlen)
+{
+    const auto position = pos();
+    if (position >= size()) {
+        return -1;
+    }
+
+    if (position < _plainSize) {
+        // The GCM stream can't be rewound, but replaying it gives the same output
+        if (position < _encryptedSoFar && !restartEncryption()) {
+            return -1;
+        }
+        if (!encryptUpTo(position)) {
+            return -1;
+        }
+
+        const auto bytesRead = _file.read(data, qMin(maxlen, _plainSize - position));
+        if (bytesRead <= 0) {
+            setErrorString(bytesRead < 0 ? _file.errorString() : tr("File changed while it was being encrypted"));
+            return -1;
+        }
+        if (!_encryptor->chunkEncryption(data, data, bytesRead)) {
+            setErrorString(tr("Could not encrypt the file"));
+            return -1;
+        }
+        _encryptedSoFar += bytesRead;
+
+        if (_encryptedSoFar == _plainSize && !finishEncryption()) {
+            return -1;
+        }
+        return bytesRead;
+    }
+
+    // The e2EeTag follows the ciphertext
+    if (!_encryptor->isFinished() && !encryptUpTo(_plainSize)) {
+        return -1;
+    }
+    const auto tagPosition = position - _plainSize;
+    const auto bytesCopied = qMin(maxlen, _e2EeTag.size() - tagPosition);
+    std::memcpy(data, _e2EeTag.constData() + tagPosition, bytesCopied);
+    return bytesCopied;
+}
+
+bool EncryptionHelper::EncryptedFileDevice::restartEncryption()
+{
+    // Encrypting different content with the same key and IV would reveal both
+    if (!checkFileUnchanged()) {
+        return false;
+    }
+    if (!_file.seek(0)) {
+        setErrorString(_file.errorString());
+        return false;
+    }
+
+    _encryptor = std::make_unique<StreamingEncryptor>(_key, _iv);
+    _encryptedSoFar = 0;
+    if (!_encryptor->isInitialized()) {
+        setErrorString(tr("Could not encrypt the file"));
+        return false;
+    }
+    return true;
+}
+
+bool EncryptionHelper::EncryptedFileDevice::encryptUpTo(qint64 plainPos)
+{
+    QByteArray buffer;
+    while (_encryptedSoFar < plainPos) {
+        buffer.resize(qMin<qint64>(plainPos - _encryptedSoFar, 64 * 1024));
+        const auto bytesRead = _file.read(buffer.data(), buffer.size());
+        if (bytesRead <= 0) {
+            setErrorString(bytesRead < 0 ? _file.errorString() : tr("File changed while it was being encrypted"));
+            return false;
+        }
+        if (!_encryptor->chunkEncryption(buffer.constData(), buffer.data(), bytesRead)) {
+            setErrorString(tr("Could not encrypt the file"));
+            return false;
+        }
+        _encryptedSoFar += bytesRead;
+    }
+
+    if (_encryptedSoFar == _plainSize && !_encryptor->isFinished()) {
+        return finishEncryption();
+    }
+    return true;
+}
+
+bool EncryptionHelper::EncryptedFileDevice::finishEncryption()
+{
+    if (!_encryptor->finalize()) {
+        setErrorString(tr("Could not encrypt the file"));
+        return false;
+    }
+    if (!checkFileUnchanged()) {
+        return false;
+    }
+
+    // Later passes must produce exactly the content of the first one
+    if (_e2EeTag.isEmpty()) {
+        _e2EeTag = _encryptor->e2EeTag();
+    } else if (_e2EeTag != _encryptor->e2EeTag()) {
+        qCWarning(lcCse()) << "The content of" << _fileName << "changed between two encryption passes";
+        setErrorString(tr("File changed while it was being encrypted"));
+        return false;
+    }
+    return true;
+}
+
+bool EncryptionHelper::EncryptedFileDevice::checkFileUnchanged()
+{
+    qint32 modtimeNsec = 0;
+    const auto modtime = FileSystem::getModTime(_fileName, &modtimeNsec);
+    if (FileSystem::getSize(_fileName) != _plainSize || modtime != _plainModtime || modtimeNsec != _plainModtimeNsec) {
+        setErrorString(tr("File changed while it was being encrypted"));
+        return false;
+    }
+    return true;
+}
 }
@@ -10,11 +10,14 @@
 #include <QSslCertificate>
 #include <QSslKey>
 #include <QFile>
+#include <QIODevice>
 #include <QVector>
 #include <QMap>
 
 #include <openssl/evp.h>
 
+#include <memory>
+
 #include "accountfwd.h"
 #include "networkjobs.h"
 
@@ -122,6 +125,88 @@ private:
     quint64 _decryptedSoFar = 0;
     quint64 _totalSize = 0;
 };
+
+class OWNCLOUDSYNC_EXPORT StreamingEncryptor
+{
+public:
+    StreamingEncryptor(const QByteArray &key, const QByteArray &iv);
+    ~StreamingEncryptor() = default;
+
+    /// Encrypts \a chunkSize bytes of \a input into \a output, which may be the same buffer
+    bool chunkEncryption(const char *input, char *output, quint64 chunkSize);
+
+    /// Finishes the encryption, e2EeTag() is available afterwards
+    bool finalize();
+
+    [[nodiscard]] QByteArray e2EeTag() const;
+    [[nodiscard]] bool isInitialized() const;
+    [[nodiscard]] bool isFinished() const;
+
+private:
+    Q_DISABLE_COPY(StreamingEncryptor)
+
+    CipherCtx _ctx;
+    QByteArray _e2EeTag;
+    bool _isInitialized = false;
+    bool _isFinished = false;
+};
+
+/**
+ * Read-only device providing the encrypted content of a local file
+ *
+ * The content is encrypted on the fly while it is read, the e2EeTag is
+ * appended after the ciphertext, like fileEncryption() would write it.
+ * Seeking forward encrypts and skips the data in between, seeking backwards
+ * restarts the encryption from the beginning of the file.
+ *
+ * Every pass uses the same key and IV, which is only safe as long as the
+ * plain content stays the same. The size and modification time of the file
+ * are taken when the device is created and reading fails once they changed,
+ * as well as when a pass ends with a different e2EeTag than the first one.
+ */
+class OWNCLOUDSYNC_EXPORT EncryptedFileDevice : public QIODevice
+{
+    Q_OBJECT
+public:
+    EncryptedFileDevice(const QString &fileName, const QByteArray &key, const QByteArray &iv, QObject *parent = nullptr);
+    ~EncryptedFileDevice() override;
+
+    bool open(QIODevice::OpenMode mode) override;
+    void close() override;
+
+    [[nodiscard]] qint64 size() const override;
+    [[nodiscard]] bool isSequential() const override;
+
+    /// The e2EeTag of the first complete pass, empty until the device was read up to the tag
+    [[nodiscard]] QByteArray e2EeTag() const;
+
+    /// The size of the encrypted content of a file of \a plainSize bytes
+    static qint64 encryptedSize(qint64 plainSize);
+
+protected:
+    qint64 readData(char *data, qint64 maxlen) override;
+    qint64 writeData(const char *, qint64) override;
+
+private:
+    Q_DISABLE_COPY(EncryptedFileDevice)
+
+    bool restartEncryption();
+    bool encryptUpTo(qint64 plainPos);
+    bool finishEncryption();
+    bool checkFileUnchanged();
+
+    QString _fileName;
+    QFile _file;
+    QByteArray _key;
+    QByteArray _iv;
+    std::unique_ptr<StreamingEncryptor> _encryptor;
+    QByteArray _e2EeTag;
+    qint64 _plainSize = 0;
+    time_t _plainModtime = 0;
+    qint32 _plainModtimeNsec = 0;
+    /// Number of bytes that went through _encryptor
+    qint64 _encryptedSoFar = 0;
+};
 }
 
 class OWNCLOUDSYNC_EXPORT ClientSideEncryption : public QObject {
@@ -77,6 +77,9 @@ static constexpr char chunkSizeC[] = "chunkSize";
 static constexpr char minChunkSizeC[] = "minChunkSize";
 static constexpr char maxChunkSizeC[] = "maxChunkSize";
 static constexpr char targetChunkUploadDurationC[] = "targetChunkUploadDuration";
+static constexpr char maxConcurrentSyncsC[] = "maxConcurrentSyncs";
+static constexpr char maxParallelNetworkJobsC[] = "maxParallelNetworkJobs";
+static constexpr char sqliteReadConnectionsC[] = "sqliteReadConnections";
 static constexpr char automaticLogDirC[] = "logToTemporaryLogDir";
 static constexpr char logDirC[] = "logDir";
 static constexpr char logDebugC[] = "logDebug";
@@ -270,6 +273,24 @@ chrono::milliseconds ConfigFile::targetChunkUploadDuration() const
     return millisecondsValue(settings, targetChunkUploadDurationC, chrono::minutes(1));
 }
 
+int ConfigFile::maxConcurrentSyncs() const
+{
+    QSettings settings(configFile(), QSettings::IniFormat);
+    return qMax(1, settings.value(QLatin1String(maxConcurrentSyncsC), defaultMaxConcurrentSyncs).toInt());
+}
+
+int ConfigFile::maxParallelNetworkJobs() const
+{
+    QSettings settings(configFile(), QSettings::IniFormat);
+    return qMax(1, settings.value(QLatin1String(maxParallelNetworkJobsC), 20).toInt());
+}
+
+bool ConfigFile::sqliteReadConnections() const
+{
+    QSettings settings(configFile(), QSettings::IniFormat);
+    return settings.value(QLatin1String(sqliteReadConnectionsC), false).toBool();
+}
+
 void ConfigFile::setOptionalServerNotifications(bool show)
 {
     QSettings settings(configFile(), QSettings::IniFormat);
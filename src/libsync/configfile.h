@@ -176,6 +176,14 @@ public:
     [[nodiscard]] qint64 minChunkSize() const;
     [[nodiscard]] std::chrono::milliseconds targetChunkUploadDuration() const;
 
+    /// How many folders may sync at the same time
+    [[nodiscard]] int maxConcurrentSyncs() const;
+    static constexpr int defaultMaxConcurrentSyncs = 2;
+    /// How many network jobs all the syncs running at the same time may use together
+    [[nodiscard]] int maxParallelNetworkJobs() const;
+    /// Whether the GUI reads the sync journals on separate connections, needs non-exclusive journal locking
+    [[nodiscard]] bool sqliteReadConnections() const;
+
     void saveGeometry(QWidget *w);
     void restoreGeometry(QWidget *w);
 
@@ -39,6 +39,29 @@ namespace OCC {
 
 Q_LOGGING_CATEGORY(lcDisco, "nextcloud.sync.discovery", QtInfoMsg)
 
+namespace {
+// Local checksums are disk bound: keep them off the global pool so they
+// don't starve the local directory listings.
+class LocalChecksumThreadPool : public QThreadPool
+{
+public:
+    LocalChecksumThreadPool() { setMaxThreadCount(2); }
+};
+}
+
+Q_GLOBAL_STATIC(LocalChecksumThreadPool, localChecksumThreadPool)
+
+/** Whether a local mtime is still the one recorded in the journal
+ *
+ * The sub-second part is only compared when the journal knows it: records
+ * written by older versions only have seconds.
+ */
+static bool localModTimeUnchanged(const SyncJournalFileRecord &record, time_t modtime, qint32 modtimeNsec)
+{
+    return record._modtime == modtime
+        && (record._modtimeNsec < 0 || record._modtimeNsec == modtimeNsec);
+}
+
 ProcessDirectoryJob::ProcessDirectoryJob(DiscoveryPhase *data, PinState basePinState, qint64 lastSyncTimestamp, QObject *parent)
     : QObject(parent)
     , _lastSyncTimestamp(lastSyncTimestamp)
@@ -79,24 +102,23 @@ void ProcessDirectoryJob::start()
     _discoveryData->_noCaseConflictRecordsInDb = _discoveryData->_statedb->caseClashConflictRecordPaths().isEmpty();
 
     if (_queryServer == NormalQuery) {
-        _serverJob = startAsyncServerQuery();
+        if (!takePrefetchedServerEntries()) {
+            _serverJob = startAsyncServerQuery();
+        }
     } else {
         _serverQueryDone = true;
     }
 
     // Check whether a normal local query is even necessary
-    if (_queryLocal == NormalQuery) {
-        if (!_discoveryData->_shouldDiscoverLocaly(_currentFolder._local)
-            && (_currentFolder._local == _currentFolder._original || !_discoveryData->_shouldDiscoverLocaly(_currentFolder._original))
-            && !_discoveryData->isInSelectiveSyncBlackList(_currentFolder._original)) {
-            _queryLocal = ParentNotChanged;
-            qCDebug(lcDisco) << "adjusted discovery policy" << _currentFolder._server << _queryServer << _currentFolder._local << _queryLocal;
-        }
+    if (_queryLocal == NormalQuery && !needsLocalQuery()) {
+        _queryLocal = ParentNotChanged;
+        qCDebug(lcDisco) << "adjusted discovery policy" << _currentFolder._server << _queryServer << _currentFolder._local << _queryLocal;
     }
 
     if (_queryLocal == NormalQuery) {
         startAsyncLocalQuery();
     } else {
+        _discoveryData->dropLocalListing(_discoveryData->_localDir + _currentFolder._local);
         _localQueryDone = true;
     }
 
@@ -109,6 +131,10 @@ void ProcessDirectoryJob::process()
 {
     ASSERT(_localQueryDone && _serverQueryDone);
 
+    if (_discoveryData->_syncOptions._streamedPropagation) {
+        emit _discoveryData->directoryListed(_dirItem);
+    }
+
     // Build lookup tables for local, remote and db entries.
     // For suffix-virtual files, the key will normally be the base file name
     // without the suffix.
@@ -242,6 +268,7 @@ void ProcessDirectoryJob::process()
         processFile(std::move(path), e.localEntry, e.serverEntry, e.dbEntry);
     }
     _discoveryData->_listExclusiveFiles.clear();
+    prefetchLocalListings();
     QTimer::singleShot(0, _discoveryData, &DiscoveryPhase::scheduleMoreJobs);
 }
 
@@ -496,7 +523,7 @@ void ProcessDirectoryJob::processFile(PathTuple path,
     item->_previousSize = dbEntry._fileSize;
     item->_previousModtime = dbEntry._modtime;
 
-    if (dbEntry._modtime == localEntry.modtime && dbEntry._type == ItemTypeVirtualFile && localEntry.type == ItemTypeFile) {
+    if (localModTimeUnchanged(dbEntry, localEntry.modtime, localEntry.modtimeNsec) && dbEntry._type == ItemTypeVirtualFile && localEntry.type == ItemTypeFile) {
         item->_type = ItemTypeFile;
         qCInfo(lcDisco) << "Changing item type from virtual to normal file" << item->_file;
     }
@@ -548,20 +575,28 @@ void ProcessDirectoryJob::processFile(PathTuple path,
     processFileAnalyzeLocalInfo(item, path, localEntry, serverEntry, dbEntry, _queryServer);
 }
 
-// Compute the checksum of the given file and assign the result in item->_checksumHeader
-// Returns true if the checksum was successfully computed
-static bool computeLocalChecksum(const QByteArray &header, const QString &path, const SyncFileItemPtr &item)
+void ProcessDirectoryJob::computeLocalChecksum(const QByteArray &header, const QString &path, const SyncFileItemPtr &item, const std::function<void(bool)> &callback)
 {
-    auto type = parseChecksumHeaderType(header);
-    if (!type.isEmpty()) {
-        // TODO: compute async?
-        QByteArray checksum = ComputeChecksum::computeNowOnFile(path, type);
+    const auto type = parseChecksumHeaderType(header);
+    if (type.isEmpty()) {
+        callback(false);
+        return;
+    }
+
+    _pendingAsyncJobs++;
+    auto computeChecksum = new ComputeChecksum(this);
+    computeChecksum->setChecksumType(type);
+    computeChecksum->setThreadPool(localChecksumThreadPool());
+    connect(computeChecksum, &ComputeChecksum::done, this, [=](const QByteArray &checksumType, const QByteArray &checksum) {
+        computeChecksum->deleteLater();
         if (!checksum.isEmpty()) {
-            item->_checksumHeader = makeChecksumHeader(type, checksum);
-            return true;
+            item->_checksumHeader = makeChecksumHeader(checksumType, checksum);
         }
-    }
-    return false;
+        callback(!checksum.isEmpty());
+        _pendingAsyncJobs--;
+        QTimer::singleShot(0, _discoveryData, &DiscoveryPhase::scheduleMoreJobs);
+    });
+    computeChecksum->start(path);
 }
 
 void ProcessDirectoryJob::postProcessServerNew(const SyncFileItemPtr &item,
@@ -722,6 +757,7 @@ void ProcessDirectoryJob::processFileAnalyzeRemoteInfo(const SyncFileItemPtr &it
             item->_instruction = CSYNC_INSTRUCTION_TYPE_CHANGE;
             item->_direction = SyncFileItem::Down;
             item->_modtime = serverEntry.modtime;
+            item->_modtimeNsec = -1;
             item->_size = sizeOnServer;
         } else if ((dbEntry._type == ItemTypeVirtualFileDownload || localEntry.type == ItemTypeVirtualFileDownload)
             && (localEntry.isValid() || _queryLocal == ParentNotChanged)) {
@@ -733,6 +769,7 @@ void ProcessDirectoryJob::processFileAnalyzeRemoteInfo(const SyncFileItemPtr &it
         } else if (dbEntry._etag != serverEntry.etag) {
             item->_direction = SyncFileItem::Down;
             item->_modtime = serverEntry.modtime;
+            item->_modtimeNsec = -1;
             item->_size = sizeOnServer;
 
             if (serverEntry.isDirectory) {
@@ -753,6 +790,7 @@ void ProcessDirectoryJob::processFileAnalyzeRemoteInfo(const SyncFileItemPtr &it
                    && dbEntry._etag == serverEntry.etag) {
             item->_direction = SyncFileItem::Down;
             item->_modtime = serverEntry.modtime;
+            item->_modtimeNsec = -1;
             item->_size = sizeOnServer;
             item->_instruction = CSYNC_INSTRUCTION_UPDATE_METADATA;
         } else if (dbEntry._remotePerm != serverEntry.remotePerm || dbEntry._fileId != serverEntry.fileId || metaDataSizeNeedsUpdateForE2EeFilePlaceholder) {
@@ -894,7 +932,7 @@ void ProcessDirectoryJob::processFileAnalyzeRemoteInfo(const SyncFileItemPtr &it
             }
             // NOTE: This prohibits some VFS renames from being detected since
             // suffix-file size is different from the db size. That's ok, they'll DELETE+NEW.
-            if (buf.modtime != base._modtime || buf.size != base._fileSize || buf.type == ItemTypeDirectory) {
+            if (!localModTimeUnchanged(base, buf.modtime, buf.modtime_nsec) || buf.size != base._fileSize || buf.type == ItemTypeDirectory) {
                 qCInfo(lcDisco) << "File has changed locally, not a rename." << originalPath;
                 return;
             }
@@ -916,6 +954,7 @@ void ProcessDirectoryJob::processFileAnalyzeRemoteInfo(const SyncFileItemPtr &it
             const auto adjustedOriginalPath = _discoveryData->adjustRenamedPath(originalPath, SyncFileItem::Up);
             _discoveryData->_renamedItemsRemote.insert(originalPath, path._target);
             item->_modtime = base._modtime;
+            item->_modtimeNsec = base._modtimeNsec;
             item->_inode = base._inode;
             item->_instruction = CSYNC_INSTRUCTION_RENAME;
             item->_direction = SyncFileItem::Down;
@@ -1006,8 +1045,9 @@ void ProcessDirectoryJob::processFileAnalyzeLocalInfo(
 
     _childModified |= serverModified;
 
-    auto finalize = [&] {
-        bool recurse = item->isDirectory() || localEntry.isDirectory || serverEntry.isDirectory;
+    auto finalizeWith = [item, this, isLocalDirectory = localEntry.isDirectory, isServerDirectory = serverEntry.isDirectory,
+                         hasDbEntry = dbEntry.isValid(), dbEncryptionStatus = dbEntry._e2eEncryptionStatus](const PathTuple &path, QueryMode recurseQueryServer) {
+        bool recurse = item->isDirectory() || isLocalDirectory || isServerDirectory;
         // Even if we have a local directory: If the remote is a file that's propagated as a
         // conflict we don't need to recurse into it. (local c1.owncloud, c1/ ; remote: c1)
         if (item->_instruction == CSYNC_INSTRUCTION_CONFLICT && !item->isDirectory())
@@ -1022,16 +1062,19 @@ void ProcessDirectoryJob::processFileAnalyzeLocalInfo(
             item->_status = SyncFileItem::Status::NormalError;
         }
 
-        if (dbEntry.isValid() && item->isDirectory()) {
-            item->_e2eEncryptionStatus = EncryptionStatusEnums::fromDbEncryptionStatus(dbEntry._e2eEncryptionStatus);
+        if (hasDbEntry && item->isDirectory()) {
+            item->_e2eEncryptionStatus = EncryptionStatusEnums::fromDbEncryptionStatus(dbEncryptionStatus);
             if (item->isEncrypted()) {
                 item->_e2eEncryptionServerCapability = EncryptionStatusEnums::fromEndToEndEncryptionApiVersion(_discoveryData->_account->capabilities().clientSideEncryptionVersion());
             }
         }
 
-        auto recurseQueryLocal = _queryLocal == ParentNotChanged ? ParentNotChanged : localEntry.isDirectory || item->_instruction == CSYNC_INSTRUCTION_RENAME ? NormalQuery : ParentDontExist;
+        auto recurseQueryLocal = _queryLocal == ParentNotChanged ? ParentNotChanged : isLocalDirectory || item->_instruction == CSYNC_INSTRUCTION_RENAME ? NormalQuery : ParentDontExist;
         processFileFinalize(item, path, recurse, recurseQueryLocal, recurseQueryServer);
     };
+    auto finalize = [&] {
+        finalizeWith(path, recurseQueryServer);
+    };
 
     if (!localEntry.isValid()) {
         if (_queryLocal == ParentNotChanged && dbEntry.isValid()) {
@@ -1092,7 +1135,7 @@ void ProcessDirectoryJob::processFileAnalyzeLocalInfo(
                 // If we find what looks to be a spurious "abc.owncloud" the base file "abc"
                 // might have been renamed to that. Make sure that the base file is not
                 // deleted from the server.
-                if (dbEntry._modtime == localEntry.modtime && dbEntry._fileSize == localEntry.size) {
+                if (localModTimeUnchanged(dbEntry, localEntry.modtime, localEntry.modtimeNsec) && dbEntry._fileSize == localEntry.size) {
                     qCInfo(lcDisco) << "Base file was renamed to virtual file:" << item->_file;
                     item->_direction = SyncFileItem::Down;
                     item->_instruction = CSYNC_INSTRUCTION_SYNC;
@@ -1104,7 +1147,7 @@ void ProcessDirectoryJob::processFileAnalyzeLocalInfo(
                     item->_instruction = CSYNC_INSTRUCTION_IGNORE;
                 }
             }
-        } else if (!typeChange && ((dbEntry._modtime == localEntry.modtime && dbEntry._fileSize == localEntry.size) || localEntry.isDirectory)) {
+        } else if (!typeChange && ((localModTimeUnchanged(dbEntry, localEntry.modtime, localEntry.modtimeNsec) && dbEntry._fileSize == localEntry.size) || localEntry.isDirectory)) {
             // Local file unchanged.
             if (noServerEntry) {
 #if !defined QT_NO_DEBUG
@@ -1126,7 +1169,7 @@ void ProcessDirectoryJob::processFileAnalyzeLocalInfo(
         } else if (!typeChange && isVfsWithSuffix()
             && dbEntry.isVirtualFile() && !localEntry.isVirtualFile
             && dbEntry._inode == localEntry.inode
-            && dbEntry._modtime == localEntry.modtime
+            && localModTimeUnchanged(dbEntry, localEntry.modtime, localEntry.modtimeNsec)
             && localEntry.size == 1) {
             // A suffix vfs file can be downloaded by renaming it to remove the suffix.
             // This check leaks some details of VfsSuffix, particularly the size of placeholders.
@@ -1153,6 +1196,7 @@ void ProcessDirectoryJob::processFileAnalyzeLocalInfo(
             item->_checksumHeader.clear();
             item->_size = localEntry.size;
             item->_modtime = localEntry.modtime;
+            item->_modtimeNsec = localEntry.modtimeNsec;
             item->_type = localEntry.isDirectory ? ItemTypeDirectory : ItemTypeFile;
             _childModified = true;
         } else if (dbEntry._modtime > 0 && (localEntry.modtime <= 0 || localEntry.modtime >= 0xFFFFFFFF) && dbEntry._fileSize == localEntry.size) {
@@ -1160,6 +1204,7 @@ void ProcessDirectoryJob::processFileAnalyzeLocalInfo(
             item->_direction = SyncFileItem::Down;
             item->_size = localEntry.size > 0 ? localEntry.size : dbEntry._fileSize;
             item->_modtime = dbEntry._modtime;
+            item->_modtimeNsec = dbEntry._modtimeNsec;
             item->_previousModtime = dbEntry._modtime;
             item->_type = localEntry.isDirectory ? ItemTypeDirectory : ItemTypeFile;
             qCDebug(lcDisco) << "CSYNC_INSTRUCTION_SYNC: File" << item->_file << "if (dbEntry._modtime > 0 && localEntry.modtime <= 0)"
@@ -1177,6 +1222,7 @@ void ProcessDirectoryJob::processFileAnalyzeLocalInfo(
             item->_checksumHeader.clear();
             item->_size = localEntry.size;
             item->_modtime = localEntry.modtime;
+            item->_modtimeNsec = localEntry.modtimeNsec;
             _childModified = true;
 
             qCDebug(lcDisco) << "Local file was changed: File" << item->_file
@@ -1190,11 +1236,15 @@ void ProcessDirectoryJob::processFileAnalyzeLocalInfo(
             // check #4754 #4755
             bool isEmlFile = path._original.endsWith(QLatin1String(".eml"), Qt::CaseInsensitive);
             if (isEmlFile && dbEntry._fileSize == localEntry.size && !dbEntry._checksumHeader.isEmpty()) {
-                if (computeLocalChecksum(dbEntry._checksumHeader, _discoveryData->_localDir + path._local, item)
-                        && item->_checksumHeader == dbEntry._checksumHeader) {
-                    qCInfo(lcDisco) << "NOTE: Checksums are identical, file did not actually change: " << path._local;
-                    item->_instruction = CSYNC_INSTRUCTION_UPDATE_METADATA;
-                }
+                computeLocalChecksum(dbEntry._checksumHeader, _discoveryData->_localDir + path._local, item,
+                    [item, path, recurseQueryServer, finalizeWith, dbChecksumHeader = dbEntry._checksumHeader](bool computed) {
+                        if (computed && item->_checksumHeader == dbChecksumHeader) {
+                            qCInfo(lcDisco) << "NOTE: Checksums are identical, file did not actually change: " << path._local;
+                            item->_instruction = CSYNC_INSTRUCTION_UPDATE_METADATA;
+                        }
+                        finalizeWith(path, recurseQueryServer);
+                    });
+                return;
             }
         }
 
@@ -1223,6 +1273,7 @@ void ProcessDirectoryJob::processFileAnalyzeLocalInfo(
     item->_checksumHeader.clear();
     item->_size = localEntry.size;
     item->_modtime = localEntry.modtime;
+    item->_modtimeNsec = localEntry.modtimeNsec;
     item->_type = localEntry.isDirectory ? ItemTypeDirectory : localEntry.isVirtualFile ? ItemTypeVirtualFile : ItemTypeFile;
     _childModified = true;
 
@@ -1342,9 +1393,9 @@ void ProcessDirectoryJob::processFileAnalyzeLocalInfo(
         }
         // Directories and virtual files don't need size/mtime equality
         if (!localEntry.isDirectory && !base.isVirtualFile()
-            && (base._modtime != localEntry.modtime || base._fileSize != localEntry.size)) {
+            && (!localModTimeUnchanged(base, localEntry.modtime, localEntry.modtimeNsec) || base._fileSize != localEntry.size)) {
             qCInfo(lcDisco) << "Not a move, mtime or size differs, "
-                            << "modtime:" << base._modtime << localEntry.modtime << ", "
+                            << "modtime:" << base._modtime << base._modtimeNsec << localEntry.modtime << localEntry.modtimeNsec << ", "
                             << "size:" << base._fileSize << localEntry.size;
             return false;
         }
@@ -1360,17 +1411,6 @@ void ProcessDirectoryJob::processFileAnalyzeLocalInfo(
             return false;
         }
 
-        // Verify the checksum where possible
-        if (!base._checksumHeader.isEmpty() && item->_type == ItemTypeFile && base._type == ItemTypeFile) {
-            if (computeLocalChecksum(base._checksumHeader, _discoveryData->_localDir + path._original, item)) {
-                qCInfo(lcDisco) << "checking checksum of potential rename " << path._original << item->_checksumHeader << base._checksumHeader;
-                if (item->_checksumHeader != base._checksumHeader) {
-                    qCInfo(lcDisco) << "Not a move, checksums differ";
-                    return false;
-                }
-            }
-        }
-
         if (_discoveryData->isRenamed(originalPath)) {
             qCInfo(lcDisco) << "Not a move, base path already renamed";
             return false;
@@ -1405,115 +1445,145 @@ void ProcessDirectoryJob::processFileAnalyzeLocalInfo(
         return;
     }
 
-    // Check local permission if we are allowed to put move the file here
-    // Technically we should use the permissions from the server, but we'll assume it is the same
-    const auto isExternalStorage = base._remotePerm.hasPermission(RemotePermissions::IsMounted);
-    const auto movePerms = checkMovePermissions(base._remotePerm, originalPath, item->isDirectory());
-    if (!movePerms.sourceOk || !movePerms.destinationOk || isExternalStorage) {
-        qCInfo(lcDisco) << "Move without permission to rename base file, "
-                        << "source:" << movePerms.sourceOk
-                        << ", target:" << movePerms.destinationOk
-                        << ", targetNew:" << movePerms.destinationNewOk
-                        << ", isExternalStorage:" << isExternalStorage;
-
-        // If we can create the destination, do that.
-        // Permission errors on the destination will be handled by checkPermissions later.
-        postProcessLocalNew();
-        finalize();
+    auto processMove = [=]() mutable {
+        // Check local permission if we are allowed to put move the file here
+        // Technically we should use the permissions from the server, but we'll assume it is the same
+        const auto isExternalStorage = base._remotePerm.hasPermission(RemotePermissions::IsMounted);
+        const auto movePerms = checkMovePermissions(base._remotePerm, originalPath, item->isDirectory());
+        if (!movePerms.sourceOk || !movePerms.destinationOk || isExternalStorage) {
+            qCInfo(lcDisco) << "Move without permission to rename base file, "
+                            << "source:" << movePerms.sourceOk
+                            << ", target:" << movePerms.destinationOk
+                            << ", targetNew:" << movePerms.destinationNewOk
+                            << ", isExternalStorage:" << isExternalStorage;
+
+            // If we can create the destination, do that.
+            // Permission errors on the destination will be handled by checkPermissions later.
+            postProcessLocalNew();
+            finalizeWith(path, recurseQueryServer);
+
+            // If the destination upload will work, we're fine with the source deletion.
+            // If the source deletion can't work, checkPermissions will error.
+            // In case of external storage mounted folders we are never allowed to move/delete them
+            if (movePerms.destinationNewOk && !isExternalStorage) {
+                return;
+            }
 
-        // If the destination upload will work, we're fine with the source deletion.
-        // If the source deletion can't work, checkPermissions will error.
-        // In case of external storage mounted folders we are never allowed to move/delete them
-        if (movePerms.destinationNewOk && !isExternalStorage) {
+            // Here we know the new location can't be uploaded: must prevent the source delete.
+            // Two cases: either the source item was already processed or not.
+            auto wasDeletedOnClient = _discoveryData->findAndCancelDeletedJob(originalPath);
+            if (wasDeletedOnClient.first) {
+                // More complicated. The REMOVE is canceled. Restore will happen next sync.
+                qCInfo(lcDisco) << "Undid remove instruction on source" << originalPath;
+                if (!_discoveryData->_statedb->deleteFileRecord(originalPath, true)) {
+                    qCWarning(lcDisco) << "Failed to delete a file record from the local DB" << originalPath;
+                }
+                _discoveryData->_statedb->schedulePathForRemoteDiscovery(originalPath);
+                _discoveryData->_anotherSyncNeeded = true;
+            } else {
+                // Signal to future checkPermissions() to forbid the REMOVE and set to restore instead
+                qCInfo(lcDisco) << "Preventing future remove on source" << originalPath;
+                _discoveryData->_forbiddenDeletes[originalPath + '/'] = true;
+            }
             return;
         }
 
-        // Here we know the new location can't be uploaded: must prevent the source delete.
-        // Two cases: either the source item was already processed or not.
         auto wasDeletedOnClient = _discoveryData->findAndCancelDeletedJob(originalPath);
-        if (wasDeletedOnClient.first) {
-            // More complicated. The REMOVE is canceled. Restore will happen next sync.
-            qCInfo(lcDisco) << "Undid remove instruction on source" << originalPath;
-            if (!_discoveryData->_statedb->deleteFileRecord(originalPath, true)) {
-                qCWarning(lcDisco) << "Failed to delete a file record from the local DB" << originalPath;
+
+        auto processRename = [item, originalPath, base, this](PathTuple &path) {
+            auto adjustedOriginalPath = _discoveryData->adjustRenamedPath(originalPath, SyncFileItem::Down);
+            _discoveryData->_renamedItemsLocal.insert(originalPath, path._target);
+            item->_renameTarget = path._target;
+            path._server = adjustedOriginalPath;
+            item->_file = path._server;
+            path._original = originalPath;
+            item->_originalFile = path._original;
+            item->_modtime = base._modtime;
+            item->_modtimeNsec = base._modtimeNsec;
+            item->_inode = base._inode;
+            item->_instruction = CSYNC_INSTRUCTION_RENAME;
+            item->_direction = SyncFileItem::Up;
+            item->_fileId = base._fileId;
+            item->_remotePerm = base._remotePerm;
+            item->_isShared = base._isShared;
+            item->_sharedByMe = base._sharedByMe;
+            item->_lastShareStateFetchedTimestamp = base._lastShareStateFetchedTimestamp;
+            item->_etag = base._etag;
+            item->_type = base._type;
+
+            // Discard any download/dehydrate tags on the base file.
+            // They could be preserved and honored in a follow-up sync,
+            // but it complicates handling a lot and will happen rarely.
+            if (item->_type == ItemTypeVirtualFileDownload)
+                item->_type = ItemTypeVirtualFile;
+            if (item->_type == ItemTypeVirtualFileDehydration) {
+                item->_type = ItemTypeFile;
+                qCInfo(lcDisco) << "Changing item type from virtual to normal file" << item->_file;
             }
-            _discoveryData->_statedb->schedulePathForRemoteDiscovery(originalPath);
-            _discoveryData->_anotherSyncNeeded = true;
+
+            qCInfo(lcDisco) << "Rename detected (up) " << item->_file << " -> " << item->_renameTarget;
+        };
+        if (wasDeletedOnClient.first) {
+            recurseQueryServer = wasDeletedOnClient.second == base._etag ? ParentNotChanged : NormalQuery;
+            processRename(path);
         } else {
-            // Signal to future checkPermissions() to forbid the REMOVE and set to restore instead
-            qCInfo(lcDisco) << "Preventing future remove on source" << originalPath;
-            _discoveryData->_forbiddenDeletes[originalPath + '/'] = true;
-        }
-        return;
-    }
+            // We must query the server to know if the etag has not changed
+            _pendingAsyncJobs++;
+            QString serverOriginalPath = _discoveryData->_remoteFolder + _discoveryData->adjustRenamedPath(originalPath, SyncFileItem::Down);
+            if (base.isVirtualFile() && isVfsWithSuffix())
+                chopVirtualFileSuffix(serverOriginalPath);
+            auto job = new RequestEtagJob(_discoveryData->_account, serverOriginalPath, this);
+            connect(job, &RequestEtagJob::finishedWithResult, this, [=](const HttpResult<QByteArray> &etag) mutable {
 
-    auto wasDeletedOnClient = _discoveryData->findAndCancelDeletedJob(originalPath);
 
-    auto processRename = [item, originalPath, base, this](PathTuple &path) {
-        auto adjustedOriginalPath = _discoveryData->adjustRenamedPath(originalPath, SyncFileItem::Down);
-        _discoveryData->_renamedItemsLocal.insert(originalPath, path._target);
-        item->_renameTarget = path._target;
-        path._server = adjustedOriginalPath;
-        item->_file = path._server;
-        path._original = originalPath;
-        item->_originalFile = path._original;
-        item->_modtime = base._modtime;
-        item->_inode = base._inode;
-        item->_instruction = CSYNC_INSTRUCTION_RENAME;
-        item->_direction = SyncFileItem::Up;
-        item->_fileId = base._fileId;
-        item->_remotePerm = base._remotePerm;
-        item->_isShared = base._isShared;
-        item->_sharedByMe = base._sharedByMe;
-        item->_lastShareStateFetchedTimestamp = base._lastShareStateFetchedTimestamp;
-        item->_etag = base._etag;
-        item->_type = base._type;
-
-        // Discard any download/dehydrate tags on the base file.
-        // They could be preserved and honored in a follow-up sync,
-        // but it complicates handling a lot and will happen rarely.
-        if (item->_type == ItemTypeVirtualFileDownload)
-            item->_type = ItemTypeVirtualFile;
-        if (item->_type == ItemTypeVirtualFileDehydration) {
-            item->_type = ItemTypeFile;
-            qCInfo(lcDisco) << "Changing item type from virtual to normal file" << item->_file;
+                if (!etag || (etag.get() != base._etag && !item->isDirectory()) || _discoveryData->isRenamed(originalPath)
+                    || (isAnyParentBeingRestored(originalPath) && !isRename(originalPath))) {
+                    qCInfo(lcDisco) << "Can't rename because the etag has changed or the directory is gone or we are restoring one of the file's parents." << originalPath;
+                    // Can't be a rename, leave it as a new.
+                    postProcessLocalNew();
+                } else {
+                    // In case the deleted item was discovered in parallel
+                    _discoveryData->findAndCancelDeletedJob(originalPath);
+                    processRename(path);
+                    recurseQueryServer = etag.get() == base._etag ? ParentNotChanged : NormalQuery;
+                }
+                processFileFinalize(item, path, item->isDirectory(), NormalQuery, recurseQueryServer);
+                _pendingAsyncJobs--;
+                QTimer::singleShot(0, _discoveryData, &DiscoveryPhase::scheduleMoreJobs);
+            });
+            job->start();
+            return;
         }
 
-        qCInfo(lcDisco) << "Rename detected (up) " << item->_file << " -> " << item->_renameTarget;
+        finalizeWith(path, recurseQueryServer);
     };
-    if (wasDeletedOnClient.first) {
-        recurseQueryServer = wasDeletedOnClient.second == base._etag ? ParentNotChanged : NormalQuery;
-        processRename(path);
-    } else {
-        // We must query the server to know if the etag has not changed
-        _pendingAsyncJobs++;
-        QString serverOriginalPath = _discoveryData->_remoteFolder + _discoveryData->adjustRenamedPath(originalPath, SyncFileItem::Down);
-        if (base.isVirtualFile() && isVfsWithSuffix())
-            chopVirtualFileSuffix(serverOriginalPath);
-        auto job = new RequestEtagJob(_discoveryData->_account, serverOriginalPath, this);
-        connect(job, &RequestEtagJob::finishedWithResult, this, [=](const HttpResult<QByteArray> &etag) mutable {
-
-
-            if (!etag || (etag.get() != base._etag && !item->isDirectory()) || _discoveryData->isRenamed(originalPath)
-                || (isAnyParentBeingRestored(originalPath) && !isRename(originalPath))) {
-                qCInfo(lcDisco) << "Can't rename because the etag has changed or the directory is gone or we are restoring one of the file's parents." << originalPath;
-                // Can't be a rename, leave it as a new.
-                postProcessLocalNew();
-            } else {
-                // In case the deleted item was discovered in parallel
-                _discoveryData->findAndCancelDeletedJob(originalPath);
-                processRename(path);
-                recurseQueryServer = etag.get() == base._etag ? ParentNotChanged : NormalQuery;
-            }
-            processFileFinalize(item, path, item->isDirectory(), NormalQuery, recurseQueryServer);
-            _pendingAsyncJobs--;
-            QTimer::singleShot(0, _discoveryData, &DiscoveryPhase::scheduleMoreJobs);
-        });
-        job->start();
+
+    // Verify the checksum where possible
+    if (!base._checksumHeader.isEmpty() && item->_type == ItemTypeFile && base._type == ItemTypeFile) {
+        computeLocalChecksum(base._checksumHeader, _discoveryData->_localDir + path._original, item,
+            [=](bool computed) mutable {
+                if (computed) {
+                    qCInfo(lcDisco) << "checking checksum of potential rename " << path._original << item->_checksumHeader << base._checksumHeader;
+                    if (item->_checksumHeader != base._checksumHeader) {
+                        qCInfo(lcDisco) << "Not a move, checksums differ";
+                        postProcessLocalNew();
+                        finalizeWith(path, recurseQueryServer);
+                        return;
+                    }
+                }
+                // Another job may have claimed the base file while the checksum was computed
+                if (_discoveryData->isRenamed(originalPath)) {
+                    qCInfo(lcDisco) << "Not a move, base path already renamed";
+                    postProcessLocalNew();
+                    finalizeWith(path, recurseQueryServer);
+                    return;
+                }
+                processMove();
+            });
         return;
     }
 
-    finalize();
+    processMove();
 }
 
 void ProcessDirectoryJob::processFileConflict(const SyncFileItemPtr &item, ProcessDirectoryJob::PathTuple path, const LocalInfo &localEntry, const RemoteInfo &serverEntry, const SyncJournalFileRecord &dbEntry)
@@ -1590,6 +1660,7 @@ void ProcessDirectoryJob::processFileConflict(const SyncFileItemPtr &item, Proce
             rec._etag = serverEntry.etag;
             rec._fileId = serverEntry.fileId;
             rec._modtime = serverEntry.modtime;
+            rec._modtimeNsec = -1;
             rec._type = item->_type;
             rec._fileSize = serverEntry.size;
             rec._remotePerm = serverEntry.remotePerm;
@@ -1701,7 +1772,7 @@ void ProcessDirectoryJob::processBlacklisted(const PathTuple &path, const OCC::L
     item->_originalFile = path._original;
     item->_inode = localEntry.inode;
     item->_isSelectiveSync = true;
-    if (dbEntry.isValid() && ((dbEntry._modtime == localEntry.modtime && dbEntry._fileSize == localEntry.size) || (localEntry.isDirectory && dbEntry.isDirectory()))) {
+    if (dbEntry.isValid() && ((localModTimeUnchanged(dbEntry, localEntry.modtime, localEntry.modtimeNsec) && dbEntry._fileSize == localEntry.size) || (localEntry.isDirectory && dbEntry.isDirectory()))) {
         item->_instruction = CSYNC_INSTRUCTION_REMOVE;
         item->_direction = SyncFileItem::Down;
     } else {
@@ -1769,6 +1840,7 @@ bool ProcessDirectoryJob::checkPermissions(const OCC::SyncFileItemPtr &item)
             // Do a lookup into the csync remote tree to get the metadata we need to restore.
             qSwap(item->_size, item->_previousSize);
             qSwap(item->_modtime, item->_previousModtime);
+            item->_modtimeNsec = -1;
             return false;
         }
         break;
@@ -1973,6 +2045,9 @@ DiscoverySingleDirectoryJob *ProcessDirectoryJob::startAsyncServerQuery()
     if (!_dirItem) {
         serverJob->setIsRootPath(); // query the fingerprint on the root
     }
+    if (canListServerRecursively()) {
+        serverJob->setRecursive();
+    }
 
     connect(serverJob, &DiscoverySingleDirectoryJob::etag, this, &ProcessDirectoryJob::etag);
     _discoveryData->_currentlyActiveJobs++;
@@ -1995,7 +2070,17 @@ DiscoverySingleDirectoryJob *ProcessDirectoryJob::startAsyncServerQuery()
         }
         _discoveryData->_currentlyActiveJobs--;
         _pendingAsyncJobs--;
+        if (serverJob->recursiveListingRefused()) {
+            _discoveryData->_recursiveRemoteListingRefused = true;
+        }
         if (results) {
+            const auto subdirectoryListings = serverJob->takeSubdirectoryListings();
+            for (auto it = subdirectoryListings.cbegin(); it != subdirectoryListings.cend(); ++it) {
+                _discoveryData->_prefetchedRemoteListings.insert(PathTuple::pathAppend(_currentFolder._server, it.key()), it.value());
+            }
+            if (!subdirectoryListings.isEmpty()) {
+                qCInfo(lcDisco) << "Recursive listing of" << _currentFolder._server << "prefetched" << subdirectoryListings.size() << "directories";
+            }
             _serverNormalQueryEntries = *results;
             _serverQueryDone = true;
             if (!serverJob->_dataFingerprint.isEmpty() && _discoveryData->_dataFingerprint.isEmpty())
@@ -2030,56 +2115,107 @@ DiscoverySingleDirectoryJob *ProcessDirectoryJob::startAsyncServerQuery()
     return serverJob;
 }
 
+bool ProcessDirectoryJob::takePrefetchedServerEntries()
+{
+    const auto it = _discoveryData->_prefetchedRemoteListings.find(_currentFolder._server);
+    if (it == _discoveryData->_prefetchedRemoteListings.end()) {
+        return false;
+    }
+    qCDebug(lcDisco) << "Using the prefetched server entries of" << _currentFolder._server;
+    _serverNormalQueryEntries = std::move(it.value());
+    _discoveryData->_prefetchedRemoteListings.erase(it);
+    _serverQueryDone = true;
+    return true;
+}
+
+bool ProcessDirectoryJob::canListServerRecursively() const
+{
+    if (!_discoveryData->_syncOptions._recursiveRemoteListing || _discoveryData->_recursiveRemoteListingRefused) {
+        return false;
+    }
+    if (_dirItem && _dirItem->isEncrypted()) {
+        return false;
+    }
+
+    const auto hasDbEntries = _discoveryData->_statedb->hasFilesInPath(_currentFolder._original.toUtf8());
+    return hasDbEntries && !*hasDbEntries;
+}
+
+bool ProcessDirectoryJob::needsLocalQuery() const
+{
+    return _queryLocal == NormalQuery
+        && (_discoveryData->_shouldDiscoverLocaly(_currentFolder._local)
+            || (_currentFolder._local != _currentFolder._original && _discoveryData->_shouldDiscoverLocaly(_currentFolder._original))
+            || _discoveryData->isInSelectiveSyncBlackList(_currentFolder._original));
+}
+
+void ProcessDirectoryJob::prefetchLocalListings()
+{
+    // The subdirectories are listed in the background while the jobs wait for their turn,
+    // so that at most one directory per running job has to wait for the disk.
+    for (const auto job : _queuedJobs) {
+        if (job->needsLocalQuery()) {
+            _discoveryData->prefetchLocalListing(_discoveryData->_localDir + job->_currentFolder._local);
+        }
+    }
+}
+
 void ProcessDirectoryJob::startAsyncLocalQuery()
 {
-    QString localPath = _discoveryData->_localDir + _currentFolder._local;
-    auto localJob = new DiscoverySingleLocalDirectoryJob(_discoveryData->_account, localPath, _discoveryData->_syncOptions._vfs.data());
+    auto listing = _discoveryData->takeLocalListing(_discoveryData->_localDir + _currentFolder._local);
+    listing->setParent(this);
 
     _discoveryData->_currentlyActiveJobs++;
     _pendingAsyncJobs++;
 
-    connect(localJob, &DiscoverySingleLocalDirectoryJob::itemDiscovered, _discoveryData, &DiscoveryPhase::itemDiscovered);
+    if (listing->isDone()) {
+        QMetaObject::invokeMethod(this, [this, listing] { localListingDone(listing); }, Qt::QueuedConnection);
+    } else {
+        connect(listing, &LocalDirectoryListing::done, this, [this, listing] { localListingDone(listing); });
+    }
+}
 
-    connect(localJob, &DiscoverySingleLocalDirectoryJob::childIgnored, this, [this](bool b) {
-        _childIgnored = b;
-    });
+void ProcessDirectoryJob::localListingDone(LocalDirectoryListing *listing)
+{
+    listing->deleteLater();
 
-    connect(localJob, &DiscoverySingleLocalDirectoryJob::finishedFatalError, this, [this](const QString &msg) {
-        _discoveryData->_currentlyActiveJobs--;
-        _pendingAsyncJobs--;
-        if (_serverJob)
-            _serverJob->abort();
+    for (const auto &item : qAsConst(listing->_ignoredItems)) {
+        emit _discoveryData->itemDiscovered(item);
+    }
+    if (listing->_childIgnored) {
+        _childIgnored = true;
+    }
 
-        emit _discoveryData->fatalError(msg, ErrorCategory::NetworkError);
-    });
+    _discoveryData->_currentlyActiveJobs--;
+    _pendingAsyncJobs--;
 
-    connect(localJob, &DiscoverySingleLocalDirectoryJob::finishedNonFatalError, this, [this](const QString &msg) {
-        _discoveryData->_currentlyActiveJobs--;
-        _pendingAsyncJobs--;
+    switch (listing->_status) {
+    case LocalDirectoryListing::Status::FatalError:
+        if (_serverJob)
+            _serverJob->abort();
 
+        emit _discoveryData->fatalError(listing->_errorString, ErrorCategory::NetworkError);
+        break;
+    case LocalDirectoryListing::Status::NonFatalError:
         if (_dirItem) {
             _dirItem->_instruction = CSYNC_INSTRUCTION_IGNORE;
-            _dirItem->_errorString = msg;
+            _dirItem->_errorString = listing->_errorString;
             emit this->finished();
         } else {
             // Fatal for the root job since it has no SyncFileItem
-            emit _discoveryData->fatalError(msg, ErrorCategory::GenericError);
+            emit _discoveryData->fatalError(listing->_errorString, ErrorCategory::GenericError);
         }
-    });
-
-    connect(localJob, &DiscoverySingleLocalDirectoryJob::finished, this, [this](const auto &results) {
-        _discoveryData->_currentlyActiveJobs--;
-        _pendingAsyncJobs--;
-
-        _localNormalQueryEntries = results;
+        break;
+    case LocalDirectoryListing::Status::Finished:
+        _localNormalQueryEntries = std::move(listing->_results);
         _localQueryDone = true;
 
         if (_serverQueryDone)
             this->process();
-    });
-
-    QThreadPool *pool = QThreadPool::globalInstance();
-    pool->start(localJob); // QThreadPool takes ownership
+        break;
+    case LocalDirectoryListing::Status::Running:
+        Q_UNREACHABLE();
+    }
 }
 
 
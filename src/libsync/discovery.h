@@ -180,6 +180,13 @@ private:
     /// processFile helper for common final processing
     void processFileFinalize(const SyncFileItemPtr &item, PathTuple, bool recurse, QueryMode recurseQueryLocal, QueryMode recurseQueryServer);
 
+    /** Compute the checksum of a local file in the background
+     *
+     * The checksum is of the type indicated by \a header. On success it is
+     * stored in item->_checksumHeader. \a callback is called with whether a
+     * checksum could be computed. This job won't finish before that.
+     */
+    void computeLocalChecksum(const QByteArray &header, const QString &path, const SyncFileItemPtr &item, const std::function<void(bool)> &callback);
 
     /** Checks the permission for this item, if needed, change the item to a restoration item.
      * @return false indicate that this is an error and if it is a directory, one should not recurse
@@ -226,12 +233,33 @@ private:
      */
     DiscoverySingleDirectoryJob *startAsyncServerQuery();
 
+    /** Use the entries of a recursive listing done by a parent job, if there is one
+     *
+     * Fills _serverNormalQueryEntries and sets _serverQueryDone in that case.
+     */
+    bool takePrefetchedServerEntries();
+
+    /** Whether the whole subtree can be listed with a single recursive request
+     *
+     * That is the case for directories the journal knows nothing about yet.
+     */
+    [[nodiscard]] bool canListServerRecursively() const;
+
+    /** Whether the local directory needs to be listed at all */
+    [[nodiscard]] bool needsLocalQuery() const;
+
+    /** Start listing the local directories of the queued subdirectory jobs */
+    void prefetchLocalListings();
+
     /** Discover the local directory
       *
       * Fills _localNormalQueryEntries.
       */
     void startAsyncLocalQuery();
 
+    /** Apply the result of the local listing started by startAsyncLocalQuery() */
+    void localListingDone(LocalDirectoryListing *listing);
+
 
     /** Sets _pinState, the directory's pin state
      *
@@ -34,6 +34,8 @@
 #include <QFile>
 #include <QFileInfo>
 #include <QTextCodec>
+#include <QThread>
+#include <QThreadPool>
 #include <cstring>
 #include <QDateTime>
 
@@ -249,6 +251,29 @@ void DiscoveryPhase::startJob(ProcessDirectoryJob *job)
     job->start();
 }
 
+LocalDirectoryListing *DiscoveryPhase::takeLocalListing(const QString &localPath)
+{
+    if (auto listing = _prefetchedLocalListings.take(localPath)) {
+        return listing;
+    }
+    return new LocalDirectoryListing(_account, localPath, _syncOptions._vfs.data());
+}
+
+void DiscoveryPhase::prefetchLocalListing(const QString &localPath)
+{
+    if (_prefetchedLocalListings.size() >= maximumPrefetchedLocalListings || _prefetchedLocalListings.contains(localPath)) {
+        return;
+    }
+    _prefetchedLocalListings.insert(localPath, new LocalDirectoryListing(_account, localPath, _syncOptions._vfs.data(), this));
+}
+
+void DiscoveryPhase::dropLocalListing(const QString &localPath)
+{
+    if (auto listing = _prefetchedLocalListings.take(localPath)) {
+        listing->deleteLater();
+    }
+}
+
 void DiscoveryPhase::setSelectiveSyncBlackList(const QStringList &list)
 {
     _selectiveSyncBlackList = list;
@@ -336,6 +361,7 @@ void DiscoverySingleLocalDirectoryJob::run() {
             continue;
         }
         i.modtime = dirent->modtime;
+        i.modtimeNsec = dirent->modtime_nsec;
         i.size = dirent->size;
         i.inode = dirent->inode;
         i.isDirectory = dirent->type == ItemTypeDirectory;
@@ -364,6 +390,59 @@ void DiscoverySingleLocalDirectoryJob::run() {
     emit finished(results);
 }
 
+namespace {
+// Listing directories is I/O bound: use more threads than there are cores, separate
+// from the global pool so that other users of it don't wait behind the discovery.
+class LocalDiscoveryThreadPool : public QThreadPool
+{
+public:
+    LocalDiscoveryThreadPool() { setMaxThreadCount(qMax(8, 2 * QThread::idealThreadCount())); }
+};
+}
+
+Q_GLOBAL_STATIC(LocalDiscoveryThreadPool, localDiscoveryThreadPool)
+
+LocalDirectoryListing::LocalDirectoryListing(const AccountPtr &account, const QString &localPath, OCC::Vfs *vfs, QObject *parent)
+    : QObject(parent)
+{
+    auto job = new DiscoverySingleLocalDirectoryJob(account, localPath, vfs);
+
+    connect(job, &DiscoverySingleLocalDirectoryJob::itemDiscovered, this, [this](const SyncFileItemPtr &item) {
+        _ignoredItems.push_back(item);
+    });
+    connect(job, &DiscoverySingleLocalDirectoryJob::childIgnored, this, [this](bool b) {
+        _childIgnored = b;
+    });
+    connect(job, &DiscoverySingleLocalDirectoryJob::finishedFatalError, this, [this](const QString &msg) {
+        setDone(Status::FatalError, msg);
+    });
+    connect(job, &DiscoverySingleLocalDirectoryJob::finishedNonFatalError, this, [this](const QString &msg) {
+        setDone(Status::NonFatalError, msg);
+    });
+    connect(job, &DiscoverySingleLocalDirectoryJob::finished, this, [this](const QVector<LocalInfo> &results) {
+        _results = results;
+        setDone(Status::Finished);
+    });
+    // A path that turned out not to be a directory is considered empty, the job just ends
+    connect(job, &QObject::destroyed, this, [this] {
+        if (!isDone()) {
+            setDone(Status::Finished);
+        }
+    });
+
+    localDiscoveryThreadPool()->start(job); // QThreadPool takes ownership
+}
+
+void LocalDirectoryListing::setDone(Status status, const QString &errorString)
+{
+    if (isDone()) {
+        return;
+    }
+    _status = status;
+    _errorString = errorString;
+    emit done();
+}
+
 DiscoverySingleDirectoryJob::DiscoverySingleDirectoryJob(const AccountPtr &account,
                                                          const QString &path,
                                                          const QSet<QString> &topLevelE2eeFolderPaths,
@@ -413,8 +492,11 @@ void DiscoverySingleDirectoryJob::start()
     }
 
     lsColJob->setProperties(props);
+    if (_recursive) {
+        lsColJob->setDepth(QByteArrayLiteral("infinity"));
+    }
 
-    QObject::connect(lsColJob, &LsColJob::directoryListingIterated,
+    QObject::connect(lsColJob, &LsColJob::knownPropertiesIterated,
         this, &DiscoverySingleDirectoryJob::directoryListingIteratedSlot);
     QObject::connect(lsColJob, &LsColJob::finishedWithError, this, &DiscoverySingleDirectoryJob::lsJobFinishedWithErrorSlot);
     QObject::connect(lsColJob, &LsColJob::finishedWithoutError, this, &DiscoverySingleDirectoryJob::lsJobFinishedWithoutErrorSlot);
@@ -430,6 +512,11 @@ void DiscoverySingleDirectoryJob::abort()
     }
 }
 
+QHash<QString, QVector<RemoteInfo>> DiscoverySingleDirectoryJob::takeSubdirectoryListings()
+{
+    return std::exchange(_subdirectoryListings, {});
+}
+
 bool DiscoverySingleDirectoryJob::isFileDropDetected() const
 {
     return _isFileDropDetected;
@@ -450,21 +537,26 @@ SyncFileItem::EncryptionStatus DiscoverySingleDirectoryJob::requiredEncryptionSt
     return _encryptionStatusRequired;
 }
 
-static void propertyMapToRemoteInfo(const QMap<QString, QString> &map, RemoteInfo &result)
+using Property = LsColXMLParser::Property;
+
+static void propertyMapToRemoteInfo(const LsColXMLParser::KnownProperties &map, RemoteInfo &result)
 {
     for (auto it = map.constBegin(); it != map.constEnd(); ++it) {
-        QString property = it.key();
-        QString value = it.value();
-        if (property == QLatin1String("resourcetype")) {
+        const QString &value = it.value();
+        switch (it.key()) {
+        case Property::ResourceType:
             result.isDirectory = value.contains(QLatin1String("collection"));
-        } else if (property == QLatin1String("getlastmodified")) {
+            break;
+        case Property::GetLastModified: {
             const auto date = QDateTime::fromString(value, Qt::RFC2822Date);
             Q_ASSERT(date.isValid());
             result.modtime = 0;
             if (date.toSecsSinceEpoch() > 0) {
                 result.modtime = date.toSecsSinceEpoch();
             }
-        } else if (property == QLatin1String("getcontentlength")) {
+            break;
+        }
+        case Property::GetContentLength: {
             // See #4573, sometimes negative size values are returned
             bool ok = false;
             qlonglong ll = value.toLongLong(&ok);
@@ -473,20 +565,31 @@ static void propertyMapToRemoteInfo(const QMap<QString, QString> &map, RemoteInf
             } else {
                 result.size = 0;
             }
-        } else if (property == "getetag") {
+            break;
+        }
+        case Property::GetEtag:
             result.etag = Utility::normalizeEtag(value.toUtf8());
-        } else if (property == "id") {
+            break;
+        case Property::Id:
             result.fileId = value.toUtf8();
-        } else if (property == "downloadURL") {
+            break;
+        case Property::DownloadUrl:
             result.directDownloadUrl = value;
-        } else if (property == "dDC") {
+            break;
+        case Property::DDC:
             result.directDownloadCookies = value;
-        } else if (property == "permissions") {
+            break;
+        case Property::Permissions:
             result.remotePerm = RemotePermissions::fromServerString(value);
-        } else if (property == "checksums") {
+            break;
+        case Property::Checksums:
             result.checksumHeader = findBestChecksum(value.toUtf8());
-        } else if (property == "share-types" && !value.isEmpty()) {
-            // Since QMap is sorted, "share-types" is always after "permissions".
+            break;
+        case Property::ShareTypes:
+            if (value.isEmpty()) {
+                break;
+            }
+            // Since QMap is sorted, ShareTypes is always after Permissions.
             if (result.remotePerm.isNull()) {
                 qWarning() << "Server returned a share type, but no permissions?";
             } else {
@@ -497,18 +600,22 @@ static void propertyMapToRemoteInfo(const QMap<QString, QString> &map, RemoteInf
                 result.remotePerm.setPermission(RemotePermissions::IsShared);
                 result.sharedByMe = true;
             }
-        } else if (property == "is-encrypted" && value == QStringLiteral("1")) {
-            result._isE2eEncrypted = true;
-        } else if (property == "lock") {
+            break;
+        case Property::IsEncrypted:
+            if (value == QStringLiteral("1")) {
+                result._isE2eEncrypted = true;
+            }
+            break;
+        case Property::Lock:
             result.locked = (value == QStringLiteral("1") ? SyncFileItem::LockStatus::LockedItem : SyncFileItem::LockStatus::UnlockedItem);
-        }
-        if (property == "lock-owner-displayname") {
+            break;
+        case Property::LockOwnerDisplayName:
             result.lockOwnerDisplayName = value;
-        }
-        if (property == "lock-owner") {
+            break;
+        case Property::LockOwner:
             result.lockOwnerId = value;
-        }
-        if (property == "lock-owner-type") {
+            break;
+        case Property::LockOwnerType: {
             auto ok = false;
             const auto intConvertedValue = value.toULongLong(&ok);
             if (ok) {
@@ -516,11 +623,12 @@ static void propertyMapToRemoteInfo(const QMap<QString, QString> &map, RemoteInf
             } else {
                 result.lockOwnerType = SyncFileItem::LockOwnerType::UserLock;
             }
+            break;
         }
-        if (property == "lock-owner-editor") {
+        case Property::LockOwnerEditor:
             result.lockEditorApp = value;
-        }
-        if (property == "lock-time") {
+            break;
+        case Property::LockTime: {
             auto ok = false;
             const auto intConvertedValue = value.toULongLong(&ok);
             if (ok) {
@@ -528,8 +636,9 @@ static void propertyMapToRemoteInfo(const QMap<QString, QString> &map, RemoteInf
             } else {
                 result.lockTime = 0;
             }
+            break;
         }
-        if (property == "lock-timeout") {
+        case Property::LockTimeout: {
             auto ok = false;
             const auto intConvertedValue = value.toULongLong(&ok);
             if (ok) {
@@ -537,44 +646,51 @@ static void propertyMapToRemoteInfo(const QMap<QString, QString> &map, RemoteInf
             } else {
                 result.lockTimeout = 0;
             }
+            break;
+        }
+        case Property::Size:
+        case Property::FileId:
+        case Property::DataFingerprint:
+        case Property::Unknown:
+            break;
         }
-
     }
 
-    if (result.isDirectory && map.contains("size")) {
-        result.sizeOfFolder = map.value("size").toInt();
+    if (result.isDirectory && map.contains(Property::Size)) {
+        result.sizeOfFolder = map.value(Property::Size).toInt();
     }
 }
 
-void DiscoverySingleDirectoryJob::directoryListingIteratedSlot(const QString &file, const QMap<QString, QString> &map)
+void DiscoverySingleDirectoryJob::directoryListingIteratedSlot(const QString &file, const LsColXMLParser::KnownProperties &map)
 {
     if (!_ignoredFirst) {
         // The first entry is for the folder itself, we should process it differently.
         _ignoredFirst = true;
-        if (map.contains("permissions")) {
-            auto perm = RemotePermissions::fromServerString(map.value("permissions"));
+        _listedHref = file;
+        if (map.contains(Property::Permissions)) {
+            auto perm = RemotePermissions::fromServerString(map.value(Property::Permissions));
             emit firstDirectoryPermissions(perm);
             _isExternalStorage = perm.hasPermission(RemotePermissions::IsMounted);
         }
-        if (map.contains("data-fingerprint")) {
-            _dataFingerprint = map.value("data-fingerprint").toUtf8();
+        if (map.contains(Property::DataFingerprint)) {
+            _dataFingerprint = map.value(Property::DataFingerprint).toUtf8();
             if (_dataFingerprint.isEmpty()) {
                 // Placeholder that means that the server supports the feature even if it did not set one.
                 _dataFingerprint = "[empty]";
             }
         }
-        if (map.contains(QStringLiteral("fileid"))) {
-            _localFileId = map.value(QStringLiteral("fileid")).toUtf8();
+        if (map.contains(Property::FileId)) {
+            _localFileId = map.value(Property::FileId).toUtf8();
         }
-        if (map.contains("id")) {
-            _fileId = map.value("id").toUtf8();
+        if (map.contains(Property::Id)) {
+            _fileId = map.value(Property::Id).toUtf8();
         }
-        if (map.contains("is-encrypted") && map.value("is-encrypted") == QStringLiteral("1")) {
+        if (map.contains(Property::IsEncrypted) && map.value(Property::IsEncrypted) == QStringLiteral("1")) {
             _encryptionStatusCurrent = SyncFileItem::EncryptionStatus::Encrypted;
             Q_ASSERT(!_fileId.isEmpty());
         }
-        if (map.contains("size")) {
-            _size = map.value("size").toInt();
+        if (map.contains(Property::Size)) {
+            _size = map.value(Property::Size).toInt();
         }
     } else {
 
@@ -586,6 +702,26 @@ void DiscoverySingleDirectoryJob::directoryListingIteratedSlot(const QString &fi
         if (result.isDirectory)
             result.size = 0;
 
+        // The entries of a recursive listing belong to the listed directory or to one of its sub directories
+        QString parentPath;
+        if (_recursive) {
+            const auto relativePath = file.mid(_listedHref.size() + 1);
+            parentPath = relativePath.left(qMax(0, relativePath.lastIndexOf('/')));
+            if (result.isDirectory) {
+                if (result.sizeOfFolder == 0 && !_subdirectoryListings.contains(relativePath)) {
+                    // Empty directories are listed as well. Others only get a listing once their
+                    // entries show up, should the server not have gone deep enough they get queried.
+                    _subdirectoryListings.insert(relativePath, {});
+                }
+                if (result.remotePerm.hasPermission(RemotePermissions::IsMounted)) {
+                    _mountedSubdirectories.insert(relativePath);
+                }
+                if (result.isE2eEncrypted()) {
+                    _encryptedSubdirectories.insert(relativePath);
+                }
+            }
+        }
+
         if (_isExternalStorage && result.remotePerm.hasPermission(RemotePermissions::IsMounted)) {
             /* All the entries in a external storage have 'M' in their permission. However, for all
                purposes in the desktop client, we only need to know about the mount points.
@@ -593,13 +729,17 @@ void DiscoverySingleDirectoryJob::directoryListingIteratedSlot(const QString &fi
             result.remotePerm.unsetPermission(RemotePermissions::IsMounted);
             result.remotePerm.setPermission(RemotePermissions::IsMountedSub);
         }
-        _results.push_back(std::move(result));
+        if (parentPath.isEmpty()) {
+            _results.push_back(std::move(result));
+        } else {
+            _subdirectoryListings[parentPath].push_back(std::move(result));
+        }
     }
 
     //This works in concerto with the RequestEtagJob and the Folder object to check if the remote folder changed.
-    if (map.contains("getetag")) {
+    if (map.contains(Property::GetEtag)) {
         if (_firstEtag.isEmpty()) {
-            _firstEtag = parseEtag(map.value(QStringLiteral("getetag")).toUtf8()); // for directory itself
+            _firstEtag = parseEtag(map.value(Property::GetEtag).toUtf8()); // for directory itself
         }
     }
 }
@@ -616,7 +756,10 @@ void DiscoverySingleDirectoryJob::lsJobFinishedWithoutErrorSlot()
         emit finished(HttpError{ 0, _error });
         deleteLater();
         return;
-    } else if (isE2eEncrypted()) {
+    }
+
+    finishSubdirectoryListings();
+    if (isE2eEncrypted()) {
         emit etag(_firstEtag, QDateTime::fromString(QString::fromUtf8(_lsColJob->responseTimestamp()), Qt::RFC2822Date));
         fetchE2eMetadata();
         return;
@@ -626,6 +769,41 @@ void DiscoverySingleDirectoryJob::lsJobFinishedWithoutErrorSlot()
     deleteLater();
 }
 
+void DiscoverySingleDirectoryJob::finishSubdirectoryListings()
+{
+    if (isE2eEncrypted()) {
+        // Names below an encrypted directory are only known from its metadata
+        _subdirectoryListings.clear();
+        return;
+    }
+
+    for (auto it = _subdirectoryListings.begin(); it != _subdirectoryListings.end();) {
+        auto isBelowEncryptedDirectory = false;
+        for (auto path = it.key(); !path.isEmpty(); path = path.left(qMax(0, path.lastIndexOf('/')))) {
+            if (_encryptedSubdirectories.contains(path)) {
+                isBelowEncryptedDirectory = true;
+                break;
+            }
+        }
+        if (isBelowEncryptedDirectory) {
+            // Will be listed on its own, with its metadata
+            it = _subdirectoryListings.erase(it);
+            continue;
+        }
+
+        if (_mountedSubdirectories.contains(it.key())) {
+            // Same as for the entries of an external storage in directoryListingIteratedSlot
+            for (auto &entry : it.value()) {
+                if (entry.remotePerm.hasPermission(RemotePermissions::IsMounted)) {
+                    entry.remotePerm.unsetPermission(RemotePermissions::IsMounted);
+                    entry.remotePerm.setPermission(RemotePermissions::IsMountedSub);
+                }
+            }
+        }
+        ++it;
+    }
+}
+
 void DiscoverySingleDirectoryJob::lsJobFinishedWithErrorSlot(QNetworkReply *r)
 {
     const auto contentType = r->header(QNetworkRequest::ContentTypeHeader).toString();
@@ -636,6 +814,22 @@ void DiscoverySingleDirectoryJob::lsJobFinishedWithErrorSlot(QNetworkReply *r)
     const auto httpCode = r->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
     auto msg = r->errorString();
 
+    if (_recursive && (httpCode == 400 || httpCode == 403 || httpCode == 405 || httpCode == 501)) {
+        // Servers may refuse Depth: infinity (RFC 4918 propfind-finite-depth), list this directory alone
+        qCInfo(lcDiscovery) << "Recursive listing of" << _subPath << "refused with" << httpCode << ", falling back to Depth: 1";
+        _recursive = false;
+        _recursiveListingRefused = true;
+        _ignoredFirst = false;
+        _firstEtag.clear();
+        _listedHref.clear();
+        _results.clear();
+        _subdirectoryListings.clear();
+        _mountedSubdirectories.clear();
+        _encryptedSubdirectories.clear();
+        start();
+        return;
+    }
+
     qCWarning(lcDiscovery) << "LSCOL job error" << r->errorString() << httpCode << r->error();
 
     if (r->error() == QNetworkReply::NoError && invalidContentType) {
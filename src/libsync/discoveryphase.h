@@ -94,6 +94,7 @@ struct LocalInfo
     QString name;
     QString caseClashConflictingName;
     time_t modtime = 0;
+    qint32 modtimeNsec = 0;
     int64_t size = 0;
     uint64_t inode = 0;
     ItemType type = ItemTypeSkip;
@@ -132,6 +133,42 @@ private:
 public:
 };
 
+/**
+ * @brief The outcome of a DiscoverySingleLocalDirectoryJob
+ *
+ * The job runs on the local discovery thread pool, possibly before the
+ * ProcessDirectoryJob of the directory exists. What it reports is kept
+ * here until that job takes it, see DiscoveryPhase::takeLocalListing().
+ */
+class LocalDirectoryListing : public QObject
+{
+    Q_OBJECT
+public:
+    enum class Status {
+        Running,
+        Finished,
+        FatalError,
+        NonFatalError,
+    };
+
+    explicit LocalDirectoryListing(const AccountPtr &account, const QString &localPath, OCC::Vfs *vfs, QObject *parent = nullptr);
+
+    [[nodiscard]] bool isDone() const { return _status != Status::Running; }
+
+    Status _status = Status::Running;
+    QVector<LocalInfo> _results;
+    QString _errorString;
+    // Entries that could not be listed, to be reported with itemDiscovered
+    QVector<SyncFileItemPtr> _ignoredItems;
+    bool _childIgnored = false;
+
+signals:
+    void done();
+
+private:
+    void setDone(Status status, const QString &errorString = {});
+};
+
 class FolderMetadata;
 
 /**
@@ -152,6 +189,16 @@ public:
                                          QObject *parent = nullptr);
     // Specify that this is the root and we need to check the data-fingerprint
     void setIsRootPath() { _isRootPath = true; }
+    /** List the whole subtree with a single Depth: infinity request.
+     *
+     * The listings of the sub directories are available with
+     * takeSubdirectoryListings() once finished. If the server refuses the
+     * request, the job falls back to a Depth: 1 listing.
+     */
+    void setRecursive() { _recursive = true; }
+    [[nodiscard]] bool recursiveListingRefused() const { return _recursiveListingRefused; }
+    /// Maps the path of each sub directory, relative to the listed one, to its entries
+    [[nodiscard]] QHash<QString, QVector<RemoteInfo>> takeSubdirectoryListings();
     void start();
     void abort();
     [[nodiscard]] bool isFileDropDetected() const;
@@ -166,7 +213,7 @@ signals:
     void finished(const OCC::HttpResult<QVector<OCC::RemoteInfo>> &result);
 
 private slots:
-    void directoryListingIteratedSlot(const QString &, const QMap<QString, QString> &);
+    void directoryListingIteratedSlot(const QString &, const OCC::LsColXMLParser::KnownProperties &);
     void lsJobFinishedWithoutErrorSlot();
     void lsJobFinishedWithErrorSlot(QNetworkReply *);
     void fetchE2eMetadata();
@@ -177,6 +224,8 @@ private:
 
     [[nodiscard]] bool isE2eEncrypted() const { return _encryptionStatusCurrent != SyncFileItem::EncryptionStatus::NotEncrypted; }
 
+    void finishSubdirectoryListings();
+
     QVector<RemoteInfo> _results;
     QString _subPath;
     QByteArray _firstEtag;
@@ -203,6 +252,15 @@ private:
     // store top level E2EE folder paths as they are used later when discovering nested folders
     QSet<QString> _topLevelE2eeFolderPaths;
 
+    bool _recursive = false;
+    bool _recursiveListingRefused = false;
+    // The href of the listed directory, the entries of a recursive listing are relative to it
+    QString _listedHref;
+    QHash<QString, QVector<RemoteInfo>> _subdirectoryListings;
+    // Sub directories whose own entry has the 'M' or that are end-to-end encrypted
+    QSet<QString> _mountedSubdirectories;
+    QSet<QString> _encryptedSubdirectories;
+
 public:
     QByteArray _dataFingerprint;
 };
@@ -260,6 +318,34 @@ class DiscoveryPhase : public QObject
 
     int _currentlyActiveJobs = 0;
 
+    /** Server entries of directories that were received as part of the recursive
+     * listing of one of their ancestors, keyed by their server path.
+     *
+     * Taken by the ProcessDirectoryJob of that directory instead of querying the server.
+     */
+    QHash<QString, QVector<RemoteInfo>> _prefetchedRemoteListings;
+
+    // Set once the server refused a recursive listing, it won't be attempted again
+    bool _recursiveRemoteListingRefused = false;
+
+    /** Local listings started ahead of the ProcessDirectoryJob of their directory,
+     * keyed by absolute local path. Bounded by maximumPrefetchedLocalListings.
+     */
+    QHash<QString, LocalDirectoryListing *> _prefetchedLocalListings;
+    static constexpr int maximumPrefetchedLocalListings = 64;
+
+    /** Returns the prefetched listing of the local directory or starts listing it
+     *
+     * The caller takes ownership.
+     */
+    LocalDirectoryListing *takeLocalListing(const QString &localPath);
+
+    /// Starts listing the local directory ahead of time, unless too many listings are pending
+    void prefetchLocalListing(const QString &localPath);
+
+    /// Forgets about a prefetched listing that won't be needed after all
+    void dropLocalListing(const QString &localPath);
+
     // both must contain a sorted list
     QStringList _selectiveSyncBlackList;
     QStringList _selectiveSyncWhiteList;
@@ -343,6 +429,14 @@ signals:
     void itemDiscovered(const OCC::SyncFileItemPtr &item);
     void finished();
 
+    /** The entries of a directory are known and are about to be processed.
+     *
+     * Only emitted when SyncOptions::_streamedPropagation is set. dirItem
+     * is null for the root of the sync. The item of the directory itself
+     * is still emitted through itemDiscovered() once its subtree is done.
+     */
+    void directoryListed(const OCC::SyncFileItemPtr &dirItem);
+
     // A new folder was discovered and was not synced because of the confirmation feature
     void newBigFolder(const QString &folder, bool isExternal);
     void existingFolderNowBig(const QString &folder);
@@ -55,26 +55,32 @@ bool FileSystem::fileEquals(const QString &fn1, const QString &fn2)
     return true;
 }
 
-time_t FileSystem::getModTime(const QString &filename)
+time_t FileSystem::getModTime(const QString &filename, qint32 *modTimeNsec)
 {
     csync_file_stat_t stat;
     time_t result = -1;
     if (csync_vio_local_stat(filename, &stat) != -1 && (stat.modtime != 0)) {
         result = stat.modtime;
+        if (modTimeNsec) {
+            *modTimeNsec = stat.modtime_nsec;
+        }
     } else {
         result = Utility::qDateTimeToTime_t(QFileInfo(filename).lastModified());
+        if (modTimeNsec) {
+            *modTimeNsec = -1;
+        }
         qCWarning(lcFileSystem) << "Could not get modification time for" << filename
                                 << "with csync, using QFileInfo:" << result;
     }
     return result;
 }
 
-bool FileSystem::setModTime(const QString &filename, time_t modTime)
+bool FileSystem::setModTime(const QString &filename, time_t modTime, qint32 modTimeNsec)
 {
-    struct timeval times[2];
+    struct timespec times[2];
     times[0].tv_sec = times[1].tv_sec = modTime;
-    times[0].tv_usec = times[1].tv_usec = 0;
-    int rc = c_utimes(filename, times);
+    times[0].tv_nsec = times[1].tv_nsec = qMax(modTimeNsec, 0);
+    int rc = c_utimens(filename, times);
     if (rc != 0) {
         qCWarning(lcFileSystem) << "Error setting mtime for" << filename
                                 << "failed: rc" << rc << ", errno:" << errno;
@@ -83,24 +89,35 @@ bool FileSystem::setModTime(const QString &filename, time_t modTime)
     return true;
 }
 
+static bool sameModTimeNsec(qint32 previousMtimeNsec, qint32 actualMtimeNsec)
+{
+    return previousMtimeNsec < 0 || actualMtimeNsec < 0 || previousMtimeNsec == actualMtimeNsec;
+}
+
 bool FileSystem::fileChanged(const QString &fileName,
     qint64 previousSize,
-    time_t previousMtime)
+    time_t previousMtime,
+    qint32 previousMtimeNsec)
 {
+    qint32 actualMtimeNsec = -1;
     return getSize(fileName) != previousSize
-        || getModTime(fileName) != previousMtime;
+        || getModTime(fileName, &actualMtimeNsec) != previousMtime
+        || !sameModTimeNsec(previousMtimeNsec, actualMtimeNsec);
 }
 
 bool FileSystem::verifyFileUnchanged(const QString &fileName,
                                      qint64 previousSize,
-                                     time_t previousMtime)
+                                     time_t previousMtime,
+                                     qint32 previousMtimeNsec)
 {
     const auto actualSize = getSize(fileName);
-    const auto actualMtime = getModTime(fileName);
-    if ((actualSize != previousSize && actualMtime > 0) || (actualMtime != previousMtime && previousMtime > 0 && actualMtime > 0)) {
+    qint32 actualMtimeNsec = -1;
+    const auto actualMtime = getModTime(fileName, &actualMtimeNsec);
+    const auto mtimeChanged = actualMtime != previousMtime || !sameModTimeNsec(previousMtimeNsec, actualMtimeNsec);
+    if ((actualSize != previousSize && actualMtime > 0) || (mtimeChanged && previousMtime > 0 && actualMtime > 0)) {
         qCInfo(lcFileSystem) << "File" << fileName << "has changed:"
                              << "size: " << previousSize << "<->" << actualSize
-                             << ", mtime: " << previousMtime << "<->" << actualMtime;
+                             << ", mtime: " << previousMtime << previousMtimeNsec << "<->" << actualMtime << actualMtimeNsec;
         return false;
     }
     return true;
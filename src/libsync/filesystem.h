@@ -50,10 +50,13 @@ namespace FileSystem {
      *
      * Use this over QFileInfo::lastModified() to avoid timezone related bugs. See
      * owncloud/core#9781 for details.
+     *
+     * If \a modTimeNsec is given, it is set to the sub-second part of the mtime,
+     * or to -1 if that could not be determined.
      */
-    time_t OWNCLOUDSYNC_EXPORT getModTime(const QString &filename);
+    time_t OWNCLOUDSYNC_EXPORT getModTime(const QString &filename, qint32 *modTimeNsec = nullptr);
 
-    bool OWNCLOUDSYNC_EXPORT setModTime(const QString &filename, time_t modTime);
+    bool OWNCLOUDSYNC_EXPORT setModTime(const QString &filename, time_t modTime, qint32 modTimeNsec = 0);
 
     /**
      * @brief Get the size for a file
@@ -72,19 +75,23 @@ namespace FileSystem {
      * @brief Check if \a fileName has changed given previous size and mtime
      *
      * Nonexisting files are covered through mtime: they have an mtime of -1.
+     * The sub-second part of the mtime is only compared if \a previousMtimeNsec
+     * is known, i.e. not negative.
      *
      * @return true if the file's mtime or size are not what is expected.
      */
     bool OWNCLOUDSYNC_EXPORT fileChanged(const QString &fileName,
         qint64 previousSize,
-        time_t previousMtime);
+        time_t previousMtime,
+        qint32 previousMtimeNsec = -1);
 
     /**
      * @brief Like !fileChanged() but with verbose logging if the file *did* change.
      */
     bool OWNCLOUDSYNC_EXPORT verifyFileUnchanged(const QString &fileName,
         qint64 previousSize,
-        time_t previousMtime);
+        time_t previousMtime,
+        qint32 previousMtimeNsec = -1);
 
     /**
      * Removes a directory and its contents recursively
@@ -21,9 +21,11 @@
 #include <QStringList>
 #include <QtGlobal>
 #include <QTextCodec>
+#include <QThread>
 #include <qmetaobject.h>
 
 #include <iostream>
+#include <vector>
 
 #ifdef ZLIB_FOUND
 #include <zlib.h>
@@ -37,6 +39,10 @@ namespace {
 
 constexpr int CrashLogSize = 20;
 constexpr auto MaxLogLinesCount = 50000;
+// Must be a power of two
+constexpr size_t AsyncLogQueueSize = 16384;
+// How long the writer sleeps when nobody wakes it up, in ms
+constexpr unsigned long AsyncLogWriteInterval = 100;
 
 static bool compressLog(const QString &originalName, const QString &targetName)
 {
@@ -68,6 +74,84 @@ static bool compressLog(const QString &originalName, const QString &targetName)
 
 namespace OCC {
 
+/**
+ * Bounded queue of formatted log lines with many producers and one consumer.
+ *
+ * Every cell carries a sequence number telling whether it's free for the
+ * producer at that position or filled for the consumer, so pushing only
+ * needs a compare-and-swap on the write position and never blocks.
+ * pop() must only be called by one thread at a time, the Logger calls it
+ * with _mutex held.
+ */
+class Logger::AsyncLogQueue
+{
+public:
+    AsyncLogQueue()
+        : _cells(AsyncLogQueueSize)
+    {
+        for (size_t i = 0; i < AsyncLogQueueSize; ++i) {
+            _cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    /// Returns false and counts the line as dropped if the queue is full
+    bool push(const QString &line)
+    {
+        auto pos = _writePos.load(std::memory_order_relaxed);
+        Cell *cell = nullptr;
+        while (true) {
+            cell = &_cells[pos & (AsyncLogQueueSize - 1)];
+            const auto sequence = cell->sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<qint64>(sequence) - static_cast<qint64>(pos);
+            if (diff == 0) {
+                if (_writePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                _dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            } else {
+                pos = _writePos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->line = line;
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(QString &line)
+    {
+        const auto pos = _readPos.load(std::memory_order_relaxed);
+        auto &cell = _cells[pos & (AsyncLogQueueSize - 1)];
+        if (cell.sequence.load(std::memory_order_acquire) != pos + 1)
+            return false;
+        _readPos.store(pos + 1, std::memory_order_relaxed);
+        line = std::move(cell.line);
+        cell.line = QString();
+        cell.sequence.store(pos + AsyncLogQueueSize, std::memory_order_release);
+        return true;
+    }
+
+    /// Approximate, producers may be pushing concurrently
+    size_t size() const
+    {
+        return _writePos.load(std::memory_order_relaxed) - _readPos.load(std::memory_order_relaxed);
+    }
+
+    quint64 takeDropped() { return _dropped.exchange(0, std::memory_order_relaxed); }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence{0};
+        QString line;
+    };
+
+    std::vector<Cell> _cells;
+    std::atomic<size_t> _writePos{0};
+    std::atomic<size_t> _readPos{0};
+    std::atomic<quint64> _dropped{0};
+};
+
 Logger *Logger::instance()
 {
     static Logger log;
@@ -76,6 +160,7 @@ Logger *Logger::instance()
 
 Logger::Logger(QObject *parent)
     : QObject(parent)
+    , _asyncQueue(new AsyncLogQueue)
 {
     qSetMessagePattern(QStringLiteral("%{time yyyy-MM-dd hh:mm:ss:zzz} [ %{type} %{category} %{file}:%{line} "
                                       "]%{if-debug}\t[ %{function} ]%{endif}:\t%{message}"));
@@ -89,6 +174,7 @@ Logger::Logger(QObject *parent)
 
 Logger::~Logger()
 {
+    setLogAsync(false);
     if (_logstream) {
         _logstream->flush();
     }
@@ -116,7 +202,6 @@ bool Logger::isLoggingToFile() const
 
 void Logger::doLog(QtMsgType type, const QMessageLogContext &ctx, const QString &message)
 {
-    static long long int linesCounter = 0;
     const auto &msg = qFormatLogMessage(type, ctx, message);
 #if defined(Q_OS_WIN) && defined(QT_DEBUG)
     // write logs to Output window of Visual Studio
@@ -142,26 +227,22 @@ void Logger::doLog(QtMsgType type, const QMessageLogContext &ctx, const QString
         OutputDebugString(msgW.c_str());
     }
 #endif
+    if (_async.load(std::memory_order_acquire) && type != QtFatalMsg) {
+        _asyncQueue->push(msg);
+        if (_doFileFlush || _asyncQueue->size() >= AsyncLogQueueSize / 4) {
+            _asyncWakeup.wakeOne();
+        }
+        emit logWindowLog(msg);
+        return;
+    }
     {
         QMutexLocker lock(&_mutex);
 
-        if (linesCounter >= MaxLogLinesCount) {
-            linesCounter = 0;
-            if (_logstream) {
-                _logstream->flush();
-            }
-            closeNoLock();
-            enterNextLogFileNoLock();
-        }
-        ++linesCounter;
-
-        _crashLogIndex = (_crashLogIndex + 1) % CrashLogSize;
-        _crashLog[_crashLogIndex] = msg;
-
-        if (_logstream) {
-            (*_logstream) << msg << "\n";
-            if (_doFileFlush)
-                _logstream->flush();
+        // Lines queued before switching to synchronous logging, or before a fatal message
+        drainAsyncQueueNoLock();
+        writeLogLineNoLock(msg);
+        if (_logstream && _doFileFlush) {
+            _logstream->flush();
         }
         if (type == QtFatalMsg) {
             closeNoLock();
@@ -174,6 +255,89 @@ void Logger::doLog(QtMsgType type, const QMessageLogContext &ctx, const QString
     emit logWindowLog(msg);
 }
 
+void Logger::writeLogLineNoLock(const QString &msg)
+{
+    if (_linesCounter >= MaxLogLinesCount) {
+        _linesCounter = 0;
+        if (_logstream) {
+            _logstream->flush();
+        }
+        closeNoLock();
+        enterNextLogFileNoLock();
+    }
+    ++_linesCounter;
+
+    _crashLogIndex = (_crashLogIndex + 1) % CrashLogSize;
+    _crashLog[_crashLogIndex] = msg;
+
+    if (_logstream) {
+        (*_logstream) << msg << "\n";
+    }
+}
+
+void Logger::drainAsyncQueueNoLock()
+{
+    if (const auto dropped = _asyncQueue->takeDropped()) {
+        writeLogLineNoLock(QStringLiteral("[ Logger ] %1 log lines dropped, the log queue was full").arg(dropped));
+    }
+
+    QString line;
+    bool written = false;
+    while (_asyncQueue->pop(line)) {
+        writeLogLineNoLock(line);
+        written = true;
+    }
+    // One flush per batch instead of one per line
+    if (written && _logstream) {
+        _logstream->flush();
+    }
+}
+
+void Logger::asyncWriterLoop()
+{
+    while (!_asyncStop.load(std::memory_order_acquire)) {
+        {
+            QMutexLocker lock(&_mutex);
+            drainAsyncQueueNoLock();
+        }
+
+        QMutexLocker lock(&_asyncWakeupMutex);
+        if (!_asyncStop.load(std::memory_order_acquire) && _asyncQueue->size() == 0) {
+            // Producers don't take a lock to wake us, so a wakeup can be missed: only wait a bit
+            _asyncWakeup.wait(&_asyncWakeupMutex, AsyncLogWriteInterval);
+        }
+    }
+}
+
+void Logger::setLogAsync(bool async)
+{
+    if (async == _async.load(std::memory_order_acquire)) {
+        return;
+    }
+
+    if (async) {
+        _asyncStop.store(false, std::memory_order_release);
+        _asyncWriter = QThread::create([this] { asyncWriterLoop(); });
+        _asyncWriter->setObjectName(QStringLiteral("LogWriter"));
+        _asyncWriter->start(QThread::LowPriority);
+        _async.store(true, std::memory_order_release);
+        return;
+    }
+
+    _async.store(false, std::memory_order_release);
+    {
+        QMutexLocker lock(&_asyncWakeupMutex);
+        _asyncStop.store(true, std::memory_order_release);
+        _asyncWakeup.wakeOne();
+    }
+    _asyncWriter->wait();
+    delete _asyncWriter;
+    _asyncWriter = nullptr;
+
+    QMutexLocker lock(&_mutex);
+    drainAsyncQueueNoLock();
+}
+
 void Logger::closeNoLock()
 {
     dumpCrashLog();
@@ -226,6 +390,8 @@ void Logger::setLogDebug(bool debug)
         removeLogRule(rules);
     }
     _logDebug = debug;
+    // Debug logging is verbose enough to slow down the sync when written by the logging threads
+    setLogAsync(debug);
 }
 
 QString Logger::temporaryFolderLogDirPath() const
@@ -20,11 +20,16 @@
 #include <QDateTime>
 #include <QFile>
 #include <QTextStream>
+#include <QWaitCondition>
 #include <qmutex.h>
 
+#include <atomic>
+
 #include "common/utility.h"
 #include "owncloudlib.h"
 
+class QThread;
+
 namespace OCC {
 
 /**
@@ -57,6 +62,16 @@ public:
     bool logDebug() const { return _logDebug; }
     void setLogDebug(bool debug);
 
+    /** Whether log lines are written by a background thread.
+     *
+     * The logging threads only format the line and queue it. When the queue
+     * is full, lines are dropped and the number of dropped lines is logged.
+     * Fatal messages are always written directly.
+     * Enabled together with the debug logging by setLogDebug().
+     */
+    bool isLogAsync() const { return _async; }
+    void setLogAsync(bool async);
+
     /** Returns where the automatic logdir would be */
     QString temporaryFolderLogDirPath() const;
 
@@ -94,8 +109,13 @@ private:
     Logger(QObject *parent = nullptr);
     ~Logger() override;
 
+    class AsyncLogQueue;
+
     void closeNoLock();
     void dumpCrashLog();
+    void writeLogLineNoLock(const QString &msg);
+    void drainAsyncQueueNoLock();
+    void asyncWriterLoop();
     void enterNextLogFileNoLock();
     void setLogFileNoLock(const QString &name);
 
@@ -110,6 +130,15 @@ private:
     QSet<QString> _logRules;
     QVector<QString> _crashLog;
     int _crashLogIndex = 0;
+    long long _linesCounter = 0;
+
+    // Lines queued by doLog() in async mode, written by _asyncWriter
+    QScopedPointer<AsyncLogQueue> _asyncQueue;
+    std::atomic<bool> _async{false};
+    std::atomic<bool> _asyncStop{false};
+    QThread *_asyncWriter = nullptr;
+    QMutex _asyncWakeupMutex;
+    QWaitCondition _asyncWakeup;
 };
 
 } // namespace OCC
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "networkjobbudget.h"
+
+#include <QSet>
+
+namespace OCC {
+
+NetworkJobBudget *NetworkJobBudget::instance()
+{
+    static NetworkJobBudget budget;
+    return &budget;
+}
+
+int NetworkJobBudget::limit() const
+{
+    return _limit;
+}
+
+void NetworkJobBudget::setLimit(int limit)
+{
+    _limit = qMax(1, limit);
+}
+
+void NetworkJobBudget::addPropagator(const OwncloudPropagator *propagator, const Account *account)
+{
+    _propagators.insert(propagator, account);
+}
+
+void NetworkJobBudget::removePropagator(const OwncloudPropagator *propagator)
+{
+    _propagators.remove(propagator);
+}
+
+int NetworkJobBudget::share(const OwncloudPropagator *propagator) const
+{
+    const auto it = _propagators.constFind(propagator);
+    if (it == _propagators.constEnd()) {
+        return _limit;
+    }
+
+    QSet<const Account *> accounts;
+    int propagatorsOfAccount = 0;
+    for (auto other = _propagators.constBegin(); other != _propagators.constEnd(); ++other) {
+        accounts.insert(other.value());
+        if (other.value() == it.value()) {
+            ++propagatorsOfAccount;
+        }
+    }
+
+    const auto accountShare = _limit / accounts.size();
+    return qMax(1, accountShare / propagatorsOfAccount);
+}
+
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#pragma once
+
+#include "owncloudlib.h"
+
+#include <QHash>
+
+namespace OCC {
+
+class Account;
+class OwncloudPropagator;
+
+/**
+ * @brief Number of network jobs the running propagations may have in total
+ *
+ * When several folders sync at the same time, the budget is split evenly
+ * between the accounts that are syncing, and the share of an account evenly
+ * between its propagations. A propagation always gets at least one job.
+ *
+ * Only used from the main thread.
+ *
+ * @ingroup libsync
+ */
+class OWNCLOUDSYNC_EXPORT NetworkJobBudget
+{
+public:
+    static NetworkJobBudget *instance();
+
+    /** The number of network jobs shared by all propagations, at least 1 */
+    [[nodiscard]] int limit() const;
+    void setLimit(int limit);
+
+    void addPropagator(const OwncloudPropagator *propagator, const Account *account);
+    void removePropagator(const OwncloudPropagator *propagator);
+
+    /** The number of network jobs \a propagator may currently run */
+    [[nodiscard]] int share(const OwncloudPropagator *propagator) const;
+
+private:
+    NetworkJobBudget() = default;
+
+    int _limit = 20;
+    QHash<const OwncloudPropagator *, const Account *> _propagators;
+};
+
+}
@@ -28,6 +28,7 @@
 #include <QStack>
 #include <QTimer>
 #include <QMutex>
+#include <QMetaMethod>
 #include <QCoreApplication>
 #include <QJsonObject>
 #include <QLoggingCategory>
@@ -192,125 +193,314 @@ static QString readContentsAsString(QXmlStreamReader &reader)
         QXmlStreamReader::TokenType type = reader.readNext();
         if (type == QXmlStreamReader::StartElement) {
             level++;
-            result += "<" + reader.name().toString() + ">";
+            result += QLatin1Char('<');
+            result += reader.name();
+            result += QLatin1Char('>');
         } else if (type == QXmlStreamReader::Characters) {
-            result += reader.text();
+            if (result.isEmpty()) {
+                // The common case of a plain text property: a single allocation of the right size
+                result = reader.text().toString();
+            } else {
+                result += reader.text();
+            }
         } else if (type == QXmlStreamReader::EndElement) {
             level--;
             if (level < 0) {
                 break;
             }
-            result += "</" + reader.name().toString() + ">";
+            result += QLatin1String("</");
+            result += reader.name();
+            result += QLatin1Char('>');
         }
 
     } while (!reader.atEnd());
     return result;
 }
 
+namespace {
+struct PropertyName
+{
+    QLatin1String name;
+    LsColXMLParser::Property property;
+};
+
+const PropertyName propertyNames[] = {
+    { QLatin1String("resourcetype"), LsColXMLParser::Property::ResourceType },
+    { QLatin1String("getlastmodified"), LsColXMLParser::Property::GetLastModified },
+    { QLatin1String("getcontentlength"), LsColXMLParser::Property::GetContentLength },
+    { QLatin1String("getetag"), LsColXMLParser::Property::GetEtag },
+    { QLatin1String("size"), LsColXMLParser::Property::Size },
+    { QLatin1String("id"), LsColXMLParser::Property::Id },
+    { QLatin1String("fileid"), LsColXMLParser::Property::FileId },
+    { QLatin1String("downloadURL"), LsColXMLParser::Property::DownloadUrl },
+    { QLatin1String("dDC"), LsColXMLParser::Property::DDC },
+    { QLatin1String("permissions"), LsColXMLParser::Property::Permissions },
+    { QLatin1String("checksums"), LsColXMLParser::Property::Checksums },
+    { QLatin1String("data-fingerprint"), LsColXMLParser::Property::DataFingerprint },
+    { QLatin1String("share-types"), LsColXMLParser::Property::ShareTypes },
+    { QLatin1String("is-encrypted"), LsColXMLParser::Property::IsEncrypted },
+    { QLatin1String("lock"), LsColXMLParser::Property::Lock },
+    { QLatin1String("lock-owner-displayname"), LsColXMLParser::Property::LockOwnerDisplayName },
+    { QLatin1String("lock-owner"), LsColXMLParser::Property::LockOwner },
+    { QLatin1String("lock-owner-type"), LsColXMLParser::Property::LockOwnerType },
+    { QLatin1String("lock-owner-editor"), LsColXMLParser::Property::LockOwnerEditor },
+    { QLatin1String("lock-time"), LsColXMLParser::Property::LockTime },
+    { QLatin1String("lock-timeout"), LsColXMLParser::Property::LockTimeout },
+};
+}
+
+LsColXMLParser::Property LsColXMLParser::propertyFromName(QStringView name)
+{
+    for (const auto &entry : propertyNames) {
+        if (name == entry.name) {
+            return entry.property;
+        }
+    }
+    return Property::Unknown;
+}
+
+QString LsColXMLParser::internedPropertyName(Property property)
+{
+    static const auto names = [] {
+        QVector<QString> result(static_cast<int>(Property::LockTimeout) + 1);
+        for (const auto &entry : propertyNames) {
+            result[static_cast<int>(entry.property)] = QString(entry.name);
+        }
+        return result;
+    }();
+
+    return names.at(static_cast<int>(property));
+}
+
+// Whether QUrl would hand back the decoded href unchanged, which is true for most of them.
+// Anything that might need normalization or that QUrl might re-encode takes the slow path.
+static bool isPlainPath(QStringView path)
+{
+    QChar previous;
+    for (const auto c : path) {
+        const auto u = c.unicode();
+        if (u == '/' || u == '.') {
+            if (previous == QLatin1Char('/')) {
+                return false; // "//", "/." or "/.."
+            }
+        } else if (u < 0x80) {
+            if (!c.isLetterOrNumber() && !QStringView(u" -_~()+,@").contains(c)) {
+                return false;
+            }
+        } else if (!c.isLetterOrNumber()) {
+            return false;
+        }
+        previous = c;
+    }
+    return true;
+}
+
+static QString normalizedHref(const QString &href)
+{
+    // We don't use URL encoding in our request URL (which is the expected path) (QNAM will do it for us)
+    // but the result will have URL encoding..
+    const auto decoded = href.contains(QLatin1Char('%')) ? QUrl::fromPercentEncoding(href.toUtf8()) : href;
+    if (isPlainPath(decoded)) {
+        return decoded;
+    }
+    return QUrl::fromLocalFile(decoded)
+        .adjusted(QUrl::NormalizePathSegments)
+        .path();
+}
+
+// Returns the position right after the last complete </d:response> end tag in data, or -1.
+// A '<' cannot appear unescaped in character data, so the last one before the match is a tag start.
+static qsizetype endOfLastResponse(const QByteArray &data)
+{
+    static const QByteArray responseTag("response>");
+    auto index = data.lastIndexOf(responseTag);
+    while (index > 0) {
+        const auto tagStart = data.lastIndexOf('<', index);
+        if (tagStart >= 0 && data.at(tagStart + 1) == '/') {
+            const auto prefix = data.mid(tagStart + 2, index - tagStart - 2);
+            if (prefix.isEmpty() || (prefix.endsWith(':') && !prefix.contains('>'))) {
+                return index + responseTag.size();
+            }
+        }
+        index = data.lastIndexOf(responseTag, index - 1);
+    }
+    return -1;
+}
 
 LsColXMLParser::LsColXMLParser() = default;
 
 bool LsColXMLParser::parse(const QByteArray &xml, QHash<QString, ExtraFolderInfo> *fileInfo, const QString &expectedPath)
 {
-    // Parse DAV response
-    QXmlStreamReader reader(xml);
-    reader.addExtraNamespaceDeclaration(QXmlStreamNamespaceDeclaration("d", "DAV:"));
+    start(fileInfo, expectedPath);
+    return addData(xml) && finish();
+}
 
-    QStringList folders;
-    QString currentHref;
-    QMap<QString, QString> currentTmpProperties;
-    QMap<QString, QString> currentHttp200Properties;
-    bool currentPropsHaveHttp200 = false;
-    bool insidePropstat = false;
-    bool insideProp = false;
-    bool insideMultiStatus = false;
+void LsColXMLParser::start(QHash<QString, ExtraFolderInfo> *fileInfo, const QString &expectedPath)
+{
+    _reader.clear();
+    _reader.addExtraNamespaceDeclaration(QXmlStreamNamespaceDeclaration("d", "DAV:"));
+    _pending.clear();
+    _fileInfo = fileInfo;
+    _expectedPath = expectedPath;
 
-    while (!reader.atEnd()) {
-        QXmlStreamReader::TokenType type = reader.readNext();
-        QString name = reader.name().toString();
+    _folders.clear();
+    _currentHref.clear();
+    _currentTmpProperties.clear();
+    _currentTmpUnknownProperties.clear();
+    _currentHttp200Properties.clear();
+    _currentHttp200UnknownProperties.clear();
+    _currentPropsHaveHttp200 = false;
+    _insidePropstat = false;
+    _insideProp = false;
+    _insideMultiStatus = false;
+    _failed = false;
+}
+
+bool LsColXMLParser::addData(const QByteArray &data)
+{
+    if (_failed) {
+        return false;
+    }
+    _pending += data;
+
+    // Only hand complete responses to the reader: readElementText() and readContentsAsString()
+    // cannot resume when the data ends in the middle of an element.
+    const auto end = endOfLastResponse(_pending);
+    if (end < 0) {
+        return true;
+    }
+    _reader.addData(_pending.left(end));
+    _pending.remove(0, end);
+    return parseAvailable();
+}
+
+bool LsColXMLParser::finish()
+{
+    if (_failed) {
+        return false;
+    }
+    _reader.addData(_pending);
+    _pending.clear();
+    if (!parseAvailable()) {
+        return false;
+    }
+
+    if (_reader.hasError()) {
+        // Truncated document. Whatever had been emitted before will come as directoryListingIterated
+        qCWarning(lcLsColJob) << "ERROR" << _reader.errorString();
+        _failed = true;
+        return false;
+    } else if (!_insideMultiStatus) {
+        qCWarning(lcLsColJob) << "ERROR no WebDAV response?";
+        _failed = true;
+        return false;
+    }
+    emit directoryListingSubfolders(_folders);
+    emit finishedWithoutError();
+    return true;
+}
+
+bool LsColXMLParser::parseAvailable()
+{
+    auto &reader = _reader;
+
+    // readNext() resumes after a PrematureEndOfDocumentError once more data was added
+    for (auto type = reader.readNext(); type != QXmlStreamReader::Invalid; type = reader.readNext()) {
+        if (type == QXmlStreamReader::EndDocument) {
+            break;
+        }
+        const auto name = reader.name();
         // Start elements with DAV:
         if (type == QXmlStreamReader::StartElement && reader.namespaceUri() == QLatin1String("DAV:")) {
             if (name == QLatin1String("href")) {
-                // We don't use URL encoding in our request URL (which is the expected path) (QNAM will do it for us)
-                // but the result will have URL encoding..
-                QString hrefString = QUrl::fromLocalFile(QUrl::fromPercentEncoding(reader.readElementText().toUtf8()))
-                        .adjusted(QUrl::NormalizePathSegments)
-                        .path();
-                if (!hrefString.startsWith(expectedPath)) {
-                    qCWarning(lcLsColJob) << "Invalid href" << hrefString << "expected starting with" << expectedPath;
+                QString hrefString = normalizedHref(reader.readElementText());
+                if (!hrefString.startsWith(_expectedPath)) {
+                    qCWarning(lcLsColJob) << "Invalid href" << hrefString << "expected starting with" << _expectedPath;
+                    _failed = true;
                     return false;
                 }
-                currentHref = hrefString;
+                _currentHref = hrefString;
             } else if (name == QLatin1String("response")) {
             } else if (name == QLatin1String("propstat")) {
-                insidePropstat = true;
-            } else if (name == QLatin1String("status") && insidePropstat) {
-                QString httpStatus = reader.readElementText();
-                if (httpStatus.startsWith("HTTP/1.1 200")) {
-                    currentPropsHaveHttp200 = true;
+                _insidePropstat = true;
+            } else if (name == QLatin1String("status") && _insidePropstat) {
+                const QString httpStatus = reader.readElementText();
+                if (httpStatus.startsWith(QLatin1String("HTTP/1.1 200"))) {
+                    _currentPropsHaveHttp200 = true;
                 } else {
-                    currentPropsHaveHttp200 = false;
+                    _currentPropsHaveHttp200 = false;
                 }
             } else if (name == QLatin1String("prop")) {
-                insideProp = true;
+                _insideProp = true;
                 continue;
             } else if (name == QLatin1String("multistatus")) {
-                insideMultiStatus = true;
+                _insideMultiStatus = true;
                 continue;
             }
         }
 
-        if (type == QXmlStreamReader::StartElement && insidePropstat && insideProp) {
-            // All those elements are properties
+        if (type == QXmlStreamReader::StartElement && _insidePropstat && _insideProp) {
+            // All those elements are properties, name is only valid until the reader moves on
+            const auto property = propertyFromName(name);
+            const auto unknownPropertyName = property == Property::Unknown ? name.toString() : QString();
             QString propertyContent = readContentsAsString(reader);
-            if (name == QLatin1String("resourcetype") && propertyContent.contains("collection")) {
-                folders.append(currentHref);
-            } else if (name == QLatin1String("size")) {
+            if (property == Property::ResourceType && propertyContent.contains(QLatin1String("collection"))) {
+                _folders.append(_currentHref);
+            } else if (property == Property::Size) {
                 bool ok = false;
                 auto s = propertyContent.toLongLong(&ok);
-                if (ok && fileInfo) {
-                    (*fileInfo)[currentHref].size = s;
+                if (ok && _fileInfo) {
+                    (*_fileInfo)[_currentHref].size = s;
                 }
-            } else if (name == QLatin1String("fileid")) {
-                (*fileInfo)[currentHref].fileId = propertyContent.toUtf8();
+            } else if (property == Property::FileId) {
+                (*_fileInfo)[_currentHref].fileId = propertyContent.toUtf8();
+            }
+            if (property == Property::Unknown) {
+                _currentTmpUnknownProperties.insert(unknownPropertyName, propertyContent);
+            } else {
+                _currentTmpProperties.insert(property, propertyContent);
             }
-            currentTmpProperties.insert(reader.name().toString(), propertyContent);
         }
 
         // End elements with DAV:
         if (type == QXmlStreamReader::EndElement) {
             if (reader.namespaceUri() == QLatin1String("DAV:")) {
-                if (reader.name() == "response") {
-                    if (currentHref.endsWith('/')) {
-                        currentHref.chop(1);
+                if (reader.name() == QLatin1String("response")) {
+                    if (_currentHref.endsWith('/')) {
+                        _currentHref.chop(1);
+                    }
+                    if (isSignalConnected(QMetaMethod::fromSignal(&LsColXMLParser::directoryListingIterated))) {
+                        auto properties = _currentHttp200UnknownProperties;
+                        for (auto it = _currentHttp200Properties.constBegin(); it != _currentHttp200Properties.constEnd(); ++it) {
+                            properties.insert(internedPropertyName(it.key()), it.value());
+                        }
+                        emit directoryListingIterated(_currentHref, properties);
                     }
-                    emit directoryListingIterated(currentHref, currentHttp200Properties);
-                    currentHref.clear();
-                    currentHttp200Properties.clear();
-                } else if (reader.name() == "propstat") {
-                    insidePropstat = false;
-                    if (currentPropsHaveHttp200) {
-                        currentHttp200Properties = QMap<QString, QString>(currentTmpProperties);
+                    emit knownPropertiesIterated(_currentHref, _currentHttp200Properties);
+                    _currentHref.clear();
+                    _currentHttp200Properties.clear();
+                    _currentHttp200UnknownProperties.clear();
+                } else if (reader.name() == QLatin1String("propstat")) {
+                    _insidePropstat = false;
+                    if (_currentPropsHaveHttp200) {
+                        _currentHttp200Properties = _currentTmpProperties;
+                        _currentHttp200UnknownProperties = _currentTmpUnknownProperties;
                     }
-                    currentTmpProperties.clear();
-                    currentPropsHaveHttp200 = false;
-                } else if (reader.name() == "prop") {
-                    insideProp = false;
+                    _currentTmpProperties.clear();
+                    _currentTmpUnknownProperties.clear();
+                    _currentPropsHaveHttp200 = false;
+                } else if (reader.name() == QLatin1String("prop")) {
+                    _insideProp = false;
                 }
             }
         }
     }
 
-    if (reader.hasError()) {
+    if (reader.hasError() && reader.error() != QXmlStreamReader::PrematureEndOfDocumentError) {
         // XML Parser error? Whatever had been emitted before will come as directoryListingIterated
-        qCWarning(lcLsColJob) << "ERROR" << reader.errorString() << xml;
-        return false;
-    } else if (!insideMultiStatus) {
-        qCWarning(lcLsColJob) << "ERROR no WebDAV response?" << xml;
+        qCWarning(lcLsColJob) << "ERROR" << reader.errorString();
+        _failed = true;
         return false;
-    } else {
-        emit directoryListingSubfolders(folders);
-        emit finishedWithoutError();
     }
     return true;
 }
@@ -338,6 +528,11 @@ QList<QByteArray> LsColJob::properties() const
     return _properties;
 }
 
+void LsColJob::setDepth(const QByteArray &depth)
+{
+    _depth = depth;
+}
+
 void LsColJob::start()
 {
     QList<QByteArray> properties = _properties;
@@ -361,7 +556,7 @@ void LsColJob::start()
     }
 
     QNetworkRequest req;
-    req.setRawHeader("Depth", "1");
+    req.setRawHeader("Depth", _depth);
     QByteArray xml("<?xml version=\"1.0\" ?>\n"
                    "<d:propfind xmlns:d=\"DAV:\" xmlns:oc=\"http://owncloud.org/ns\">\n"
                    "  <d:prop>\n"
@@ -378,41 +573,64 @@ void LsColJob::start()
     AbstractNetworkJob::start();
 }
 
-// TODO: Instead of doing all in this slot, we should iteratively parse in readyRead(). This
-// would allow us to be more asynchronous in processing while data is coming from the network,
-// not all in one big blob at the end.
-bool LsColJob::finished()
+void LsColJob::newReplyHook(QNetworkReply *reply)
 {
-    qCInfo(lcLsColJob) << "LSCOL of" << reply()->request().url() << "FINISHED WITH STATUS"
-                       << replyStatusString();
+    // A redirected or re-authenticated request starts a new document
+    _parser.reset();
+    connect(reply, &QIODevice::readyRead, this, &LsColJob::slotReadyRead);
+}
 
+bool LsColJob::isMultiStatusReply() const
+{
     const auto contentType = reply()->header(QNetworkRequest::ContentTypeHeader).toString();
     const auto httpCode = reply()->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
     const auto validContentType = contentType.contains("application/xml; charset=utf-8") ||
                                   contentType.contains("application/xml; charset=\"utf-8\"") ||
                                   contentType.contains("text/xml; charset=utf-8") ||
                                   contentType.contains("text/xml; charset=\"utf-8\"");
+    return httpCode == 207 && validContentType;
+}
+
+void LsColJob::slotReadyRead()
+{
+    // Leave other bodies alone, they are needed for the error message
+    if (!reply() || !isMultiStatusReply()) {
+        return;
+    }
 
-    if (httpCode == 207 && validContentType) {
-        LsColXMLParser parser;
-        connect(&parser, &LsColXMLParser::directoryListingSubfolders,
+    if (!_parser) {
+        _parser = std::make_unique<LsColXMLParser>();
+        connect(_parser.get(), &LsColXMLParser::directoryListingSubfolders,
             this, &LsColJob::directoryListingSubfolders);
-        connect(&parser, &LsColXMLParser::directoryListingIterated,
-            this, &LsColJob::directoryListingIterated);
-        connect(&parser, &LsColXMLParser::finishedWithError,
+        // Only build the property maps keyed by name when someone needs them
+        if (isSignalConnected(QMetaMethod::fromSignal(&LsColJob::directoryListingIterated))) {
+            connect(_parser.get(), &LsColXMLParser::directoryListingIterated,
+                this, &LsColJob::directoryListingIterated);
+        }
+        connect(_parser.get(), &LsColXMLParser::knownPropertiesIterated,
+            this, &LsColJob::knownPropertiesIterated);
+        connect(_parser.get(), &LsColXMLParser::finishedWithError,
             this, &LsColJob::finishedWithError);
-        connect(&parser, &LsColXMLParser::finishedWithoutError,
+        connect(_parser.get(), &LsColXMLParser::finishedWithoutError,
             this, &LsColJob::finishedWithoutError);
 
-        // bool LsColXMLParser::parse takes a while, let's process some events in attempt to make UI more responsive
-        // from https://doc.qt.io/qt-5/qcoreapplication.html#processEvents-1 
-        // "You can call this function occasionally when your program is busy doing a long operation (e.g. copying a file)."
-        // we should not abuse this function, as it affects QObject instances lifetime (when children are getting deleted or when deleteLater is called)
-        // one reason I had to remove ability for LsColJob to have parent, which, otherwise, leads to a crash later
-        QCoreApplication::processEvents(QEventLoop::AllEvents, 100);
+        const QString expectedPath = reply()->request().url().path(); // something like "/owncloud/remote.php/dav/folder"
+        _parser->start(&_folderInfos, expectedPath);
+    }
+
+    // Once the document is known to be invalid the rest of it is drained and dropped
+    _parser->addData(reply()->readAll());
+}
+
+bool LsColJob::finished()
+{
+    qCInfo(lcLsColJob) << "LSCOL of" << reply()->request().url() << "FINISHED WITH STATUS"
+                       << replyStatusString();
 
-        QString expectedPath = reply()->request().url().path(); // something like "/owncloud/remote.php/dav/folder"
-        if (!parser.parse(reply()->readAll(), &_folderInfos, expectedPath)) {
+    if (isMultiStatusReply()) {
+        // Parse whatever arrived after the last readyRead
+        slotReadyRead();
+        if (!_parser->finish()) {
             // XML parse error
             emit finishedWithError(reply());
         }
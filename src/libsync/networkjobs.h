@@ -17,6 +17,9 @@
 #define NETWORKJOBS_H
 
 #include <QBuffer>
+#include <QXmlStreamReader>
+
+#include <memory>
 
 #include "abstractnetworkjob.h"
 
@@ -123,17 +126,107 @@ class OWNCLOUDSYNC_EXPORT LsColXMLParser : public QObject
 {
     Q_OBJECT
 public:
+    /** The properties the client requests, identified by their local name */
+    enum class Property {
+        Unknown,
+        ResourceType,
+        GetLastModified,
+        GetContentLength,
+        GetEtag,
+        Size,
+        Id,
+        FileId,
+        DownloadUrl,
+        DDC,
+        Permissions,
+        Checksums,
+        DataFingerprint,
+        ShareTypes,
+        IsEncrypted,
+        Lock,
+        LockOwnerDisplayName,
+        LockOwner,
+        LockOwnerType,
+        LockOwnerEditor,
+        LockTime,
+        LockTimeout,
+    };
+
+    /** The values of the known properties of an entry, ordered like Property */
+    using KnownProperties = QMap<Property, QString>;
+
     explicit LsColXMLParser();
 
+    [[nodiscard]] static Property propertyFromName(QStringView name);
+
+    /**
+     * The name of a known property is shared between all property maps
+     * emitted with directoryListingIterated instead of allocated per entry.
+     *
+     * Empty for Property::Unknown.
+     */
+    [[nodiscard]] static QString internedPropertyName(Property property);
+
+    /**
+     * Parses a complete multistatus document.
+     *
+     * Equivalent to start(), addData() and finish() in one go.
+     */
     bool parse(const QByteArray &xml,
                QHash<QString, ExtraFolderInfo> *sizes,
                const QString &expectedPath);
 
+    /**
+     * Starts an incremental parse. The document is then passed in pieces
+     * with addData() as it arrives and completed with finish().
+     */
+    void start(QHash<QString, ExtraFolderInfo> *sizes, const QString &expectedPath);
+
+    /**
+     * Parses every <d:response> that is complete once \a data is appended,
+     * directoryListingIterated is emitted for each of them.
+     *
+     * Returns false if the document is invalid.
+     */
+    bool addData(const QByteArray &data);
+
+    /**
+     * Parses the rest of the document and emits directoryListingSubfolders
+     * and finishedWithoutError if it was complete and valid.
+     */
+    bool finish();
+
 signals:
     void directoryListingSubfolders(const QStringList &items);
     void directoryListingIterated(const QString &name, const QMap<QString, QString> &properties);
+    /**
+     * Emitted together with directoryListingIterated, with the known properties only.
+     *
+     * The property map of directoryListingIterated is only built when that signal is connected.
+     */
+    void knownPropertiesIterated(const QString &name, const OCC::LsColXMLParser::KnownProperties &properties);
     void finishedWithError(QNetworkReply *reply);
     void finishedWithoutError();
+
+private:
+    bool parseAvailable();
+
+    QXmlStreamReader _reader;
+    QByteArray _pending; // data after the last complete <d:response>
+    QHash<QString, ExtraFolderInfo> *_fileInfo = nullptr;
+    QString _expectedPath;
+
+    QStringList _folders;
+    QString _currentHref;
+    KnownProperties _currentTmpProperties;
+    QMap<QString, QString> _currentTmpUnknownProperties;
+    KnownProperties _currentHttp200Properties;
+    QMap<QString, QString> _currentHttp200UnknownProperties;
+    bool _currentPropsHaveHttp200 = false;
+    bool _insidePropstat = false;
+    bool _insideProp = false;
+    bool _insideMultiStatus = false;
+    bool _failed = false;
 };
 
 class OWNCLOUDSYNC_EXPORT LsColJob : public AbstractNetworkJob
@@ -156,18 +249,36 @@ public:
     void setProperties(QList<QByteArray> properties);
     [[nodiscard]] QList<QByteArray> properties() const;
 
+    /**
+     * The Depth header of the request, "1" by default.
+     *
+     * With "infinity" the listing covers the whole subtree.
+     */
+    void setDepth(const QByteArray &depth);
+
 signals:
     void directoryListingSubfolders(const QStringList &items);
     void directoryListingIterated(const QString &name, const QMap<QString, QString> &properties);
+    void knownPropertiesIterated(const QString &name, const OCC::LsColXMLParser::KnownProperties &properties);
     void finishedWithError(QNetworkReply *reply);
     void finishedWithoutError();
 
+protected:
+    void newReplyHook(QNetworkReply *reply) override;
+
 private slots:
     bool finished() override;
+    void slotReadyRead();
 
 private:
+    [[nodiscard]] bool isMultiStatusReply() const;
+
     QList<QByteArray> _properties;
+    QByteArray _depth = QByteArrayLiteral("1");
     QUrl _url; // Used instead of path() if the url is specified in the constructor
+
+    // Fed from readyRead so that entries are processed while the listing is still arriving
+    std::unique_ptr<LsColXMLParser> _parser;
 };
 
 /**
@@ -32,6 +32,9 @@
 #include "discoveryphase.h"
 #include "syncfileitem.h"
 #include "foldermetadata.h"
+#include "common/checksums.h"
+#include "vio/csync_vio_local.h"
+#include "networkjobbudget.h"
 
 #ifdef Q_OS_WIN
 #include <windef.h>
@@ -48,6 +51,8 @@
 #include <QRegularExpression>
 #include <qmath.h>
 
+#include <utility>
+
 namespace OCC {
 
 Q_LOGGING_CATEGORY(lcPropagator, "nextcloud.sync.propagator", QtInfoMsg)
@@ -81,18 +86,20 @@ qint64 freeSpaceLimit()
     return value;
 }
 
-OwncloudPropagator::~OwncloudPropagator() = default;
+OwncloudPropagator::~OwncloudPropagator()
+{
+    NetworkJobBudget::instance()->removePropagator(this);
+}
 
 
 int OwncloudPropagator::maximumActiveTransferJob()
 {
-    if (_downloadLimit != 0
-        || _uploadLimit != 0
-        || !_syncOptions._parallelNetworkJobs) {
-        // disable parallelism when there is a network limit.
+    if (!_syncOptions._parallelNetworkJobs) {
         return 1;
     }
-    return qMin(3, qCeil(_syncOptions._parallelNetworkJobs / 2.));
+    // Network limits don't need to disable parallelism, the BandwidthManager
+    // shares its quota between all running transfers.
+    return qMin(3, qCeil(parallelNetworkJobs() / 2.));
 }
 
 /* The maximum number of active jobs in parallel  */
@@ -100,7 +107,13 @@ int OwncloudPropagator::hardMaximumActiveJob()
 {
     if (!_syncOptions._parallelNetworkJobs)
         return 1;
-    return _syncOptions._parallelNetworkJobs;
+    return parallelNetworkJobs();
+}
+
+int OwncloudPropagator::parallelNetworkJobs() const
+{
+    // Other folders may be syncing at the same time, only use our share
+    return qMin(_syncOptions._parallelNetworkJobs, NetworkJobBudget::instance()->share(this));
 }
 
 PropagateItemJob::~PropagateItemJob()
@@ -514,6 +527,7 @@ void OwncloudPropagator::start(SyncFileItemVector &&items)
     Q_ASSERT(std::is_sorted(items.begin(), items.end()));
 
     _abortRequested = false;
+    NetworkJobBudget::instance()->addPropagator(this, _account.data());
 
     /* This builds all the jobs needed for the propagation.
      * Each directory is a PropagateDirectory job, which contains the files in it.
@@ -553,6 +567,112 @@ void OwncloudPropagator::start(SyncFileItemVector &&items)
 
     resetDelayedUploadTasks();
     _rootJob.reset(new PropagateRootDirectory(this));
+    appendItemsToJobTree(items);
+
+    connect(_rootJob.data(), &PropagatorJob::finished, this, &OwncloudPropagator::emitFinished);
+
+    _jobScheduled = false;
+    _schedulingDuration = {};
+    _schedulingPasses = 0;
+    scheduleNextJob();
+}
+
+void OwncloudPropagator::startStreaming()
+{
+    _abortRequested = false;
+    _isStreaming = true;
+    NetworkJobBudget::instance()->addPropagator(this, _account.data());
+
+    resetDelayedUploadTasks();
+    _rootJob.reset(new PropagateRootDirectory(this));
+    _rootJob->_subJobs._awaitingMoreJobs = true;
+
+    connect(_rootJob.data(), &PropagatorJob::finished, this, &OwncloudPropagator::emitFinished);
+
+    _jobScheduled = false;
+    _schedulingDuration = {};
+    _schedulingPasses = 0;
+}
+
+void OwncloudPropagator::appendStreamedItem(const SyncFileItemPtr &item)
+{
+    ASSERT(_isStreaming);
+
+    const auto parentJob = streamedParentDirectory(item->_file);
+    if (!parentJob || parentJob->_state == PropagatorJob::Finished) {
+        // The parent directory job failed already, its children are not propagated either
+        qCInfo(lcPropagator) << "Skipping streamed item of a finished directory job" << item->_file << item->_instruction;
+        return;
+    }
+
+    if (item->isDirectory()) {
+        const auto directoryJob = new PropagateDirectory(this, item);
+        directoryJob->_subJobs._awaitingMoreJobs = true;
+        parentJob->appendJob(directoryJob);
+        _streamedDirectories.insert(item->_file, directoryJob);
+    } else {
+        parentJob->appendTask(item);
+    }
+
+    scheduleNextJob();
+}
+
+void OwncloudPropagator::finishStreaming(SyncFileItemVector &&items)
+{
+    Q_ASSERT(std::is_sorted(items.begin(), items.end()));
+    ASSERT(_isStreaming);
+
+    adjustDeletedFoldersWithNewChildren(items);
+    appendItemsToJobTree(items);
+
+    // Everything is known now, let the directories finish
+    const auto streamedDirectories = std::exchange(_streamedDirectories, {});
+    for (const auto &directoryJob : streamedDirectories) {
+        if (directoryJob) {
+            directoryJob->_subJobs.stopAwaitingMoreJobs();
+        }
+    }
+    _rootJob->_subJobs.stopAwaitingMoreJobs();
+    _isStreaming = false;
+
+    scheduleNextJob();
+}
+
+PropagateDirectory *OwncloudPropagator::streamedParentDirectory(const QString &path) const
+{
+    auto parentPath = path;
+    for (auto index = parentPath.lastIndexOf(QLatin1Char('/')); index > 0; index = parentPath.lastIndexOf(QLatin1Char('/'))) {
+        parentPath.truncate(index);
+        const auto it = _streamedDirectories.constFind(parentPath);
+        if (it != _streamedDirectories.constEnd()) {
+            return it->data();
+        }
+    }
+    return _rootJob.data();
+}
+
+void OwncloudPropagator::pushStreamedParentDirectories(const QString &path, QStack<QPair<QString, PropagateDirectory *>> &directories) const
+{
+    QVector<QPair<QString, PropagateDirectory *>> parentDirectories;
+    auto parentPath = path;
+    for (auto index = parentPath.lastIndexOf(QLatin1Char('/')); index > 0; index = parentPath.lastIndexOf(QLatin1Char('/'))) {
+        parentPath.truncate(index);
+        if (parentPath.size() < directories.top().first.size()) {
+            // Everything above is on the stack already
+            break;
+        }
+        const auto directoryJob = _streamedDirectories.value(parentPath);
+        if (directoryJob) {
+            parentDirectories.prepend(qMakePair(parentPath + QLatin1Char('/'), directoryJob.data()));
+        }
+    }
+    for (const auto &parentDirectory : parentDirectories) {
+        directories.push(parentDirectory);
+    }
+}
+
+void OwncloudPropagator::appendItemsToJobTree(const SyncFileItemVector &items)
+{
     QStack<QPair<QString /* directory name */, PropagateDirectory * /* job */>> directories;
     directories.push(qMakePair(QString(), _rootJob.data()));
     QVector<PropagatorJob *> directoriesToRemove;
@@ -605,6 +725,10 @@ void OwncloudPropagator::start(SyncFileItemVector &&items)
         while (!item->destination().startsWith(directories.top().first)) {
             directories.pop();
         }
+        if (!_streamedDirectories.isEmpty()) {
+            // The jobs of streamed directories exist already, their remaining children go there
+            pushStreamedParentDirectories(item->destination(), directories);
+        }
 
         if (item->isDirectory()) {
             startDirectoryPropagation(item,
@@ -624,11 +748,6 @@ void OwncloudPropagator::start(SyncFileItemVector &&items)
     foreach (PropagatorJob *it, directoriesToRemove) {
         _rootJob->appendDirDeletionJob(it);
     }
-
-    connect(_rootJob.data(), &PropagatorJob::finished, this, &OwncloudPropagator::emitFinished);
-
-    _jobScheduled = false;
-    scheduleNextJob();
 }
 
 void OwncloudPropagator::startDirectoryPropagation(const SyncFileItemPtr &item,
@@ -728,7 +847,7 @@ void OwncloudPropagator::processE2eeMetadataMigration(const SyncFileItemPtr &ite
         SyncFileItemPtr topLevelitem = item;
         if (foundDirectory.second) {
             topLevelitem = foundDirectory.second->_item;
-            if (!foundDirectory.second->_subJobs._jobsToDo.isEmpty()) {
+            if (!foundDirectory.second->_subJobs._jobsToDo.empty()) {
                 for (const auto jobToDo : foundDirectory.second->_subJobs._jobsToDo) {
                     if (const auto foundExistingUpdateMigratedE2eeMetadataJob = qobject_cast<UpdateMigratedE2eeMetadataJob *>(jobToDo)) {
                         existingUpdateJob = foundExistingUpdateMigratedE2eeMetadataJob;
@@ -863,6 +982,15 @@ QString OwncloudPropagator::localPath() const
     return _localDir;
 }
 
+void OwncloudPropagator::setupChecksumCache(ComputeChecksum *computeChecksum, const QString &filePath) const
+{
+    csync_file_stat_t stat;
+    if (csync_vio_local_stat(filePath, &stat) != 0 || stat.type != ItemTypeFile) {
+        return;
+    }
+    computeChecksum->setChecksumCache(_journal, stat.inode, stat.size, stat.modtime, stat.modtime_nsec);
+}
+
 void OwncloudPropagator::scheduleNextJob()
 {
     if (_jobScheduled) return; // don't schedule more than 1
@@ -879,6 +1007,10 @@ void OwncloudPropagator::scheduleNextJobImpl()
 
     _jobScheduled = false;
 
+    QElapsedTimer schedulingTimer;
+    schedulingTimer.start();
+    ++_schedulingPasses;
+
     if (_activeJobList.count() < maximumActiveTransferJob()) {
         if (_rootJob->scheduleSelfOrChild()) {
             scheduleNextJob();
@@ -901,6 +1033,8 @@ void OwncloudPropagator::scheduleNextJobImpl()
             }
         }
     }
+
+    _schedulingDuration += std::chrono::nanoseconds(schedulingTimer.nsecsElapsed());
 }
 
 void OwncloudPropagator::reportProgress(const SyncFileItem &item, qint64 bytes)
@@ -937,7 +1071,8 @@ bool OwncloudPropagator::createConflict(const SyncFileItemPtr &item,
     QString fn = fullLocalPath(item->_file);
 
     QString renameError;
-    auto conflictModTime = FileSystem::getModTime(fn);
+    qint32 conflictModTimeNsec = -1;
+    auto conflictModTime = FileSystem::getModTime(fn, &conflictModTimeNsec);
     if (conflictModTime <= 0) {
         *error = tr("Impossible to get modification time for file in conflict %1").arg(fn);
         return false;
@@ -993,6 +1128,7 @@ bool OwncloudPropagator::createConflict(const SyncFileItemPtr &item,
             conflictItem->_direction = SyncFileItem::Up;
             conflictItem->_instruction = CSYNC_INSTRUCTION_NEW;
             conflictItem->_modtime = conflictModTime;
+            conflictItem->_modtimeNsec = conflictModTimeNsec;
             conflictItem->_size = item->_previousSize;
             emit newItem(conflictItem);
             composite->appendTask(conflictItem);
@@ -1236,7 +1372,7 @@ void PropagatorCompositeJob::slotSubJobAbortFinished()
 void PropagatorCompositeJob::appendJob(PropagatorJob *job)
 {
     job->setAssociatedComposite(this);
-    _jobsToDo.append(job);
+    _jobsToDo.push_back(job);
 }
 
 bool PropagatorCompositeJob::scheduleSelfOrChild()
@@ -1268,9 +1404,9 @@ bool PropagatorCompositeJob::scheduleSelfOrChild()
 
     // Now it's our turn, check if we have something left to do.
     // First, convert a task to a job if necessary
-    while (_jobsToDo.isEmpty() && !_tasksToDo.isEmpty()) {
-        SyncFileItemPtr nextTask = _tasksToDo.first();
-        _tasksToDo.remove(0);
+    while (_jobsToDo.empty() && !_tasksToDo.empty()) {
+        SyncFileItemPtr nextTask = std::move(_tasksToDo.front());
+        _tasksToDo.pop_front();
         PropagatorJob *job = propagator()->createJob(nextTask);
         if (!job) {
             qCWarning(lcDirectory) << "Useless task found for file" << nextTask->destination() << "instruction" << nextTask->_instruction;
@@ -1280,16 +1416,16 @@ bool PropagatorCompositeJob::scheduleSelfOrChild()
         break;
     }
     // Then run the next job
-    if (!_jobsToDo.isEmpty()) {
-        PropagatorJob *nextJob = _jobsToDo.first();
-        _jobsToDo.remove(0);
+    if (!_jobsToDo.empty()) {
+        PropagatorJob *nextJob = _jobsToDo.front();
+        _jobsToDo.pop_front();
         _runningJobs.append(nextJob);
         return possiblyRunNextJob(nextJob);
     }
 
     // If neither us or our children had stuff left to do we could hang. Make sure
     // we mark this job as finished so that the propagator can schedule a new one.
-    if (_jobsToDo.isEmpty() && _tasksToDo.isEmpty() && _runningJobs.isEmpty()) {
+    if (_jobsToDo.empty() && _tasksToDo.empty() && _runningJobs.isEmpty()) {
         // Our parent jobs are already iterating over their running jobs, post to the event loop
         // to avoid removing ourself from that list while they iterate.
         QMetaObject::invokeMethod(this, "finalize", Qt::QueuedConnection);
@@ -1318,13 +1454,23 @@ void PropagatorCompositeJob::slotSubJobFinished(SyncFileItem::Status status)
         _hasError = status;
     }
 
-    if (_jobsToDo.isEmpty() && _tasksToDo.isEmpty() && _runningJobs.isEmpty()) {
+    if (_jobsToDo.empty() && _tasksToDo.empty() && _runningJobs.isEmpty()) {
         finalize();
     } else {
         propagator()->scheduleNextJob();
     }
 }
 
+void PropagatorCompositeJob::stopAwaitingMoreJobs()
+{
+    _awaitingMoreJobs = false;
+
+    // Nothing else would finish a running job that already ran out of sub jobs
+    if (_state == Running && _jobsToDo.empty() && _tasksToDo.empty() && _runningJobs.isEmpty()) {
+        QMetaObject::invokeMethod(this, "finalize", Qt::QueuedConnection);
+    }
+}
+
 void PropagatorCompositeJob::finalize()
 {
     // The propagator will do parallel scheduling and this could be posted
@@ -1332,6 +1478,10 @@ void PropagatorCompositeJob::finalize()
     if (_state == Finished)
         return;
 
+    // More sub jobs are going to be appended, see stopAwaitingMoreJobs()
+    if (_awaitingMoreJobs)
+        return;
+
     _state = Finished;
     emit finished(_hasError == SyncFileItem::NoStatus ? SyncFileItem::Success : _hasError);
 }
@@ -1523,7 +1673,7 @@ void PropagateRootDirectory::appendDirDeletionJob(PropagatorJob *job)
 
 bool PropagateRootDirectory::scheduleSelfOrChild()
 {
-    qCInfo(lcRootDirectory()) << "scheduleSelfOrChild" << _state << "pending uploads" << propagator()->delayedTasks().size() << "subjobs state" << _subJobs._state;
+    qCDebug(lcRootDirectory()) << "scheduleSelfOrChild" << _state << "pending uploads" << propagator()->delayedTasks().size() << "subjobs state" << _subJobs._state;
 
     if (_state == Finished) {
         return false;
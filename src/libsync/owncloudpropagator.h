@@ -56,6 +56,7 @@ qint64 freeSpaceLimit();
 void blacklistUpdate(SyncJournalDb *journal, SyncFileItem &item);
 
 class SyncJournalDb;
+class ComputeChecksum;
 class OwncloudPropagator;
 class PropagatorCompositeJob;
 class FolderMetadata;
@@ -241,12 +242,20 @@ class PropagatorCompositeJob : public PropagatorJob
 {
     Q_OBJECT
 public:
-    QVector<PropagatorJob *> _jobsToDo;
-    SyncFileItemVector _tasksToDo;
+    // Queues in directory order, sub jobs are started from the front
+    std::deque<PropagatorJob *> _jobsToDo;
+    std::deque<SyncFileItemPtr> _tasksToDo;
     QVector<PropagatorJob *> _runningJobs;
     SyncFileItem::Status _hasError = SyncFileItem::NoStatus; // NoStatus,  or NormalError / SoftError if there was an error
     quint64 _abortsCount = 0;
 
+    /** While set the job doesn't finish when it runs out of sub jobs.
+     *
+     * Used by streamed propagation, where sub jobs keep being appended
+     * while the discovery is still running. See stopAwaitingMoreJobs().
+     */
+    bool _awaitingMoreJobs = false;
+
     explicit PropagatorCompositeJob(OwncloudPropagator *propagator)
         : PropagatorJob(propagator)
     {
@@ -260,9 +269,12 @@ public:
     void appendJob(PropagatorJob *job);
     void appendTask(const SyncFileItemPtr &item)
     {
-        _tasksToDo.append(item);
+        _tasksToDo.push_back(item);
     }
 
+    /** No more sub jobs will be appended, finish once the current ones are done */
+    void stopAwaitingMoreJobs();
+
     bool scheduleSelfOrChild() override;
     [[nodiscard]] JobParallelism parallelism() const override;
 
@@ -438,6 +450,33 @@ public:
 
     void start(SyncFileItemVector &&_syncedItems);
 
+    /** Start a propagation that receives its items while the discovery is still running.
+     *
+     * Items are handed over with appendStreamedItem() as they are discovered,
+     * finishStreaming() appends the remaining ones and lets the propagation finish.
+     */
+    void startStreaming();
+
+    /** Append a discovered item to a streamed propagation.
+     *
+     * The item ends up in the job of its closest streamed parent directory.
+     * Directories stay open for more children until finishStreaming().
+     */
+    void appendStreamedItem(const SyncFileItemPtr &item);
+
+    /** Append the items that were not streamed and finish the job tree.
+     *
+     * The items must be sorted, like for start().
+     */
+    void finishStreaming(SyncFileItemVector &&items);
+
+    [[nodiscard]] bool isStreaming() const { return _isStreaming; }
+
+    /// Time spent looking for the next jobs to start during this propagation
+    [[nodiscard]] std::chrono::nanoseconds schedulingDuration() const { return _schedulingDuration; }
+    /// How often the job tree was asked for the next jobs to start
+    [[nodiscard]] qint64 schedulingPasses() const { return _schedulingPasses; }
+
     void startDirectoryPropagation(const SyncFileItemPtr &item,
                                    QStack<QPair<QString, PropagateDirectory*>> &directories,
                                    QVector<PropagatorJob *> &directoriesToRemove,
@@ -500,6 +539,9 @@ public:
     /* The maximum number of active jobs in parallel  */
     int hardMaximumActiveJob();
 
+    /** The number of parallel network jobs, within our share of the NetworkJobBudget */
+    [[nodiscard]] int parallelNetworkJobs() const;
+
     /** Check whether a download would clash with an existing file
      * in filesystems that are only case-preserving.
      */
@@ -516,6 +558,11 @@ public:
      */
     bool hasCaseClashAccessibilityProblem(const QString &relfile);
 
+    /** Lets \a computeChecksum reuse and fill the journal's checksum cache
+     * for the local file at \a filePath.
+     */
+    void setupChecksumCache(ComputeChecksum *computeChecksum, const QString &filePath) const;
+
     Q_REQUIRED_RESULT QString fullLocalPath(const QString &tmp_file_name) const;
     [[nodiscard]] QString localPath() const;
 
@@ -681,10 +728,21 @@ private:
 
     static void adjustDeletedFoldersWithNewChildren(SyncFileItemVector &items);
 
+    /** Builds the jobs for the sorted items and appends them to the root job */
+    void appendItemsToJobTree(const SyncFileItemVector &items);
+
+    /** Pushes the streamed directories that are parents of path on the stack */
+    void pushStreamedParentDirectories(const QString &path, QStack<QPair<QString, PropagateDirectory *>> &directories) const;
+
+    /** Returns the job of the closest streamed parent directory of path, or the root job */
+    [[nodiscard]] PropagateDirectory *streamedParentDirectory(const QString &path) const;
+
     AccountPtr _account;
     QScopedPointer<PropagateRootDirectory> _rootJob;
     SyncOptions _syncOptions;
     bool _jobScheduled = false;
+    std::chrono::nanoseconds _schedulingDuration{0};
+    qint64 _schedulingPasses = 0;
 
     const QString _localDir; // absolute path to the local directory. ends with '/'
     const QString _remoteFolder; // remote folder, ends with '/'
@@ -692,6 +750,10 @@ private:
     std::deque<SyncFileItemPtr> _delayedTasks;
     bool _scheduleDelayedTasks = false;
 
+    bool _isStreaming = false;
+    // Directory jobs of a streamed propagation that may still receive children, by path
+    QHash<QString, QPointer<PropagateDirectory>> _streamedDirectories;
+
     QSet<QString> &_bulkUploadBlackList;
 
     static bool _allowDelayedUpload;
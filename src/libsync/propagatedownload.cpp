@@ -32,6 +32,10 @@
 #include <QNetworkAccessManager>
 #include <QFileInfo>
 #include <QDir>
+#include <QFutureWatcher>
+#include <qtconcurrentrun.h>
+
+#include <algorithm>
 #include <cmath>
 
 #ifdef Q_OS_UNIX
@@ -43,6 +47,9 @@ namespace OCC {
 Q_LOGGING_CATEGORY(lcGetJob, "nextcloud.sync.networkjob.get", QtInfoMsg)
 Q_LOGGING_CATEGORY(lcPropagateDownload, "nextcloud.sync.propagator.download", QtInfoMsg)
 
+// The number of ranges a segmented download is split into
+static constexpr auto downloadSegmentCount = 8;
+
 // Always coming in with forward slashes.
 // In csync_excluded_no_ctx we ignore all files with longer than 254 chars
 // This function also adds a dot at the beginning of the filename to hide the file on OS X and Linux
@@ -68,6 +75,16 @@ QString OWNCLOUDSYNC_EXPORT createDownloadTmpFileName(const QString &previous)
     }
 }
 
+// The checksum header of a GET reply, as used to validate the download
+static QByteArray checksumHeaderFromReply(const QNetworkReply &reply)
+{
+    auto checksumHeader = findBestChecksum(reply.rawHeader(checkSumHeaderC));
+    const auto contentMd5Header = reply.rawHeader(contentMd5HeaderC);
+    if (checksumHeader.isEmpty() && !contentMd5Header.isEmpty())
+        checksumHeader = "MD5:" + contentMd5Header;
+    return checksumHeader;
+}
+
 // DOES NOT take ownership of the device.
 GETFileJob::GETFileJob(AccountPtr account, const QString &path, QIODevice *device,
     const QMap<QByteArray, QByteArray> &headers, const QByteArray &expectedEtagForResume,
@@ -81,7 +98,6 @@ GETFileJob::GETFileJob(AccountPtr account, const QString &path, QIODevice *devic
     , _errorStatus(SyncFileItem::NoStatus)
     , _bandwidthLimited(false)
     , _bandwidthChoked(false)
-    , _bandwidthQuota(0)
     , _bandwidthManager(nullptr)
     , _hasEmittedFinishedSignal(false)
     , _lastModified()
@@ -102,7 +118,6 @@ GETFileJob::GETFileJob(AccountPtr account, const QUrl &url, QIODevice *device,
     , _directDownloadUrl(url)
     , _bandwidthLimited(false)
     , _bandwidthChoked(false)
-    , _bandwidthQuota(0)
     , _bandwidthManager(nullptr)
     , _hasEmittedFinishedSignal(false)
     , _lastModified()
@@ -113,8 +128,8 @@ GETFileJob::GETFileJob(AccountPtr account, const QUrl &url, QIODevice *device,
 
 void GETFileJob::start()
 {
-    if (_resumeStart > 0) {
-        _headers["Range"] = "bytes=" + QByteArray::number(_resumeStart) + '-';
+    if (_resumeStart > 0 || _rangeEnd >= 0) {
+        _headers["Range"] = "bytes=" + QByteArray::number(_resumeStart) + '-' + (_rangeEnd >= 0 ? QByteArray::number(_rangeEnd) : QByteArray());
         _headers["Accept-Ranges"] = "bytes";
         qCDebug(lcGetJob) << "Retry with range " << _headers["Range"];
     }
@@ -205,6 +220,16 @@ void GETFileJob::slotMetaDataChanged()
         return;
     }
 
+    if (_rangeEnd >= 0 && reply()->rawHeader("Content-Range").isEmpty()) {
+        // The other segments of the file are written to the same device
+        qCWarning(lcGetJob) << "Server ignored the range of a segmented download";
+        _rangeIgnored = true;
+        _errorString = tr("Server does not support ranged downloads");
+        _errorStatus = SyncFileItem::SoftError;
+        reply()->abort();
+        return;
+    }
+
     bool ok = false;
     _contentLength = reply()->header(QNetworkRequest::ContentLengthHeader).toLongLong(&ok);
     if (ok && _expectedContentLength != -1 && _contentLength != _expectedContentLength) {
@@ -251,6 +276,98 @@ void GETFileJob::slotMetaDataChanged()
     }
 
     _saveBodyToFile = true;
+
+    if (_computeChecksum) {
+        startChecksumComputation();
+    }
+}
+
+void GETFileJob::startChecksumComputation()
+{
+    _checksumCalculator.reset();
+    _checksummedFileBytes = 0;
+    _checksumIsLive = false;
+    _checksumType = parseChecksumHeaderType(checksumHeaderFromReply(*reply()));
+    if (_checksumType.isEmpty()) {
+        return;
+    }
+
+    auto checksumCalculator = std::make_shared<ChecksumCalculator>(_checksumType);
+    if (!checksumCalculator->isValid()) {
+        return;
+    }
+
+    if (_resumeStart > 0 && !qobject_cast<QFile *>(_device)) {
+        return;
+    }
+    _checksumCalculator = std::move(checksumCalculator);
+
+    if (_resumeStart > 0) {
+        // Reading the existing part could block the GUI for a while
+        checksumWrittenData();
+    } else {
+        _checksumIsLive = true;
+    }
+}
+
+void GETFileJob::checksumWrittenData()
+{
+    // The data received in the meantime is written but not checksummed, that
+    // is caught up with as well before the received data is checksummed directly
+    const auto file = qobject_cast<QFile *>(_device);
+    file->flush();
+    const auto from = _checksummedFileBytes;
+    const auto to = file->size();
+
+    auto watcher = new QFutureWatcher<qint64>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, calculator = _checksumCalculator] {
+        watcher->deleteLater();
+        const auto checksummedBytes = watcher->result();
+        if (calculator != _checksumCalculator || _hasEmittedFinishedSignal) {
+            return; // the computation was restarted, or is not needed anymore
+        }
+        if (checksummedBytes < 0) {
+            _checksumCalculator.reset();
+            return;
+        }
+        _checksummedFileBytes = checksummedBytes;
+
+        const auto file = qobject_cast<QFile *>(_device);
+        file->flush();
+        if (file->size() > _checksummedFileBytes) {
+            checksumWrittenData();
+        } else {
+            _checksumIsLive = true;
+        }
+    });
+    watcher->setFuture(QtConcurrent::run([calculator = _checksumCalculator, fileName = file->fileName(), from, to]() -> qint64 {
+        QFile existingPart(fileName);
+        if (!existingPart.open(QIODevice::ReadOnly) || !existingPart.seek(from)) {
+            qCWarning(lcGetJob) << "Could not read the existing part of" << fileName << existingPart.errorString();
+            return -1;
+        }
+        QByteArray buffer(qMin(to - from, 500 * 1024ll), Qt::Uninitialized);
+        auto remaining = to - from;
+        while (remaining > 0) {
+            const auto readBytes = existingPart.read(buffer.data(), qMin(remaining, qint64(buffer.size())));
+            if (readBytes <= 0) {
+                qCWarning(lcGetJob) << "Could not read the existing part of" << fileName << existingPart.errorString();
+                return -1;
+            }
+            calculator->addChunk(buffer, readBytes);
+            remaining -= readBytes;
+        }
+        return to;
+    }));
+}
+
+QByteArray GETFileJob::computedChecksumHeader() const
+{
+    // Not caught up yet, the file is checksummed after the download instead
+    if (!_checksumCalculator || !_checksumIsLive) {
+        return {};
+    }
+    return makeChecksumHeader(_checksumType, _checksumCalculator->result());
 }
 
 void GETFileJob::setBandwidthManager(BandwidthManager *bwm)
@@ -270,13 +387,6 @@ void GETFileJob::setBandwidthLimited(bool b)
     QMetaObject::invokeMethod(this, "slotReadyRead", Qt::QueuedConnection);
 }
 
-void GETFileJob::giveBandwidthQuota(qint64 q)
-{
-    _bandwidthQuota = q;
-    qCDebug(lcGetJob) << "Got" << q << "bytes";
-    QMetaObject::invokeMethod(this, "slotReadyRead", Qt::QueuedConnection);
-}
-
 qint64 GETFileJob::currentDownloadPosition()
 {
     if (_device && _device->pos() > 0 && _device->pos() > qint64(_resumeStart)) {
@@ -303,16 +413,18 @@ void GETFileJob::slotReadyRead()
             break;
         }
         qint64 toRead = bufferSize;
-        if (_bandwidthLimited) {
-            toRead = qMin(qint64(bufferSize), _bandwidthQuota);
+        if (_bandwidthLimited && _bandwidthManager) {
+            toRead = _bandwidthManager->takeDownloadQuota(bufferSize);
             if (toRead == 0) {
                 qCDebug(lcGetJob) << "Out of quota";
                 break;
             }
-            _bandwidthQuota -= toRead;
         }
 
         const qint64 readBytes = reply()->read(buffer.data(), toRead);
+        if (_bandwidthLimited && _bandwidthManager && readBytes < toRead) {
+            _bandwidthManager->returnDownloadQuota(toRead - qMax(readBytes, qint64(0)));
+        }
         if (readBytes < 0) {
             _errorString = networkReplyErrorString(*reply());
             _errorStatus = SyncFileItem::NormalError;
@@ -329,6 +441,9 @@ void GETFileJob::slotReadyRead()
             reply()->abort();
             return;
         }
+        if (_checksumCalculator && _checksumIsLive) {
+            _checksumCalculator->addChunk(buffer, readBytes);
+        }
     }
 
     if (reply()->isFinished() && (reply()->bytesAvailable() == 0 || !_saveBodyToFile)) {
@@ -579,6 +694,7 @@ void PropagateDownloadFile::startAfterIsEncryptedIsChecked()
         qCDebug(lcPropagateDownload) << _item->_file << "may not need download, computing checksum";
         auto computeChecksum = new ComputeChecksum(this);
         computeChecksum->setChecksumType(parseChecksumHeaderType(_item->_checksumHeader));
+        propagator()->setupChecksumCache(computeChecksum, propagator()->fullLocalPath(_item->_file));
         connect(computeChecksum, &ComputeChecksum::done,
             this, &PropagateDownloadFile::conflictChecksumComputed);
         propagator()->_activeJobList.append(this);
@@ -610,7 +726,7 @@ void PropagateDownloadFile::conflictChecksumComputed(const QByteArray &checksumT
             FileSystem::setModTime(fn, _item->_modtime);
             emit propagator()->touchedFile(fn);
         }
-        _item->_modtime = FileSystem::getModTime(fn);
+        _item->_modtime = FileSystem::getModTime(fn, &_item->_modtimeNsec);
         Q_ASSERT(_item->_modtime > 0);
         if (_item->_modtime <= 0) {
             qCWarning(lcPropagateDownload()) << "invalid modified time" << _item->_file << _item->_modtime;
@@ -646,15 +762,22 @@ void PropagateDownloadFile::startDownload()
 
     QString tmpFileName;
     QByteArray expectedEtagForResume;
+    _downloadInfo = SyncJournalDb::DownloadInfo();
     const SyncJournalDb::DownloadInfo progressInfo = propagator()->_journal->getDownloadInfo(_item->_file);
     if (progressInfo._valid) {
+        // The segments of a segmented download can only be resumed as such
+        const auto segmentsUsable = progressInfo._segments.isEmpty()
+            || (segmentedDownloadEnabled()
+                && progressInfo._segments.constLast()._offset + progressInfo._segments.constLast()._size == _item->_size);
+
         // if the etag has changed meanwhile, remove the already downloaded part.
-        if (progressInfo._etag != _item->_etag) {
+        if (progressInfo._etag != _item->_etag || !segmentsUsable) {
             FileSystem::remove(propagator()->fullLocalPath(progressInfo._tmpfile));
             propagator()->_journal->setDownloadInfo(_item->_file, SyncJournalDb::DownloadInfo());
         } else {
             tmpFileName = progressInfo._tmpfile;
             expectedEtagForResume = progressInfo._etag;
+            _downloadInfo._segments = progressInfo._segments;
         }
     }
 
@@ -663,7 +786,25 @@ void PropagateDownloadFile::startDownload()
     }
     _tmpFile.setFileName(propagator()->fullLocalPath(tmpFileName));
 
-    _resumeStart = _tmpFile.size();
+    // The downloaded segments are gone if the pre-allocated file was removed
+    if (!_downloadInfo._segments.isEmpty() && _tmpFile.size() != _item->_size) {
+        FileSystem::remove(_tmpFile.fileName());
+        _downloadInfo._segments.clear();
+    }
+
+    // A partial sequential download is resumed sequentially
+    if (_downloadInfo._segments.isEmpty() && _tmpFile.size() == 0 && segmentedDownloadEnabled()) {
+        const auto segmentSize = (_item->_size + downloadSegmentCount - 1) / downloadSegmentCount;
+        for (qint64 offset = 0; offset < _item->_size; offset += segmentSize) {
+            SyncJournalDb::DownloadInfo::Segment segment;
+            segment._offset = offset;
+            segment._size = qMin(segmentSize, _item->_size - offset);
+            _downloadInfo._segments.append(segment);
+        }
+    }
+    const auto segmented = !_downloadInfo._segments.isEmpty();
+
+    _resumeStart = segmented ? 0 : _tmpFile.size();
     if (_resumeStart > 0 && _resumeStart == _item->_size) {
         qCInfo(lcPropagateDownload) << "File is already complete, no need to download";
         downloadFinished();
@@ -674,7 +815,8 @@ void PropagateDownloadFile::startDownload()
     // file writable if it exists.
     if (_tmpFile.exists())
         FileSystem::setFileReadOnly(_tmpFile.fileName(), false);
-    if (!_tmpFile.open(QIODevice::Append | QIODevice::Unbuffered)) {
+    const auto openMode = segmented ? QIODevice::ReadWrite : QIODevice::Append;
+    if (!_tmpFile.open(openMode | QIODevice::Unbuffered)) {
         propagator()->account()->reportClientStatus(ClientStatusReportingStatus::DownloadError_Cannot_Create_File);
         qCWarning(lcPropagateDownload) << "could not open temporary file" << _tmpFile.fileName();
         done(SyncFileItem::NormalError, _tmpFile.errorString(), ErrorCategory::GenericError);
@@ -699,20 +841,43 @@ void PropagateDownloadFile::startDownload()
         }
 
         // Remove the temporary, if empty.
-        if (_resumeStart == 0) {
+        if (_tmpFile.size() == 0) {
             _tmpFile.remove();
         }
 
         return;
     }
 
+    // The segments are written into the pre-allocated file at their offsets
+    if (segmented && _tmpFile.size() != _item->_size && !_tmpFile.resize(_item->_size)) {
+        qCWarning(lcPropagateDownload) << "could not allocate temporary file" << _tmpFile.fileName() << _tmpFile.errorString();
+        done(SyncFileItem::NormalError, _tmpFile.errorString(), ErrorCategory::GenericError);
+        _tmpFile.remove();
+        return;
+    }
+
     {
-        SyncJournalDb::DownloadInfo pi;
-        pi._etag = _item->_etag;
-        pi._tmpfile = tmpFileName;
-        pi._valid = true;
-        propagator()->_journal->setDownloadInfo(_item->_file, pi);
-        propagator()->_journal->commit("download file start");
+        _downloadInfo._etag = _item->_etag;
+        _downloadInfo._tmpfile = tmpFileName;
+        _downloadInfo._valid = true;
+        propagator()->_journal->setDownloadInfo(_item->_file, _downloadInfo);
+        // Resuming only pays off for large files, the others can share a transaction
+        if (_item->_size >= propagator()->syncOptions().minChunkSize()) {
+            propagator()->_journal->commit("download file start");
+        } else {
+            propagator()->_journal->scheduleCommit(QStringLiteral("download file start"));
+        }
+    }
+
+    if (segmented) {
+        _tmpFile.close();
+        _segmentJobs = QVector<QPointer<GETFileJob>>(_downloadInfo._segments.size());
+        _segmentChecksumHeader.clear();
+        _segmentErrorStatus = SyncFileItem::NoStatus;
+        _discardSegments = false;
+        qCInfo(lcPropagateDownload) << "Downloading" << _item->_file << "in" << _downloadInfo._segments.size() << "segments";
+        startNextSegments();
+        return;
     }
 
     QMap<QByteArray, QByteArray> headers;
@@ -736,6 +901,7 @@ void PropagateDownloadFile::startDownload()
             &_tmpFile, headers, expectedEtagForResume, _resumeStart, this);
     }
     _job->setBandwidthManager(&propagator()->_bandwidthManager);
+    _job->setComputeChecksum(true);
     connect(_job.data(), &GETFileJob::finishedSignal, this, &PropagateDownloadFile::slotGetFinished);
     connect(_job.data(), &GETFileJob::downloadProgress, this, &PropagateDownloadFile::slotDownloadProgress);
     propagator()->_activeJobList.append(this);
@@ -744,7 +910,9 @@ void PropagateDownloadFile::startDownload()
 
 qint64 PropagateDownloadFile::committedDiskSpace() const
 {
-    if (_state == Running) {
+    if (_state == Running && !_downloadInfo._segments.isEmpty()) {
+        return qBound(0LL, _item->_size - segmentedDownloadedBytes(), _item->_size);
+    } else if (_state == Running) {
         return qBound(0LL, _item->_size - _resumeStart - _downloadProgress, _item->_size);
     }
     return 0;
@@ -838,22 +1006,7 @@ void PropagateDownloadFile::slotGetFinished()
         return;
     }
 
-    _item->_responseTimeStamp = job->responseTimestamp();
-
-    if (!job->etag().isEmpty()) {
-        // The etag will be empty if we used a direct download URL.
-        // (If it was really empty by the server, the GETFileJob will have errored
-        _item->_etag = parseEtag(job->etag());
-    }
-    if (job->lastModified()) {
-        // It is possible that the file was modified on the server since we did the discovery phase
-        // so make sure we have the up-to-date time
-        _item->_modtime = job->lastModified();
-        Q_ASSERT(_item->_modtime > 0);
-        if (_item->_modtime <= 0) {
-            qCWarning(lcPropagateDownload()) << "invalid modified time" << _item->_file << _item->_modtime;
-        }
-    }
+    readReplyMetadata(job);
 
     _tmpFile.close();
     _tmpFile.flush();
@@ -901,6 +1054,29 @@ void PropagateDownloadFile::slotGetFinished()
         return;
     }
 
+    validateTransmissionChecksum(checksumHeaderFromReply(*job->reply()), job->computedChecksumHeader());
+}
+
+void PropagateDownloadFile::readReplyMetadata(GETFileJob *job)
+{
+    _item->_responseTimeStamp = job->responseTimestamp();
+
+    if (!job->etag().isEmpty()) {
+        // The etag will be empty if we used a direct download URL.
+        // (If it was really empty by the server, the GETFileJob will have errored
+        _item->_etag = parseEtag(job->etag());
+    }
+    if (job->lastModified()) {
+        // It is possible that the file was modified on the server since we did the discovery phase
+        // so make sure we have the up-to-date time
+        _item->_modtime = job->lastModified();
+        _item->_modtimeNsec = -1;
+        Q_ASSERT(_item->_modtime > 0);
+        if (_item->_modtime <= 0) {
+            qCWarning(lcPropagateDownload()) << "invalid modified time" << _item->_file << _item->_modtime;
+        }
+    }
+
     // Did the file come with conflict headers? If so, store them now!
     // If we download conflict files but the server doesn't send conflict
     // headers, the record will be established by SyncEngine::conflictRecordMaintenance.
@@ -921,7 +1097,10 @@ void PropagateDownloadFile::slotGetFinished()
         // successfully, much further down. Here we just grab the headers because the
         // job will be deleted later.
     }
+}
 
+void PropagateDownloadFile::validateTransmissionChecksum(const QByteArray &checksumHeader, const QByteArray &computedChecksumHeader)
+{
     // Do checksum validation for the download. If there is no checksum header, the validator
     // will also emit the validated() signal to continue the flow in slot transmissionChecksumValidated()
     // as this is (still) also correct.
@@ -930,13 +1109,223 @@ void PropagateDownloadFile::slotGetFinished()
         this, &PropagateDownloadFile::transmissionChecksumValidated);
     connect(validator, &ValidateChecksumHeader::validationFailed,
         this, &PropagateDownloadFile::slotChecksumFail);
-    auto checksumHeader = findBestChecksum(job->reply()->rawHeader(checkSumHeaderC));
-    auto contentMd5Header = job->reply()->rawHeader(contentMd5HeaderC);
-    if (checksumHeader.isEmpty() && !contentMd5Header.isEmpty())
-        checksumHeader = "MD5:" + contentMd5Header;
+    QByteArray computedChecksumType, computedChecksum;
+    if (!computedChecksumHeader.isEmpty()
+        && parseChecksumHeader(computedChecksumHeader, &computedChecksumType, &computedChecksum)) {
+        // The data was checksummed while it was downloaded
+        validator->validate(checksumHeader, computedChecksumType, computedChecksum);
+        return;
+    }
     validator->start(_tmpFile.fileName(), checksumHeader);
 }
 
+bool PropagateDownloadFile::segmentedDownloadEnabled() const
+{
+    const auto minSize = propagator()->syncOptions()._minSegmentedDownloadSize;
+    return !_segmentedDownloadUnsupported
+        && minSize > 0 && _item->_size >= minSize
+        // The encrypted data on the server is not the size of the item
+        && !isEncrypted()
+        && _item->_directDownloadUrl.isEmpty();
+}
+
+void PropagateDownloadFile::startNextSegments()
+{
+    auto running = std::count_if(_segmentJobs.cbegin(), _segmentJobs.cend(), [](const QPointer<GETFileJob> &job) {
+        return !job.isNull();
+    });
+
+    if (_segmentErrorStatus == SyncFileItem::NoStatus && !propagator()->_abortRequested) {
+        const auto &segments = _downloadInfo._segments;
+        for (int i = 0; i < segments.size(); ++i) {
+            if (segments.at(i).isComplete() || _segmentJobs.at(i)) {
+                continue;
+            }
+            // Use the free transfer slots, but always keep one segment running
+            if (running > 0 && propagator()->_activeJobList.count() >= propagator()->maximumActiveTransferJob()) {
+                break;
+            }
+            if (!startSegment(i)) {
+                break;
+            }
+            ++running;
+        }
+    }
+
+    if (running > 0) {
+        return;
+    }
+
+    if (_segmentedDownloadUnsupported || _discardSegments) {
+        FileSystem::remove(_tmpFile.fileName());
+        propagator()->_journal->setDownloadInfo(_item->_file, SyncJournalDb::DownloadInfo());
+    }
+
+    if (_segmentedDownloadUnsupported) {
+        qCInfo(lcPropagateDownload) << "Downloading" << _item->_file << "sequentially instead";
+        _downloadInfo = SyncJournalDb::DownloadInfo();
+        startDownload();
+        return;
+    }
+
+    if (_segmentErrorStatus != SyncFileItem::NoStatus) {
+        done(_segmentErrorStatus, _segmentErrorString, _segmentErrorCategory);
+        return;
+    }
+
+    segmentedDownloadFinished();
+}
+
+bool PropagateDownloadFile::startSegment(int index)
+{
+    const auto &segment = _downloadInfo._segments.at(index);
+    const auto start = segment._offset + segment._downloaded;
+
+    // Each segment writes through its own handle, the job deletes it
+    auto device = new QFile(_tmpFile.fileName());
+    if (!device->open(QIODevice::ReadWrite | QIODevice::Unbuffered) || !device->seek(start)) {
+        qCWarning(lcPropagateDownload) << "could not open temporary file" << _tmpFile.fileName() << device->errorString();
+        abortSegments(SyncFileItem::NormalError, device->errorString(), ErrorCategory::GenericError);
+        delete device;
+        return false;
+    }
+
+    QMap<QByteArray, QByteArray> headers;
+    auto job = new GETFileJob(propagator()->account(),
+        propagator()->fullRemotePath(_item->_file),
+        device, headers, _downloadInfo._etag, start, this);
+    device->setParent(job);
+    job->setRangeEnd(segment._offset + segment._size - 1);
+    job->setExpectedContentLength(segment._size - segment._downloaded);
+    job->setBandwidthManager(&propagator()->_bandwidthManager);
+    connect(job, &GETFileJob::finishedSignal, this, [this, index] {
+        slotSegmentFinished(index);
+    });
+    connect(job, &GETFileJob::downloadProgress, this, [this, index] {
+        slotSegmentProgress(index);
+    });
+    _segmentJobs[index] = job;
+    propagator()->_activeJobList.append(this);
+    job->start();
+    return true;
+}
+
+void PropagateDownloadFile::slotSegmentFinished(int index)
+{
+    propagator()->_activeJobList.removeOne(this);
+
+    GETFileJob *job = _segmentJobs.at(index);
+    ASSERT(job);
+    _segmentJobs[index].clear();
+
+    auto &segment = _downloadInfo._segments[index];
+    segment._downloaded = qBound(segment._downloaded, job->currentDownloadPosition() - segment._offset, segment._size);
+
+    const auto err = job->reply()->error();
+    if (err != QNetworkReply::NoError) {
+        if (_segmentErrorStatus == SyncFileItem::NoStatus) {
+            _item->_httpErrorCode = job->reply()->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+            _item->_requestId = job->requestId();
+
+            if (job->rangeIgnored()) {
+                _segmentedDownloadUnsupported = true;
+            }
+            // The whole file has to be downloaded again
+            const bool badRangeHeader = _item->_httpErrorCode == 416;
+            const bool fileNotFound = _item->_httpErrorCode == 404;
+            if (badRangeHeader || fileNotFound) {
+                qCWarning(lcPropagateDownload) << "server replied" << _item->_httpErrorCode << "to a segment of" << _item->_file;
+                _discardSegments = true;
+                propagator()->_anotherSyncNeeded = true;
+            }
+
+            const auto reply = job->reply();
+            if (err == QNetworkReply::OperationCanceledError && reply->property(owncloudCustomSoftErrorStringC).isValid()) {
+                job->setErrorString(reply->property(owncloudCustomSoftErrorStringC).toString());
+                job->setErrorStatus(SyncFileItem::SoftError);
+            } else if (badRangeHeader) {
+                job->setErrorStatus(SyncFileItem::SoftError);
+            } else if (fileNotFound) {
+                job->setErrorString(tr("File was deleted from server"));
+                job->setErrorStatus(SyncFileItem::SoftError);
+                propagator()->_journal->schedulePathForRemoteDiscovery(_item->_file);
+            }
+
+            QByteArray errorBody;
+            const auto errorString = _item->_httpErrorCode >= 400 ? job->errorStringParsingBody(&errorBody)
+                                                                  : job->errorString();
+            auto status = job->errorStatus();
+            if (status == SyncFileItem::NoStatus) {
+                status = classifyError(err, _item->_httpErrorCode,
+                    &propagator()->_anotherSyncNeeded, errorBody);
+            }
+            abortSegments(status, errorString, errorCategoryFromNetworkError(err));
+        }
+    } else if (!segment.isComplete()) {
+        qCWarning(lcPropagateDownload) << "segment of" << _item->_file << "is incomplete" << segment._offset << segment._size << segment._downloaded;
+        propagator()->_anotherSyncNeeded = true;
+        abortSegments(SyncFileItem::SoftError, tr("The file could not be downloaded completely."), ErrorCategory::GenericError);
+    } else {
+        _item->_httpErrorCode = job->reply()->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        _item->_requestId = job->requestId();
+        readReplyMetadata(job);
+        _segmentChecksumHeader = checksumHeaderFromReply(*job->reply());
+    }
+
+    // Keep what was downloaded for resuming
+    propagator()->_journal->setDownloadInfo(_item->_file, _downloadInfo);
+
+    startNextSegments();
+}
+
+void PropagateDownloadFile::abortSegments(SyncFileItem::Status status, const QString &errorString, ErrorCategory category)
+{
+    if (_segmentErrorStatus == SyncFileItem::NoStatus) {
+        _segmentErrorStatus = status;
+        _segmentErrorString = errorString;
+        _segmentErrorCategory = category;
+    }
+    // Queued, as an aborted reply finishes right away and re-enters slotSegmentFinished()
+    for (const auto &job : std::as_const(_segmentJobs)) {
+        if (job && job->reply()) {
+            QMetaObject::invokeMethod(job->reply(), &QNetworkReply::abort, Qt::QueuedConnection);
+        }
+    }
+}
+
+qint64 PropagateDownloadFile::segmentedDownloadedBytes() const
+{
+    qint64 downloaded = 0;
+    for (const auto &segment : _downloadInfo._segments) {
+        downloaded += segment._downloaded;
+    }
+    return downloaded;
+}
+
+void PropagateDownloadFile::segmentedDownloadFinished()
+{
+    const auto &segments = _downloadInfo._segments;
+    if (!std::all_of(segments.cbegin(), segments.cend(), [](const SyncJournalDb::DownloadInfo::Segment &segment) {
+            return segment.isComplete();
+        })) {
+        propagator()->_anotherSyncNeeded = true;
+        done(SyncFileItem::SoftError, tr("The file could not be downloaded completely."), ErrorCategory::GenericError);
+        return;
+    }
+
+    if (_tmpFile.size() != _item->_size) {
+        qCWarning(lcPropagateDownload) << "temporary file has the wrong size" << _tmpFile.fileName() << _tmpFile.size() << _item->_size;
+        FileSystem::remove(_tmpFile.fileName());
+        propagator()->_journal->setDownloadInfo(_item->_file, SyncJournalDb::DownloadInfo());
+        propagator()->_anotherSyncNeeded = true;
+        done(SyncFileItem::SoftError, tr("The file could not be downloaded completely."), ErrorCategory::GenericError);
+        return;
+    }
+
+    // The segments arrived out of order, so the data is checksummed afterwards
+    validateTransmissionChecksum(_segmentChecksumHeader, {});
+}
+
 void PropagateDownloadFile::slotChecksumFail(const QString &errMsg,
     const QByteArray &calculatedChecksumType, const QByteArray &calculatedChecksum, const ValidateChecksumHeader::FailureReason reason)
 {
@@ -1119,6 +1508,7 @@ void PropagateDownloadFile::contentChecksumComputed(const QByteArray &checksumTy
         && (record._modtime == _item->_modtime && record._etag != _item->_etag)) {
         const auto computeChecksum = new ComputeChecksum(this);
         computeChecksum->setChecksumType(checksumType);
+        propagator()->setupChecksumCache(computeChecksum, localFilePath);
         connect(computeChecksum, &ComputeChecksum::done, this, &PropagateDownloadFile::localFileContentChecksumComputed);
         computeChecksum->start(localFilePath);
         return;
@@ -1168,7 +1558,7 @@ void PropagateDownloadFile::downloadFinished()
     FileSystem::setModTime(_tmpFile.fileName(), _item->_modtime);
     // We need to fetch the time again because some file systems such as FAT have worse than a second
     // Accuracy, and we really need the time from the file system. (#3103)
-    _item->_modtime = FileSystem::getModTime(_tmpFile.fileName());
+    _item->_modtime = FileSystem::getModTime(_tmpFile.fileName(), &_item->_modtimeNsec);
     if (_item->_modtime <= 0) {
         FileSystem::remove(_tmpFile.fileName());
         done(SyncFileItem::NormalError, tr("File %1 has invalid modified time reported by server. Do not save it.").arg(QDir::toNativeSeparators(_item->_file)), ErrorCategory::GenericError);
@@ -1341,7 +1731,7 @@ void PropagateDownloadFile::updateMetadata(bool isConflict)
         propagator()->_journal->setDownloadInfo(_item->_encryptedFileName, SyncJournalDb::DownloadInfo());
     }
 
-    propagator()->_journal->commit("download file start2");
+    propagator()->_journal->scheduleCommit(QStringLiteral("download file start2"));
 
     done(isConflict ? SyncFileItem::Conflict : SyncFileItem::Success, {}, ErrorCategory::NoError);
 
@@ -1374,11 +1764,25 @@ void PropagateDownloadFile::slotDownloadProgress(qint64 received, qint64)
     propagator()->reportProgress(*_item, _resumeStart + received);
 }
 
+void PropagateDownloadFile::slotSegmentProgress(int index)
+{
+    const auto job = _segmentJobs.at(index);
+    if (!job)
+        return;
+    auto &segment = _downloadInfo._segments[index];
+    segment._downloaded = qBound(segment._downloaded, job->currentDownloadPosition() - segment._offset, segment._size);
+    propagator()->reportProgress(*_item, segmentedDownloadedBytes());
+}
+
 
 void PropagateDownloadFile::abort(PropagatorJob::AbortType abortType)
 {
     if (_job && _job->reply())
         _job->reply()->abort();
+    for (const auto &job : std::as_const(_segmentJobs)) {
+        if (job && job->reply())
+            job->reply()->abort();
+    }
 
     if (abortType == AbortType::Asynchronous) {
         emit abortFinished();
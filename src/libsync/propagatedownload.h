@@ -18,11 +18,14 @@
 #include "networkjobs.h"
 #include "clientsideencryption.h"
 #include <common/checksums.h>
+#include <common/checksumcalculator.h>
 #include "foldermetadata.h"
 
 #include <QBuffer>
 #include <QFile>
 
+#include <memory>
+
 namespace OCC {
 class PropagateDownloadEncrypted;
 
@@ -39,12 +42,13 @@ class OWNCLOUDSYNC_EXPORT GETFileJob : public AbstractNetworkJob
     QByteArray _expectedEtagForResume;
     qint64 _expectedContentLength;
     qint64 _resumeStart;
+    qint64 _rangeEnd = -1;
+    bool _rangeIgnored = false;
     SyncFileItem::Status _errorStatus;
     QUrl _directDownloadUrl;
     QByteArray _etag;
-    bool _bandwidthLimited; // if _bandwidthQuota will be used
+    bool _bandwidthLimited; // if the quota of the bandwidth manager will be used
     bool _bandwidthChoked; // if download is paused (won't read on readyRead())
-    qint64 _bandwidthQuota;
     QPointer<BandwidthManager> _bandwidthManager;
     bool _hasEmittedFinishedSignal;
     time_t _lastModified;
@@ -52,6 +56,18 @@ class OWNCLOUDSYNC_EXPORT GETFileJob : public AbstractNetworkJob
     /// Will be set to true once we've seen a 2xx response header
     bool _saveBodyToFile = false;
 
+    bool _computeChecksum = false;
+    QByteArray _checksumType;
+    // Shared with the thread that adds the resumed part of the file
+    std::shared_ptr<ChecksumCalculator> _checksumCalculator;
+    // Bytes of the file that were added by that thread
+    qint64 _checksummedFileBytes = 0;
+    // Whether the received data is added as it is written, once the file was caught up with
+    bool _checksumIsLive = false;
+
+    void startChecksumComputation();
+    void checksumWrittenData();
+
 protected:
     qint64 _contentLength;
 
@@ -95,7 +111,6 @@ public:
     void setBandwidthManager(BandwidthManager *bwm);
     void setChoked(bool c);
     void setBandwidthLimited(bool b);
-    void giveBandwidthQuota(qint64 q);
     qint64 currentDownloadPosition();
 
     [[nodiscard]] QString errorString() const override;
@@ -110,6 +125,27 @@ public:
     qint64 resumeStart() { return _resumeStart; }
     time_t lastModified() { return _lastModified; }
 
+    /** Only request the data up to this offset (inclusive), -1 for the end of the file
+     *
+     * Used by segmented downloads: the request fails instead of falling back to
+     * downloading the whole file if the server doesn't honor the range.
+     */
+    void setRangeEnd(qint64 end) { _rangeEnd = end; }
+
+    /// Whether the server replied with the whole file to a request with a range end
+    [[nodiscard]] bool rangeIgnored() const { return _rangeIgnored; }
+
+    /** Checksum the downloaded data while writing it to the device
+     *
+     * The checksum type is the one announced by the server's checksum headers.
+     * When resuming, the existing part of the device, which must be a QFile,
+     * is read once to include it.
+     */
+    void setComputeChecksum(bool enabled) { _computeChecksum = enabled; }
+
+    /// The checksum header of the downloaded data, empty if it wasn't computed
+    [[nodiscard]] QByteArray computedChecksumHeader() const;
+
     [[nodiscard]] qint64 contentLength() const { return _contentLength; }
     [[nodiscard]] qint64 expectedContentLength() const { return _expectedContentLength; }
     void setExpectedContentLength(qint64 size) { _expectedContentLength = size; }
@@ -190,6 +226,13 @@ private:
     +-> updateMetadata() <-------------------------+
 
 \endcode
+
+ * Files of at least SyncOptions::_minSegmentedDownloadSize are downloaded in
+ * segments instead: startDownload() pre-allocates the temporary file and
+ * startNextSegments() runs a ranged GETFileJob for as many segments as the
+ * propagator has free transfer slots. Each finished segment is stored in the
+ * download info so it is not downloaded again when resuming. Once all segments
+ * are done, segmentedDownloadFinished() continues with the checksum validation.
  */
 class PropagateDownloadFile : public PropagateItemJob
 {
@@ -236,8 +279,14 @@ private slots:
     /// Called when it's time to update the db metadata
     void updateMetadata(bool isConflict);
 
+    /// Called when the GETFileJob of a segment finishes
+    void slotSegmentFinished(int index);
+    /// Called when all segments are downloaded
+    void segmentedDownloadFinished();
+
     void abort(PropagatorJob::AbortType abortType) override;
     void slotDownloadProgress(qint64, qint64);
+    void slotSegmentProgress(int index);
     void slotChecksumFail(const QString &errMsg, const QByteArray &calculatedChecksumType,
         const QByteArray &calculatedChecksum, const ValidateChecksumHeader::FailureReason reason);
     void processChecksumRecalculate(const QNetworkReply *reply, const QByteArray &originalChecksumHeader, const QString &errorMessage);
@@ -248,6 +297,18 @@ private:
     void deleteExistingFolder();
     [[nodiscard]] bool isEncrypted() const { return _isEncrypted; }
 
+    /// Take the etag, mtime and conflict headers of a successful GET
+    void readReplyMetadata(GETFileJob *job);
+    void validateTransmissionChecksum(const QByteArray &checksumHeader, const QByteArray &computedChecksumHeader);
+
+    /// Whether the file should be downloaded in several ranges at the same time
+    [[nodiscard]] bool segmentedDownloadEnabled() const;
+    void startNextSegments();
+    bool startSegment(int index);
+    /// Abort the running segments, the error is reported once all of them stopped
+    void abortSegments(SyncFileItem::Status status, const QString &errorString, ErrorCategory category);
+    [[nodiscard]] qint64 segmentedDownloadedBytes() const;
+
     qint64 _resumeStart = 0;
     qint64 _downloadProgress = 0;
     QPointer<GETFileJob> _job;
@@ -259,6 +320,16 @@ private:
 
     QElapsedTimer _stopwatch;
 
+    /// The resume info of a segmented download, no segments for a sequential download
+    SyncJournalDb::DownloadInfo _downloadInfo;
+    QVector<QPointer<GETFileJob>> _segmentJobs;
+    QByteArray _segmentChecksumHeader;
+    SyncFileItem::Status _segmentErrorStatus = SyncFileItem::NoStatus;
+    QString _segmentErrorString;
+    ErrorCategory _segmentErrorCategory = ErrorCategory::NoError;
+    bool _discardSegments = false;
+    bool _segmentedDownloadUnsupported = false;
+
     PropagateDownloadEncrypted *_downloadEncryptedHelper = nullptr;
 };
 }
@@ -120,7 +120,7 @@ void PropagateRemoteDelete::slotDeleteJobFinished()
         return;
     }
 
-    propagator()->_journal->commit("Remote Remove");
+    propagator()->_journal->scheduleCommit(QStringLiteral("Remote Remove"));
 
     done(SyncFileItem::Success, {}, ErrorCategory::NoError);
 }
@@ -132,7 +132,7 @@ void PropagateRemoteDeleteEncryptedRootFolder::slotDeleteNestedRemoteItemFinishe
             if (!_propagator->_journal->deleteFileRecord(nestedItem._path, nestedItem._type == ItemTypeDirectory)) {
                 qCWarning(PROPAGATE_REMOVE_ENCRYPTED_ROOTFOLDER) << "Failed to delete file record from local DB" << nestedItem._path;
             }
-            _propagator->_journal->commit("Remote Remove");
+            _propagator->_journal->scheduleCommit(QStringLiteral("Remote Remove"));
         }
     }
 
@@ -278,7 +278,7 @@ void PropagateRemoteMove::finalize()
     }
 
     if (!QFileInfo::exists(targetFile)) {
-        propagator()->_journal->commit("Remote Rename");
+        propagator()->_journal->scheduleCommit(QStringLiteral("Remote Rename"));
         done(SyncFileItem::Success, {}, ErrorCategory::NoError);
         return;
     }
@@ -305,7 +305,7 @@ void PropagateRemoteMove::finalize()
         }
     }
 
-    propagator()->_journal->commit("Remote Rename");
+    propagator()->_journal->scheduleCommit(QStringLiteral("Remote Rename"));
     done(SyncFileItem::Success, {}, ErrorCategory::NoError);
 }
 
@@ -319,7 +319,7 @@ void PropagateUploadFileCommon::slotComputeContentChecksum()
     // change during the checksum calculation - This goes inside of the _item->_file
     // and not the _fileToUpload because we are checking the original file, not there
     // probably temporary one.
-    _item->_modtime = FileSystem::getModTime(filePath);
+    _item->_modtime = FileSystem::getModTime(filePath, &_item->_modtimeNsec);
     if (_item->_modtime <= 0) {
         slotOnErrorStartFolderUnlock(SyncFileItem::NormalError, tr("File %1 has invalid modification time. Do not upload to the server.").arg(QDir::toNativeSeparators(_item->_file)));
         return;
@@ -341,6 +341,7 @@ void PropagateUploadFileCommon::slotComputeContentChecksum()
     // Compute the content checksum.
     auto computeChecksum = new ComputeChecksum(this);
     computeChecksum->setChecksumType(checksumType);
+    propagator()->setupChecksumCache(computeChecksum, _fileToUpload._path);
 
     connect(computeChecksum, &ComputeChecksum::done,
         this, &PropagateUploadFileCommon::slotComputeTransmissionChecksum);
@@ -356,23 +357,34 @@ void PropagateUploadFileCommon::slotComputeTransmissionChecksum(const QByteArray
     // Reuse the content checksum as the transmission checksum if possible
     const auto supportedTransmissionChecksums =
         propagator()->account()->capabilities().supportedChecksumTypes();
-    if (supportedTransmissionChecksums.contains(contentChecksumType)) {
+    if (!_uploadingEncrypted && supportedTransmissionChecksums.contains(contentChecksumType)) {
         slotStartUpload(contentChecksumType, contentChecksum);
         return;
     }
 
+    const auto transmissionChecksumType = uploadChecksumEnabled() ? propagator()->account()->capabilities().uploadChecksumType() : QByteArray();
+
+    if (_uploadingEncrypted) {
+        // The transmission checksum is the one of the encrypted content, it is
+        // computed while the file is encrypted for the metadata
+        connect(_uploadEncryptedHelper, &PropagateUploadEncrypted::uploadPrepared,
+            this, &PropagateUploadFileCommon::slotStartUpload, Qt::UniqueConnection);
+        connect(_uploadEncryptedHelper, &PropagateUploadEncrypted::uploadPreparationFailed,
+            this, &PropagateUploadFileCommon::slotEncryptedUploadPreparationFailed, Qt::UniqueConnection);
+        _uploadEncryptedHelper->prepareUpload(transmissionChecksumType);
+        return;
+    }
+
     // Compute the transmission checksum.
     auto computeChecksum = new ComputeChecksum(this);
-    if (uploadChecksumEnabled()) {
-        computeChecksum->setChecksumType(propagator()->account()->capabilities().uploadChecksumType());
-    } else {
-        computeChecksum->setChecksumType(QByteArray());
-    }
+    computeChecksum->setChecksumType(transmissionChecksumType);
 
     connect(computeChecksum, &ComputeChecksum::done,
         this, &PropagateUploadFileCommon::slotStartUpload);
     connect(computeChecksum, &ComputeChecksum::done,
         computeChecksum, &QObject::deleteLater);
+
+    propagator()->setupChecksumCache(computeChecksum, _fileToUpload._path);
     computeChecksum->start(_fileToUpload._path);
 }
 
@@ -404,10 +416,11 @@ void PropagateUploadFileCommon::slotStartUpload(const QByteArray &transmissionCh
         qCWarning(lcPropagateUpload()) << "invalid modified time" << _item->_file << _item->_modtime;
     }
     time_t prevModtime = _item->_modtime; // the _item value was set in PropagateUploadFile::start()
+    const auto prevModtimeNsec = _item->_modtimeNsec;
     // but a potential checksum calculation could have taken some time during which the file could
     // have been changed again, so better check again here.
 
-    _item->_modtime = FileSystem::getModTime(originalFilePath);
+    _item->_modtime = FileSystem::getModTime(originalFilePath, &_item->_modtimeNsec);
     if (_item->_modtime <= 0) {
         slotOnErrorStartFolderUnlock(SyncFileItem::NormalError, tr("File %1 has invalid modification time. Do not upload to the server.").arg(QDir::toNativeSeparators(_item->_file)));
         return;
@@ -416,13 +429,16 @@ void PropagateUploadFileCommon::slotStartUpload(const QByteArray &transmissionCh
     if (_item->_modtime <= 0) {
         qCWarning(lcPropagateUpload()) << "invalid modified time" << _item->_file << _item->_modtime;
     }
-    if (prevModtime != _item->_modtime) {
+    if (prevModtime != _item->_modtime || prevModtimeNsec != _item->_modtimeNsec) {
         propagator()->_anotherSyncNeeded = true;
-        qDebug() << "prevModtime" << prevModtime << "Curr" << _item->_modtime;
+        qDebug() << "prevModtime" << prevModtime << prevModtimeNsec << "Curr" << _item->_modtime << _item->_modtimeNsec;
         return slotOnErrorStartFolderUnlock(SyncFileItem::SoftError, tr("Local file changed during syncing. It will be resumed."));
     }
 
     _fileToUpload._size = FileSystem::getSize(fullFilePath);
+    if (_uploadingEncrypted) {
+        _fileToUpload._size = EncryptionHelper::EncryptedFileDevice::encryptedSize(_fileToUpload._size);
+    }
     _item->_size = FileSystem::getSize(originalFilePath);
 
     // But skip the file if the mtime is too close to 'now'!
@@ -457,6 +473,22 @@ void PropagateUploadFileCommon::slotOnErrorStartFolderUnlock(SyncFileItem::Statu
     }
 }
 
+void PropagateUploadFileCommon::slotEncryptedUploadPreparationFailed(const QString &errorString)
+{
+    propagator()->_activeJobList.removeOne(this);
+    qCWarning(lcPropagateUpload) << "Could not prepare the encrypted upload of" << _item->_file << errorString;
+    propagator()->_anotherSyncNeeded = true;
+    slotOnErrorStartFolderUnlock(SyncFileItem::SoftError, tr("Failed to upload encrypted file."));
+}
+
+std::unique_ptr<UploadDevice> PropagateUploadFileCommon::createUploadDevice(qint64 start, qint64 size)
+{
+    if (_uploadingEncrypted) {
+        return std::make_unique<UploadDevice>(_uploadEncryptedHelper->encryptedDevice(), start, size, &propagator()->_bandwidthManager);
+    }
+    return std::make_unique<UploadDevice>(_fileToUpload._path, start, size, &propagator()->_bandwidthManager);
+}
+
 UploadDevice::UploadDevice(const QString &fileName, qint64 start, qint64 size, BandwidthManager *bwm)
     : _file(fileName)
     , _start(start)
@@ -466,6 +498,15 @@ UploadDevice::UploadDevice(const QString &fileName, qint64 start, qint64 size, B
     _bandwidthManager->registerUploadDevice(this);
 }
 
+UploadDevice::UploadDevice(const QSharedPointer<QIODevice> &source, qint64 start, qint64 size, BandwidthManager *bwm)
+    : _source(source)
+    , _start(start)
+    , _size(size)
+    , _bandwidthManager(bwm)
+{
+    _bandwidthManager->registerUploadDevice(this);
+}
+
 
 UploadDevice::~UploadDevice()
 {
@@ -479,6 +520,16 @@ bool UploadDevice::open(QIODevice::OpenMode mode)
     if (mode & QIODevice::WriteOnly)
         return false;
 
+    if (_source) {
+        if (!_source->isOpen() && !_source->open(QIODevice::ReadOnly)) {
+            setErrorString(_source->errorString());
+            return false;
+        }
+        _size = qBound(0ll, _size, _source->size() - _start);
+        _read = 0;
+        return QIODevice::open(mode);
+    }
+
     // Get the file size now: _file.fileName() is no longer reliable
     // on all platforms after openAndSeekFileSharedRead().
     auto fileDiskSize = FileSystem::getSize(_file.fileName());
@@ -523,17 +574,28 @@ qint64 UploadDevice::readData(char *data, qint64 maxlen)
     if (isChoked()) {
         return 0;
     }
-    if (isBandwidthLimited()) {
-        maxlen = qMin(maxlen, _bandwidthQuota);
-        if (maxlen <= 0) { // no quota
+    const auto quotaTaken = isBandwidthLimited() && _bandwidthManager;
+    if (quotaTaken) {
+        maxlen = _bandwidthManager->takeUploadQuota(maxlen);
+        if (maxlen <= 0) { // no quota, the bandwidth manager wakes us up once there is some
             return 0;
         }
-        _bandwidthQuota -= maxlen;
     }
 
-    auto c = _file.read(data, maxlen);
+    if (_source && _source->pos() != _start + _read && !_source->seek(_start + _read)) {
+        if (quotaTaken) {
+            _bandwidthManager->returnUploadQuota(maxlen);
+        }
+        setErrorString(_source->errorString());
+        return -1;
+    }
+    auto c = input()->read(data, maxlen);
+    // The quota is for what is sent, not for what was asked for
+    if (quotaTaken && c < maxlen) {
+        _bandwidthManager->returnUploadQuota(maxlen - qMax(c, qint64(0)));
+    }
     if (c < 0) {
-        setErrorString(_file.errorString());
+        setErrorString(input()->errorString());
         return -1;
     }
     _read += c;
@@ -578,16 +640,13 @@ bool UploadDevice::seek(qint64 pos)
         return false;
     }
     _read = pos;
-    _file.seek(_start + pos);
+    input()->seek(_start + pos);
     return true;
 }
 
-void UploadDevice::giveBandwidthQuota(qint64 bwq)
+QIODevice *UploadDevice::input()
 {
-    if (!atEnd()) {
-        _bandwidthQuota = bwq;
-        QMetaObject::invokeMethod(this, "readyRead", Qt::QueuedConnection); // tell QNAM that we have quota
-    }
+    return _source ? _source.data() : &_file;
 }
 
 void UploadDevice::setBandwidthLimited(bool b)
@@ -827,7 +886,7 @@ void PropagateUploadFileCommon::finalize()
 
     // Remove from the progress database:
     propagator()->_journal->setUploadInfo(_item->_file, SyncJournalDb::UploadInfo());
-    propagator()->_journal->commit("upload file start");
+    propagator()->_journal->scheduleCommit(QStringLiteral("upload file start"));
 
     if (_uploadingEncrypted) {
         _uploadStatus = { SyncFileItem::Success, QString() };
@@ -19,6 +19,9 @@
 #include <QBuffer>
 #include <QFile>
 #include <QElapsedTimer>
+#include <QSharedPointer>
+
+#include <memory>
 
 
 namespace OCC {
@@ -39,6 +42,8 @@ class UploadDevice : public QIODevice
     Q_OBJECT
 public:
     UploadDevice(const QString &fileName, qint64 start, qint64 size, BandwidthManager *bwm);
+    /// Reads from \a source instead of a local file, it may be shared by several devices
+    UploadDevice(const QSharedPointer<QIODevice> &source, qint64 start, qint64 size, BandwidthManager *bwm);
     ~UploadDevice() override;
 
     bool open(QIODevice::OpenMode mode) override;
@@ -56,14 +61,19 @@ public:
     bool isBandwidthLimited() { return _bandwidthLimited; }
     void setChoked(bool);
     bool isChoked() { return _choked; }
-    void giveBandwidthQuota(qint64 bwq);
 
 signals:
 
 private:
+    /// The device to read data from, _file or _source
+    QIODevice *input();
+
     /// The local file to read data from
     QFile _file;
 
+    /// Data source used instead of _file, positioned before every read
+    QSharedPointer<QIODevice> _source;
+
     /// Start of the file data to use
     qint64 _start = 0;
     /// Amount of file data after _start to use
@@ -73,9 +83,8 @@ private:
 
     // Bandwidth manager related
     QPointer<BandwidthManager> _bandwidthManager;
-    qint64 _bandwidthQuota = 0;
     qint64 _readWithProgress = 0;
-    bool _bandwidthLimited = false; // if _bandwidthQuota will be used
+    bool _bandwidthLimited = false; // if the quota of the bandwidth manager will be used
     bool _choked = false; // if upload is paused (readData() will return 0)
     friend class BandwidthManager;
 public slots:
@@ -266,6 +275,8 @@ private slots:
     void slotFolderUnlocked(const QByteArray &folderId, int httpReturnCode);
     // invoked on internal error to unlock a folder and failed
     void slotOnErrorStartFolderUnlock(SyncFileItem::Status status, const QString &errorString);
+    // invoked when the encrypted file could not be prepared for uploading
+    void slotEncryptedUploadPreparationFailed(const QString &errorString);
 
 public:
     virtual void doStartUpload() = 0;
@@ -316,6 +327,16 @@ protected:
 
     /** Bases headers that need to be sent on the PUT, or in the MOVE for chunking-ng */
     QMap<QByteArray, QByteArray> headers();
+
+    /** Device reading \a size bytes of the content to upload, from \a start
+     *
+     * For encrypted files the content is encrypted again while it is read. All
+     * the devices share one encryption stream, which is fast when they are read
+     * one after the other in order.
+     */
+    std::unique_ptr<UploadDevice> createUploadDevice(qint64 start, qint64 size);
+
+    [[nodiscard]] bool isUploadingEncrypted() const { return _uploadingEncrypted; }
 private:
   PropagateUploadEncrypted *_uploadEncryptedHelper = nullptr;
   bool _uploadingEncrypted = false;
@@ -398,9 +419,10 @@ private slots:
     void slotMkColFinished();
     void slotPutFinished();
     void slotMoveJobFinished();
-    void slotUploadProgress(qint64, qint64);
 
 private:
+    void chunkUploadProgress(PUTFileJob *job, qint64 sent, qint64 total);
+
     // Map chunk number with its size  from the PROPFIND on resume.
     // (Only used from slotPropfindIterate/slotPropfindFinished because the LsColJob use signals to report data.)
     struct ServerChunkInfo {
@@ -416,9 +438,18 @@ private:
     void startNextChunk();
     void finishUpload();
 
+    /// Whether several chunks of the file may be uploaded at the same time
+    [[nodiscard]] bool parallelChunkUploadEnabled() const;
+    /// The data of the chunks the server confirmed plus what the running chunks sent so far
+    [[nodiscard]] qint64 transmittedBytes() const;
+
     QMap<qint64, ServerChunkInfo> _serverChunks;
+    QHash<PUTFileJob *, qint64> _runningChunksSent; /// bytes sent so far by each running chunk
 
-    qint64 _sent = 0; /// amount of data (bytes) that was already sent
+    qint64 _sent = 0; /// amount of data (bytes) that was already sent or is being sent by the running chunks
+    qint64 _acknowledged = 0; /// amount of data (bytes) of the chunks the server confirmed
+    QElapsedTimer _throughputTimer; /// runs since the first chunk of this upload attempt was started
+    qint64 _throughputBaseline = 0; /// _acknowledged when _throughputTimer was started
     uint _transferId = 0; /// transfer id (part of the url)
     int _currentChunk = 1; /// Id of the next chunk that will be sent
     qint64 _currentChunkSize = 0; /// current chunk size
@@ -5,6 +5,7 @@
 #include "foldermetadata.h"
 #include "encryptedfoldermetadatahandler.h"
 #include "account.h"
+#include "common/checksumcalculator.h"
 #include <QFileInfo>
 #include <QDir>
 #include <QUrl>
@@ -12,6 +13,9 @@
 #include <QTemporaryFile>
 #include <QLoggingCategory>
 #include <QMimeDatabase>
+#include <qtconcurrentrun.h>
+
+#include <optional>
 
 namespace OCC {
 
@@ -48,9 +52,9 @@ void PropagateUploadEncrypted::start()
      * find the ID of the folder.
      * lock the folder using it's id.
      * download the metadata
-     * update the metadata
-     * upload the file
-     * upload the metadata
+     * encrypt the file once, for the authentication tag
+     * update and upload the metadata
+     * upload the file, encrypting it again on the fly
      * unlock the folder.
      */
     // Encrypt File!
@@ -90,6 +94,66 @@ const QByteArray PropagateUploadEncrypted::folderToken() const
     return _encryptedFolderMetadataHandler ? _encryptedFolderMetadataHandler->folderToken() : QByteArray{};
 }
 
+QSharedPointer<QIODevice> PropagateUploadEncrypted::encryptedDevice() const
+{
+    return _encryptedDevice;
+}
+
+void PropagateUploadEncrypted::prepareUpload(const QByteArray &transmissionChecksumType)
+{
+    Q_ASSERT(_encryptedDevice);
+
+    // The metadata needs the authentication tag, which is only known once the whole
+    // file was encrypted. Do that pass in a thread and compute the transmission
+    // checksum of the encrypted content on the way, as it is going to be uploaded.
+    _transmissionChecksumType = transmissionChecksumType;
+    connect(&_encryptionWatcher, &QFutureWatcherBase::finished,
+        this, &PropagateUploadEncrypted::slotEncryptionFinished, Qt::UniqueConnection);
+    _encryptionWatcher.setFuture(QtConcurrent::run([device = _encryptedDevice, transmissionChecksumType]() -> std::optional<QByteArray> {
+        if (!device->open(QIODevice::ReadOnly)) {
+            return {};
+        }
+        std::optional<ChecksumCalculator> checksumCalculator;
+        if (!transmissionChecksumType.isEmpty()) {
+            checksumCalculator.emplace(transmissionChecksumType);
+        }
+        QByteArray buffer(64 * 1024, Qt::Uninitialized);
+        while (!device->atEnd()) {
+            const auto bytesRead = device->read(buffer.data(), buffer.size());
+            if (bytesRead <= 0) {
+                device->close();
+                return {};
+            }
+            if (checksumCalculator && checksumCalculator->isValid()) {
+                checksumCalculator->addChunk(buffer, bytesRead);
+            }
+        }
+        device->close();
+        return checksumCalculator ? checksumCalculator->result() : QByteArray();
+    }));
+}
+
+void PropagateUploadEncrypted::slotEncryptionFinished()
+{
+    const auto transmissionChecksum = _encryptionWatcher.result();
+    if (!transmissionChecksum || _encryptedDevice->e2EeTag().isEmpty()) {
+        qCWarning(lcPropagateUploadEncrypted) << "Could not encrypt the file" << _item->_file << _encryptedDevice->errorString();
+        emit uploadPreparationFailed(_encryptedDevice->errorString());
+        return;
+    }
+    _transmissionChecksum = *transmissionChecksum;
+    _encryptedFile.authenticationTag = _encryptedDevice->e2EeTag();
+
+    qCDebug(lcPropagateUploadEncrypted) << "Creating the metadata for the encrypted file.";
+
+    _encryptedFolderMetadataHandler->folderMetadata()->addEncryptedFile(_encryptedFile);
+
+    qCDebug(lcPropagateUploadEncrypted) << "Metadata created, sending to the server.";
+
+    connect(_encryptedFolderMetadataHandler.data(), &EncryptedFolderMetadataHandler::uploadFinished, this, &PropagateUploadEncrypted::slotUploadFileMetadataFinished);
+    _encryptedFolderMetadataHandler->uploadMetadata(EncryptedFolderMetadataHandler::UploadMode::KeepLock);
+}
+
 void PropagateUploadEncrypted::slotFetchMetadataJobFinished(int statusCode, const QString &message)
 {
     qCDebug(lcPropagateUploadEncrypted) << "Metadata Received, Preparing it for the new file." << message;
@@ -146,27 +210,23 @@ void PropagateUploadEncrypted::slotFetchMetadataJobFinished(int statusCode, cons
     _item->_e2eEncryptionServerCapability =
         EncryptionStatusEnums::fromEndToEndEncryptionApiVersion(_propagator->account()->capabilities().clientSideEncryptionVersion());
 
-    qCDebug(lcPropagateUploadEncrypted) << "Creating the encrypted file.";
-
-    if (info.isDir()) {
-        _completeFileName = encryptedFile.encryptedFilename;
-    } else {
-        QFile input(info.absoluteFilePath());
-        QFile output(QDir::tempPath() + QDir::separator() + encryptedFile.encryptedFilename);
+    _encryptedFile = encryptedFile;
 
-        QByteArray tag;
-        bool encryptionResult = EncryptionHelper::fileEncryption(encryptedFile.encryptionKey, encryptedFile.initializationVector, &input, &output, tag);
+    if (!info.isDir()) {
+        // The file is encrypted while it is uploaded, the metadata is uploaded by prepareUpload()
+        _encryptedDevice.reset(new EncryptionHelper::EncryptedFileDevice(info.absoluteFilePath(),
+                                                                         encryptedFile.encryptionKey,
+                                                                         encryptedFile.initializationVector));
 
-        if (!encryptionResult) {
-            qCDebug(lcPropagateUploadEncrypted()) << "There was an error encrypting the file, aborting upload.";
-            emit error();
-            return;
-        }
-
-        encryptedFile.authenticationTag = tag;
-        _completeFileName = output.fileName();
+        qCDebug(lcPropagateUploadEncrypted) << "Finalizing the upload part, now the actuall uploader will take over";
+        emit finalized(info.absoluteFilePath(),
+                       _remoteParentPath + QLatin1Char('/') + encryptedFile.encryptedFilename,
+                       EncryptionHelper::EncryptedFileDevice::encryptedSize(info.size()));
+        return;
     }
 
+    _completeFileName = encryptedFile.encryptedFilename;
+
     qCDebug(lcPropagateUploadEncrypted) << "Creating the metadata for the encrypted file.";
 
     metadata->addEncryptedFile(encryptedFile);
@@ -186,7 +246,7 @@ void PropagateUploadEncrypted::slotUploadMetadataFinished(int statusCode, const
         return;
     }
 
-    qCDebug(lcPropagateUploadEncrypted) << "Uploading of the metadata success, Encrypting the file";
+    qCDebug(lcPropagateUploadEncrypted) << "Uploading of the metadata success";
     QFileInfo outputInfo(_completeFileName);
 
     qCDebug(lcPropagateUploadEncrypted) << "Encrypted Info:" << outputInfo.path() << outputInfo.fileName() << outputInfo.size();
@@ -196,4 +256,18 @@ void PropagateUploadEncrypted::slotUploadMetadataFinished(int statusCode, const
                    outputInfo.size());
 }
 
-} // namespace OCC
\ No newline at end of file
+void PropagateUploadEncrypted::slotUploadFileMetadataFinished(int statusCode, const QString &message)
+{
+    disconnect(_encryptedFolderMetadataHandler.data(), &EncryptedFolderMetadataHandler::uploadFinished, this, &PropagateUploadEncrypted::slotUploadFileMetadataFinished);
+
+    if (statusCode != 200) {
+        qCDebug(lcPropagateUploadEncrypted) << "Update metadata error for folder" << _encryptedFolderMetadataHandler->folderId() << "with error" << message;
+        emit uploadPreparationFailed(message);
+        return;
+    }
+
+    qCDebug(lcPropagateUploadEncrypted) << "Uploading of the metadata success";
+    emit uploadPrepared(_transmissionChecksumType, _transmissionChecksum);
+}
+
+} // namespace OCC
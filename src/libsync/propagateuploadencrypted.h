@@ -10,9 +10,14 @@
 #include <QScopedPointer>
 #include <QFile>
 #include <QTemporaryFile>
+#include <QSharedPointer>
+#include <QFutureWatcher>
+
+#include <optional>
 
 #include "owncloudpropagator.h"
 #include "clientsideencryption.h"
+#include "foldermetadata.h"
 
 namespace OCC {
 
@@ -21,9 +26,14 @@ namespace OCC {
  * client starts the upload request we don't know if the folder is
  * encrypted on the server.
  *
+ * Files are encrypted while they are uploaded, through encryptedDevice().
+ * prepareUpload() encrypts them once before, for the authentication tag
+ * the metadata needs.
+ *
  * emits:
  * finalized() if the encrypted file is ready to be uploaded
  * error() if there was an error with the encryption
+ * uploadPrepared() or uploadPreparationFailed() when prepareUpload() finished
  * folderNotEncrypted() if the file is within a folder that's not encrypted.
  *
  */
@@ -45,14 +55,29 @@ public:
     [[nodiscard]] bool isFolderLocked() const;
     [[nodiscard]] const QByteArray folderToken() const;
 
+    /** The encrypted content of the file, shared by all the requests uploading it */
+    [[nodiscard]] QSharedPointer<QIODevice> encryptedDevice() const;
+
+    /** Adds the file to the folder metadata and uploads it, keeping the folder locked
+     *
+     * The file is encrypted in a thread for its authentication tag, the transmission
+     * checksum of the encrypted content is computed on the way, unless
+     * \a transmissionChecksumType is empty. Must be called before uploading the file.
+     */
+    void prepareUpload(const QByteArray &transmissionChecksumType);
+
 private slots:
     void slotFetchMetadataJobFinished(int statusCode, const QString &message);
     void slotUploadMetadataFinished(int statusCode, const QString &message);
+    void slotEncryptionFinished();
+    void slotUploadFileMetadataFinished(int statusCode, const QString &message);
 
 signals:
-    // Emitted after the file is encrypted and everything is setup.
+    // Emitted when everything is setup for uploading the (encrypted) file.
     void finalized(const QString& path, const QString& filename, quint64 size);
     void error();
+    void uploadPrepared(const QByteArray &transmissionChecksumType, const QByteArray &transmissionChecksum);
+    void uploadPreparationFailed(const QString &errorString);
     void folderUnlocked(const QByteArray &folderId, int httpStatus);
 
 private:
@@ -71,6 +96,12 @@ private:
   QString _completeFileName;
   QString _remoteParentAbsolutePath;
 
+  FolderMetadata::EncryptedFile _encryptedFile;
+  QSharedPointer<EncryptionHelper::EncryptedFileDevice> _encryptedDevice;
+  QFutureWatcher<std::optional<QByteArray>> _encryptionWatcher;
+  QByteArray _transmissionChecksumType;
+  QByteArray _transmissionChecksum;
+
   QScopedPointer<EncryptedFolderMetadataHandler> _encryptedFolderMetadataHandler;
 };
 
@@ -30,6 +30,8 @@
 #include <QNetworkAccessManager>
 #include <QFileInfo>
 #include <QDir>
+
+#include <algorithm>
 #include <cmath>
 #include <cstring>
 
@@ -82,6 +84,10 @@ QUrl PropagateUploadFileNG::chunkUrl(const int chunk) const
     |
     +-> MOVE ------> moveJobFinished() ---> finalize()
 
+    Unless parallel chunk upload is disabled, startNextChunk() keeps starting chunks
+    as long as the propagator allows more transfer jobs, and the MOVE is only sent
+    once every chunk has been acknowledged.
+
 
  */
 
@@ -151,6 +157,8 @@ void PropagateUploadFileNG::slotPropfindFinished()
     propagator()->_activeJobList.removeOne(this);
 
     // Chunked upload v2: numbers range from 1 to 10000
+    // Chunks are uploaded in parallel, so they may have completed out of order: only
+    // the chunks before the first missing one are kept, the later ones are removed below.
     _currentChunk = 1;
     _sent = 0;
     while (_serverChunks.contains(_currentChunk)) {
@@ -158,6 +166,8 @@ void PropagateUploadFileNG::slotPropfindFinished()
         _serverChunks.remove(_currentChunk);
         ++_currentChunk;
     }
+    _acknowledged = _sent;
+    _throughputTimer.invalidate();
 
     if (_sent > _fileToUpload._size) {
         // Normally this can't happen because the size is xor'ed with the transfer id, and it is
@@ -256,6 +266,8 @@ void PropagateUploadFileNG::startNewUpload()
     }
     _transferId = uint(Utility::rand() ^ uint(_item->_modtime) ^ (uint(_fileToUpload._size) << 16) ^ qHash(_fileToUpload._file));
     _sent = 0;
+    _acknowledged = 0;
+    _throughputTimer.invalidate();
     _currentChunk = 1; // Chunked upload v2: numbers range from 1 to 10000
 
     propagator()->reportProgress(*_item, 0);
@@ -350,12 +362,15 @@ void PropagateUploadFileNG::startNextChunk()
     _currentChunkSize = qMin(propagator()->_chunkSize, fileSize - _sent);
 
     if (_currentChunkSize == 0) {
-        finishUpload();
+        if (_jobs.isEmpty()) {
+            finishUpload();
+        }
+        // otherwise the last running chunk finishes the upload
         return;
     }
 
     const auto fileName = _fileToUpload._path;
-    auto device = std::make_unique<UploadDevice>(fileName, _sent, _currentChunkSize, &propagator()->_bandwidthManager);
+    auto device = createUploadDevice(_sent, _currentChunkSize);
     if (!device->open(QIODevice::ReadOnly)) {
         qCWarning(lcPropagateUploadNG) << "Could not prepare upload device: " << device->errorString();
 
@@ -373,6 +388,11 @@ void PropagateUploadFileNG::startNextChunk()
     headers["OC-Chunk-Offset"] = QByteArray::number(_sent);
     headers["Destination"] = destinationHeader();
 
+    if (!_throughputTimer.isValid()) {
+        _throughputTimer.start();
+        _throughputBaseline = _acknowledged;
+    }
+
     _sent += _currentChunkSize;
     const auto url = chunkUrl(_currentChunk);
 
@@ -381,14 +401,45 @@ void PropagateUploadFileNG::startNextChunk()
     const auto job = new PUTFileJob(propagator()->account(), url, std::move(device), headers, _currentChunk, this);
     _jobs.append(job);
     connect(job, &PUTFileJob::finishedSignal, this, &PropagateUploadFileNG::slotPutFinished);
-    connect(job, &PUTFileJob::uploadProgress,
-        this, &PropagateUploadFileNG::slotUploadProgress);
+    connect(job, &PUTFileJob::uploadProgress, this, [this, job](qint64 sent, qint64 total) {
+        chunkUploadProgress(job, sent, total);
+    });
     connect(job, &PUTFileJob::uploadProgress,
         devicePtr, &UploadDevice::slotJobUploadProgress);
     connect(job, &QObject::destroyed, this, &PropagateUploadFileCommon::slotJobDestroyed);
+    connect(job, &QObject::destroyed, this, [this, job] {
+        _runningChunksSent.remove(job);
+    });
     job->start();
     propagator()->_activeJobList.append(this);
     _currentChunk++;
+
+    if (_sent < fileSize && parallelChunkUploadEnabled()
+        && propagator()->_activeJobList.count() < propagator()->maximumActiveTransferJob()) {
+        startNextChunk();
+    }
+}
+
+bool PropagateUploadFileNG::parallelChunkUploadEnabled() const
+{
+    if (propagator()->account()->capabilities().chunkingParallelUploadDisabled()) {
+        return false;
+    }
+    if (isUploadingEncrypted()) {
+        // The chunks are encrypted in order while they are read
+        return false;
+    }
+    const auto env = qgetenv("OWNCLOUD_PARALLEL_CHUNK");
+    return env.isEmpty() || (env != "false" && env != "0");
+}
+
+qint64 PropagateUploadFileNG::transmittedBytes() const
+{
+    auto amount = _acknowledged;
+    for (const auto sent : _runningChunksSent) {
+        amount += sent;
+    }
+    return amount;
 }
 
 void PropagateUploadFileNG::slotPutFinished()
@@ -397,6 +448,7 @@ void PropagateUploadFileNG::slotPutFinished()
     ASSERT(job);
 
     slotJobDestroyed(job); // remove it from the _jobs list
+    _runningChunksSent.remove(job);
 
     propagator()->_activeJobList.removeOne(this);
 
@@ -419,14 +471,23 @@ void PropagateUploadFileNG::slotPutFinished()
 
     ENFORCE(_sent <= _fileToUpload._size, "can't send more than size");
 
+    const auto chunkSize = job->device()->size();
+    _acknowledged += chunkSize;
+
     // Adjust the chunk size for the time taken.
     //
     // Dynamic chunk sizing is enabled if the server configured a
     // target duration for each chunk upload.
     auto targetDuration = propagator()->syncOptions()._targetChunkUploadDuration;
     if (targetDuration.count() > 0) {
-        auto uploadTime = ++job->msSinceStart(); // add one to avoid div-by-zero
-        qint64 predictedGoodSize = (_currentChunkSize * targetDuration) / uploadTime;
+        // The chunks running at the same time share the bandwidth: measure the throughput
+        // of all of them together and give each running chunk its part of it.
+        const auto runningChunks = 1 + std::count_if(_jobs.cbegin(), _jobs.cend(), [](AbstractNetworkJob *runningJob) {
+            return qobject_cast<PUTFileJob *>(runningJob) != nullptr;
+        });
+        const auto uploadTime = _throughputTimer.elapsed() + 1; // add one to avoid div-by-zero
+        const auto uploadedBytes = transmittedBytes() - _throughputBaseline;
+        qint64 predictedGoodSize = uploadedBytes * targetDuration.count() / uploadTime / runningChunks;
 
         // The whole targeting is heuristic. The predictedGoodSize will fluctuate
         // quite a bit because of external factors (like available bandwidth)
@@ -439,13 +500,14 @@ void PropagateUploadFileNG::slotPutFinished()
         // Adjust the dynamic chunk size _chunkSize used for sizing of the item's chunks to be send
         propagator()->_chunkSize = ::qBound(propagator()->syncOptions().minChunkSize(), targetSize, propagator()->syncOptions().maxChunkSize());
 
-        qCInfo(lcPropagateUploadNG) << "Chunked upload of" << _currentChunkSize << "bytes took" << uploadTime.count()
-                                  << "ms, desired is" << targetDuration.count() << "ms, expected good chunk size is"
+        qCInfo(lcPropagateUploadNG) << "Chunked upload of" << chunkSize << "bytes done," << uploadedBytes << "bytes took"
+                                  << uploadTime << "ms with" << runningChunks << "chunks running, desired is"
+                                  << targetDuration.count() << "ms, expected good chunk size is"
                                   << predictedGoodSize << "bytes and nudged next chunk size to "
                                   << propagator()->_chunkSize << "bytes";
     }
 
-    _finished = _sent == _item->_size;
+    _finished = _acknowledged == _fileToUpload._size;
 
     // Check if the file still exists
     const QString fullFilePath(propagator()->fullLocalPath(_item->_file));
@@ -463,7 +525,7 @@ void PropagateUploadFileNG::slotPutFinished()
     if (_item->_modtime <= 0) {
         qCWarning(lcPropagateUpload()) << "invalid modified time" << _item->_file << _item->_modtime;
     }
-    if (!FileSystem::verifyFileUnchanged(fullFilePath, _item->_size, _item->_modtime)) {
+    if (!FileSystem::verifyFileUnchanged(fullFilePath, _item->_size, _item->_modtime, _item->_modtimeNsec)) {
         propagator()->_anotherSyncNeeded = true;
         if (!_finished) {
             abortWithError(SyncFileItem::SoftError, tr("Local file changed during sync."));
@@ -550,7 +612,7 @@ void PropagateUploadFileNG::slotMoveJobFinished()
     finalize();
 }
 
-void PropagateUploadFileNG::slotUploadProgress(qint64 sent, qint64 total)
+void PropagateUploadFileNG::chunkUploadProgress(PUTFileJob *job, qint64 sent, qint64 total)
 {
     // Completion is signaled with sent=0, total=0; avoid accidentally
     // resetting progress due to the sent being zero by ignoring it.
@@ -559,7 +621,8 @@ void PropagateUploadFileNG::slotUploadProgress(qint64 sent, qint64 total)
     if (sent == 0 && total == 0) {
         return;
     }
-    propagator()->reportProgress(*_item, _sent + sent - total);
+    _runningChunksSent[job] = sent;
+    propagator()->reportProgress(*_item, transmittedBytes());
 }
 
 void PropagateUploadFileNG::abort(PropagatorJob::AbortType abortType)
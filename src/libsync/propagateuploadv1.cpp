@@ -135,8 +135,7 @@ void PropagateUploadFileV1::startNextChunk()
     }
 
     const QString fileName = _fileToUpload._path;
-    auto device = std::make_unique<UploadDevice>(
-            fileName, chunkStart, currentChunkSize, &propagator()->_bandwidthManager);
+    auto device = createUploadDevice(chunkStart, currentChunkSize);
     if (!device->open(QIODevice::ReadOnly)) {
         qCWarning(lcPropagateUploadV1) << "Could not prepare upload device: " << device->errorString();
 
@@ -169,6 +168,9 @@ void PropagateUploadFileV1::startNextChunk()
     if (propagator()->account()->capabilities().chunkingParallelUploadDisabled()) {
         // Server may also disable parallel chunked upload for any higher version
         parallelChunkUpload = false;
+    } else if (isUploadingEncrypted()) {
+        // The chunks are encrypted in order while they are read
+        parallelChunkUpload = false;
     } else {
         QByteArray env = qgetenv("OWNCLOUD_PARALLEL_CHUNK");
         if (!env.isEmpty()) {
@@ -264,7 +266,7 @@ void PropagateUploadFileV1::slotPutFinished()
     if (_item->_modtime <= 0) {
         qCWarning(lcPropagateUpload()) << "invalid modified time" << _item->_file << _item->_modtime;
     }
-    if (!FileSystem::verifyFileUnchanged(fullFilePath, _item->_size, _item->_modtime)) {
+    if (!FileSystem::verifyFileUnchanged(fullFilePath, _item->_size, _item->_modtime, _item->_modtimeNsec)) {
         propagator()->_anotherSyncNeeded = true;
         if (!_finished) {
             abortWithError(SyncFileItem::SoftError, tr("Local file changed during sync."));
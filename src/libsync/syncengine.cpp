@@ -41,7 +41,9 @@
 
 #include <climits>
 #include <cassert>
+#include <algorithm>
 #include <chrono>
+#include <iterator>
 
 #include <QCoreApplication>
 #include <QSslSocket>
@@ -63,7 +65,7 @@ namespace OCC {
 
 Q_LOGGING_CATEGORY(lcEngine, "nextcloud.sync.engine", QtInfoMsg)
 
-bool SyncEngine::s_anySyncRunning = false;
+int SyncEngine::s_runningSyncs = 0;
 
 /** When the client touches a file, block change notifications for this duration (ms)
  *
@@ -112,6 +114,19 @@ SyncEngine::SyncEngine(AccountPtr account,
     _clearTouchedFilesTimer.setSingleShot(true);
     _clearTouchedFilesTimer.setInterval(30 * 1000);
     connect(&_clearTouchedFilesTimer, &QTimer::timeout, this, &SyncEngine::slotClearTouchedFiles);
+
+    _journalMaintenanceTimer.setSingleShot(true);
+    connect(&_journalMaintenanceTimer, &QTimer::timeout, this, [this] {
+        if (!_syncRunning) {
+            _journalMaintenanceWatcher.setFuture(_journal->scheduleMaintenance());
+        }
+    });
+    connect(&_journalMaintenanceWatcher, &QFutureWatcherBase::finished, this, [this] {
+        if (_startSyncAfterJournalMaintenance) {
+            _startSyncAfterJournalMaintenance = false;
+            startSync();
+        }
+    });
     connect(this, &SyncEngine::finished, [this](bool /* finished */) {
         _journal->keyValueStoreSet("last_sync", QDateTime::currentSecsSinceEpoch());
     });
@@ -211,6 +226,27 @@ static bool isFileTransferInstruction(SyncInstructions instruction)
         || instruction == CSYNC_INSTRUCTION_TYPE_CHANGE;
 }
 
+// Whether the item can be propagated before the discovery is finished.
+// Anything that may still be changed by later discovery results is excluded,
+// like deletions and renames, as well as anything involving encryption.
+static bool isStreamableItem(const SyncFileItem &item)
+{
+    if (item.isEncrypted() || item._isRestoration || item._isFileDropDetected || item._isEncryptedMetadataNeedUpdate) {
+        return false;
+    }
+    if (item._type == ItemTypeVirtualFile || item._type == ItemTypeVirtualFileDownload || item._type == ItemTypeVirtualFileDehydration) {
+        return false;
+    }
+    if (item.isDirectory()) {
+        return item._instruction == CSYNC_INSTRUCTION_NEW
+            || item._instruction == CSYNC_INSTRUCTION_UPDATE_METADATA
+            || item._instruction == CSYNC_INSTRUCTION_NONE;
+    }
+    return item._instruction == CSYNC_INSTRUCTION_NEW
+        || item._instruction == CSYNC_INSTRUCTION_SYNC
+        || item._instruction == CSYNC_INSTRUCTION_IGNORE;
+}
+
 void SyncEngine::deleteStaleDownloadInfos(const SyncFileItemVector &syncItems)
 {
     // Find all downloadinfo paths that we want to preserve.
@@ -376,6 +412,8 @@ void OCC::SyncEngine::slotItemDiscovered(const OCC::SyncFileItemPtr &item)
             if (rec._checksumHeader.isEmpty())
                 rec._checksumHeader = prev._checksumHeader;
             rec._serverHasIgnoredFiles |= prev._serverHasIgnoredFiles;
+            if (rec._modtimeNsec < 0 && rec._modtime == prev._modtime)
+                rec._modtimeNsec = prev._modtimeNsec;
 
             // Ensure it's a placeholder file on disk
             if (item->_type == ItemTypeFile && _syncOptions._vfs->mode() != Vfs::Off) {
@@ -413,7 +451,7 @@ void OCC::SyncEngine::slotItemDiscovered(const OCC::SyncFileItemPtr &item)
                     return;
                 }
             } else if (prev._modtime != item->_modtime) {
-                if (!FileSystem::setModTime(filePath, item->_modtime)) {
+                if (!FileSystem::setModTime(filePath, item->_modtime, item->_modtimeNsec)) {
                     item->_instruction = CSYNC_INSTRUCTION_ERROR;
                     item->_errorString = tr("Could not update file metadata: %1").arg(filePath);
                     emit itemCompleted(item, ErrorCategory::GenericError);
@@ -443,7 +481,7 @@ void OCC::SyncEngine::slotItemDiscovered(const OCC::SyncFileItemPtr &item)
             lockInfo._lockOwnerDisplayName = item->_lockOwnerDisplayName;
             lockInfo._lockEditorApp = item->_lockOwnerDisplayName;
 
-            if (!_journal->updateLocalMetadata(item->_file, item->_modtime, item->_size, item->_inode, lockInfo)) {
+            if (!_journal->updateLocalMetadata(item->_file, item->_modtime, item->_modtimeNsec, item->_size, item->_inode, lockInfo)) {
                 qCWarning(lcEngine) << "Could not update local metadata for file" << item->_file;
             }
         }
@@ -478,19 +516,103 @@ void OCC::SyncEngine::slotItemDiscovered(const OCC::SyncFileItemPtr &item)
     checkErrorBlacklisting(*item);
     _needsUpdate = true;
 
-    // Insert sorted
-    auto it = std::lower_bound( _syncItems.begin(), _syncItems.end(), item ); // the _syncItems is sorted
-    _syncItems.insert( it, item );
+    // Sorted once the discovery is finished, inserting sorted is quadratic for large trees
+    _syncItems.append(item);
 
     slotNewItem(item);
 
+    if (_propagator && _propagator->isStreaming()) {
+        streamDiscoveredItem(item);
+    }
+
     if (item->isDirectory()) {
         slotFolderDiscovered(item->_etag.isEmpty(), item->_file);
     }
 }
 
+void SyncEngine::slotDirectoryListed(const SyncFileItemPtr &dirItem)
+{
+    if (!dirItem) {
+        startStreamedPropagation();
+        return;
+    }
+
+    if (!_propagator || !_propagator->isStreaming()) {
+        return;
+    }
+
+    const auto parentPath = dirItem->_file.left(qMax(0, dirItem->_file.lastIndexOf(QLatin1Char('/'))));
+    if (!_streamedDirectories.contains(parentPath) || !isStreamableItem(*dirItem)) {
+        return;
+    }
+    _streamedDirectories.insert(dirItem->_file);
+
+    // Unchanged directories don't have a job, their children go to the closest parent job
+    if (dirItem->_instruction == CSYNC_INSTRUCTION_NONE) {
+        return;
+    }
+
+    appendStreamedItem(dirItem);
+}
+
+void SyncEngine::startStreamedPropagation()
+{
+    // The fingerprint check of the root listing may turn downloads into conflicts
+    // and the file regex needs all items, both only happen at the end of the discovery
+    const auto databaseFingerprint = _journal->dataFingerprint();
+    if (singleItemDiscoveryOptions().isValid()
+        || syncOptions().fileRegex().isValid()
+        || (!databaseFingerprint.isEmpty() && _discoveryPhase->_dataFingerprint != databaseFingerprint)) {
+        qCInfo(lcEngine) << "Not starting the propagation before the end of the discovery";
+        return;
+    }
+
+    qCInfo(lcEngine) << "#### Streamed propagation start #################################################### " << _stopWatch.addLapTime(QStringLiteral("Streamed propagation start")) << "ms";
+
+    setupPropagator();
+    _propagator->startStreaming();
+    _streamedDirectories.insert(QString());
+
+    // To announce the beginning of the sync, the items follow with itemAboutToPropagate()
+    emit aboutToPropagate(_syncItems);
+}
+
+void SyncEngine::streamDiscoveredItem(const SyncFileItemPtr &item)
+{
+    if (_streamedItems.contains(item.data())) {
+        // A directory that was handed to the propagator when it was listed
+        return;
+    }
+
+    const auto parentPath = item->_file.left(qMax(0, item->_file.lastIndexOf(QLatin1Char('/'))));
+    if (item->isDirectory() || !_streamedDirectories.contains(parentPath) || !isStreamableItem(*item)) {
+        return;
+    }
+
+    appendStreamedItem(item);
+}
+
+void SyncEngine::appendStreamedItem(const SyncFileItemPtr &item)
+{
+    if (_streamedItems.isEmpty()) {
+        // Emit the started signal only after the propagator has been set up.
+        Q_EMIT started();
+    }
+    _streamedItems.insert(item.data());
+    emit itemAboutToPropagate(item);
+    _propagator->appendStreamedItem(item);
+}
+
 void SyncEngine::startSync()
 {
+    if (_journalMaintenanceWatcher.isRunning()) {
+        // The journal calls would wait for the running maintenance step
+        qCInfo(lcEngine) << "Starting the sync once the journal maintenance stopped";
+        _startSyncAfterJournalMaintenance = true;
+        _journal->abortMaintenance();
+        return;
+    }
+
     if (_journal->exists()) {
         QVector<SyncJournalDb::PollInfo> pollInfos = _journal->getPollInfos();
         if (!pollInfos.isEmpty()) {
@@ -518,7 +640,7 @@ void SyncEngine::startSync()
         }
     }
 
-    if (s_anySyncRunning || _syncRunning) {
+    if (_syncRunning) {
         return;
     }
     const auto currentEncryptionStatus = EncryptionStatusEnums::toDbEncryptionStatus(EncryptionStatusEnums::fromEndToEndEncryptionApiVersion(_account->capabilities().clientSideEncryptionVersion()));
@@ -526,10 +648,14 @@ void SyncEngine::startSync()
         _journal->schedulePathForRemoteDiscovery(record.path());
     });
 
-    s_anySyncRunning = true;
+    ++s_runningSyncs;
     _syncRunning = true;
+    if (s_runningSyncs > 1) {
+        qCInfo(lcEngine) << "Starting a sync while" << s_runningSyncs - 1 << "other syncs are running";
+    }
     _anotherSyncNeeded = NoFollowUpSync;
     _clearTouchedFilesTimer.stop();
+    _journalMaintenanceTimer.stop();
 
     _hasNoneFiles = false;
     _hasRemoveFile = false;
@@ -569,6 +695,9 @@ void SyncEngine::startSync()
 
     _syncItems.clear();
     _needsUpdate = false;
+    _firstTransferSeen = false;
+    _streamedDirectories.clear();
+    _streamedItems.clear();
 
     if (!_journal->exists()) {
         qCInfo(lcEngine) << "New sync (no sync journal exists)";
@@ -679,12 +808,23 @@ void SyncEngine::startSync()
     connect(_discoveryPhase.data(), &DiscoveryPhase::existingFolderNowBig, this, &SyncEngine::existingFolderNowBig);
     connect(_discoveryPhase.data(), &DiscoveryPhase::fatalError, this, [this](const QString &errorString, ErrorCategory errorCategory) {
         Q_EMIT syncError(errorString, errorCategory);
-        finalize(false);
+        if (_propagator) {
+            // A streamed propagation is running, the sync is finalized once it is aborted
+            abort();
+        } else {
+            finalize(false);
+        }
     });
     connect(_discoveryPhase.data(), &DiscoveryPhase::finished, this, &SyncEngine::slotDiscoveryFinished);
+    connect(_discoveryPhase.data(), &DiscoveryPhase::directoryListed, this, &SyncEngine::slotDirectoryListed);
     connect(_discoveryPhase.data(), &DiscoveryPhase::silentlyExcluded,
         _syncFileStatusTracker.data(), &SyncFileStatusTracker::slotAddSilentlyExcluded);
 
+    // Discovering a single item only needs a handful of journal lookups
+    if (!singleItemDiscoveryOptions().isValid()) {
+        _journal->loadDiscoverySnapshot(_syncOptions._discoverySnapshotMemoryBudget);
+    }
+
     ProcessDirectoryJob *discoveryJob = nullptr;
 
     if (singleItemDiscoveryOptions().isValid()) {
@@ -782,11 +922,21 @@ void SyncEngine::slotDiscoveryFinished()
 
     qCInfo(lcEngine) << "#### Discovery end #################################################### " << _stopWatch.addLapTime(QLatin1String("Discovery Finished")) << "ms";
 
+    // Only the discovery does enough lookups to be worth keeping the journal in memory
+    _journal->dropDiscoverySnapshot();
+
+    // The propagator relies on the contents of a directory directly following it
+    std::stable_sort(_syncItems.begin(), _syncItems.end());
+
     // Sanity check
     if (!_journal->open()) {
         qCWarning(lcEngine) << "Bailing out, DB failure";
         Q_EMIT syncError(tr("Cannot open the sync journal"), ErrorCategory::GenericError);
-        finalize(false);
+        if (_propagator) {
+            abort();
+        } else {
+            finalize(false);
+        }
         return;
     } else {
         // Commits a possibly existing (should not though) transaction and starts a new one for the propagate phase
@@ -834,8 +984,21 @@ void SyncEngine::slotDiscoveryFinished()
 
         _localDiscoveryPaths.clear();
 
-        // To announce the beginning of the sync
-        emit aboutToPropagate(_syncItems);
+        const auto isStreamedPropagation = _propagator && _propagator->isStreaming();
+        SyncFileItemVector remainingItems;
+        if (isStreamedPropagation) {
+            // The streamed items were announced already
+            std::copy_if(_syncItems.cbegin(), _syncItems.cend(), std::back_inserter(remainingItems), [this](const SyncFileItemPtr &item) {
+                return !_streamedItems.contains(item.data());
+            });
+            qCInfo(lcEngine) << "Propagation was started during the discovery with" << _streamedItems.size() << "items," << remainingItems.size() << "items remaining";
+            for (const auto &item : qAsConst(remainingItems)) {
+                emit itemAboutToPropagate(item);
+            }
+        } else {
+            // To announce the beginning of the sync
+            emit aboutToPropagate(_syncItems);
+        }
 
         qCInfo(lcEngine) << "#### Reconcile (aboutToPropagate OK) #################################################### "<< _stopWatch.addLapTime(QStringLiteral("Reconcile (aboutToPropagate OK)")) << "ms";
 
@@ -863,22 +1026,9 @@ void SyncEngine::slotDiscoveryFinished()
         // do a database commit
         _journal->commit(QStringLiteral("post treewalk"));
 
-        _propagator = QSharedPointer<OwncloudPropagator>(
-            new OwncloudPropagator(_account, _localPath, _remotePath, _journal, _bulkUploadBlackList));
-        _propagator->setSyncOptions(_syncOptions);
-        connect(_propagator.data(), &OwncloudPropagator::itemCompleted,
-            this, &SyncEngine::slotItemCompleted);
-        connect(_propagator.data(), &OwncloudPropagator::progress,
-            this, &SyncEngine::slotProgress);
-        connect(_propagator.data(), &OwncloudPropagator::finished, this, &SyncEngine::slotPropagationFinished, Qt::QueuedConnection);
-        connect(_propagator.data(), &OwncloudPropagator::seenLockedFile, this, &SyncEngine::seenLockedFile);
-        connect(_propagator.data(), &OwncloudPropagator::touchedFile, this, &SyncEngine::slotAddTouchedFile);
-        connect(_propagator.data(), &OwncloudPropagator::insufficientLocalStorage, this, &SyncEngine::slotInsufficientLocalStorage);
-        connect(_propagator.data(), &OwncloudPropagator::insufficientRemoteStorage, this, &SyncEngine::slotInsufficientRemoteStorage);
-        connect(_propagator.data(), &OwncloudPropagator::newItem, this, &SyncEngine::slotNewItem);
-
-        // apply the network limits to the propagator
-        setNetworkLimits(_uploadLimit, _downloadLimit);
+        if (!isStreamedPropagation) {
+            setupPropagator();
+        }
 
         deleteStaleDownloadInfos(_syncItems);
         deleteStaleUploadInfos(_syncItems);
@@ -886,10 +1036,16 @@ void SyncEngine::slotDiscoveryFinished()
         _journal->commit(QStringLiteral("post stale entry removal"));
 
         // Emit the started signal only after the propagator has been set up.
-        if (_needsUpdate)
+        if (_needsUpdate && _streamedItems.isEmpty())
             Q_EMIT started();
 
-        _propagator->start(std::move(_syncItems));
+        if (isStreamedPropagation) {
+            _syncItems.clear();
+            _streamedItems.clear();
+            _propagator->finishStreaming(std::move(remainingItems));
+        } else {
+            _propagator->start(std::move(_syncItems));
+        }
 
         qCInfo(lcEngine) << "#### Post-Reconcile end #################################################### " << _stopWatch.addLapTime(QStringLiteral("Post-Reconcile Finished")) << "ms";
     };
@@ -914,7 +1070,11 @@ void SyncEngine::slotDiscoveryFinished()
             guard->deleteLater();
             if (cancel) {
                 qCInfo(lcEngine) << "User aborted sync";
-                finalize(false);
+                if (_propagator) {
+                    abort();
+                } else {
+                    finalize(false);
+                }
                 return;
             } else {
                 finish();
@@ -926,6 +1086,29 @@ void SyncEngine::slotDiscoveryFinished()
     finish();
 }
 
+void SyncEngine::setupPropagator()
+{
+    _propagator = QSharedPointer<OwncloudPropagator>(
+        new OwncloudPropagator(_account, _localPath, _remotePath, _journal, _bulkUploadBlackList));
+    _propagator->setSyncOptions(_syncOptions);
+    connect(_propagator.data(), &OwncloudPropagator::itemCompleted,
+        this, &SyncEngine::slotItemCompleted);
+    connect(_propagator.data(), &OwncloudPropagator::progress,
+        this, &SyncEngine::slotProgress);
+    connect(_propagator.data(), &OwncloudPropagator::finished, this, &SyncEngine::slotPropagationFinished, Qt::QueuedConnection);
+    connect(_propagator.data(), &OwncloudPropagator::seenLockedFile, this, &SyncEngine::seenLockedFile);
+    connect(_propagator.data(), &OwncloudPropagator::touchedFile, this, &SyncEngine::slotAddTouchedFile);
+    connect(_propagator.data(), &OwncloudPropagator::insufficientLocalStorage, this, &SyncEngine::slotInsufficientLocalStorage);
+    connect(_propagator.data(), &OwncloudPropagator::insufficientRemoteStorage, this, &SyncEngine::slotInsufficientRemoteStorage);
+    connect(_propagator.data(), &OwncloudPropagator::newItem, this, &SyncEngine::slotNewItem);
+
+    // apply the network limits to the propagator
+    setNetworkLimits(_uploadLimit, _downloadLimit);
+
+    // Jobs schedule their commits, so many small files don't need a transaction each
+    _journal->setGroupCommitEnabled(true);
+}
+
 void SyncEngine::slotCleanPollsJobAborted(const QString &error, const ErrorCategory errorCategory)
 {
     emit syncError(error, errorCategory);
@@ -970,6 +1153,7 @@ void SyncEngine::slotPropagationFinished(OCC::SyncFileItem::Status status)
     caseClashConflictRecordMaintenance();
 
     _journal->deleteStaleFlagsEntries();
+    _journal->deleteStaleChecksumCacheEntries();
     _journal->commit("All Finished.", false);
 
     // Send final progress information even if no
@@ -987,12 +1171,29 @@ void SyncEngine::finalize(bool success)
     setSingleItemDiscoveryOptions({});
 
     qCInfo(lcEngine) << "Sync run took " << _stopWatch.addLapTime(QLatin1String("Sync Finished")) << "ms";
+    if (_firstTransferSeen) {
+        qCInfo(lcEngine) << "Time to first transfer" << _stopWatch.durationOfLap(QStringLiteral("First transfer")) << "ms";
+    }
+    if (_propagator) {
+        qCInfo(lcEngine) << "Time spent scheduling propagation jobs"
+                         << std::chrono::duration_cast<std::chrono::milliseconds>(_propagator->schedulingDuration()).count() << "ms in"
+                         << _propagator->schedulingPasses() << "passes";
+    }
+    const auto commitStatistics = _journal->commitStatistics();
+    if (commitStatistics.transactions > 0) {
+        qCInfo(lcEngine) << "Journal commits:" << commitStatistics.transactions << "transactions for"
+                         << commitStatistics.commitRequests << "requested commits in" << commitStatistics.elapsedMsecs << "ms,"
+                         << commitStatistics.transactions * 1000.0 / qMax<qint64>(commitStatistics.elapsedMsecs, 1) << "per second,"
+                         << double(commitStatistics.commitRequests) / commitStatistics.transactions << "commits per transaction";
+    }
+    _journal->setGroupCommitEnabled(false);
+    _journal->dropDiscoverySnapshot();
     _stopWatch.stop();
 
     if (_discoveryPhase) {
         _discoveryPhase.take()->deleteLater();
     }
-    s_anySyncRunning = false;
+    --s_runningSyncs;
     _syncRunning = false;
     emit finished(success);
 
@@ -1009,6 +1210,9 @@ void SyncEngine::finalize(bool success)
     _localDiscoveryStyle = LocalDiscoveryStyle::FilesystemOnly;
 
     _clearTouchedFilesTimer.start();
+    if (_syncOptions._journalMaintenanceDelay.count() > 0) {
+        _journalMaintenanceTimer.start(_syncOptions._journalMaintenanceDelay);
+    }
     _leadingAndTrailingSpacesFilesAllowed.clear();
 }
 
@@ -1031,6 +1235,10 @@ void SyncEngine::processCaseClashConflictsBeforeDiscovery()
 
 void SyncEngine::slotProgress(const SyncFileItem &item, qint64 current)
 {
+    if (!_firstTransferSeen) {
+        _firstTransferSeen = true;
+        qCInfo(lcEngine) << "#### First transfer #################################################### " << _stopWatch.addLapTime(QStringLiteral("First transfer")) << "ms";
+    }
     _progressInfo->setProgressItem(item, current);
     emit transmissionProgress(*_progressInfo);
 }
@@ -1243,7 +1451,13 @@ void SyncEngine::switchToVirtualFiles(const QString &localPath, SyncJournalDb &j
 
 void SyncEngine::abort()
 {
+    _startSyncAfterJournalMaintenance = false;
     if (_propagator) {
+        if (_discoveryPhase && _propagator->isStreaming()) {
+            // The discovery still feeds the propagator, make sure it can't finish and add more
+            disconnect(_discoveryPhase.data(), nullptr, this, nullptr);
+            _discoveryPhase.take()->deleteLater();
+        }
         // If we're already in the propagation phase, aborting that is sufficient
         qCInfo(lcEngine) << "Aborting sync in propagator...";
         _propagator->abort();
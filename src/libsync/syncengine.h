@@ -17,6 +17,7 @@
 
 #include <cstdint>
 
+#include <QFutureWatcher>
 #include <QMutex>
 #include <QThread>
 #include <QString>
@@ -126,7 +127,7 @@ public:
 
     static void switchToVirtualFiles(const QString &localPath, SyncJournalDb &journal, Vfs &vfs);
 
-    [[nodiscard]] QSharedPointer<OwncloudPropagator> getPropagator() const { return _propagator; } // for the test
+    [[nodiscard]] QSharedPointer<OwncloudPropagator> getPropagator() const { return _propagator; }
     [[nodiscard]] const SyncEngine::SingleItemDiscoveryOptions &singleItemDiscoveryOptions() const;
 
 public slots:
@@ -162,6 +163,10 @@ signals:
     // after the above signals. with the items that actually need propagating
     void aboutToPropagate(OCC::SyncFileItemVector &);
 
+    // with streamed propagation aboutToPropagate() comes with no items,
+    // they are announced one by one before being handed to the propagator
+    void itemAboutToPropagate(const OCC::SyncFileItemPtr &item);
+
     // after each item completed by a job (successful or not)
     void itemCompleted(const OCC::SyncFileItemPtr &item, const OCC::ErrorCategory category);
 
@@ -202,6 +207,12 @@ private slots:
     /** When the discovery phase discovers an item */
     void slotItemDiscovered(const OCC::SyncFileItemPtr &item);
 
+    /** When the discovery phase starts processing the entries of a directory
+     *
+     * Used to start and feed a streamed propagation, see SyncOptions::_streamedPropagation.
+     */
+    void slotDirectoryListed(const OCC::SyncFileItemPtr &dirItem);
+
     /** Called when a SyncFileItem gets accepted for a sync.
      *
      * Mostly done in initial creation inside treewalkFile but
@@ -293,6 +304,17 @@ private:
     // cleanup and emit the finished signal
     void finalize(bool success);
 
+    // Creates the propagator and connects it to the engine
+    void setupPropagator();
+
+    // Starts the propagator before the discovery is finished, if the sync allows it
+    void startStreamedPropagation();
+
+    // Hands a discovered item to a streamed propagation, or holds it back for
+    // the regular start of the propagation after the discovery
+    void streamDiscoveredItem(const SyncFileItemPtr &item);
+    void appendStreamedItem(const SyncFileItemPtr &item);
+
     void processCaseClashConflictsBeforeDiscovery();
 
     // Aggregate scheduled sync runs into interval buckets. Can be used to
@@ -313,9 +335,10 @@ private:
     QSharedPointer<SyncEngine::ScheduledSyncTimer> nearbyScheduledSyncTimer(const qint64 scheduledSyncTimerSecs,
                                                                             const qint64 intervalSecs) const;
 
-    static bool s_anySyncRunning; //true when one sync is running somewhere (for debugging)
+    static int s_runningSyncs; // number of syncs running in this process, folders may sync concurrently (for debugging)
 
     // Must only be accessed during update and reconcile
+    // Items are appended during discovery and only sorted once it is finished
     QVector<SyncFileItemPtr> _syncItems;
 
     AccountPtr _account;
@@ -339,6 +362,15 @@ private:
     QScopedPointer<SyncFileStatusTracker> _syncFileStatusTracker;
     Utility::StopWatch _stopWatch;
 
+    // true once the first transfer progress of the sync run was reported
+    bool _firstTransferSeen = false;
+
+    // Directories whose new children may be handed to a streamed propagation
+    QSet<QString> _streamedDirectories;
+
+    // Items that were handed to the propagator while the discovery was running
+    QSet<const SyncFileItem *> _streamedItems;
+
     /**
      * check if we are allowed to propagate everything, and if we are not, adjust the instructions
      * to recover
@@ -375,6 +407,12 @@ private:
     /** For clearing the _touchedFiles variable after sync finished */
     QTimer _clearTouchedFilesTimer;
 
+    /** Runs the journal maintenance once no sync ran for a while */
+    QTimer _journalMaintenanceTimer;
+    QFutureWatcher<void> _journalMaintenanceWatcher;
+    /** startSync() was called while the journal maintenance was running */
+    bool _startSyncAfterJournalMaintenance = false;
+
     /** List of unique errors that occurred in a sync run. */
     QSet<QString> _uniqueErrors;
 
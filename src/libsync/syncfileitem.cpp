@@ -97,6 +97,7 @@ SyncJournalFileRecord SyncFileItem::toSyncJournalFileRecordWithInode(const QStri
     SyncJournalFileRecord rec;
     rec._path = destination().toUtf8();
     rec._modtime = _modtime;
+    rec._modtimeNsec = _modtimeNsec;
 
     // Some types should never be written to the database when propagation completes
     rec._type = _type;
@@ -146,6 +147,7 @@ SyncFileItemPtr SyncFileItem::fromSyncJournalFileRecord(const SyncJournalFileRec
     item->_file = rec.path();
     item->_inode = rec._inode;
     item->_modtime = rec._modtime;
+    item->_modtimeNsec = rec._modtimeNsec;
     item->_type = rec._type;
     item->_etag = rec._etag;
     item->_fileId = rec._fileId;
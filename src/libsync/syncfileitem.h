@@ -299,6 +299,8 @@ public:
     // Variables used by the propagator
     SyncInstructions _instruction = CSYNC_INSTRUCTION_NONE;
     time_t _modtime = 0;
+    // Sub-second part of _modtime when it comes from the local file system, -1 otherwise
+    qint32 _modtimeNsec = -1;
     QByteArray _etag;
     qint64 _size = 0;
     quint64 _inode = 0;
@@ -115,11 +115,14 @@ SyncFileStatusTracker::SyncFileStatusTracker(SyncEngine *syncEngine)
 {
     connect(syncEngine, &SyncEngine::aboutToPropagate,
         this, &SyncFileStatusTracker::slotAboutToPropagate);
+    connect(syncEngine, &SyncEngine::itemAboutToPropagate,
+        this, &SyncFileStatusTracker::slotItemAboutToPropagate);
     connect(syncEngine, &SyncEngine::itemCompleted,
         this, &SyncFileStatusTracker::slotItemCompleted);
     connect(syncEngine, &SyncEngine::finished, this, &SyncFileStatusTracker::slotSyncFinished);
     connect(syncEngine, &SyncEngine::started, this, &SyncFileStatusTracker::slotSyncEngineRunningChanged);
     connect(syncEngine, &SyncEngine::finished, this, &SyncFileStatusTracker::slotSyncEngineRunningChanged);
+    connect(this, &SyncFileStatusTracker::fileStatusChanged, this, &SyncFileStatusTracker::slotInvalidateCachedStatus);
 }
 
 SyncFileStatus SyncFileStatusTracker::fileStatus(const QString &relativePath)
@@ -131,6 +134,29 @@ SyncFileStatus SyncFileStatusTracker::fileStatus(const QString &relativePath)
         return resolveSyncAndErrorStatus(QString(), NotShared);
     }
 
+    const auto cached = _statusCache.constFind(relativePath);
+    if (cached != _statusCache.cend())
+        return *cached;
+
+    const auto status = computeFileStatus(relativePath);
+    _statusCache.insert(relativePath, status);
+    return status;
+}
+
+SyncFileStatus SyncFileStatusTracker::uncachedFileStatus(const QString &relativePath)
+{
+    // The cached status is only dropped by the fileStatusChanged signal about to be emitted
+    _statusCache.remove(relativePath);
+    return fileStatus(relativePath);
+}
+
+SyncFileStatus SyncFileStatusTracker::computeFileStatus(const QString &relativePath)
+{
+    // The record also tells whether the path is a directory, for the exclude check below.
+    // Read what is committed, so the file manager doesn't wait for a running sync.
+    SyncJournalFileRecord rec;
+    const auto hasRecord = _syncEngine->journal()->getCommittedFileRecord(relativePath, &rec) && rec.isValid();
+
     // The SyncEngine won't notify us at all for CSYNC_FILE_SILENTLY_EXCLUDED
     // and CSYNC_FILE_EXCLUDE_AND_REMOVE excludes. Even though it's possible
     // that the status of CSYNC_FILE_EXCLUDE_LIST excludes will change if the user
@@ -139,8 +165,10 @@ SyncFileStatus SyncFileStatusTracker::fileStatus(const QString &relativePath)
     // it's an acceptable compromise to treat all exclude types the same.
     // Update: This extra check shouldn't hurt even though silently excluded files
     // are now available via slotAddSilentlyExcluded().
-    if (_syncEngine->excludedFiles().isExcluded(_syncEngine->localPath() + relativePath,
-            _syncEngine->localPath(),
+    // Paths without a record are checked as files, excluded directories found by the
+    // discovery are in _syncProblems anyway.
+    if (_syncEngine->excludedFiles().isExcludedPath(relativePath,
+            rec.isDirectory() ? ItemTypeDirectory : ItemTypeFile,
             _syncEngine->ignoreHiddenFiles())) {
         return SyncFileStatus::StatusExcluded;
     }
@@ -148,9 +176,8 @@ SyncFileStatus SyncFileStatusTracker::fileStatus(const QString &relativePath)
     if (_dirtyPaths.contains(relativePath))
         return SyncFileStatus::StatusSync;
 
-    // First look it up in the database to know if it's shared
-    SyncJournalFileRecord rec;
-    if (_syncEngine->journal()->getFileRecord(relativePath, &rec) && rec.isValid()) {
+    // The database knows if it's shared
+    if (hasRecord) {
         return resolveSyncAndErrorStatus(relativePath, rec._remotePerm.hasPermission(RemotePermissions::IsShared) ? Shared : NotShared);
     }
 
@@ -181,7 +208,7 @@ void SyncFileStatusTracker::incSyncCountAndEmitStatusChanged(const QString &rela
     int count = _syncCount[relativePath]++;
     if (!count) {
         SyncFileStatus status = sharedFlag == UnknownShared
-            ? fileStatus(relativePath)
+            ? uncachedFileStatus(relativePath)
             : resolveSyncAndErrorStatus(relativePath, sharedFlag);
         emit fileStatusChanged(getSystemDestination(relativePath), status);
 
@@ -204,7 +231,7 @@ void SyncFileStatusTracker::decSyncCountAndEmitStatusChanged(const QString &rela
         _syncCount.remove(relativePath);
 
         SyncFileStatus status = sharedFlag == UnknownShared
-            ? fileStatus(relativePath)
+            ? uncachedFileStatus(relativePath)
             : resolveSyncAndErrorStatus(relativePath, sharedFlag);
         emit fileStatusChanged(getSystemDestination(relativePath), status);
 
@@ -222,30 +249,14 @@ void SyncFileStatusTracker::slotAboutToPropagate(SyncFileItemVector &items)
 {
     ASSERT(_syncCount.isEmpty());
 
+    // The problems of the previous sync are about to be replaced
+    _statusCache.clear();
+
     ProblemsMap oldProblems;
     std::swap(_syncProblems, oldProblems);
 
     foreach (const SyncFileItemPtr &item, items) {
-        qCInfo(lcStatusTracker) << "Investigating" << item->destination() << item->_status << item->_instruction << item->_direction;
-        _dirtyPaths.remove(item->destination());
-
-        if (hasErrorStatus(*item)) {
-            _syncProblems[item->destination()] = SyncFileStatus::StatusError;
-            invalidateParentPaths(item->destination());
-        } else if (hasExcludedStatus(*item)) {
-            _syncProblems[item->destination()] = SyncFileStatus::StatusExcluded;
-        }
-
-        SharedFlag sharedFlag = item->_remotePerm.hasPermission(RemotePermissions::IsShared) ? Shared : NotShared;
-        if (item->_instruction != CSYNC_INSTRUCTION_NONE
-            && item->_instruction != CSYNC_INSTRUCTION_UPDATE_METADATA
-            && item->_instruction != CSYNC_INSTRUCTION_IGNORE
-            && item->_instruction != CSYNC_INSTRUCTION_ERROR) {
-            // Mark this path as syncing for instructions that will result in propagation.
-            incSyncCountAndEmitStatusChanged(item->destination(), sharedFlag);
-        } else {
-            emit fileStatusChanged(getSystemDestination(item->destination()), resolveSyncAndErrorStatus(item->destination(), sharedFlag));
-        }
+        slotItemAboutToPropagate(item);
     }
 
     // Some metadata status won't trigger files to be synced, make sure that we
@@ -254,7 +265,7 @@ void SyncFileStatusTracker::slotAboutToPropagate(SyncFileItemVector &items)
     QSet<QString> oldDirtyPaths;
     std::swap(_dirtyPaths, oldDirtyPaths);
     for (const auto &oldDirtyPath : qAsConst(oldDirtyPaths))
-        emit fileStatusChanged(getSystemDestination(oldDirtyPath), fileStatus(oldDirtyPath));
+        emit fileStatusChanged(getSystemDestination(oldDirtyPath), uncachedFileStatus(oldDirtyPath));
 
     // Make sure to push any status that might have been resolved indirectly since the last sync
     // (like an error file being deleted from disk)
@@ -265,7 +276,31 @@ void SyncFileStatusTracker::slotAboutToPropagate(SyncFileItemVector &items)
         SyncFileStatus::SyncFileStatusTag severity = oldProblem.second;
         if (severity == SyncFileStatus::StatusError)
             invalidateParentPaths(path);
-        emit fileStatusChanged(getSystemDestination(path), fileStatus(path));
+        emit fileStatusChanged(getSystemDestination(path), uncachedFileStatus(path));
+    }
+}
+
+void SyncFileStatusTracker::slotItemAboutToPropagate(const SyncFileItemPtr &item)
+{
+    qCInfo(lcStatusTracker) << "Investigating" << item->destination() << item->_status << item->_instruction << item->_direction;
+    _dirtyPaths.remove(item->destination());
+
+    if (hasErrorStatus(*item)) {
+        _syncProblems[item->destination()] = SyncFileStatus::StatusError;
+        invalidateParentPaths(item->destination());
+    } else if (hasExcludedStatus(*item)) {
+        _syncProblems[item->destination()] = SyncFileStatus::StatusExcluded;
+    }
+
+    SharedFlag sharedFlag = item->_remotePerm.hasPermission(RemotePermissions::IsShared) ? Shared : NotShared;
+    if (item->_instruction != CSYNC_INSTRUCTION_NONE
+        && item->_instruction != CSYNC_INSTRUCTION_UPDATE_METADATA
+        && item->_instruction != CSYNC_INSTRUCTION_IGNORE
+        && item->_instruction != CSYNC_INSTRUCTION_ERROR) {
+        // Mark this path as syncing for instructions that will result in propagation.
+        incSyncCountAndEmitStatusChanged(item->destination(), sharedFlag);
+    } else {
+        emit fileStatusChanged(getSystemDestination(item->destination()), resolveSyncAndErrorStatus(item->destination(), sharedFlag));
     }
 }
 
@@ -279,7 +314,13 @@ void SyncFileStatusTracker::slotItemCompleted(const SyncFileItemPtr &item)
     } else if (hasExcludedStatus(*item)) {
         _syncProblems[item->destination()] = SyncFileStatus::StatusExcluded;
     } else {
-        _syncProblems.erase(item->destination());
+        const auto problem = _syncProblems.find(item->destination());
+        if (problem != _syncProblems.end()) {
+            // The parents might have been showing a warning for this error
+            if (problem->second == SyncFileStatus::StatusError)
+                _statusCache.clear();
+            _syncProblems.erase(problem);
+        }
     }
 
     SharedFlag sharedFlag = item->_remotePerm.hasPermission(RemotePermissions::IsShared) ? Shared : NotShared;
@@ -305,12 +346,14 @@ void SyncFileStatusTracker::slotSyncFinished()
             continue;
         }
 
-        emit fileStatusChanged(getSystemDestination(it.key()), fileStatus(it.key()));
+        emit fileStatusChanged(getSystemDestination(it.key()), uncachedFileStatus(it.key()));
     }
 }
 
 void SyncFileStatusTracker::slotSyncEngineRunningChanged()
 {
+    // The exclude list is reloaded and the journal written while syncing
+    _statusCache.clear();
     emit fileStatusChanged(getSystemDestination(QString()), resolveSyncAndErrorStatus(QString(), NotShared));
 }
 
@@ -342,7 +385,7 @@ void SyncFileStatusTracker::invalidateParentPaths(const QString &path)
     QStringList splitPath = path.split('/', Qt::SkipEmptyParts);
     for (int i = 0; i < splitPath.size(); ++i) {
         QString parentPath = QStringList(splitPath.mid(0, i)).join(QLatin1String("/"));
-        emit fileStatusChanged(getSystemDestination(parentPath), fileStatus(parentPath));
+        emit fileStatusChanged(getSystemDestination(parentPath), uncachedFileStatus(parentPath));
     }
 }
 
@@ -356,4 +399,11 @@ QString SyncFileStatusTracker::getSystemDestination(const QString &relativePath)
     }
     return systemPath;
 }
+
+void SyncFileStatusTracker::slotInvalidateCachedStatus(const QString &systemFileName)
+{
+    // The inverse of getSystemDestination()
+    const auto &localPath = _syncEngine->localPath();
+    _statusCache.remove(systemFileName.size() < localPath.size() ? QString() : systemFileName.mid(localPath.size()));
+}
 }
@@ -36,6 +36,13 @@ class OWNCLOUDSYNC_EXPORT SyncFileStatusTracker : public QObject
     Q_OBJECT
 public:
     explicit SyncFileStatusTracker(SyncEngine *syncEngine);
+
+    /**
+     * The status of the path, as shown by the shell integration.
+     *
+     * Results are cached until the status of the path changes, so repeated
+     * lookups don't query the journal again and never touch the file system.
+     */
     SyncFileStatus fileStatus(const QString &relativePath);
 
 public slots:
@@ -48,9 +55,11 @@ signals:
 
 private slots:
     void slotAboutToPropagate(OCC::SyncFileItemVector &items);
+    void slotItemAboutToPropagate(const OCC::SyncFileItemPtr &item);
     void slotItemCompleted(const OCC::SyncFileItemPtr &item);
     void slotSyncFinished();
     void slotSyncEngineRunningChanged();
+    void slotInvalidateCachedStatus(const QString &systemFileName);
 
 private:
     struct PathComparator {
@@ -64,6 +73,9 @@ private:
         Shared };
     enum PathKnownFlag { PathUnknown = 0,
         PathKnown };
+    // Like fileStatus(), but ignores the cache, for a status that is about to be pushed
+    SyncFileStatus uncachedFileStatus(const QString &relativePath);
+    SyncFileStatus computeFileStatus(const QString &relativePath);
     SyncFileStatus resolveSyncAndErrorStatus(const QString &relativePath, SharedFlag sharedState, PathKnownFlag isPathKnown = PathKnown);
 
     void invalidateParentPaths(const QString &path);
@@ -79,6 +91,9 @@ private:
     // We'll show a file/directory as SYNC as long as its sync count is > 0.
     // A directory that starts/ends propagation will in turn increase/decrease its own parent by 1.
     QHash<QString, int> _syncCount;
+    // The results of fileStatus(), dropped whenever fileStatusChanged is emitted for
+    // a path and cleared when a sync starts or finishes.
+    QHash<QString, SyncFileStatus> _statusCache;
 };
 }
 
@@ -67,6 +67,26 @@ void SyncOptions::fillFromEnvironmentVariables()
     int maxParallel = qgetenv("OWNCLOUD_MAX_PARALLEL").toInt();
     if (maxParallel > 0)
         _parallelNetworkJobs = maxParallel;
+
+    QByteArray streamedPropagationEnv = qgetenv("OWNCLOUD_STREAMED_PROPAGATION");
+    if (!streamedPropagationEnv.isEmpty())
+        _streamedPropagation = streamedPropagationEnv != "0";
+
+    QByteArray minSegmentedDownloadSizeEnv = qgetenv("OWNCLOUD_MIN_SEGMENTED_DOWNLOAD_SIZE");
+    if (!minSegmentedDownloadSizeEnv.isEmpty())
+        _minSegmentedDownloadSize = minSegmentedDownloadSizeEnv.toLongLong();
+
+    QByteArray recursiveRemoteListingEnv = qgetenv("OWNCLOUD_RECURSIVE_REMOTE_LISTING");
+    if (!recursiveRemoteListingEnv.isEmpty())
+        _recursiveRemoteListing = recursiveRemoteListingEnv != "0";
+
+    QByteArray discoverySnapshotBudgetEnv = qgetenv("OWNCLOUD_DISCOVERY_SNAPSHOT_BUDGET");
+    if (!discoverySnapshotBudgetEnv.isEmpty())
+        _discoverySnapshotMemoryBudget = discoverySnapshotBudgetEnv.toLongLong();
+
+    QByteArray journalMaintenanceDelayEnv = qgetenv("OWNCLOUD_JOURNAL_MAINTENANCE_DELAY");
+    if (!journalMaintenanceDelayEnv.isEmpty())
+        _journalMaintenanceDelay = std::chrono::milliseconds(journalMaintenanceDelayEnv.toUInt());
 }
 
 void SyncOptions::verifyChunkSizes()
@@ -66,6 +66,44 @@ public:
     /** The maximum number of active jobs in parallel  */
     int _parallelNetworkJobs = 6;
 
+    /** Start propagating items while discovery is still running.
+     *
+     * New items below directories that were already listed are handed to
+     * the propagator as soon as they are discovered instead of waiting for
+     * the whole tree to be walked. Removals, renames and anything needing
+     * the complete discovery result are still propagated afterwards.
+     */
+    bool _streamedPropagation = false;
+
+    /** Files of at least this size (in bytes) are downloaded in several byte
+     * ranges in parallel, written into the same temporary file.
+     *
+     * Set to 0 it will disable segmented downloads.
+     */
+    qint64 _minSegmentedDownloadSize = 100LL * 1000LL * 1000LL; // 100MB
+
+    /** List remote directories that are unknown to the journal with a single
+     * Depth: infinity PROPFIND for their whole subtree instead of one request
+     * per directory.
+     *
+     * Falls back to Depth: 1 listings if the server refuses such requests.
+     */
+    bool _recursiveRemoteListing = false;
+
+    /** Load the journal into memory for the discovery if it fits into this
+     * many bytes, instead of querying it once per directory and file.
+     *
+     * Set to 0 it will always query the journal.
+     */
+    qint64 _discoverySnapshotMemoryBudget = 256LL * 1024LL * 1024LL; // 256MiB
+
+    /** How long the sync engine has to be idle before the journal maintenance
+     * (WAL checkpoint, vacuum, ANALYZE) runs.
+     *
+     * Set to 0 it will disable the maintenance.
+     */
+    std::chrono::milliseconds _journalMaintenanceDelay = std::chrono::minutes(1);
+
     static constexpr auto chunkV2MinChunkSize = 5LL * 1000LL * 1000LL; // 5 MB
     static constexpr auto chunkV2MaxChunkSize = 5LL * 1000LL * 1000LL * 1000LL; // 5 GB
 
@@ -80,7 +118,9 @@ public:
     /** Reads settings from env vars where available.
      *
      * Currently reads _initialChunkSize, _minChunkSize, _maxChunkSize,
-     * _targetChunkUploadDuration, _parallelNetworkJobs.
+     * _targetChunkUploadDuration, _parallelNetworkJobs, _streamedPropagation,
+     * _minSegmentedDownloadSize, _recursiveRemoteListing,
+     * _discoverySnapshotMemoryBudget, _journalMaintenanceDelay.
      */
     void fillFromEnvironmentVariables();
 
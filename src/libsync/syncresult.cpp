@@ -185,4 +185,10 @@ void SyncResult::processCompletedItem(const SyncFileItemPtr &item)
     }
 }
 
+void SyncResult::setSchedulingStatistics(std::chrono::milliseconds duration, qint64 passes)
+{
+    _schedulingDuration = duration;
+    _schedulingPasses = passes;
+}
+
 } // ns mirall
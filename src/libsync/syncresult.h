@@ -19,6 +19,8 @@
 #include <QHash>
 #include <QDateTime>
 
+#include <chrono>
+
 #include "owncloudlib.h"
 #include "syncfileitem.h"
 
@@ -87,6 +89,11 @@ public:
 
     void processCompletedItem(const SyncFileItemPtr &item);
 
+    /// Time the propagator spent picking the jobs to start, and in how many passes
+    [[nodiscard]] std::chrono::milliseconds schedulingDuration() const { return _schedulingDuration; }
+    [[nodiscard]] qint64 schedulingPasses() const { return _schedulingPasses; }
+    void setSchedulingStatistics(std::chrono::milliseconds duration, qint64 passes);
+
 private:
     Status _status = Undefined;
     SyncFileItemVector _syncItems;
@@ -109,6 +116,9 @@ private:
     int _numErrorItems = 0;
     int _numLockedItems = 0;
 
+    std::chrono::milliseconds _schedulingDuration{0};
+    qint64 _schedulingPasses = 0;
+
     SyncFileItemPtr _firstItemNew;
     SyncFileItemPtr _firstItemDeleted;
     SyncFileItemPtr _firstItemUpdated;
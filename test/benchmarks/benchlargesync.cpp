@@ -31,11 +31,13 @@ void addBunchOfFiles(int depth, const QString &path, FileModifier &fi) {
     }
 }
 
-int main(int argc, char *argv[])
+template<int filesPerDir, int dirPerDir, int maxDepth>
+bool benchLargeSync()
 {
-    QCoreApplication app(argc, argv);
+    numDirs = 0;
+    numFiles = 0;
     FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
-    addBunchOfFiles<10, 8, 4>(0, "", fakeFolder.localModifier());
+    addBunchOfFiles<filesPerDir, dirPerDir, maxDepth>(0, "", fakeFolder.localModifier());
 
     qDebug() << "NUMFILES" << numFiles;
     qDebug() << "NUMDIRS" << numDirs;
@@ -45,5 +47,15 @@ int main(int argc, char *argv[])
     qDebug() << "FIRST SYNC: " << result1 << timer.restart();
     bool result2 = fakeFolder.syncOnce();
     qDebug() << "SECOND SYNC: " << result2 << timer.restart();
-    return (result1 && result2) ? 0 : -1;
+    return result1 && result2;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    bool result = benchLargeSync<10, 8, 4>();
+
+    // About 500k items, large enough for anything quadratic in the number of items to show
+    result &= benchLargeSync<22, 12, 4>();
+    return result ? 0 : -1;
 }
@@ -0,0 +1,149 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include "networkjobs.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QDebug>
+
+#include <atomic>
+#include <cstdlib>
+
+using namespace OCC;
+
+#if defined(__has_feature)
+#if __has_feature(address_sanitizer) || __has_feature(memory_sanitizer) || __has_feature(thread_sanitizer)
+#define BENCH_SANITIZER_BUILD
+#endif
+#endif
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+#define BENCH_SANITIZER_BUILD
+#endif
+
+// Sanitizers replace malloc themselves, allocations are only counted without them
+#if defined(__GLIBC__) && !defined(BENCH_SANITIZER_BUILD)
+#define BENCH_COUNT_ALLOCATIONS
+
+namespace {
+std::atomic<quint64> allocations{0};
+}
+
+// Qt containers allocate with malloc directly, so count there rather than in operator new
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+    ++allocations;
+    return __libc_malloc(size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    ++allocations;
+    return __libc_realloc(ptr, size);
+}
+}
+#endif
+
+static QByteArray multiStatus(int entries)
+{
+    QByteArray xml = "<?xml version='1.0' encoding='utf-8'?>"
+                     "<d:multistatus xmlns:d=\"DAV:\" xmlns:s=\"http://sabredav.org/ns\" xmlns:oc=\"http://owncloud.org/ns\" xmlns:nc=\"http://nextcloud.org/ns\">";
+    for (int i = 0; i < entries; ++i) {
+        const QByteArray number = QByteArray::number(i);
+        // Every third name needs percent decoding, as with real world names containing spaces
+        QByteArray name;
+        if (i > 0) {
+            name = (i % 3 ? QByteArrayLiteral("file%20") : QByteArrayLiteral("file")) + number + QByteArrayLiteral(".txt");
+        }
+        const QByteArray resourceType = i % 10 == 0 ? QByteArrayLiteral("<d:collection/>") : QByteArray();
+
+        xml += "<d:response><d:href>/remote.php/dav/files/admin/large/";
+        xml += name;
+        xml += "</d:href><d:propstat><d:prop><d:resourcetype>";
+        xml += resourceType;
+        xml += "</d:resourcetype>"
+               "<d:getlastmodified>Fri, 06 Feb 2015 13:49:55 GMT</d:getlastmodified>"
+               "<d:getcontentlength>";
+        xml += number;
+        xml += "</d:getcontentlength><d:getetag>\"5527beb0400b0";
+        xml += number;
+        xml += "\"</d:getetag><oc:id>";
+        xml += number.rightJustified(8, '0');
+        xml += "ocobzus5kn6s</oc:id><oc:fileid>";
+        xml += number;
+        xml += "</oc:fileid>"
+               "<oc:permissions>RDNVW</oc:permissions>"
+               "<oc:checksums><oc:checksum>SHA1:9e2bf1bcbc6fc1a0c1e2fa6c8a2e4fa0b8f8e9d1</oc:checksum></oc:checksums>"
+               "<oc:share-types/>"
+               "</d:prop>"
+               "<d:status>HTTP/1.1 200 OK</d:status>"
+               "</d:propstat>"
+               "<d:propstat>"
+               "<d:prop>"
+               "<oc:downloadURL/>"
+               "<oc:dDC/>"
+               "</d:prop>"
+               "<d:status>HTTP/1.1 404 Not Found</d:status>"
+               "</d:propstat>"
+               "</d:response>";
+    }
+    xml += "</d:multistatus>";
+    return xml;
+}
+
+static bool benchParse(const QByteArray &xml, int entries, int chunkSize)
+{
+    LsColXMLParser parser;
+    int items = 0;
+    // What the discovery listens to
+    QObject::connect(&parser, &LsColXMLParser::knownPropertiesIterated, [&items](const QString &, const LsColXMLParser::KnownProperties &) {
+        ++items;
+    });
+
+    QHash<QString, ExtraFolderInfo> folderInfos;
+#ifdef BENCH_COUNT_ALLOCATIONS
+    const auto allocationsBefore = allocations.load();
+#endif
+    QElapsedTimer timer;
+    timer.start();
+
+    parser.start(&folderInfos, QStringLiteral("/remote.php/dav/files/admin/large"));
+    bool ok = true;
+    for (int i = 0; ok && i < xml.size(); i += chunkSize) {
+        ok = parser.addData(QByteArray::fromRawData(xml.constData() + i, qMin(chunkSize, xml.size() - i)));
+    }
+    ok = ok && parser.finish();
+
+    const auto elapsed = timer.nsecsElapsed();
+    qDebug() << "CHUNK SIZE" << chunkSize << "ENTRIES" << items << "TIME" << elapsed / 1000000 << "ms"
+             << "(" << double(elapsed) / entries << "ns per entry)";
+#ifdef BENCH_COUNT_ALLOCATIONS
+    const auto allocated = allocations.load() - allocationsBefore;
+    qDebug() << "CHUNK SIZE" << chunkSize << "ALLOCATIONS" << allocated << "(" << double(allocated) / entries << "per entry)";
+#else
+    qDebug() << "CHUNK SIZE" << chunkSize << "ALLOCATIONS not counted in sanitizer builds";
+#endif
+    return ok && items == entries;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    const int entries = 100000;
+    const auto xml = multiStatus(entries);
+    qDebug() << "MULTISTATUS SIZE" << xml.size() / 1024 << "KiB";
+
+    bool result = benchParse(xml, entries, xml.size());
+    // As it comes in from the network
+    result &= benchParse(xml, entries, 16 * 1024);
+    return result ? 0 : -1;
+}
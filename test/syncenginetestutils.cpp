@@ -16,6 +16,7 @@
 #include <QJsonObject>
 #include <QJsonValue>
 
+#include <functional>
 #include <memory>
 
 
@@ -391,9 +392,18 @@ FakePropfindReply::FakePropfindReply(FileInfo &remoteRootFileInfo, QNetworkAcces
         xml.writeEndElement(); // response
     };
 
+    // With Depth: infinity the whole subtree is listed, parents before their children
+    const auto recursive = request.rawHeader("Depth") == "infinity";
+    std::function<void(const FileInfo &)> writeChildrenResponses = [&](const FileInfo &dirInfo) {
+        foreach (const FileInfo &childFileInfo, dirInfo.children) {
+            writeFileResponse(childFileInfo);
+            if (recursive && childFileInfo.isDir)
+                writeChildrenResponses(childFileInfo);
+        }
+    };
+
     writeFileResponse(*fileInfo);
-    foreach (const FileInfo &childFileInfo, fileInfo->children)
-        writeFileResponse(childFileInfo);
+    writeChildrenResponses(*fileInfo);
     xml.writeEndElement(); // multistatus
     xml.writeEndDocument();
 
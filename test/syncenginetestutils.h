@@ -296,7 +296,7 @@ class FakeMoveReply : public FakeReply
 public:
     FakeMoveReply(FileInfo &remoteRootFileInfo, QNetworkAccessManager::Operation op, const QNetworkRequest &request, QObject *parent);
 
-    Q_INVOKABLE void respond();
+    Q_INVOKABLE virtual void respond();
 
     void abort() override { }
     qint64 readData(char *, qint64) override { return 0; }
@@ -36,8 +36,34 @@ static void partialUpload(FakeFolder &fakeFolder, const QString &name, qint64 si
 
     QCOMPARE(fakeFolder.uploadState().children.count(), 1); // the transfer was done with chunking
     auto upStateChildren = fakeFolder.uploadState().children.first().children;
-    QCOMPARE(sizeWhenAbort, std::accumulate(upStateChildren.cbegin(), upStateChildren.cend(), 0,
-                                            [](int s, const FileInfo &i) { return s + i.size; }));
+    const auto uploadedSize = std::accumulate(upStateChildren.cbegin(), upStateChildren.cend(), 0LL,
+                                              [](qint64 s, const FileInfo &i) { return s + i.size; });
+    if (qgetenv("OWNCLOUD_PARALLEL_CHUNK") == "false") {
+        QCOMPARE(sizeWhenAbort, uploadedSize);
+    } else {
+        // The fake server stores a chunk as soon as its PUT is sent, the chunks that were
+        // running at the time of the abort are stored but not in the progress yet
+        QVERIFY(sizeWhenAbort <= uploadedSize);
+        QVERIFY(uploadedSize < size);
+    }
+}
+
+// The tests of resuming, aborts and errors run with parallel chunks, the default, and with sequential ones
+static void addChunkModes()
+{
+    QTest::addColumn<bool>("parallelChunks");
+    QTest::newRow("parallel chunks") << true;
+    QTest::newRow("sequential chunks") << false;
+}
+
+static auto setChunkMode(bool parallelChunks)
+{
+    if (parallelChunks) {
+        qunsetenv("OWNCLOUD_PARALLEL_CHUNK");
+    } else {
+        qputenv("OWNCLOUD_PARALLEL_CHUNK", "false");
+    }
+    return qScopeGuard([] { qunsetenv("OWNCLOUD_PARALLEL_CHUNK"); });
 }
 
 // Reduce max chunk size a bit so we get more chunks
@@ -111,8 +137,17 @@ private slots:
         QCOMPARE(fakeFolder.uploadState().children.count(), 2); // the transfer was done with chunking
     }
 
+    void testResume1_data()
+    {
+        addChunkModes();
+    }
+
     // Test resuming when there's a confusing chunk added
-    void testResume1() {
+    void testResume1()
+    {
+        QFETCH(bool, parallelChunks);
+        const auto chunkMode = setChunkMode(parallelChunks);
+
         FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
         fakeFolder.syncEngine().account()->setCapabilities({ { "dav", QVariantMap{ {"chunking", "1.0"} } } });
         const int size = 10 * 1000 * 1000; // 10 MB
@@ -147,8 +182,17 @@ private slots:
         QCOMPARE(fakeFolder.uploadState().children.first().name, chunkingId);
     }
 
+    void testResume2_data()
+    {
+        addChunkModes();
+    }
+
     // Test resuming when one of the uploaded chunks got removed
-    void testResume2() {
+    void testResume2()
+    {
+        QFETCH(bool, parallelChunks);
+        const auto chunkMode = setChunkMode(parallelChunks);
+
         FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
         fakeFolder.syncEngine().account()->setCapabilities({ { "dav", QVariantMap{ {"chunking", "1.0"} } } });
         setChunkSize(fakeFolder.syncEngine(), 1 * 1000 * 1000);
@@ -203,8 +247,17 @@ private slots:
         QCOMPARE(fakeFolder.uploadState().children.first().name, chunkingId);
     }
 
+    void testResume3_data()
+    {
+        addChunkModes();
+    }
+
     // Test resuming when all chunks are already present
-    void testResume3() {
+    void testResume3()
+    {
+        QFETCH(bool, parallelChunks);
+        const auto chunkMode = setChunkMode(parallelChunks);
+
         FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
         fakeFolder.syncEngine().account()->setCapabilities({ { "dav", QVariantMap{ {"chunking", "1.0"} } } });
         const int size = 30 * 1000 * 1000; // 30 MB
@@ -249,9 +302,18 @@ private slots:
         QCOMPARE(fakeFolder.uploadState().children.first().name, chunkingId);
     }
 
+    void testResume4_data()
+    {
+        addChunkModes();
+    }
+
     // Test resuming (or rather not resuming!) for the error case of the sum of
     // chunk sizes being larger than the file size
-    void testResume4() {
+    void testResume4()
+    {
+        QFETCH(bool, parallelChunks);
+        const auto chunkMode = setChunkMode(parallelChunks);
+
         FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
         fakeFolder.syncEngine().account()->setCapabilities({ { "dav", QVariantMap{ {"chunking", "1.0"} } } });
 
@@ -285,10 +347,18 @@ private slots:
         QVERIFY(fakeFolder.uploadState().children.first().name != chunkingId);
     }
 
+    void testLateAbortHard_data()
+    {
+        addChunkModes();
+    }
+
     // Check what happens when we abort during the final MOVE and the
     // the final MOVE takes longer than the abort-delay
     void testLateAbortHard()
     {
+        QFETCH(bool, parallelChunks);
+        const auto chunkMode = setChunkMode(parallelChunks);
+
         FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
         fakeFolder.syncEngine().account()->setCapabilities({ { "dav", QVariantMap{ { "chunking", "1.0" } } }, { "checksums", QVariantMap{ { "supportedTypes", QStringList() << "SHA1" } } } });
         const int size = 15 * 1000 * 1000; // 15 MB
@@ -369,10 +439,18 @@ private slots:
         QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
     }
 
+    void testLateAbortRecoverable_data()
+    {
+        addChunkModes();
+    }
+
     // Check what happens when we abort during the final MOVE and the
     // the final MOVE is short enough for the abort-delay to help
     void testLateAbortRecoverable()
     {
+        QFETCH(bool, parallelChunks);
+        const auto chunkMode = setChunkMode(parallelChunks);
+
         FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
         fakeFolder.syncEngine().account()->setCapabilities({ { "dav", QVariantMap{ { "chunking", "1.0" } } }, { "checksums", QVariantMap{ { "supportedTypes", QStringList() << "SHA1" } } } });
         const int size = 15 * 1000 * 1000; // 15 MB
@@ -400,8 +478,16 @@ private slots:
         QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
     }
 
+    void testRemoveStale1_data()
+    {
+        addChunkModes();
+    }
+
     // We modify the file locally after it has been partially uploaded
-    void testRemoveStale1() {
+    void testRemoveStale1()
+    {
+        QFETCH(bool, parallelChunks);
+        const auto chunkMode = setChunkMode(parallelChunks);
 
         FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
         fakeFolder.syncEngine().account()->setCapabilities({ { "dav", QVariantMap{ {"chunking", "1.0"} } } });
@@ -425,8 +511,16 @@ private slots:
         QVERIFY(fakeFolder.uploadState().children.first().name != chunkingId);
     }
 
+    void testRemoveStale2_data()
+    {
+        addChunkModes();
+    }
+
     // We remove the file locally after it has been partially uploaded
-    void testRemoveStale2() {
+    void testRemoveStale2()
+    {
+        QFETCH(bool, parallelChunks);
+        const auto chunkMode = setChunkMode(parallelChunks);
 
         FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
         fakeFolder.syncEngine().account()->setCapabilities({ { "dav", QVariantMap{ {"chunking", "1.0"} } } });
@@ -443,7 +537,16 @@ private slots:
     }
 
 
-    void testCreateConflictWhileSyncing() {
+    void testCreateConflictWhileSyncing_data()
+    {
+        addChunkModes();
+    }
+
+    void testCreateConflictWhileSyncing()
+    {
+        QFETCH(bool, parallelChunks);
+        const auto chunkMode = setChunkMode(parallelChunks);
+
         FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
         fakeFolder.syncEngine().account()->setCapabilities({ { "dav", QVariantMap{ {"chunking", "1.0"} } } });
         const int size = 10 * 1000 * 1000; // 10 MB
@@ -498,7 +601,15 @@ private slots:
         QCOMPARE(fakeFolder.uploadState().children.count(), 0); // The last sync cleaned the chunks
     }
 
-    void testModifyLocalFileWhileUploading() {
+    void testModifyLocalFileWhileUploading_data()
+    {
+        addChunkModes();
+    }
+
+    void testModifyLocalFileWhileUploading()
+    {
+        QFETCH(bool, parallelChunks);
+        const auto chunkMode = setChunkMode(parallelChunks);
 
         FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
         fakeFolder.syncEngine().account()->setCapabilities({ { "dav", QVariantMap{ {"chunking", "1.0"} } } });
@@ -537,7 +648,15 @@ private slots:
     }
 
 
-    void testResumeServerDeletedChunks() {
+    void testResumeServerDeletedChunks_data()
+    {
+        addChunkModes();
+    }
+
+    void testResumeServerDeletedChunks()
+    {
+        QFETCH(bool, parallelChunks);
+        const auto chunkMode = setChunkMode(parallelChunks);
 
         FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
         fakeFolder.syncEngine().account()->setCapabilities({ { "dav", QVariantMap{ {"chunking", "1.0"} } } });
@@ -559,6 +678,54 @@ private slots:
         QVERIFY(fakeFolder.uploadState().children.first().name != chunkingId);
     }
 
+    void testParallelChunkUpload()
+    {
+        FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
+        fakeFolder.syncEngine().account()->setCapabilities({ { "dav", QVariantMap{ {"chunking", "1.0"} } } });
+        const int size = 10 * 1000 * 1000; // 10 MB
+        setChunkSize(fakeFolder.syncEngine(), 1 * 1000 * 1000);
+
+        QSet<QNetworkReply *> runningPuts;
+        int maxRunningPuts = 0;
+        bool failSecondChunk = true;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *outgoingData) -> QNetworkReply * {
+            if (op != QNetworkAccessManager::PutOperation || !request.url().path().contains("/uploads/")) {
+                return nullptr;
+            }
+            QNetworkReply *reply = nullptr;
+            if (failSecondChunk && request.url().path().endsWith("/00002")) {
+                reply = new FakeErrorReply(op, request, &fakeFolder.syncEngine(), 500);
+            } else {
+                reply = new FakePutReply(fakeFolder.uploadState(), op, request, outgoingData->readAll(), &fakeFolder.syncEngine());
+            }
+            runningPuts.insert(reply);
+            maxRunningPuts = qMax(maxRunningPuts, int(runningPuts.size()));
+            connect(reply, &QNetworkReply::finished, this, [&runningPuts, reply] { runningPuts.remove(reply); });
+            connect(reply, &QObject::destroyed, this, [&runningPuts, reply] { runningPuts.remove(reply); });
+            return reply;
+        });
+
+        // The second chunk fails while the following ones were already sent
+        fakeFolder.localModifier().insert("A/a0", size);
+        QVERIFY(!fakeFolder.syncOnce());
+        QVERIFY(maxRunningPuts > 1);
+        QCOMPARE(fakeFolder.uploadState().children.count(), 1);
+        const auto chunkingId = fakeFolder.uploadState().children.first().name;
+        const auto chunks = fakeFolder.uploadState().children.first().children;
+        QVERIFY(chunks.contains("00001"));
+        QVERIFY(!chunks.contains("00002"));
+        QVERIFY(chunks.contains("00003"));
+
+        // Resuming keeps the first chunk and replaces the ones after the hole
+        failSecondChunk = false;
+        fakeFolder.syncEngine().journal()->wipeErrorBlacklist();
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(fakeFolder.currentRemoteState().find("A/a0")->size, size);
+        QCOMPARE(fakeFolder.uploadState().children.count(), 1);
+        QCOMPARE(fakeFolder.uploadState().children.first().name, chunkingId);
+    }
+
     // Check what happens when the connection is dropped on the PUT (non-chunking) or MOVE (chunking)
     // for on the issue #5106
     void connectionDroppedBeforeEtagRecieved_data()
@@ -12,6 +12,7 @@
 #include <common/constants.h>
 
 #include "clientsideencryption.h"
+#include "filesystem.h"
 
 using namespace OCC;
 
@@ -248,6 +249,84 @@ private slots:
         chunkedOutputDecrypted.close();
     }
 
+    void testEncryptedFileDevice_data()
+    {
+        QTest::addColumn<int>("totalBytes");
+        QTest::addColumn<int>("bytesToRead");
+
+        QTest::newRow("empty") << 0 << 16;
+        QTest::newRow("data1") << 64 << 2;
+        QTest::newRow("data2") << 76 << 64;
+        QTest::newRow("data3") << 200 * 1024 << 3000;
+    }
+
+    void testEncryptedFileDevice()
+    {
+        QFETCH(int, totalBytes);
+        QFETCH(int, bytesToRead);
+
+        QTemporaryFile dummyInputFile;
+        QVERIFY(dummyInputFile.open());
+        QCOMPARE(dummyInputFile.write(EncryptionHelper::generateRandom(totalBytes)), totalBytes);
+        dummyInputFile.close();
+
+        const auto encryptionKey = EncryptionHelper::generateRandom(16);
+        const auto initializationVector = EncryptionHelper::generateRandom(16);
+
+        QTemporaryFile dummyEncryptionOutputFile;
+        QByteArray tag;
+        QVERIFY(EncryptionHelper::fileEncryption(encryptionKey, initializationVector, &dummyInputFile, &dummyEncryptionOutputFile, tag));
+        QVERIFY(dummyEncryptionOutputFile.open());
+        const auto expected = dummyEncryptionOutputFile.readAll();
+
+        EncryptionHelper::EncryptedFileDevice device(dummyInputFile.fileName(), encryptionKey, initializationVector);
+        QVERIFY(device.open(QIODevice::ReadOnly));
+        QCOMPARE(device.size(), expected.size());
+
+        // reading in pieces gives the same content as fileEncryption()
+        QByteArray encrypted;
+        while (!device.atEnd()) {
+            const auto chunk = device.read(bytesToRead);
+            QVERIFY(!chunk.isEmpty());
+            encrypted += chunk;
+        }
+        QCOMPARE(encrypted, expected);
+        QCOMPARE(device.e2EeTag(), tag);
+
+        // seeking backwards and forwards too
+        for (const auto position : {expected.size() / 2, qint64(0), expected.size() - 1, expected.size() / 3}) {
+            QVERIFY(device.seek(position));
+            QCOMPARE(device.read(bytesToRead), expected.mid(position, bytesToRead));
+        }
+        QCOMPARE(device.e2EeTag(), tag);
+    }
+
+    void testEncryptedFileDeviceFileChanged()
+    {
+        QTemporaryFile dummyInputFile;
+        QVERIFY(dummyInputFile.open());
+        QCOMPARE(dummyInputFile.write(EncryptionHelper::generateRandom(1024)), 1024);
+        dummyInputFile.close();
+
+        EncryptionHelper::EncryptedFileDevice device(dummyInputFile.fileName(), EncryptionHelper::generateRandom(16), EncryptionHelper::generateRandom(16));
+        QVERIFY(device.open(QIODevice::ReadOnly));
+        const auto encrypted = device.readAll();
+        QCOMPARE(encrypted.size(), device.size());
+        const auto tag = device.e2EeTag();
+        QVERIFY(!tag.isEmpty());
+        device.close();
+
+        // the same key and IV must never encrypt other content
+        QVERIFY(dummyInputFile.open());
+        QCOMPARE(dummyInputFile.write(EncryptionHelper::generateRandom(1024)), 1024);
+        dummyInputFile.close();
+        FileSystem::setModTime(dummyInputFile.fileName(), FileSystem::getModTime(dummyInputFile.fileName()) + 1);
+
+        QVERIFY(!device.open(QIODevice::ReadOnly));
+        QVERIFY(!device.errorString().isEmpty());
+        QCOMPARE(device.e2EeTag(), tag);
+    }
+
     void testGzipThenEncryptDataAndBack()
     {
         const auto metadataKeySize = 16;
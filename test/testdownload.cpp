@@ -9,6 +9,7 @@
 #include "syncenginetestutils.h"
 #include <syncengine.h>
 #include <owncloudpropagator.h>
+#include <propagatorjobs.h>
 
 using namespace OCC;
 
@@ -39,6 +40,38 @@ public:
     }
 };
 
+/* A BrokenFakeGetReply that honors the Range header, sending all of the range unless 'fakeSize' is lowered */
+class RangedFakeGetReply : public BrokenFakeGetReply
+{
+    Q_OBJECT
+public:
+    RangedFakeGetReply(FileInfo &remoteRootFileInfo, QNetworkAccessManager::Operation op, const QNetworkRequest &request, QObject *parent)
+        : BrokenFakeGetReply(remoteRootFileInfo, op, request, parent)
+    {
+        fakeSize = std::numeric_limits<int>::max();
+        connect(this, &QNetworkReply::metaDataChanged, this, [this, range = request.rawHeader("Range")] {
+            static const QRegularExpression rx(QStringLiteral("bytes=(\\d+)-(\\d*)"));
+            const auto match = rx.match(QString::fromLatin1(range));
+            if (!match.hasMatch()) {
+                return;
+            }
+            const auto start = match.captured(1).toInt();
+            const auto end = match.captured(2).isEmpty() ? size - 1 : match.captured(2).toInt();
+            setAttribute(QNetworkRequest::HttpStatusCodeAttribute, 206);
+            setRawHeader("Content-Range", "bytes " + QByteArray::number(start) + '-' + QByteArray::number(end) + '/' + QByteArray::number(size));
+            size = end - start + 1;
+            setHeader(QNetworkRequest::ContentLengthHeader, size);
+        });
+    }
+};
+
+static void setMinSegmentedDownloadSize(SyncEngine &engine, qint64 size)
+{
+    auto options = engine.syncOptions();
+    options._minSegmentedDownloadSize = size;
+    engine.setSyncOptions(options);
+}
+
 
 SyncFileItemPtr getItem(const QSignalSpy &spy, const QString &path)
 {
@@ -91,6 +124,143 @@ private slots:
         QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
     }
 
+    void testResumeWithChecksum()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder.syncEngine().setIgnoreHiddenFiles(true);
+        auto size = 30 * 1000 * 1000;
+        fakeFolder.remoteModifier().insert("A/a0", size);
+        const auto contentChar = fakeFolder.remoteModifier().find("A/a0")->contentChar;
+        const auto checksumHeader = "SHA1:" + QCryptographicHash::hash(QByteArray(size, contentChar), QCryptographicHash::Sha1).toHex();
+
+        // First, download only the first 3 MB of the file
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::GetOperation && request.url().path().endsWith("A/a0")) {
+                return new BrokenFakeGetReply(fakeFolder.remoteModifier(), op, request, this);
+            }
+            return nullptr;
+        });
+        QVERIFY(!fakeFolder.syncOnce());
+
+        // Resume with a server honoring the range: the checksum covers the whole file,
+        // so the already downloaded part must be included in the validation
+        QByteArray ranges;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::GetOperation && request.url().path().endsWith("A/a0")) {
+                ranges = request.rawHeader("Range");
+                const auto start = ranges.mid(6).chopped(1).toInt(); // "bytes=<start>-"
+                auto reply = new FakeGetReply(fakeFolder.remoteModifier(), op, request, this);
+                reply->setRawHeader(checkSumHeaderC, checksumHeader);
+                connect(reply, &QNetworkReply::metaDataChanged, reply, [reply, start] {
+                    reply->setRawHeader("Content-Range", "bytes " + QByteArray::number(start) + '-' + QByteArray::number(reply->size - 1) + '/' + QByteArray::number(reply->size));
+                    reply->size -= start;
+                    reply->setRawHeader("Content-Length", QByteArray::number(reply->size));
+                });
+                return reply;
+            }
+            return nullptr;
+        });
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(ranges, QByteArray("bytes=" + QByteArray::number(stopAfter) + "-"));
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+
+        // A checksum that doesn't match the complete file fails the download
+        fakeFolder.remoteModifier().insert("A/a5", size);
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::GetOperation && request.url().path().endsWith("A/a5")) {
+                auto reply = new FakeGetReply(fakeFolder.remoteModifier(), op, request, this);
+                reply->setRawHeader(checkSumHeaderC, "SHA1:bad");
+                return reply;
+            }
+            return nullptr;
+        });
+        QVERIFY(!fakeFolder.syncOnce());
+    }
+
+    void testSegmentedDownload()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder.syncEngine().setIgnoreHiddenFiles(true);
+        setMinSegmentedDownloadSize(fakeFolder.syncEngine(), 1000 * 1000);
+        const auto size = 30 * 1000 * 1000;
+        fakeFolder.remoteModifier().insert("A/a0", size);
+
+        QByteArrayList ranges;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::GetOperation && request.url().path().endsWith("A/a0")) {
+                ranges.append(request.rawHeader("Range"));
+                return new RangedFakeGetReply(fakeFolder.remoteModifier(), op, request, this);
+            }
+            return nullptr;
+        });
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(ranges.size(), 8);
+        QVERIFY(ranges.contains("bytes=0-3749999"));
+        QVERIFY(ranges.contains("bytes=26250000-29999999"));
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(fakeFolder.syncJournal().downloadInfoCount(), 0);
+    }
+
+    void testSegmentedDownloadResume()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder.syncEngine().setIgnoreHiddenFiles(true);
+        setMinSegmentedDownloadSize(fakeFolder.syncEngine(), 1000 * 1000);
+        QSignalSpy completeSpy(&fakeFolder.syncEngine(), &OCC::SyncEngine::itemCompleted);
+        const auto size = 30 * 1000 * 1000;
+        fakeFolder.remoteModifier().insert("A/a0", size);
+
+        // The second segment stops early
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::GetOperation && request.url().path().endsWith("A/a0")) {
+                auto reply = new RangedFakeGetReply(fakeFolder.remoteModifier(), op, request, this);
+                if (request.rawHeader("Range") == "bytes=3750000-7499999") {
+                    reply->fakeSize = stopAfter;
+                }
+                return reply;
+            }
+            return nullptr;
+        });
+        QVERIFY(!fakeFolder.syncOnce());
+        QCOMPARE(getItem(completeSpy, "A/a0")->_status, SyncFileItem::SoftError);
+        QCOMPARE(getItem(completeSpy, "A/a0")->_errorString, QString("The file could not be downloaded completely."));
+
+        // Only the missing data is requested again
+        QByteArrayList ranges;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::GetOperation && request.url().path().endsWith("A/a0")) {
+                ranges.append(request.rawHeader("Range"));
+                return new RangedFakeGetReply(fakeFolder.remoteModifier(), op, request, this);
+            }
+            return nullptr;
+        });
+        QVERIFY(fakeFolder.syncOnce());
+        QVERIFY(ranges.size() < 8);
+        QVERIFY(ranges.contains("bytes=" + QByteArray::number(3750000 + stopAfter) + "-7499999"));
+        QVERIFY(!ranges.contains("bytes=0-3749999"));
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+    }
+
+    void testSegmentedDownloadWithoutRangeSupport()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder.syncEngine().setIgnoreHiddenFiles(true);
+        setMinSegmentedDownloadSize(fakeFolder.syncEngine(), 1000 * 1000);
+        fakeFolder.remoteModifier().insert("A/a0", 30 * 1000 * 1000);
+
+        // The fake server ignores the Range header: the file is downloaded sequentially
+        QByteArrayList ranges;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::GetOperation && request.url().path().endsWith("A/a0")) {
+                ranges.append(request.rawHeader("Range"));
+            }
+            return nullptr;
+        });
+        QVERIFY(fakeFolder.syncOnce());
+        QVERIFY(ranges.contains(QByteArray()));
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+    }
+
     void testErrorMessage () {
         // This test's main goal is to test that the error string from the server is shown in the UI
 
@@ -9,6 +9,7 @@
 #include <QTemporaryDir>
 
 #include "csync_exclude.h"
+#include "common/utility.h"
 
 using namespace OCC;
 
@@ -87,6 +88,18 @@ private slots:
         QVERIFY(excluded.isExcluded("/a/.b", "/a", excludeHidden));
 
         QVERIFY(excluded.isExcluded("/a/#b#", "/a", keepHidden));
+
+        QVERIFY(!excluded.isExcludedPath("b", ItemTypeFile, keepHidden));
+        QVERIFY(excluded.isExcludedPath("b~", ItemTypeFile, keepHidden));
+        QVERIFY(!excluded.isExcludedPath("c/.b", ItemTypeFile, keepHidden));
+        QVERIFY(excluded.isExcludedPath("c/.b", ItemTypeFile, excludeHidden));
+        QVERIFY(excluded.isExcludedPath(".c/b", ItemTypeFile, excludeHidden));
+        QVERIFY(!excluded.isExcludedPath(".sync-exclude.lst", ItemTypeFile, excludeHidden));
+
+        excluded.addManualExclude("dir/");
+        QVERIFY(!excluded.isExcludedPath("dir", ItemTypeFile, keepHidden));
+        QVERIFY(excluded.isExcludedPath("dir", ItemTypeDirectory, keepHidden));
+        QVERIFY(excluded.isExcludedPath("dir/b", ItemTypeFile, keepHidden));
     }
 
     void check_csync_exclude_add()
@@ -102,7 +115,8 @@ private slots:
         QVERIFY(!excludedFiles->_bnameTraversalRegexFile[QStringLiteral("/")].pattern().contains("csync1"));
 
         excludedFiles->addManualExclude("foo");
-        QVERIFY(excludedFiles->_bnameTraversalRegexFile[QStringLiteral("/")].pattern().contains("foo"));
+        QVERIFY(excludedFiles->_bnameTraversalLiteralsFile[QStringLiteral("/")].exclude.names.contains("foo"));
+        QVERIFY(!excludedFiles->_bnameTraversalRegexFile[QStringLiteral("/")].pattern().contains("foo"));
         QVERIFY(excludedFiles->_fullRegexFile[QStringLiteral("/")].pattern().contains("foo"));
         QVERIFY(!excludedFiles->_fullTraversalRegexFile[QStringLiteral("/")].pattern().contains("foo"));
     }
@@ -590,6 +604,55 @@ private slots:
         QCOMPARE(translate("a/abc*/foo*"), "foo*");
     }
 
+    void check_csync_bname_literals()
+    {
+        setup();
+        excludedFiles->addManualExclude("*.tmp");
+        excludedFiles->addManualExclude("]*.part");
+        excludedFiles->addManualExclude("~$*");
+        excludedFiles->addManualExclude("*.tar.gz");
+        excludedFiles->addManualExclude("]Thumbs.db");
+        excludedFiles->addManualExclude("cache/");
+        excludedFiles->addManualExclude("keep*.part");
+
+        const auto &literals = excludedFiles->_bnameTraversalLiteralsDir[QStringLiteral("/")];
+        QVERIFY(literals.exclude.extensions.contains(".tmp"));
+        QVERIFY(literals.exclude.suffixes.contains(".tar.gz"));
+        QVERIFY(literals.exclude.prefixes.contains("~$"));
+        QVERIFY(literals.exclude.names.contains("cache"));
+        QVERIFY(literals.excludeRemove.extensions.contains(".part"));
+        QVERIFY(literals.excludeRemove.names.contains("Thumbs.db"));
+        QVERIFY(literals.regexNeeded);
+        QVERIFY(!excludedFiles->_bnameTraversalLiteralsFile[QStringLiteral("/")].exclude.names.contains("cache"));
+
+        QCOMPARE(check_file_traversal("a.tmp"), CSYNC_FILE_EXCLUDE_LIST);
+        QCOMPARE(check_file_traversal("dir/.tmp"), CSYNC_FILE_EXCLUDE_LIST);
+        QCOMPARE(check_file_traversal("a.tmp.txt"), CSYNC_NOT_EXCLUDED);
+        QCOMPARE(check_file_traversal("dir/a.b.tar.gz"), CSYNC_FILE_EXCLUDE_LIST);
+        QCOMPARE(check_file_traversal("~$document.docx"), CSYNC_FILE_EXCLUDE_LIST);
+        QCOMPARE(check_file_traversal("dir/Thumbs.db"), CSYNC_FILE_EXCLUDE_AND_REMOVE);
+        QCOMPARE(check_file_traversal("video.part"), CSYNC_FILE_EXCLUDE_AND_REMOVE);
+        QCOMPARE(check_file_traversal("cache"), CSYNC_NOT_EXCLUDED);
+        QCOMPARE(check_dir_traversal("dir/cache"), CSYNC_FILE_EXCLUDE_LIST);
+
+        // A regex exclude wins over a literal exclude-and-remove, like in the full match
+        QCOMPARE(check_file_traversal("keep.part"), CSYNC_FILE_EXCLUDE_LIST);
+        QCOMPARE(check_file_full("keep.part"), CSYNC_FILE_EXCLUDE_LIST);
+
+        if (Utility::fsCasePreserving()) {
+            QCOMPARE(check_file_traversal("A.TMP"), CSYNC_FILE_EXCLUDE_LIST);
+            QCOMPARE(check_file_traversal("thumbs.DB"), CSYNC_FILE_EXCLUDE_AND_REMOVE);
+        } else {
+            QCOMPARE(check_file_traversal("A.TMP"), CSYNC_NOT_EXCLUDED);
+            QCOMPARE(check_file_traversal("thumbs.DB"), CSYNC_NOT_EXCLUDED);
+        }
+
+        // Literals of a nested base path only apply below it
+        excludedFiles->addManualExclude("*.log", "/sub/");
+        QCOMPARE(check_file_traversal("sub/a.log"), CSYNC_FILE_EXCLUDE_LIST);
+        QCOMPARE(check_file_traversal("a.log"), CSYNC_NOT_EXCLUDED);
+    }
+
     void check_csync_is_windows_reserved_word()
     {
         auto csync_is_windows_reserved_word = [](const char *fn) {
@@ -662,6 +725,70 @@ private slots:
         }
     }
 
+    void check_csync_excluded_performance3_data()
+    {
+        QTest::addColumn<bool>("traversalShortcuts");
+        QTest::newRow("regular expressions only") << false;
+        QTest::newRow("literals and cached base paths") << true;
+    }
+
+    // A long exclude list, as deployed by some organizations
+    void check_csync_excluded_performance3()
+    {
+        QFETCH(bool, traversalShortcuts);
+        setup_init();
+        excludedFiles->_traversalShortcuts = traversalShortcuts;
+        excludedFiles->prepare();
+        for (int i = 0; i < 400; ++i) {
+            const auto number = QString::number(i);
+            switch (i % 5) {
+            case 0:
+                excludedFiles->addManualExclude(QStringLiteral("*.ext") + number);
+                break;
+            case 1:
+                excludedFiles->addManualExclude(QStringLiteral("name") + number);
+                break;
+            case 2:
+                excludedFiles->addManualExclude(QStringLiteral("]~pfx") + number + QStringLiteral("*"));
+                break;
+            case 3:
+                excludedFiles->addManualExclude(QStringLiteral("build") + number + QStringLiteral("?/"));
+                break;
+            case 4:
+                excludedFiles->addManualExclude(QStringLiteral("docs/*.draft") + number);
+                break;
+            }
+        }
+
+        QStringList paths;
+        for (int i = 0; i < 500; ++i) {
+            const auto number = QString::number(i);
+            paths.append(QStringLiteral("file") + number + QStringLiteral(".ext") + number);
+            paths.append(QStringLiteral("docs/name") + number);
+            paths.append(QStringLiteral("~pfx") + number + QStringLiteral("report"));
+            paths.append(QStringLiteral("docs/build") + number + QStringLiteral("x"));
+            paths.append(QStringLiteral("docs/notes.draft") + number);
+            paths.append(QStringLiteral("docs/photo") + number + QStringLiteral(".jpg"));
+        }
+
+        // The full match uses plain regular expressions for all patterns: the traversal
+        // match must agree with it where no parent directory is excluded
+        for (const auto &path : qAsConst(paths)) {
+            for (const auto type : {ItemTypeFile, ItemTypeDirectory}) {
+                QCOMPARE(excludedFiles->traversalPatternMatch(path, type), excludedFiles->fullPatternMatch(path, type));
+            }
+        }
+
+        int excluded = 0;
+        QBENCHMARK {
+            excluded = 0;
+            for (const auto &path : qAsConst(paths)) {
+                excluded += excludedFiles->traversalPatternMatch(path, ItemTypeFile) != CSYNC_NOT_EXCLUDED;
+            }
+        }
+        QVERIFY(excluded > 0);
+    }
+
     void check_csync_exclude_expand_escapes()
     {
         extern void csync_exclude_expand_escapes(QByteArray &input);
@@ -0,0 +1,95 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtTest>
+#include <QTemporaryDir>
+
+#include "logger.h"
+
+using namespace OCC;
+
+class TestLogger : public QObject
+{
+    Q_OBJECT
+
+    static QStringList logLines(const QString &fileName)
+    {
+        QFile file(fileName);
+        if (!file.open(QIODevice::ReadOnly))
+            return {};
+        return QString::fromUtf8(file.readAll()).split(QLatin1Char('\n'), Qt::SkipEmptyParts);
+    }
+
+private slots:
+    void testAsyncLogFollowsDebugLogging()
+    {
+        auto logger = Logger::instance();
+        logger->setLogDebug(true);
+        QVERIFY(logger->isLogAsync());
+        logger->setLogDebug(false);
+        QVERIFY(!logger->isLogAsync());
+
+        // As toggled from the log window
+        logger->setupTemporaryFolderLogDir();
+        QVERIFY(logger->logDebug());
+        QVERIFY(logger->isLogAsync());
+        logger->disableTemporaryFolderLogDir();
+        QVERIFY(!logger->isLogAsync());
+    }
+
+    void testAsyncLogKeepsOrder()
+    {
+        QTemporaryDir dir;
+        const auto fileName = dir.filePath(QStringLiteral("async.log"));
+        auto logger = Logger::instance();
+        logger->setLogFile(fileName);
+
+        // Several threads logging at once, as the propagator and discovery do
+        constexpr int threadCount = 4;
+        constexpr int linesPerThread = 1000;
+        logger->setLogAsync(true);
+        QVERIFY(logger->isLogAsync());
+        QVector<QThread *> threads;
+        for (int t = 0; t < threadCount; ++t) {
+            threads.append(QThread::create([logger, t] {
+                for (int i = 0; i < linesPerThread; ++i) {
+                    logger->doLog(QtInfoMsg, QMessageLogContext(), QStringLiteral("thread %1 line %2").arg(t).arg(i));
+                }
+            }));
+            threads.last()->start();
+        }
+        for (auto thread : qAsConst(threads)) {
+            QVERIFY(thread->wait());
+            delete thread;
+        }
+
+        // Switching back writes what is still queued
+        logger->setLogAsync(false);
+        QVERIFY(!logger->isLogAsync());
+        logger->doLog(QtInfoMsg, QMessageLogContext(), QStringLiteral("synchronous line"));
+        logger->setLogFile(QString());
+
+        // Other messages may end up in the log too, only look at ours
+        const auto lines = logLines(fileName);
+        static const QRegularExpression rx(QStringLiteral("thread (\\d+) line (\\d+)$"));
+        QVector<int> nextLine(threadCount, 0);
+        int matched = 0;
+        for (const auto &line : lines) {
+            const auto match = rx.match(line);
+            if (!match.hasMatch())
+                continue;
+            const auto t = match.captured(1).toInt();
+            QCOMPARE(match.captured(2).toInt(), nextLine[t]++);
+            ++matched;
+        }
+        QCOMPARE(matched, threadCount * linesPerThread);
+        QVERIFY(lines.last().endsWith(QStringLiteral("synchronous line")));
+    }
+};
+
+QTEST_GUILESS_MAIN(TestLogger)
+#include "testlogger.moc"
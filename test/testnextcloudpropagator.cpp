@@ -7,6 +7,7 @@
 #include <QtTest>
 #include <QDebug>
 
+#include "bandwidthmanager.h"
 #include "propagatedownload.h"
 #include "owncloudpropagator_p.h"
 #include "syncenginetestutils.h"
@@ -99,6 +100,41 @@ private slots:
         // verify buffer is not changed
         QCOMPARE(reply->readAll().size(), body.size());
     }
+
+    void testBandwidthTokenBucket()
+    {
+        BandwidthTokenBucket bucket;
+        QCOMPARE(bucket.take(100), qint64(0));
+
+        // starts full, half a second worth of data
+        bucket.setRate(1000 * 1000);
+        QCOMPARE(bucket.capacity(), qint64(500 * 1000));
+        QCOMPARE(bucket.take(400 * 1000), qint64(400 * 1000));
+        QCOMPARE(bucket.take(400 * 1000), qint64(100 * 1000));
+        QCOMPARE(bucket.take(1), qint64(0));
+
+        // refills at the rate, up to the capacity
+        bucket.refill(100);
+        QCOMPARE(bucket.available(), qint64(100 * 1000));
+        bucket.refill(10 * 1000);
+        QCOMPARE(bucket.available(), bucket.capacity());
+
+        // small rates still allow a whole read
+        bucket.setRate(1000);
+        QVERIFY(bucket.capacity() >= 16 * 1024);
+
+        // without a rate, only granted tokens are available
+        bucket.setRate(0);
+        QCOMPARE(bucket.available(), qint64(0));
+        bucket.refill(1000);
+        QCOMPARE(bucket.available(), qint64(0));
+        bucket.grant(5000);
+        QCOMPARE(bucket.take(3000), qint64(3000));
+        QCOMPARE(bucket.take(3000), qint64(2000));
+        bucket.grant(10);
+        bucket.clear();
+        QCOMPARE(bucket.take(10), qint64(0));
+    }
 };
 
 QTEST_APPLESS_MAIN(TestNextcloudPropagator)
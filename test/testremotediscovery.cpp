@@ -171,6 +171,73 @@ private slots:
         QVERIFY(completeSpy.findItem("nofileid")->_errorString.contains("file id"));
         QVERIFY(completeSpy.findItem("nopermissions/A")->_errorString.contains("permission"));
     }
+
+    void testRecursiveListing()
+    {
+        FakeFolder fakeFolder{ FileInfo() };
+        auto options = fakeFolder.syncEngine().syncOptions();
+        options._recursiveRemoteListing = true;
+        fakeFolder.syncEngine().setSyncOptions(options);
+
+        fakeFolder.remoteModifier().mkdir("A");
+        fakeFolder.remoteModifier().mkdir("A/B");
+        fakeFolder.remoteModifier().mkdir("A/B/C");
+        fakeFolder.remoteModifier().mkdir("A/empty");
+        fakeFolder.remoteModifier().insert("A/a1");
+        fakeFolder.remoteModifier().insert("A/B/b1");
+        fakeFolder.remoteModifier().insert("A/B/C/c1");
+        fakeFolder.remoteModifier().insert("top");
+
+        QStringList propfindDepths;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation, const QNetworkRequest &req, QIODevice *) -> QNetworkReply * {
+            if (req.attribute(QNetworkRequest::CustomVerbAttribute) == "PROPFIND")
+                propfindDepths.append(QString::fromLatin1(req.rawHeader("Depth")));
+            return nullptr;
+        });
+
+        // Nothing is known yet: the whole tree comes in with a single request
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(propfindDepths, QStringList{ "infinity" });
+
+        // Known directories are listed one by one, new subtrees recursively again
+        propfindDepths.clear();
+        fakeFolder.remoteModifier().insert("A/a2");
+        fakeFolder.remoteModifier().mkdir("A/D");
+        fakeFolder.remoteModifier().mkdir("A/D/E");
+        fakeFolder.remoteModifier().insert("A/D/E/e1");
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(propfindDepths, QStringList({ "1", "1", "infinity" }));
+    }
+
+    void testRecursiveListingRefused()
+    {
+        FakeFolder fakeFolder{ FileInfo() };
+        auto options = fakeFolder.syncEngine().syncOptions();
+        options._recursiveRemoteListing = true;
+        fakeFolder.syncEngine().setSyncOptions(options);
+
+        fakeFolder.remoteModifier().mkdir("A");
+        fakeFolder.remoteModifier().mkdir("A/B");
+        fakeFolder.remoteModifier().insert("A/a1");
+        fakeFolder.remoteModifier().insert("A/B/b1");
+
+        QStringList propfindDepths;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &req, QIODevice *) -> QNetworkReply * {
+            if (req.attribute(QNetworkRequest::CustomVerbAttribute) == "PROPFIND") {
+                propfindDepths.append(QString::fromLatin1(req.rawHeader("Depth")));
+                if (req.rawHeader("Depth") == "infinity")
+                    return new FakeErrorReply(op, req, this, 403);
+            }
+            return nullptr;
+        });
+
+        // Falls back to Depth: 1 and doesn't try again for the sub directories
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(propfindDepths, QStringList({ "infinity", "1", "1", "1" }));
+    }
 };
 
 QTEST_GUILESS_MAIN(TestRemoteDiscovery)
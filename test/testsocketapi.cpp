@@ -0,0 +1,215 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtTest>
+#include <QLocalSocket>
+
+#include "account.h"
+#include "configfile.h"
+#include "folder.h"
+#include "folderman.h"
+#include "socketapi/socketapi.h"
+#include "syncenginetestutils.h"
+#include "testhelper.h"
+#include "theme.h"
+
+using namespace OCC;
+
+namespace {
+// "été.txt" with composed and with decomposed accents
+const auto composedName = QString::fromUtf8("\xc3\xa9t\xc3\xa9.txt");
+const auto decomposedName = QString::fromUtf8("e\xcc\x81te\xcc\x81.txt");
+}
+
+class TestSocketApi : public QObject
+{
+    Q_OBJECT
+
+    QTemporaryDir _configDir;
+    QTemporaryDir _syncDir;
+    QScopedPointer<FakeQNAM> _fakeQnam;
+    FolderMan _fm;
+    Folder *_folder = nullptr;
+    QLocalSocket _socket;
+    int _lastJobId = 0;
+
+    [[nodiscard]] QString localPath(const QString &relativePath) const
+    {
+        return _folder->cleanPath() + QLatin1Char('/') + relativePath;
+    }
+
+    void sendLine(const QString &line)
+    {
+        _socket.write(line.toUtf8() + '\n');
+        _socket.flush();
+    }
+
+    // The next message with that prefix and suffix, others like REGISTER_PATH are skipped
+    QString waitForMessage(const QString &prefix, const QString &suffix = {})
+    {
+        QElapsedTimer timer;
+        timer.start();
+        while (timer.elapsed() < 5000) {
+            while (_socket.canReadLine()) {
+                const auto line = QString::fromUtf8(_socket.readLine()).chopped(1);
+                if (line.startsWith(prefix) && line.endsWith(suffix)) {
+                    return line;
+                }
+            }
+            QTest::qWait(10);
+        }
+        return {};
+    }
+
+    QString retrieveFileStatus(const QString &path)
+    {
+        sendLine(QStringLiteral("RETRIEVE_FILE_STATUS:") + path);
+        const QString prefix = QStringLiteral("STATUS:");
+        const QString suffix = QLatin1Char(':') + QDir::toNativeSeparators(path);
+        const auto message = waitForMessage(prefix, suffix);
+        if (message.isEmpty()) {
+            return {};
+        }
+        return message.mid(prefix.size(), message.size() - prefix.size() - suffix.size());
+    }
+
+    QJsonObject getFileStatuses(const QJsonObject &arguments)
+    {
+        const auto jobId = QString::number(++_lastJobId);
+        const QJsonObject request({ { "id", jobId }, { "arguments", arguments } });
+        sendLine(QStringLiteral("V2/GET_FILE_STATUSES:") + QString::fromUtf8(QJsonDocument(request).toJson(QJsonDocument::Compact)));
+
+        const QString prefix = QStringLiteral("V2/GET_FILE_STATUSES_RESULT:");
+        const auto reply = QJsonDocument::fromJson(waitForMessage(prefix).mid(prefix.size()).toUtf8()).object();
+        if (reply[QStringLiteral("id")].toString() != jobId) {
+            return {};
+        }
+        return reply[QStringLiteral("arguments")].toObject();
+    }
+
+private slots:
+    void initTestCase()
+    {
+        ConfigFile::setConfDir(_configDir.path()); // we don't want to pollute the user's config file
+        // Only the socket API is tested, the folder must not sync
+        _fm.setSyncEnabled(false);
+
+        QDir syncDir(_syncDir.path());
+        QVERIFY(syncDir.mkpath(QStringLiteral("A")));
+        for (const auto &file : { QStringLiteral("A/a1"), QStringLiteral("A/") + composedName, QStringLiteral("b1") }) {
+            QFile f(syncDir.filePath(file));
+            QVERIFY(f.open(QFile::WriteOnly));
+            f.write("content");
+        }
+
+        _fakeQnam.reset(new FakeQNAM({}));
+        const auto account = Account::create();
+        account->setCredentials(new FakeCredentials{_fakeQnam.data()});
+        account->setUrl(QUrl(QStringLiteral("http://example.de")));
+        const auto accountState = new FakeAccountState(account);
+        _folder = _fm.addFolder(accountState, folderDefinition(_syncDir.path()));
+        QVERIFY(_folder);
+
+        const auto socketPath = QStandardPaths::writableLocation(QStandardPaths::RuntimeLocation)
+            + QLatin1Char('/') + Theme::instance()->appName() + QStringLiteral("/socket");
+        _socket.connectToServer(socketPath);
+        QVERIFY(_socket.waitForConnected());
+        // New clients get the sync folders first, the connection is set up after that
+        QVERIFY(!waitForMessage(QStringLiteral("REGISTER_PATH:")).isEmpty());
+    }
+
+    void cleanupTestCase()
+    {
+        _socket.disconnectFromServer();
+    }
+
+    void testGetFileStatusesOfDirectory()
+    {
+        const auto statuses = getFileStatuses({ { "directory", localPath(QStringLiteral("A")) } })[QStringLiteral("statuses")].toArray();
+
+        // The directory is monitored now, the statuses of its children are pushed
+        const auto a1 = localPath(QStringLiteral("A/a1"));
+        _fm.socketApi()->broadcastStatusPushMessage(a1, SyncFileStatus(SyncFileStatus::StatusSync));
+        QCOMPARE(waitForMessage(QStringLiteral("STATUS:"), QDir::toNativeSeparators(a1)), QStringLiteral("STATUS:SYNC:") + QDir::toNativeSeparators(a1));
+
+        // One entry per child, with the status a single lookup gives
+        QCOMPARE(statuses.size(), 2);
+        QSet<QString> paths;
+        for (const auto &value : statuses) {
+            const auto entry = value.toObject();
+            const auto path = entry[QStringLiteral("path")].toString();
+            paths.insert(path);
+            QCOMPARE(entry[QStringLiteral("status")].toString(), retrieveFileStatus(QDir::fromNativeSeparators(path)));
+        }
+        QCOMPARE(paths, (QSet<QString>{ QDir::toNativeSeparators(a1), QDir::toNativeSeparators(localPath(QStringLiteral("A/") + composedName)) }));
+
+        const auto outside = getFileStatuses({ { "directory", _configDir.path() } });
+        QCOMPARE(outside[QStringLiteral("error")].toString(), QStringLiteral("directory is not in a sync folder"));
+    }
+
+    void testGetFileStatusesOfFiles()
+    {
+        const QStringList files = {
+            localPath(QStringLiteral("A/a1")),
+            localPath(QStringLiteral("A/") + composedName),
+            localPath(QStringLiteral("b1")),
+            _configDir.path() + QStringLiteral("/outside"),
+        };
+        const auto statuses = getFileStatuses({ { "files", QJsonArray::fromStringList(files) } })[QStringLiteral("statuses")].toArray();
+
+        // In the order of the request, with the status a single lookup gives
+        QCOMPARE(statuses.size(), files.size());
+        for (int i = 0; i < files.size(); ++i) {
+            const auto entry = statuses[i].toObject();
+            QCOMPARE(entry[QStringLiteral("path")].toString(), QDir::toNativeSeparators(files[i]));
+            QCOMPARE(entry[QStringLiteral("status")].toString(), retrieveFileStatus(files[i]));
+        }
+        QCOMPARE(statuses.last().toObject()[QStringLiteral("status")].toString(), QStringLiteral("NOP"));
+    }
+
+    void testNonAsciiPaths()
+    {
+        // Plain ASCII messages skip the normalization, the others are normalized to NFC
+        const auto composedPath = localPath(QStringLiteral("A/") + composedName);
+        const auto decomposedPath = localPath(QStringLiteral("A/") + decomposedName);
+        const auto status = retrieveFileStatus(composedPath);
+        QVERIFY(!status.isEmpty());
+
+        sendLine(QStringLiteral("RETRIEVE_FILE_STATUS:") + decomposedPath);
+        QCOMPARE(waitForMessage(QStringLiteral("STATUS:"), QDir::toNativeSeparators(composedPath)), QStringLiteral("STATUS:%1:%2").arg(status, QDir::toNativeSeparators(composedPath)));
+
+        const auto statuses = getFileStatuses({ { "files", QJsonArray{ decomposedPath } } })[QStringLiteral("statuses")].toArray();
+        QCOMPARE(statuses.size(), 1);
+        QCOMPARE(statuses[0].toObject()[QStringLiteral("path")].toString(), QDir::toNativeSeparators(composedPath));
+        QCOMPARE(statuses[0].toObject()[QStringLiteral("status")].toString(), status);
+    }
+
+    void testUnknownCommands()
+    {
+        // Unknown commands are not remembered, every one of them gets the error
+        for (int i = 0; i < 2; ++i) {
+            sendLine(QStringLiteral("NOT_A_COMMAND:argument"));
+            QCOMPARE(waitForMessage(QStringLiteral("ERROR:")), QStringLiteral("ERROR:Function command_NOT_A_COMMAND(QString,SocketListener*) not found"));
+        }
+
+        // Known commands are looked up once and then dispatched from the cache
+        for (int i = 0; i < 2; ++i) {
+            sendLine(QStringLiteral("version"));
+            QVERIFY(!waitForMessage(QStringLiteral("VERSION:")).isEmpty());
+        }
+
+        sendLine(QStringLiteral(R"(V2/NOT_A_COMMAND:{"id":"unknown","arguments":{}})"));
+        QCOMPARE(waitForMessage(QStringLiteral("ERROR:")), QStringLiteral("ERROR:Function command_V2_NOT_A_COMMAND(QSharedPointer<SocketApiJobV2>) not found"));
+        QCOMPARE(waitForMessage(QStringLiteral("V2/NOT_A_COMMAND_RESULT:")), QStringLiteral(R"(V2/NOT_A_COMMAND_RESULT:{"arguments":{"error":"command not found"},"id":"unknown"})"));
+
+        // The unknown commands didn't break the dispatch of the known ones
+        QVERIFY(!retrieveFileStatus(localPath(QStringLiteral("b1"))).isEmpty());
+    }
+};
+
+QTEST_GUILESS_MAIN(TestSocketApi)
+#include "testsocketapi.moc"
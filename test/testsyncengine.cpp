@@ -8,6 +8,7 @@
 #include "syncenginetestutils.h"
 
 #include "caseclashconflictsolver.h"
+#include "common/checksums.h"
 #include "configfile.h"
 #include "propagatorjobs.h"
 #include "syncengine.h"
@@ -111,6 +112,30 @@ private slots:
         QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
     }
 
+    void testConcurrentSyncs() {
+        FakeFolder fakeFolderA{FileInfo::A12_B12_C12_S12()};
+        FakeFolder fakeFolderB{FileInfo::A12_B12_C12_S12()};
+        fakeFolderA.remoteModifier().insert("A/concurrentA");
+        fakeFolderB.remoteModifier().insert("B/concurrentB");
+
+        QSignalSpy finishedA(&fakeFolderA.syncEngine(), &SyncEngine::finished);
+        fakeFolderA.scheduleSync();
+        fakeFolderA.execUntilBeforePropagation();
+
+        // The second engine must be able to start while the first one is still running
+        bool otherSyncWasRunning = false;
+        connect(&fakeFolderB.syncEngine(), &SyncEngine::started, this, [&] {
+            otherSyncWasRunning = fakeFolderA.syncEngine().isSyncRunning();
+        });
+        QVERIFY(fakeFolderB.syncOnce());
+        QVERIFY(otherSyncWasRunning);
+
+        QVERIFY(!finishedA.isEmpty() || finishedA.wait());
+        QVERIFY(finishedA[0][0].toBool());
+        QCOMPARE(fakeFolderA.currentLocalState(), fakeFolderA.currentRemoteState());
+        QCOMPARE(fakeFolderB.currentLocalState(), fakeFolderB.currentRemoteState());
+    }
+
     void testDirDownload() {
         FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
         ItemCompletedSpy completeSpy(fakeFolder);
@@ -168,6 +193,98 @@ private slots:
         QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
     }
 
+    void testStreamedPropagation()
+    {
+        FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
+        auto options = fakeFolder.syncEngine().syncOptions();
+        options._streamedPropagation = true;
+        fakeFolder.syncEngine().setSyncOptions(options);
+
+        // Items announced before the end of the discovery are propagated while it is running
+        auto discoveryFinished = false;
+        QStringList streamedItems;
+        connect(&fakeFolder.syncEngine(), &SyncEngine::transmissionProgress, this, [&discoveryFinished](const ProgressInfo &progress) {
+            if (progress.status() == ProgressInfo::Reconcile) {
+                discoveryFinished = true;
+            }
+        });
+        connect(&fakeFolder.syncEngine(), &SyncEngine::itemAboutToPropagate, this, [&](const SyncFileItemPtr &item) {
+            if (!discoveryFinished) {
+                streamedItems.append(item->_file);
+            }
+        });
+
+        ItemCompletedSpy completeSpy(fakeFolder);
+        fakeFolder.remoteModifier().mkdir("Y");
+        fakeFolder.remoteModifier().insert("Y/y0");
+        fakeFolder.remoteModifier().insert("A/a0");
+        fakeFolder.localModifier().mkdir("Z");
+        fakeFolder.localModifier().insert("Z/z0");
+        fakeFolder.localModifier().appendByte("B/b1");
+        fakeFolder.remoteModifier().remove("C/c1");
+        QVERIFY(fakeFolder.syncOnce());
+
+        for (const auto path : {"Y", "Y/y0", "A/a0", "Z", "Z/z0", "B/b1", "C/c1"}) {
+            QVERIFY(itemDidCompleteSuccessfully(completeSpy, path));
+        }
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+
+        for (const auto path : {"Y", "Y/y0", "A/a0", "Z", "Z/z0", "B/b1"}) {
+            QVERIFY(streamedItems.contains(path));
+        }
+        // Deletions wait for the end of the discovery
+        QVERIFY(!streamedItems.contains("C/c1"));
+
+        // The directories were written to the database, nothing is left to do
+        completeSpy.clear();
+        QVERIFY(fakeFolder.syncOnce());
+        for (const auto path : {"Y", "Y/y0", "A", "Z", "Z/z0", "C"}) {
+            QVERIFY(!itemDidComplete(completeSpy, path));
+        }
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+    }
+
+    void testSchedulingOfLargeFlatDirectory()
+    {
+        FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
+
+        // The directory move is a barrier, the downloads after it start once it is done and in directory order
+        constexpr auto fileCount = 500;
+        fakeFolder.localModifier().rename("A", "A2");
+        fakeFolder.remoteModifier().mkdir("flat");
+        QStringList expectedRequests = { QStringLiteral("MOVE A"), QStringLiteral("MOVE done") };
+        for (int i = 0; i < fileCount; ++i) {
+            const auto path = QStringLiteral("flat/f%1").arg(i, 4, 10, QLatin1Char('0'));
+            fakeFolder.remoteModifier().insert(path, 1);
+            expectedRequests.append(QStringLiteral("GET ") + path);
+        }
+
+        QStringList requests;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            const auto path = getFilePathFromUrl(request.url());
+            if (op == QNetworkAccessManager::GetOperation && path.startsWith(QStringLiteral("flat/"))) {
+                requests.append(QStringLiteral("GET ") + path);
+            } else if (op == QNetworkAccessManager::CustomOperation
+                && request.attribute(QNetworkRequest::CustomVerbAttribute).toString() == QStringLiteral("MOVE")) {
+                requests.append(QStringLiteral("MOVE ") + path);
+                // Answered late, so that the scheduler passes in between have to respect the barrier
+                const auto reply = new DelayedReply<FakeMoveReply>(50, fakeFolder.remoteModifier(), op, request, &fakeFolder.syncEngine());
+                connect(reply, &QNetworkReply::finished, this, [&requests] { requests.append(QStringLiteral("MOVE done")); });
+                return reply;
+            }
+            return nullptr;
+        });
+
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(requests, expectedRequests);
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+
+        // A pass starts at most one job and every finished job asks for at most one more pass
+        const auto passes = fakeFolder.syncEngine().getPropagator()->schedulingPasses();
+        QVERIFY(passes >= fileCount);
+        QVERIFY(passes <= 2 * fileCount + 20);
+    }
+
     void testLocalDelete() {
         FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
         ItemCompletedSpy completeSpy(fakeFolder);
@@ -946,6 +1063,79 @@ private slots:
         QCOMPARE(currentMtime, expectedMtime);
     }
 
+    // A change of the same size within the same second is only visible in the sub-second part of the mtime
+    void testSubSecondModificationIsUploaded()
+    {
+        FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
+        const auto localFile = fakeFolder.localPath() + QStringLiteral("A/a1");
+
+        SyncJournalFileRecord record;
+        QVERIFY(fakeFolder.syncJournal().getFileRecord(QByteArrayLiteral("A/a1"), &record));
+        QVERIFY(record.isValid());
+        QCOMPARE(record._modtimeNsec, 0);
+
+        fakeFolder.localModifier().setContents("A/a1", 'N');
+        QVERIFY(FileSystem::setModTime(localFile, record._modtime, 500));
+        qint32 modtimeNsec = -1;
+        QCOMPARE(FileSystem::getModTime(localFile, &modtimeNsec), record._modtime);
+        if (modtimeNsec != 500) {
+            QSKIP("The file system does not store sub-second modification times");
+        }
+
+        ItemCompletedSpy completeSpy(fakeFolder);
+        QVERIFY(fakeFolder.syncOnce());
+        QVERIFY(itemDidCompleteSuccessfully(completeSpy, "A/a1"));
+        QCOMPARE(completeSpy.findItem("A/a1")->_direction, SyncFileItem::Up);
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+
+        QVERIFY(fakeFolder.syncJournal().getFileRecord(QByteArrayLiteral("A/a1"), &record));
+        QCOMPARE(record._modtimeNsec, 500);
+    }
+
+    // The checksum cache must not hand out the checksum of an earlier edit within the same second
+    void testSubSecondModificationChecksum()
+    {
+        FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
+        const auto localFile = fakeFolder.localPath() + QStringLiteral("A/a1");
+
+        QByteArray uploadedChecksumHeader;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::PutOperation) {
+                uploadedChecksumHeader = request.rawHeader(OCC::checkSumHeaderC);
+            }
+            return nullptr;
+        });
+
+        SyncJournalFileRecord record;
+        QVERIFY(fakeFolder.syncJournal().getFileRecord(QByteArrayLiteral("A/a1"), &record));
+        const auto modtime = record._modtime + 10;
+
+        const auto editAndSync = [&](char contentChar, qint32 modtimeNsec) {
+            fakeFolder.localModifier().setContents("A/a1", contentChar);
+            QVERIFY(FileSystem::setModTime(localFile, modtime, modtimeNsec));
+            uploadedChecksumHeader.clear();
+            QVERIFY(fakeFolder.syncOnce());
+
+            QByteArray checksumType;
+            QByteArray checksum;
+            QVERIFY(parseChecksumHeader(uploadedChecksumHeader, &checksumType, &checksum));
+            QCOMPARE(checksum, ComputeChecksum::computeNowOnFile(localFile, checksumType));
+            QVERIFY(fakeFolder.syncJournal().getFileRecord(QByteArrayLiteral("A/a1"), &record));
+            QCOMPARE(record._checksumHeader, uploadedChecksumHeader);
+        };
+
+        editAndSync('N', 100);
+        qint32 modtimeNsec = -1;
+        FileSystem::getModTime(localFile, &modtimeNsec);
+        if (modtimeNsec != 100) {
+            QSKIP("The file system does not store sub-second modification times");
+        }
+
+        // same size, same second
+        editAndSync('M', 600);
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+    }
+
     /**
      * Checks whether subsequent large uploads are skipped after a 507 error
      */
@@ -467,6 +467,42 @@ private slots:
         QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
     }
 
+    void cachedStatusFollowsChanges() {
+        FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
+        auto &tracker = fakeFolder.syncEngine().syncFileStatusTracker();
+        QCOMPARE(tracker.fileStatus("A/a1"), SyncFileStatus(SyncFileStatus::StatusUpToDate));
+        QCOMPARE(tracker.fileStatus("A/a1"), SyncFileStatus(SyncFileStatus::StatusUpToDate));
+
+        // A touched path must not get the cached status
+        tracker.slotPathTouched(fakeFolder.syncEngine().localPath() + "A/a1");
+        QCOMPARE(tracker.fileStatus("A/a1"), SyncFileStatus(SyncFileStatus::StatusSync));
+        QCOMPARE(tracker.fileStatus("A/a2"), SyncFileStatus(SyncFileStatus::StatusUpToDate));
+
+        fakeFolder.localModifier().appendByte("A/a1");
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(tracker.fileStatus("A/a1"), SyncFileStatus(SyncFileStatus::StatusUpToDate));
+
+        // The status pushed when the parent is done syncing must not be the one cached while syncing
+        fakeFolder.localModifier().appendByte("B/b1");
+        StatusPushSpy statusSpy(fakeFolder.syncEngine());
+        fakeFolder.scheduleSync();
+        fakeFolder.execUntilBeforePropagation();
+        QCOMPARE(tracker.fileStatus("B"), SyncFileStatus(SyncFileStatus::StatusSync));
+        QCOMPARE(tracker.fileStatus("B"), SyncFileStatus(SyncFileStatus::StatusSync));
+        fakeFolder.execUntilFinished();
+        QCOMPARE(statusSpy.statusOf("B/b1"), SyncFileStatus(SyncFileStatus::StatusUpToDate));
+        QCOMPARE(statusSpy.statusOf("B"), SyncFileStatus(SyncFileStatus::StatusUpToDate));
+        QCOMPARE(tracker.fileStatus("B"), SyncFileStatus(SyncFileStatus::StatusUpToDate));
+        verifyThatPushMatchesPull(fakeFolder, statusSpy);
+
+        // Directory only patterns apply to the children without looking at the file system
+        fakeFolder.syncEngine().excludedFiles().addManualExclude("A/");
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(tracker.fileStatus("A"), SyncFileStatus(SyncFileStatus::StatusExcluded));
+        QCOMPARE(tracker.fileStatus("A/a2"), SyncFileStatus(SyncFileStatus::StatusExcluded));
+        QCOMPARE(tracker.fileStatus("B/b1"), SyncFileStatus(SyncFileStatus::StatusUpToDate));
+    }
+
     void renameError() {
         // when rename has failed - the old file name must be restored
         FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
@@ -5,6 +5,7 @@
  *          */
 
 #include <QtTest>
+#include <QScopeGuard>
 
 #include <sqlite3.h>
 
@@ -54,6 +55,7 @@ private slots:
         // signed int being cast to uint64 either (like uint64::max would be)
         record._inode = std::numeric_limits<quint32>::max() + 12ull;
         record._modtime = dropMsecs(QDateTime::currentDateTime());
+        record._modtimeNsec = 123456789;
         record._type = ItemTypeDirectory;
         record._etag = "789789";
         record._fileId = "abcd";
@@ -74,6 +76,8 @@ private slots:
 
         // Update metadata
         record._modtime = dropMsecs(QDateTime::currentDateTime().addDays(1));
+        // unknown sub-second part, as from a record written by an older version
+        record._modtimeNsec = -1;
         // try a value that only fits uint64, not int64
         record._inode = std::numeric_limits<quint64>::max() - std::numeric_limits<quint32>::max() - 1;
         record._type = ItemTypeFile;
@@ -90,6 +94,121 @@ private slots:
         QVERIFY(!record.isValid());
     }
 
+    void testGroupCommit()
+    {
+        // Make sure a transaction is open
+        _db.commit(QStringLiteral("before group commit"));
+        _db.setGroupCommitEnabled(true);
+
+        for (int i = 0; i < 5; ++i) {
+            SyncJournalFileRecord record;
+            record._path = "group-commit" + QByteArray::number(i);
+            record._remotePerm = RemotePermissions::fromDbValue("RW");
+            QVERIFY(_db.setFileRecord(record));
+            _db.scheduleCommit(QStringLiteral("group commit test"));
+        }
+        auto statistics = _db.commitStatistics();
+        QCOMPARE(statistics.commitRequests, 5ull);
+        QCOMPARE(statistics.transactions, 0ull);
+
+        // A durability barrier commits right away
+        _db.commit(QStringLiteral("group commit barrier"));
+        statistics = _db.commitStatistics();
+        QCOMPARE(statistics.commitRequests, 6ull);
+        QCOMPARE(statistics.transactions, 1ull);
+
+        SyncJournalFileRecord storedRecord;
+        QVERIFY(_db.getFileRecord(QByteArrayLiteral("group-commit4"), &storedRecord));
+        QVERIFY(storedRecord.isValid());
+
+        // Without group commits every scheduled commit is committed
+        _db.setGroupCommitEnabled(false);
+        _db.scheduleCommit(QStringLiteral("group commit test"));
+        QCOMPARE(_db.commitStatistics().transactions, 1ull);
+
+        for (int i = 0; i < 5; ++i) {
+            QVERIFY(_db.deleteFileRecord("group-commit" + QString::number(i)));
+        }
+    }
+
+    void testCommittedFileRecord_data()
+    {
+        QTest::addColumn<bool>("fromEnvironment");
+
+        QTest::newRow("setting") << false;
+        QTest::newRow("environment") << true;
+    }
+
+    void testCommittedFileRecord()
+    {
+        QFETCH(bool, fromEnvironment);
+
+        // Read when the database is opened
+        if (fromEnvironment) {
+            qputenv("OWNCLOUD_SQLITE_READ_CONNECTIONS", "1");
+        }
+        const auto resetEnvironment = qScopeGuard([] {
+            qunsetenv("OWNCLOUD_SQLITE_READ_CONNECTIONS");
+        });
+        SyncJournalDb db(_tempDir.path() + QStringLiteral("/committed-%1.db").arg(QTest::currentDataTag()));
+        if (!fromEnvironment) {
+            db.setReadConnectionsEnabled(true);
+        }
+
+        SyncJournalFileRecord record;
+        record._path = "committed";
+        record._inode = 4242;
+        record._etag = "etag";
+        record._fileId = "committed-id";
+        record._remotePerm = RemotePermissions::fromDbValue("RW");
+        QVERIFY(db.setFileRecord(record));
+
+        SyncJournalFileRecord storedRecord;
+        QVERIFY(db.getCommittedFileRecord(QByteArrayLiteral("committed"), &storedRecord));
+#ifndef Q_OS_WIN
+        // Read on another connection, the write transaction is still open
+        QVERIFY(!storedRecord.isValid());
+#endif
+
+        db.commit(QStringLiteral("committed file record"));
+        QVERIFY(db.getCommittedFileRecord(QByteArrayLiteral("committed"), &storedRecord));
+        QVERIFY(storedRecord.isValid());
+        QCOMPARE(storedRecord._inode, record._inode);
+        QCOMPARE(storedRecord._fileId, record._fileId);
+
+        // Connections are reused, and don't keep an old snapshot of the database
+        QVERIFY(db.deleteFileRecord(QStringLiteral("committed")));
+        db.commit(QStringLiteral("committed file record"));
+        QVERIFY(db.getCommittedFileRecord(QByteArrayLiteral("committed"), &storedRecord));
+        QVERIFY(!storedRecord.isValid());
+        db.close();
+    }
+
+    void testCommittedFileRecordFallback()
+    {
+        // Without read connections the lookup uses the main connection and sees the open transaction
+        SyncJournalFileRecord record;
+        record._path = "uncommitted";
+        record._inode = 4343;
+        record._etag = "etag";
+        record._fileId = "uncommitted-id";
+        record._remotePerm = RemotePermissions::fromDbValue("RW");
+        QVERIFY(_db.setFileRecord(record));
+
+        SyncJournalFileRecord storedRecord;
+        QVERIFY(_db.getCommittedFileRecord(QByteArrayLiteral("uncommitted"), &storedRecord));
+        QVERIFY(storedRecord.isValid());
+        QCOMPARE(storedRecord._inode, record._inode);
+        QCOMPARE(storedRecord._fileId, record._fileId);
+
+        QVERIFY(_db.getCommittedFileRecordByE2eMangledName(QStringLiteral("unknown"), &storedRecord));
+        QVERIFY(!storedRecord.isValid());
+
+        QVERIFY(_db.deleteFileRecord(QStringLiteral("uncommitted")));
+        QVERIFY(_db.getCommittedFileRecord(QByteArrayLiteral("uncommitted"), &storedRecord));
+        QVERIFY(!storedRecord.isValid());
+    }
+
     void testFileRecordChecksum()
     {
         // Try with and without a checksum
@@ -126,6 +245,63 @@ private slots:
         }
     }
 
+    void testChecksumCache()
+    {
+        const quint64 inode = 4711;
+        const qint64 size = 1234;
+        const qint64 modtime = dropMsecs(QDateTime::currentDateTime());
+        const qint32 nsec = 5000;
+        QVERIFY(_db.getCachedChecksum(inode, size, modtime, nsec, "SHA1").isEmpty());
+
+        // Several types can be stored for the same file
+        QVERIFY(_db.setCachedChecksum(inode, size, modtime, nsec, "SHA1", "sha1checksum"));
+        QVERIFY(_db.setCachedChecksum(inode, size, modtime, nsec, "MD5", "md5checksum"));
+        QCOMPARE(_db.getCachedChecksum(inode, size, modtime, nsec, "SHA1"), QByteArray("sha1checksum"));
+        QCOMPARE(_db.getCachedChecksum(inode, size, modtime, nsec, "MD5"), QByteArray("md5checksum"));
+        QVERIFY(_db.getCachedChecksum(inode, size, modtime, nsec, "Adler32").isEmpty());
+
+        // A changed size or modtime doesn't match
+        QVERIFY(_db.getCachedChecksum(inode, size + 1, modtime, nsec, "SHA1").isEmpty());
+        QVERIFY(_db.getCachedChecksum(inode, size, modtime + 1, nsec, "SHA1").isEmpty());
+        QVERIFY(_db.getCachedChecksum(inode + 1, size, modtime, nsec, "SHA1").isEmpty());
+
+        // Neither does a change within the same second, nor an unknown sub-second part
+        QVERIFY(_db.getCachedChecksum(inode, size, modtime, nsec + 1, "SHA1").isEmpty());
+        QVERIFY(_db.getCachedChecksum(inode, size, modtime, -1, "SHA1").isEmpty());
+        QVERIFY(!_db.setCachedChecksum(inode, size, modtime, -1, "SHA1", "unknownchecksum"));
+
+        // Storing a checksum for the changed file drops the outdated ones
+        QVERIFY(_db.setCachedChecksum(inode, size, modtime, nsec + 1, "SHA1", "newchecksum"));
+        QCOMPARE(_db.getCachedChecksum(inode, size, modtime, nsec + 1, "SHA1"), QByteArray("newchecksum"));
+        QVERIFY(_db.getCachedChecksum(inode, size, modtime, nsec, "MD5").isEmpty());
+        QVERIFY(_db.getCachedChecksum(inode, size, modtime, nsec + 1, "MD5").isEmpty());
+
+        // Unchanged synced files provide their content checksum
+        SyncJournalFileRecord record;
+        record._path = "foo-cached";
+        record._inode = 4712;
+        record._type = ItemTypeFile;
+        record._fileSize = size;
+        record._modtime = modtime;
+        record._modtimeNsec = nsec;
+        record._remotePerm = RemotePermissions::fromDbValue("RW");
+        record._checksumHeader = "SHA1:syncedchecksum";
+        QVERIFY(_db.setFileRecord(record));
+        QCOMPARE(_db.getCachedChecksum(4712, size, modtime, nsec, "SHA1"), QByteArray("syncedchecksum"));
+        QVERIFY(_db.getCachedChecksum(4712, size, modtime + 1, nsec, "SHA1").isEmpty());
+        QVERIFY(_db.getCachedChecksum(4712, size, modtime, nsec + 1, "SHA1").isEmpty());
+
+        // but not while the sub-second part of the record is unknown
+        record._modtimeNsec = -1;
+        QVERIFY(_db.setFileRecord(record));
+        QVERIFY(_db.getCachedChecksum(4712, size, modtime, 0, "SHA1").isEmpty());
+
+        // Entries without metadata correspondent go away
+        _db.deleteStaleChecksumCacheEntries();
+        QVERIFY(_db.getCachedChecksum(inode, size, modtime, nsec + 1, "SHA1").isEmpty());
+        QVERIFY(_db.deleteFileRecord("foo-cached"));
+    }
+
     void testDownloadInfo()
     {
         using Info = SyncJournalDb::DownloadInfo;
@@ -141,6 +317,22 @@ private slots:
         Info storedRecord = _db.getDownloadInfo("foo");
         QVERIFY(storedRecord == record);
 
+        // The segments of a segmented download
+        Info::Segment segment;
+        segment._size = 100;
+        segment._downloaded = 100;
+        record._segments.append(segment);
+        segment._offset = 100;
+        segment._size = 50;
+        segment._downloaded = 10;
+        record._segments.append(segment);
+        _db.setDownloadInfo("foo", record);
+
+        storedRecord = _db.getDownloadInfo("foo");
+        QVERIFY(storedRecord == record);
+        QVERIFY(storedRecord._segments.at(0).isComplete());
+        QVERIFY(!storedRecord._segments.at(1).isComplete());
+
         _db.setDownloadInfo("foo", Info());
         Info wipedRecord = _db.getDownloadInfo("foo");
         QVERIFY(!wipedRecord._valid);
@@ -320,6 +512,173 @@ private slots:
         QVERIFY(checkElements());
     }
 
+    void testDiscoverySnapshot()
+    {
+        auto makeEntry = [&](const QByteArray &path, ItemType type, quint64 inode) {
+            SyncJournalFileRecord record;
+            record._path = path;
+            record._type = type;
+            record._inode = inode;
+            record._fileId = "snapshot-id" + QByteArray::number(inode);
+            record._etag = "etag";
+            record._remotePerm = RemotePermissions::fromDbValue("RW");
+            QVERIFY(_db.setFileRecord(record));
+        };
+        auto listPaths = [&](const QByteArray &path) {
+            QByteArrayList paths;
+            const auto result = _db.listFilesInPath(path, [&](const SyncJournalFileRecord &record) {
+                paths.append(record._path);
+            });
+            return result ? paths : QByteArrayList{"error"};
+        };
+        auto hasFiles = [&](const QByteArray &path) {
+            const auto result = _db.hasFilesInPath(path);
+            return result && *result;
+        };
+
+        makeEntry("snapshot", ItemTypeDirectory, 1001);
+        makeEntry("snapshot/a", ItemTypeDirectory, 1002);
+        makeEntry("snapshot/a/file", ItemTypeFile, 1003);
+        makeEntry("snapshot/a-b", ItemTypeFile, 1004); // sorts before "snapshot/a/"
+        makeEntry("snapshot/b", ItemTypeFile, 1005);
+
+        const auto listing = listPaths("snapshot");
+        QCOMPARE(listing, QByteArrayList({"snapshot/a-b", "snapshot/a", "snapshot/b"}));
+        QVERIFY(hasFiles("snapshot"));
+        QVERIFY(hasFiles("snapshot/a"));
+        QVERIFY(!hasFiles("snapshot/b"));
+        QVERIFY(!hasFiles("snapshot/c"));
+
+        QVERIFY(_db.loadDiscoverySnapshot(1024 * 1024));
+        QCOMPARE(listPaths("snapshot"), listing);
+        QCOMPARE(listPaths("snapshot/a"), QByteArrayList({"snapshot/a/file"}));
+        QVERIFY(hasFiles("snapshot/a"));
+        QVERIFY(!hasFiles("snapshot/b"));
+
+        SyncJournalFileRecord record;
+        QVERIFY(_db.getFileRecord(QByteArrayLiteral("snapshot/a/file"), &record));
+        QCOMPARE(record._inode, 1003ull);
+        QVERIFY(_db.getFileRecordByInode(1005, &record));
+        QCOMPARE(record._path, QByteArray("snapshot/b"));
+        QByteArrayList byFileId;
+        QVERIFY(_db.getFileRecordsByFileId("snapshot-id1004", [&](const SyncJournalFileRecord &rec) {
+            byFileId.append(rec._path);
+        }));
+        QCOMPARE(byFileId, QByteArrayList({"snapshot/a-b"}));
+
+        // Writes are seen by the following lookups
+        makeEntry("snapshot/0", ItemTypeFile, 1006);
+        QCOMPARE(listPaths("snapshot"), QByteArrayList({"snapshot/0", "snapshot/a-b", "snapshot/a", "snapshot/b"}));
+        QVERIFY(_db.updateLocalMetadata(QStringLiteral("snapshot/b"), 42, 0, 10, 1007, {}));
+        QVERIFY(_db.getFileRecordByInode(1007, &record));
+        QCOMPARE(record._modtime, qint64(42));
+        QVERIFY(_db.getFileRecordByInode(1005, &record));
+        QVERIFY(!record.isValid());
+
+        QVERIFY(_db.deleteFileRecord(QStringLiteral("snapshot/a"), true));
+        QCOMPARE(listPaths("snapshot"), QByteArrayList({"snapshot/0", "snapshot/a-b", "snapshot/b"}));
+        QVERIFY(!hasFiles("snapshot/a"));
+        QVERIFY(_db.getFileRecord(QByteArrayLiteral("snapshot/a/file"), &record));
+        QVERIFY(!record.isValid());
+        QVERIFY(_db.getFileRecordByInode(1003, &record));
+        QVERIFY(!record.isValid());
+
+        // Journals too big for the budget keep being queried
+        _db.dropDiscoverySnapshot();
+        QVERIFY(!_db.loadDiscoverySnapshot(1));
+        QCOMPARE(listPaths("snapshot"), QByteArrayList({"snapshot/0", "snapshot/a-b", "snapshot/b"}));
+        QVERIFY(hasFiles("snapshot"));
+        QVERIFY(!hasFiles("snapshot/a"));
+
+        QVERIFY(_db.deleteFileRecord(QStringLiteral("snapshot"), true));
+    }
+
+    void testMaintenance()
+    {
+        // Enough records to leave more free pages than the maintenance reclaims at least
+        const QByteArray padding(200, 'x');
+        for (int i = 0; i < 20000; ++i) {
+            SyncJournalFileRecord record;
+            record._path = "maintenance/" + padding + QByteArray::number(i);
+            record._remotePerm = RemotePermissions::fromDbValue("RW");
+            QVERIFY(_db.setFileRecord(record));
+        }
+        _db.commit(QStringLiteral("before maintenance"));
+        QVERIFY(_db.deleteFileRecord(QStringLiteral("maintenance"), true));
+        _db.commit(QStringLiteral("before maintenance"));
+
+        QVERIFY(!_db.maintenanceStatistics().lastMaintenance.isValid());
+        QVERIFY(_db.performMaintenance());
+
+        const auto statistics = _db.maintenanceStatistics();
+        QVERIFY(statistics.lastMaintenance.isValid());
+        QVERIFY(statistics.pageCount > 0);
+        QVERIFY(statistics.freePageCount * 4 < statistics.pageCount);
+        QVERIFY(statistics.databaseSize > 0);
+        // remembered across restarts
+        QVERIFY(_db.keyValueStoreGetInt(QStringLiteral("last_analyze"), 0) > 0);
+
+        // on a worker thread too
+        _db.scheduleMaintenance().waitForFinished();
+        QVERIFY(_db.maintenanceStatistics().lastMaintenance >= statistics.lastMaintenance);
+
+        // Still usable, and in a transaction again
+        SyncJournalFileRecord record;
+        record._path = "after-maintenance";
+        record._remotePerm = RemotePermissions::fromDbValue("RW");
+        QVERIFY(_db.setFileRecord(record));
+        SyncJournalFileRecord storedRecord;
+        QVERIFY(_db.getFileRecord(QByteArrayLiteral("after-maintenance"), &storedRecord));
+        QVERIFY(storedRecord.isValid());
+        QVERIFY(_db.deleteFileRecord(QStringLiteral("after-maintenance")));
+    }
+
+    void testMaintenanceConvertsOldJournals()
+    {
+        const auto dbPath = _tempDir.path() + QStringLiteral("/old-journal.db");
+        const auto autoVacuum = [&dbPath] {
+            sqlite3 *db = nullptr;
+            int value = -1;
+            if (sqlite3_open(dbPath.toUtf8().constData(), &db) == SQLITE_OK) {
+                sqlite3_exec(db, "PRAGMA auto_vacuum;", [](void *result, int, char **values, char **) {
+                    *static_cast<int *>(result) = QByteArray(values[0]).toInt();
+                    return 0;
+                }, &value, nullptr);
+            }
+            sqlite3_close(db);
+            return value;
+        };
+
+        {
+            // A journal from before auto_vacuum=INCREMENTAL, with about 2000 free pages
+            sqlite3 *db = nullptr;
+            QCOMPARE(sqlite3_open(dbPath.toUtf8().constData(), &db), SQLITE_OK);
+            QCOMPARE(sqlite3_exec(db, "PRAGMA auto_vacuum=NONE;"
+                                      "CREATE TABLE padding(data BLOB);"
+                                      "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 2000)"
+                                      "  INSERT INTO padding SELECT zeroblob(4000) FROM n;"
+                                      "DELETE FROM padding;",
+                         nullptr, nullptr, nullptr),
+                SQLITE_OK);
+            sqlite3_close(db);
+        }
+        QCOMPARE(autoVacuum(), 0);
+        const auto oldSize = QFileInfo(dbPath).size();
+
+        SyncJournalDb journal(dbPath);
+        QVERIFY(journal.open());
+        // Opening it doesn't rewrite it
+        QVERIFY(QFileInfo(dbPath).size() >= oldSize);
+
+        QVERIFY(journal.performMaintenance());
+        const auto statistics = journal.maintenanceStatistics();
+        QVERIFY(statistics.freePageCount * 4 < statistics.pageCount);
+        QVERIFY(statistics.databaseSize < oldSize);
+        journal.close();
+
+        QCOMPARE(autoVacuum(), 2); // INCREMENTAL
+    }
+
     void testPinState()
     {
         auto make = [&](const QByteArray &path, PinState state) {
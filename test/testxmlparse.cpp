@@ -123,6 +123,67 @@ private slots:
         QVERIFY(_subdirs.size() == 1);
     }
 
+    void testParserIncremental() {
+        const QByteArray firstResponse = "<?xml version='1.0' encoding='utf-8'?>"
+              "<d:multistatus xmlns:d=\"DAV:\" xmlns:s=\"http://sabredav.org/ns\" xmlns:oc=\"http://owncloud.org/ns\">"
+              "<d:response>"
+              "<d:href>/oc/remote.php/dav/sharefolder/</d:href>"
+              "<d:propstat>"
+              "<d:prop>"
+              "<oc:id>00004213ocobzus5kn6s</oc:id>"
+              "<oc:size>121780</oc:size>"
+              "<d:resourcetype>"
+              "<d:collection/>"
+              "</d:resourcetype>"
+              "</d:prop>"
+              "<d:status>HTTP/1.1 200 OK</d:status>"
+              "</d:propstat>"
+              "</d:response>";
+        const QByteArray secondResponse = "<d:response>"
+              "<d:href>/oc/remote.php/dav/sharefolder/quitte.pdf</d:href>"
+              "<d:propstat>"
+              "<d:prop>"
+              "<oc:id>00004215ocobzus5kn6s</oc:id>"
+              "<d:getetag>\"2fa2f0d9ed49ea0c3e409d49e652dea0\"</d:getetag>"
+              "<d:resourcetype/>"
+              "<d:getcontentlength>121780</d:getcontentlength>"
+              "</d:prop>"
+              "<d:status>HTTP/1.1 200 OK</d:status>"
+              "</d:propstat>"
+              "</d:response>"
+              "</d:multistatus>";
+
+        LsColXMLParser parser;
+
+        connect( &parser, &LsColXMLParser::directoryListingSubfolders,
+                 this, &TestXmlParse::slotDirectoryListingSubFolders );
+        connect( &parser, &LsColXMLParser::directoryListingIterated,
+                 this, &TestXmlParse::slotDirectoryListingIterated );
+        connect( &parser, &LsColXMLParser::finishedWithoutError,
+                 this, &TestXmlParse::slotFinishedSuccessfully );
+
+        QHash <QString, ExtraFolderInfo> sizes;
+        parser.start(&sizes, "/oc/remote.php/dav/sharefolder");
+
+        // Feed the document in small pieces, splitting elements and tags
+        const QByteArray testXml = firstResponse + secondResponse;
+        const int chunkSize = 7;
+        for (int i = 0; i < testXml.size(); i += chunkSize) {
+            QVERIFY(parser.addData(testXml.mid(i, chunkSize)));
+            // The first response is reported as soon as it is complete
+            if (i + chunkSize >= firstResponse.size() && i + chunkSize < firstResponse.size() + chunkSize) {
+                QCOMPARE(_items, QStringList() << "/oc/remote.php/dav/sharefolder");
+            }
+        }
+        QVERIFY(!_success);
+        QVERIFY(parser.finish());
+
+        QVERIFY(_success);
+        QCOMPARE(sizes.size(), 1);
+        QCOMPARE(_items, QStringList() << "/oc/remote.php/dav/sharefolder" << "/oc/remote.php/dav/sharefolder/quitte.pdf");
+        QCOMPARE(_subdirs, QStringList() << "/oc/remote.php/dav/sharefolder/");
+    }
+
     void testParserBrokenXml() {
         const QByteArray testXml = "X<?xml version='1.0' encoding='utf-8'?>"
               "<d:multistatus xmlns:d=\"DAV:\" xmlns:s=\"http://sabredav.org/ns\" xmlns:oc=\"http://owncloud.org/ns\">"
@@ -613,6 +674,60 @@ private slots:
         QVERIFY(_subdirs.size() == 1);
     }
 
+    void testPropertyNames() {
+        QCOMPARE(LsColXMLParser::propertyFromName(u"getetag"), LsColXMLParser::Property::GetEtag);
+        QCOMPARE(LsColXMLParser::propertyFromName(u"lock-owner"), LsColXMLParser::Property::LockOwner);
+        QCOMPARE(LsColXMLParser::propertyFromName(u"lock-owner-type"), LsColXMLParser::Property::LockOwnerType);
+        QCOMPARE(LsColXMLParser::propertyFromName(u"getEtag"), LsColXMLParser::Property::Unknown);
+
+        QCOMPARE(LsColXMLParser::internedPropertyName(LsColXMLParser::Property::ShareTypes), QStringLiteral("share-types"));
+        QVERIFY(LsColXMLParser::internedPropertyName(LsColXMLParser::Property::Unknown).isEmpty());
+    }
+
+    void testKnownProperties() {
+        const QByteArray testXml = "<?xml version='1.0' encoding='utf-8'?>"
+              "<d:multistatus xmlns:d=\"DAV:\" xmlns:oc=\"http://owncloud.org/ns\" xmlns:x=\"http://example.org/ns\">"
+              "<d:response>"
+              "<d:href>/oc/remote.php/dav/sharefolder/quitte.pdf</d:href>"
+              "<d:propstat>"
+              "<d:prop>"
+              "<oc:permissions>RDNVW</oc:permissions>"
+              "<d:getetag>\"2fa2f0d9ed49ea0c3e409d49e652dea0\"</d:getetag>"
+              "<oc:share-types/>"
+              "<x:not-a-known-one>value</x:not-a-known-one>"
+              "</d:prop>"
+              "<d:status>HTTP/1.1 200 OK</d:status>"
+              "</d:propstat>"
+              "<d:propstat>"
+              "<d:prop>"
+              "<oc:downloadURL/>"
+              "</d:prop>"
+              "<d:status>HTTP/1.1 404 Not Found</d:status>"
+              "</d:propstat>"
+              "</d:response>"
+              "</d:multistatus>";
+
+        LsColXMLParser parser;
+        LsColXMLParser::KnownProperties knownProperties;
+        QMap<QString, QString> namedProperties;
+        connect(&parser, &LsColXMLParser::knownPropertiesIterated, this, [&](const QString &, const LsColXMLParser::KnownProperties &properties) {
+            knownProperties = properties;
+        });
+        QHash<QString, ExtraFolderInfo> sizes;
+        QVERIFY(parser.parse(testXml, &sizes, QStringLiteral("/oc/remote.php/dav/sharefolder")));
+
+        // Keyed by the property, the unknown and the failed ones are left out
+        QCOMPARE(knownProperties.keys(), (QList<LsColXMLParser::Property>{ LsColXMLParser::Property::GetEtag, LsColXMLParser::Property::Permissions, LsColXMLParser::Property::ShareTypes }));
+        QCOMPARE(knownProperties.value(LsColXMLParser::Property::Permissions), QStringLiteral("RDNVW"));
+
+        // The maps keyed by name still have all of them
+        connect(&parser, &LsColXMLParser::directoryListingIterated, this, [&](const QString &, const QMap<QString, QString> &properties) {
+            namedProperties = properties;
+        });
+        QVERIFY(parser.parse(testXml, &sizes, QStringLiteral("/oc/remote.php/dav/sharefolder")));
+        QCOMPARE(namedProperties.keys(), (QStringList{ QStringLiteral("getetag"), QStringLiteral("not-a-known-one"), QStringLiteral("permissions"), QStringLiteral("share-types") }));
+        QCOMPARE(namedProperties.value(QStringLiteral("not-a-known-one")), QStringLiteral("value"));
+    }
 };
 
     QTEST_GUILESS_MAIN(TestXmlParse)